@@ -0,0 +1,154 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cuckoo.h"
+#include "map.h"
+#include "perf.h"
+#include "util.h"
+
+/**
+ * Memory footprint and speed of UfCuckooMap against the default
+ * UfHashmap, at a range of sizes. Size is measured as growth of the
+ * heap, so it includes malloc overhead on chain nodes.
+ *
+ * Usage: bench-cuckoo [max_items]
+ */
+
+#define DEFAULT_MAX_ITEMS 1000000
+
+/**
+ * Scattered key order, as in bench-map
+ */
+static inline uintptr_t bench_key(size_t i)
+{
+        return (uintptr_t)(uint32_t)(i * 0x9E3779B1U) + 1;
+}
+
+/**
+ * Bytes in use, counting large blocks malloc serves with mmap
+ */
+static size_t bench_heap(void)
+{
+        struct mallinfo2 info = mallinfo2();
+
+        return info.uordblks + info.hblkhd;
+}
+
+static void bench_hashmap(UfPerf *perf, size_t n)
+{
+        UfPerfSample sample;
+        UfHashmap *map = NULL;
+        size_t before = bench_heap();
+        size_t hits = 0;
+
+        uf_perf_start(perf);
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        for (size_t i = 0; map && i < n; i++) {
+                uf_hashmap_put(map, UF_INT_TO_PTR(bench_key(i)), UF_INT_TO_PTR(1));
+        }
+        uf_perf_stop(perf, &sample);
+        if (!map) {
+                exit(EXIT_FAILURE);
+        }
+        printf("  hashmap %8.1f bytes/entry\n", (double)(bench_heap() - before) / (double)n);
+        uf_perf_report("    insert", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                hits += uf_hashmap_get(map, UF_INT_TO_PTR(bench_key(i))) != NULL;
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("    lookup", &sample, n);
+
+        if (hits != n) {
+                exit(EXIT_FAILURE);
+        }
+        uf_hashmap_free(map);
+}
+
+static void bench_cuckoo(UfPerf *perf, size_t n)
+{
+        UfPerfSample sample;
+        UfCuckooMap *map = NULL;
+        size_t before = bench_heap();
+        size_t hits = 0;
+
+        uf_perf_start(perf);
+        map = uf_cuckoo_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        for (size_t i = 0; map && i < n; i++) {
+                uf_cuckoo_put(map, UF_INT_TO_PTR(bench_key(i)), UF_INT_TO_PTR(1));
+        }
+        uf_perf_stop(perf, &sample);
+        if (!map) {
+                exit(EXIT_FAILURE);
+        }
+        printf("  cuckoo  %8.1f bytes/entry (load %.2f)\n",
+               (double)(bench_heap() - before) / (double)n,
+               (double)uf_cuckoo_size(map) / (double)uf_cuckoo_capacity(map));
+        uf_perf_report("    insert", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                hits += uf_cuckoo_get(map, UF_INT_TO_PTR(bench_key(i))) != NULL;
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("    lookup", &sample, n);
+
+        if (hits != n) {
+                exit(EXIT_FAILURE);
+        }
+        uf_cuckoo_free(map);
+}
+
+int main(int argc, char **argv)
+{
+        size_t max_items = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MAX_ITEMS;
+        UfPerf *perf = NULL;
+
+        if (max_items == 0) {
+                fprintf(stderr, "Usage: %s [max_items]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        perf = uf_perf_new();
+        if (!perf) {
+                return EXIT_FAILURE;
+        }
+
+        /* Sizes between powers of ten land at varying points of the growth cycle */
+        for (size_t n = 1000; n <= max_items; n = n * 10 / 3) {
+                printf("%zu items\n", n);
+                bench_hashmap(perf, n);
+                bench_cuckoo(perf, n);
+        }
+
+        uf_perf_free(perf);
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,156 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frontdict.h"
+#include "perf.h"
+#include "util.h"
+
+/**
+ * Size and per operation cost of a UfFrontDict over synthetic file
+ * paths, which share long prefixes as real ones do. Lookups are made in
+ * a scattered order so every one pays its cache misses.
+ *
+ * Usage: bench-frontdict [paths]
+ */
+
+#define DEFAULT_PATHS 1000000
+
+static const char *bench_dirs[] = {
+        "usr/share/locale/",
+        "usr/lib/x86_64-linux-gnu/",
+        "usr/include/",
+        "home/user/.cache/thumbnails/",
+};
+
+static inline size_t bench_index(size_t i, size_t n)
+{
+        return (size_t)(((uint64_t)i * 0x9E3779B1U) % n);
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_PATHS;
+        UfFrontDict *dict = NULL;
+        UfPerf *perf = NULL;
+        UfPerfSample sample;
+        char **paths = NULL;
+        size_t raw = 0;
+        size_t hits = 0;
+        char buf[256];
+
+        if (n == 0) {
+                fprintf(stderr, "Usage: %s [paths]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        paths = malloc(n * sizeof(char *));
+        if (!paths) {
+                return EXIT_FAILURE;
+        }
+        for (size_t i = 0; i < n; i++) {
+                if (asprintf(&paths[i],
+                             "/%spackage-%zu/module-%zu/file-%zu.dat",
+                             bench_dirs[i % (sizeof(bench_dirs) / sizeof(bench_dirs[0]))],
+                             i / 1000,
+                             (i / 25) % 40,
+                             i) < 0) {
+                        return EXIT_FAILURE;
+                }
+                raw += strlen(paths[i]) + 1;
+        }
+
+        perf = uf_perf_new();
+        if (!perf) {
+                return EXIT_FAILURE;
+        }
+        if (!uf_perf_available(perf)) {
+                printf("Hardware counters unavailable, reporting time only\n");
+        }
+
+        uf_perf_start(perf);
+        dict = uf_front_dict_new((const char *const *)paths, n);
+        uf_perf_stop(perf, &sample);
+        if (!dict) {
+                return EXIT_FAILURE;
+        }
+        uf_perf_report("build", &sample, n);
+        printf("%zu string bytes, %zu dictionary bytes (%.2fx)\n",
+               raw,
+               uf_front_dict_memory(dict),
+               (double)raw / (double)uf_front_dict_memory(dict));
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                hits += uf_front_dict_lookup(dict, paths[bench_index(i, n)]) != UF_FRONT_DICT_NOT_FOUND;
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("lookup hit", &sample, n);
+
+        /* Same lengths and prefixes, but a name never stored */
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                const char *path = paths[bench_index(i, n)];
+                size_t len = strlen(path);
+
+                memcpy(buf, path, len + 1);
+                buf[len - 1] = 'x';
+                hits += uf_front_dict_lookup(dict, buf) != UF_FRONT_DICT_NOT_FOUND;
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("lookup miss", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                uf_front_dict_get(dict, bench_index(i, n), buf, sizeof(buf));
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("decode", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                uf_front_dict_lower_bound(dict, paths[bench_index(i, n)]);
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("lower bound", &sample, n);
+
+        if (hits != n) {
+                fprintf(stderr, "Expected %zu hits, got %zu\n", n, hits);
+                return EXIT_FAILURE;
+        }
+
+        uf_front_dict_free(dict);
+        for (size_t i = 0; i < n; i++) {
+                free(paths[i]);
+        }
+        free(paths);
+        uf_perf_free(perf);
+
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
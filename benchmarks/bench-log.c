@@ -0,0 +1,88 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "perf.h"
+#include "util.h"
+
+/**
+ * Measure the cost of logging on the calling thread, against /dev/null
+ * so the writer is never the bottleneck. Also reports the cost of a
+ * filtered out call.
+ *
+ * Usage: bench-log [iterations]
+ */
+
+#define DEFAULT_ITERATIONS 1000000
+
+int main(int argc, char **argv)
+{
+        size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+        UfLog *log = NULL;
+        UfPerf *perf = NULL;
+        UfPerfSample enabled, disabled;
+        int fd;
+
+        fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || iterations == 0) {
+                fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        /* Opened first so the counters follow the writer thread too */
+        perf = uf_perf_new();
+        log = uf_log_new(fd, UF_LOG_INFO);
+        if (!log || !perf) {
+                return EXIT_FAILURE;
+        }
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < iterations; i++) {
+                uf_log_info(log, "request %zu served in %d us", i, 42);
+        }
+        uf_perf_stop(perf, &enabled);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < iterations; i++) {
+                uf_log_debug(log, "request %zu served in %d us", i, 42);
+        }
+        uf_perf_stop(perf, &disabled);
+
+        uf_log_flush(log);
+        uf_perf_report("enabled", &enabled, iterations);
+        uf_perf_report("disabled", &disabled, iterations);
+        printf("%llu records dropped\n", (unsigned long long)uf_log_dropped(log));
+
+        uf_log_free(log);
+        uf_perf_free(perf);
+        close(fd);
+
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,129 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "map.h"
+#include "perf.h"
+#include "util.h"
+
+/**
+ * Per operation cost of UfHashmap inserts and lookups, with hardware
+ * counters where permitted. Lookups are made in a scattered order so the
+ * bucket layout, not the prefetcher, decides the miss counts.
+ *
+ * Usage: bench-map [items]
+ */
+
+#define DEFAULT_ITEMS 1000000
+
+/**
+ * Visit 1..n in a scattered order. Any odd step is coprime with a power
+ * of two, so stepping modulo the next power of two hits every key once.
+ */
+static inline uintptr_t bench_key(size_t i, size_t mask)
+{
+        return ((i * 0x9E3779B1U) & mask) + 1;
+}
+
+static void bench_inserts(UfPerf *perf, size_t n, size_t mask, bool reserve)
+{
+        UfHashmap *map = NULL;
+        UfPerfSample sample;
+        size_t hits = 0;
+
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        if (!map) {
+                exit(EXIT_FAILURE);
+        }
+
+        uf_perf_start(perf);
+        if (reserve && !uf_hashmap_reserve(map, n)) {
+                exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i <= mask; i++) {
+                uintptr_t k = bench_key(i, mask);
+                if (k <= n) {
+                        uf_hashmap_put(map, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k));
+                }
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report(reserve ? "insert (reserved)" : "insert", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i <= mask; i++) {
+                uintptr_t k = bench_key(i, mask);
+                if (k <= n) {
+                        hits += uf_hashmap_get(map, UF_INT_TO_PTR(k)) != NULL;
+                }
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("lookup hit", &sample, n);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < n; i++) {
+                hits += uf_hashmap_get(map, UF_INT_TO_PTR(bench_key(i, mask) + mask + 1)) != NULL;
+        }
+        uf_perf_stop(perf, &sample);
+        uf_perf_report("lookup miss", &sample, n);
+
+        if (hits != n) {
+                fprintf(stderr, "Expected %zu hits, got %zu\n", n, hits);
+                exit(EXIT_FAILURE);
+        }
+        uf_hashmap_free(map);
+}
+
+int main(int argc, char **argv)
+{
+        size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITEMS;
+        size_t mask = 1;
+        UfPerf *perf = NULL;
+
+        if (n == 0) {
+                fprintf(stderr, "Usage: %s [items]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        while (mask < n) {
+                mask <<= 1;
+        }
+        mask--;
+
+        perf = uf_perf_new();
+        if (!perf) {
+                return EXIT_FAILURE;
+        }
+        if (!uf_perf_available(perf)) {
+                printf("Hardware counters unavailable, reporting time only\n");
+        }
+
+        bench_inserts(perf, n, mask, false);
+        bench_inserts(perf, n, mask, true);
+
+        uf_perf_free(perf);
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,203 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "perf.h"
+#include "skiplist.h"
+#include "util.h"
+
+/**
+ * Scaling comparison between UfSkipList and a mutex guarded UfBTree.
+ *
+ * Each thread runs the same mixed workload over its own slice of the key
+ * space: insert everything, then 4 lookups per remove of half the keys.
+ *
+ * Usage: bench-skiplist [max_threads] [ops_per_thread]
+ */
+
+#define DEFAULT_OPS 200000
+
+typedef struct BenchState {
+        UfSkipList *list;
+        UfBTree *tree;
+        mtx_t lock;
+        size_t n_threads;
+        size_t n_ops;
+} BenchState;
+
+typedef struct BenchWorker {
+        BenchState *state;
+        size_t id;
+} BenchWorker;
+
+static inline uintptr_t bench_key(BenchWorker *w, size_t i)
+{
+        /* Interleave threads so they contend on neighbouring nodes */
+        return i * w->state->n_threads + w->id + 1;
+}
+
+static int bench_skiplist_worker(void *data)
+{
+        BenchWorker *w = data;
+        UfSkipList *list = w->state->list;
+        size_t n = w->state->n_ops;
+
+        for (size_t i = 0; i < n; i++) {
+                uintptr_t k = bench_key(w, i);
+                uf_skiplist_insert(list, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k));
+        }
+        for (size_t i = 0; i < n; i += 2) {
+                for (size_t j = 0; j < 4; j++) {
+                        (void)uf_skiplist_get(list, UF_INT_TO_PTR(bench_key(w, (i * 7 + j) % n)));
+                }
+                uf_skiplist_remove(list, UF_INT_TO_PTR(bench_key(w, i)));
+        }
+        return 0;
+}
+
+static int bench_btree_worker(void *data)
+{
+        BenchWorker *w = data;
+        BenchState *state = w->state;
+        size_t n = state->n_ops;
+
+        for (size_t i = 0; i < n; i++) {
+                uintptr_t k = bench_key(w, i);
+                mtx_lock(&state->lock);
+                uf_btree_put(state->tree, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k));
+                mtx_unlock(&state->lock);
+        }
+        for (size_t i = 0; i < n; i += 2) {
+                for (size_t j = 0; j < 4; j++) {
+                        mtx_lock(&state->lock);
+                        (void)uf_btree_get(state->tree,
+                                           UF_INT_TO_PTR(bench_key(w, (i * 7 + j) % n)));
+                        mtx_unlock(&state->lock);
+                }
+                mtx_lock(&state->lock);
+                uf_btree_remove(state->tree, UF_INT_TO_PTR(bench_key(w, i)));
+                mtx_unlock(&state->lock);
+        }
+        return 0;
+}
+
+/**
+ * Run @func on @state->n_threads threads, storing counters in @sample
+ *
+ * @returns Total number of operations performed
+ */
+static size_t bench_run(BenchState *state, thrd_start_t func, UfPerf *perf, UfPerfSample *sample)
+{
+        thrd_t threads[state->n_threads];
+        BenchWorker workers[state->n_threads];
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < state->n_threads; i++) {
+                workers[i] = (BenchWorker){.state = state, .id = i };
+                if (thrd_create(&threads[i], func, &workers[i]) != thrd_success) {
+                        fprintf(stderr, "Failed to create thread\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+        for (size_t i = 0; i < state->n_threads; i++) {
+                thrd_join(threads[i], NULL);
+        }
+        uf_perf_stop(perf, sample);
+
+        /* n inserts, then 5 operations per 2 keys */
+        return state->n_threads * (state->n_ops + (state->n_ops / 2) * 5);
+}
+
+int main(int argc, char **argv)
+{
+        BenchState state = { 0 };
+        UfPerf *perf = NULL;
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t max_threads = n_cpus > 0 ? (size_t)n_cpus : 1;
+
+        if (argc > 1) {
+                max_threads = strtoul(argv[1], NULL, 10);
+        }
+        state.n_ops = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_OPS;
+        if (max_threads < 1 || state.n_ops < 2) {
+                fprintf(stderr, "Usage: %s [max_threads] [ops_per_thread]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        if (mtx_init(&state.lock, mtx_plain) != thrd_success) {
+                return EXIT_FAILURE;
+        }
+        perf = uf_perf_new();
+        if (!perf) {
+                return EXIT_FAILURE;
+        }
+
+        for (size_t n = 1;; n *= 2) {
+                UfPerfSample skiplist, btree;
+                size_t total;
+                char label[32];
+
+                if (n > max_threads) {
+                        n = max_threads;
+                }
+                state.n_threads = n;
+
+                state.list = uf_skiplist_new(uf_hashmap_simple_compare);
+                state.tree = uf_btree_new(uf_hashmap_simple_compare);
+                if (!state.list || !state.tree) {
+                        fprintf(stderr, "Out of memory\n");
+                        return EXIT_FAILURE;
+                }
+
+                total = bench_run(&state, bench_skiplist_worker, perf, &skiplist);
+                (void)bench_run(&state, bench_btree_worker, perf, &btree);
+
+                printf("%zu threads: skiplist %.2f Mops/s, btree+mutex %.2f Mops/s\n",
+                       n,
+                       (double)total / skiplist.seconds / 1e6,
+                       (double)total / btree.seconds / 1e6);
+                snprintf(label, sizeof(label), "  skiplist x%zu", n);
+                uf_perf_report(label, &skiplist, total);
+                snprintf(label, sizeof(label), "  btree+mutex x%zu", n);
+                uf_perf_report(label, &btree, total);
+
+                uf_skiplist_free(state.list);
+                uf_btree_free(state.tree);
+
+                if (n == max_threads) {
+                        break;
+                }
+        }
+
+        uf_perf_free(perf);
+        mtx_destroy(&state.lock);
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
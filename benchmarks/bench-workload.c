@@ -0,0 +1,322 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "art.h"
+#include "btree.h"
+#include "cuckoo.h"
+#include "map.h"
+#include "perf.h"
+#include "skiplist.h"
+#include "util.h"
+#include "workload.h"
+
+/**
+ * Run every map variant against the same generated traces, for each key
+ * set and access distribution in workload.h.
+ *
+ * Each variant is first loaded with every key, then replays the trace.
+ * Collision keys degrade chained hashing to a list walk, so that key set
+ * is capped at COLLISION_KEYS.
+ *
+ * Usage: bench-workload [keys] [ops] [get%] [remove%] [zipf_skew]
+ */
+
+#define DEFAULT_KEYS 200000
+#define DEFAULT_OPS 1000000
+#define COLLISION_KEYS 2048
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/**
+ * Common face for the maps under test
+ */
+typedef struct BenchMap {
+        const char *name;
+        bool int_keys;
+        bool string_keys;
+        void *(*new)(bool string_keys);
+        void (*free)(void *map);
+        bool (*put)(void *map, void *key, void *value);
+        void *(*get)(void *map, void *key);
+        bool (*remove)(void *map, void *key);
+} BenchMap;
+
+static void *bench_hashmap_new(bool string_keys)
+{
+        return string_keys ? uf_hashmap_new(uf_hashmap_string_hash, uf_hashmap_string_equal)
+                           : uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+}
+
+static bool bench_hashmap_put(void *map, void *key, void *value)
+{
+        return uf_hashmap_put(map, key, value);
+}
+
+static void *bench_hashmap_get(void *map, void *key)
+{
+        return uf_hashmap_get(map, key);
+}
+
+static bool bench_hashmap_remove(void *map, void *key)
+{
+        return uf_hashmap_remove(map, key);
+}
+
+static void bench_hashmap_free(void *map)
+{
+        uf_hashmap_free(map);
+}
+
+static void *bench_cuckoo_new(bool string_keys)
+{
+        return string_keys ? uf_cuckoo_new(uf_hashmap_string_hash, uf_hashmap_string_equal)
+                           : uf_cuckoo_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+}
+
+static bool bench_cuckoo_put(void *map, void *key, void *value)
+{
+        return uf_cuckoo_put(map, key, value);
+}
+
+static void *bench_cuckoo_get(void *map, void *key)
+{
+        return uf_cuckoo_get(map, key);
+}
+
+static bool bench_cuckoo_remove(void *map, void *key)
+{
+        return uf_cuckoo_remove(map, key);
+}
+
+static void bench_cuckoo_free(void *map)
+{
+        uf_cuckoo_free(map);
+}
+
+static void *bench_btree_new(bool string_keys)
+{
+        return uf_btree_new(string_keys ? uf_hashmap_string_compare : uf_hashmap_simple_compare);
+}
+
+static bool bench_btree_put(void *map, void *key, void *value)
+{
+        return uf_btree_put(map, key, value);
+}
+
+static void *bench_btree_get(void *map, void *key)
+{
+        return uf_btree_get(map, key);
+}
+
+static bool bench_btree_remove(void *map, void *key)
+{
+        return uf_btree_remove(map, key);
+}
+
+static void bench_btree_free(void *map)
+{
+        uf_btree_free(map);
+}
+
+static void *bench_skiplist_new(bool string_keys)
+{
+        return uf_skiplist_new(string_keys ? uf_hashmap_string_compare : uf_hashmap_simple_compare);
+}
+
+static bool bench_skiplist_put(void *map, void *key, void *value)
+{
+        return uf_skiplist_insert(map, key, value);
+}
+
+static void *bench_skiplist_get(void *map, void *key)
+{
+        return uf_skiplist_get(map, key);
+}
+
+static bool bench_skiplist_remove(void *map, void *key)
+{
+        return uf_skiplist_remove(map, key);
+}
+
+static void bench_skiplist_free(void *map)
+{
+        uf_skiplist_free(map);
+}
+
+static void *bench_art_new(__uf_unused__ bool string_keys)
+{
+        return uf_art_new();
+}
+
+static bool bench_art_put(void *map, void *key, void *value)
+{
+        return uf_art_put(map, key, value);
+}
+
+static void *bench_art_get(void *map, void *key)
+{
+        return uf_art_get(map, key);
+}
+
+static bool bench_art_remove(void *map, void *key)
+{
+        return uf_art_remove(map, key);
+}
+
+static void bench_art_free(void *map)
+{
+        uf_art_free(map);
+}
+
+static const BenchMap bench_maps[] = {
+        { "hashmap", true, true, bench_hashmap_new, bench_hashmap_free,
+          bench_hashmap_put, bench_hashmap_get, bench_hashmap_remove },
+        { "cuckoo", true, true, bench_cuckoo_new, bench_cuckoo_free,
+          bench_cuckoo_put, bench_cuckoo_get, bench_cuckoo_remove },
+        { "btree", true, true, bench_btree_new, bench_btree_free,
+          bench_btree_put, bench_btree_get, bench_btree_remove },
+        { "skiplist", true, true, bench_skiplist_new, bench_skiplist_free,
+          bench_skiplist_put, bench_skiplist_get, bench_skiplist_remove },
+        { "art", false, true, bench_art_new, bench_art_free,
+          bench_art_put, bench_art_get, bench_art_remove },
+};
+
+/**
+ * Replay @workload against @impl. Returns a checksum so the compiler
+ * can't discard lookups.
+ */
+static size_t bench_replay(const BenchMap *impl, UfWorkload *workload, UfPerf *perf)
+{
+        UfPerfSample sample;
+        void *map = NULL;
+        size_t found = 0;
+        char label[64];
+
+        map = impl->new(workload->string_keys);
+        if (!map) {
+                exit(EXIT_FAILURE);
+        }
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < workload->n_keys; i++) {
+                impl->put(map, workload->keys[i], workload->keys[i]);
+        }
+        uf_perf_stop(perf, &sample);
+        snprintf(label, sizeof(label), "  %s load", impl->name);
+        uf_perf_report(label, &sample, workload->n_keys);
+
+        uf_perf_start(perf);
+        for (size_t i = 0; i < workload->n_ops; i++) {
+                void *key = workload->keys[workload->ops[i].key];
+
+                switch (workload->ops[i].kind) {
+                case UF_WORKLOAD_GET:
+                        found += impl->get(map, key) != NULL;
+                        break;
+                case UF_WORKLOAD_PUT:
+                        impl->put(map, key, key);
+                        break;
+                case UF_WORKLOAD_REMOVE:
+                default:
+                        impl->remove(map, key);
+                        break;
+                }
+        }
+        uf_perf_stop(perf, &sample);
+        snprintf(label, sizeof(label), "  %s trace", impl->name);
+        uf_perf_report(label, &sample, workload->n_ops);
+
+        impl->free(map);
+        return found;
+}
+
+int main(int argc, char **argv)
+{
+        UfWorkloadOptions options = {
+                .n_keys = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_KEYS,
+                .n_ops = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_OPS,
+                .get_percent = argc > 3 ? (unsigned int)strtoul(argv[3], NULL, 10) : 90,
+                .remove_percent = argc > 4 ? (unsigned int)strtoul(argv[4], NULL, 10) : 5,
+                .zipf_skew = argc > 5 ? strtod(argv[5], NULL) : 0.99,
+                .seed = 0x5EEDULL,
+        };
+        size_t n_keys = options.n_keys;
+        UfPerf *perf = NULL;
+
+        if (n_keys == 0 || options.get_percent + options.remove_percent > 100) {
+                fprintf(stderr, "Usage: %s [keys] [ops] [get%%] [remove%%] [zipf_skew]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        perf = uf_perf_new();
+        if (!perf) {
+                return EXIT_FAILURE;
+        }
+
+        for (int k = 0; k < UF_WORKLOAD_N_KEYS; k++) {
+                for (int a = 0; a < UF_WORKLOAD_N_ACCESS; a++) {
+                        UfWorkload *workload = NULL;
+                        size_t found = 0;
+
+                        options.keys = (UfWorkloadKeys)k;
+                        options.access = (UfWorkloadAccess)a;
+                        options.n_keys = k == UF_WORKLOAD_KEYS_COLLISIONS && n_keys > COLLISION_KEYS
+                                             ? COLLISION_KEYS
+                                             : n_keys;
+
+                        workload = uf_workload_new(&options);
+                        if (!workload) {
+                                fprintf(stderr, "Failed to generate workload\n");
+                                return EXIT_FAILURE;
+                        }
+
+                        printf("%s keys (%zu), %s access, %zu ops, %u%% get %u%% remove\n",
+                               uf_workload_keys_name(options.keys),
+                               options.n_keys,
+                               uf_workload_access_name(options.access),
+                               options.n_ops,
+                               options.get_percent,
+                               options.remove_percent);
+
+                        for (size_t m = 0; m < ARRAY_SIZE(bench_maps); m++) {
+                                const BenchMap *impl = &bench_maps[m];
+                                if (workload->string_keys ? !impl->string_keys : !impl->int_keys) {
+                                        continue;
+                                }
+                                found += bench_replay(impl, workload, perf);
+                        }
+                        printf("  (%zu hits)\n", found);
+
+                        uf_workload_free(workload);
+                }
+        }
+
+        uf_perf_free(perf);
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
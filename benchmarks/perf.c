@@ -0,0 +1,184 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "perf.h"
+#include "util.h"
+
+struct UfPerf {
+        int fds[UF_PERF_N_COUNTERS];
+        double start;
+};
+
+static const struct {
+        uint32_t type;
+        uint64_t config;
+        const char *name;
+} uf_perf_events[UF_PERF_N_COUNTERS] = {
+        [UF_PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles" },
+        [UF_PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instrs" },
+        [UF_PERF_CACHE_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "llc-miss" },
+        [UF_PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br-miss" },
+        [UF_PERF_DTLB_MISSES] = { PERF_TYPE_HW_CACHE,
+                                  PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                                  "dtlb-miss" },
+};
+
+static double uf_perf_now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int uf_perf_open(uint32_t type, uint64_t config)
+{
+        struct perf_event_attr attr = {
+                .size = sizeof(struct perf_event_attr),
+                .type = type,
+                .config = config,
+                .disabled = 1,
+                .inherit = 1,
+                .exclude_kernel = 1,
+                .exclude_hv = 1,
+                .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+        };
+
+        /* No glibc wrapper exists. Count this process on any CPU. */
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+UfPerf *uf_perf_new(void)
+{
+        UfPerf *ret = NULL;
+
+        ret = calloc(1, sizeof(struct UfPerf));
+        if (!ret) {
+                return NULL;
+        }
+
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                ret->fds[i] = uf_perf_open(uf_perf_events[i].type, uf_perf_events[i].config);
+        }
+
+        return ret;
+}
+
+void uf_perf_free(UfPerf *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        close(self->fds[i]);
+                }
+        }
+        free(self);
+}
+
+bool uf_perf_available(UfPerf *self)
+{
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+void uf_perf_start(UfPerf *self)
+{
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        ioctl(self->fds[i], PERF_EVENT_IOC_RESET, 0);
+                }
+        }
+        self->start = uf_perf_now();
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        ioctl(self->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+                }
+        }
+}
+
+void uf_perf_stop(UfPerf *self, UfPerfSample *sample)
+{
+        /* value, time enabled, time running */
+        uint64_t data[3];
+
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        ioctl(self->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                }
+        }
+        sample->seconds = uf_perf_now() - self->start;
+
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                sample->counts[i] = 0;
+                sample->available[i] = false;
+
+                if (self->fds[i] < 0 || read(self->fds[i], data, sizeof(data)) != sizeof(data)) {
+                        continue;
+                }
+                /* Never scheduled, i.e. the PMU had no room for us */
+                if (data[2] == 0) {
+                        continue;
+                }
+
+                /* Extrapolate if the kernel multiplexed us with other counters */
+                sample->counts[i] = data[2] == data[1]
+                                        ? data[0]
+                                        : (uint64_t)((double)data[0] * (double)data[1] /
+                                                     (double)data[2]);
+                sample->available[i] = true;
+        }
+}
+
+void uf_perf_report(const char *label, const UfPerfSample *sample, size_t n_ops)
+{
+        double ops = n_ops > 0 ? (double)n_ops : 1.0;
+
+        printf("%-24s %8.1f ns/op", label, sample->seconds * 1e9 / ops);
+
+        for (size_t i = 0; i < UF_PERF_N_COUNTERS; i++) {
+                if (sample->available[i]) {
+                        printf(" %8.2f %s", (double)sample->counts[i] / ops, uf_perf_events[i].name);
+                } else {
+                        printf(" %8s %s", "-", uf_perf_events[i].name);
+                }
+        }
+        putchar('\n');
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
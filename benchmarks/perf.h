@@ -0,0 +1,93 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfPerf reads hardware performance counters around a region of a
+ * benchmark, via perf_event_open. Layout decisions (chaining vs open
+ * addressing, fill rate) show up in miss counts long before wall clock.
+ *
+ * Counters the kernel refuses (containers, perf_event_paranoid, virtual
+ * machines without a PMU) are reported as unavailable, and the wall
+ * clock time is always measured.
+ */
+typedef struct UfPerf UfPerf;
+
+typedef enum {
+        UF_PERF_CYCLES = 0,
+        UF_PERF_INSTRUCTIONS,
+        UF_PERF_CACHE_MISSES,
+        UF_PERF_BRANCH_MISSES,
+        UF_PERF_DTLB_MISSES,
+        UF_PERF_N_COUNTERS,
+} UfPerfCounter;
+
+/**
+ * Result of one measured region
+ */
+typedef struct UfPerfSample {
+        double seconds;                       /**<Wall clock time */
+        uint64_t counts[UF_PERF_N_COUNTERS];  /**<Counter values, scaled if multiplexed */
+        bool available[UF_PERF_N_COUNTERS];   /**<Whether counts[i] was measured */
+} UfPerfSample;
+
+/**
+ * Open every counter we can for the calling thread and any threads it
+ * creates afterwards.
+ *
+ * @note Free with uf_perf_free
+ *
+ * @returns A newly allocated UfPerf, which may have no counters at all
+ */
+UfPerf *uf_perf_new(void);
+
+/**
+ * Close the counters and free @perf
+ */
+void uf_perf_free(UfPerf *perf);
+
+/**
+ * Returns true if at least one hardware counter could be opened
+ */
+bool uf_perf_available(UfPerf *perf);
+
+/**
+ * Reset and start counting
+ */
+void uf_perf_start(UfPerf *perf);
+
+/**
+ * Stop counting and store the measurement since uf_perf_start in @sample
+ */
+void uf_perf_stop(UfPerf *perf, UfPerfSample *sample);
+
+/**
+ * Print @sample divided over @n_ops operations as a single line
+ * prefixed with @label. Unavailable counters print as "-".
+ */
+void uf_perf_report(const char *label, const UfPerfSample *sample, size_t n_ops);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,364 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "str.h"
+#include "util.h"
+#include "workload.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/**
+ * Longest collision set we generate, 2^20 keys of 40 bytes
+ */
+#define UF_WORKLOAD_COLLISION_BITS 20
+
+/**
+ * splitmix64, small and good enough to drive a benchmark
+ */
+static inline uint64_t uf_workload_rand(uint64_t *state)
+{
+        uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+}
+
+/**
+ * Uniform double in [0, 1)
+ */
+static inline double uf_workload_rand_double(uint64_t *state)
+{
+        return (double)(uf_workload_rand(state) >> 11) * 0x1.0p-53;
+}
+
+/**
+ * murmur3 finaliser, a bijection on 32-bit integers fixing only zero
+ */
+static inline uint32_t uf_workload_mix32(uint32_t h)
+{
+        h ^= h >> 16;
+        h *= 0x85EBCA6BU;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35U;
+        h ^= h >> 16;
+        return h;
+}
+
+static bool uf_workload_int_keys(UfWorkload *self, UfWorkloadKeys keys, uint64_t seed)
+{
+        /* Odd multipliers are invertible mod 2^32, keeping keys distinct */
+        uint32_t scale = (uint32_t)seed | 1;
+
+        if (self->n_keys > UINT32_MAX) {
+                return false;
+        }
+        for (size_t i = 0; i < self->n_keys; i++) {
+                uint32_t k = (uint32_t)(i + 1);
+                if (keys == UF_WORKLOAD_KEYS_RANDOM) {
+                        k = uf_workload_mix32(k * scale);
+                }
+                self->keys[i] = UF_INT_TO_PTR(k);
+        }
+        return true;
+}
+
+/**
+ * Finish a string key set held back to back in @blob, fixing up the
+ * offsets stored in keys[] into pointers.
+ */
+static bool uf_workload_string_keys(UfWorkload *self, UfString *blob)
+{
+        self->strings = uf_string_steal(blob);
+        if (!self->strings) {
+                return false;
+        }
+        for (size_t i = 0; i < self->n_keys; i++) {
+                self->keys[i] = self->strings + (uintptr_t)self->keys[i];
+        }
+        self->string_keys = true;
+        return true;
+}
+
+static bool uf_workload_path_keys(UfWorkload *self, uint64_t *rng)
+{
+        static const char *roots[] = { "/usr/lib", "/usr/share", "/var/lib", "/home/user", "/etc" };
+        static const char *words[] = {
+                "x86_64-linux-gnu", "python3", "site-packages", "icons", "hicolor", "locale",
+                "systemd", "system", "doc", "man", "include", "cache", "config", "src",
+                "build", "modules", "kernel", "drivers", "firmware", "fonts", "themes", "gtk-3.0",
+        };
+        static const char *exts[] = { ".so", ".py", ".png", ".conf", ".h", ".gz", "" };
+        UfString blob;
+        bool ret = false;
+
+        uf_string_init(&blob);
+
+        for (size_t i = 0; i < self->n_keys; i++) {
+                size_t depth = 1 + (size_t)(uf_workload_rand(rng) % 4);
+
+                self->keys[i] = UF_INT_TO_PTR(uf_string_len(&blob));
+                if (!uf_string_append(&blob, roots[uf_workload_rand(rng) % ARRAY_SIZE(roots)])) {
+                        goto out;
+                }
+                for (size_t d = 0; d < depth; d++) {
+                        const char *word = words[uf_workload_rand(rng) % ARRAY_SIZE(words)];
+                        if (!uf_string_printf(&blob, "/%s", word)) {
+                                goto out;
+                        }
+                }
+                /* The index keeps every path unique */
+                if (!uf_string_printf(&blob,
+                                      "/%s-%zu%s",
+                                      words[uf_workload_rand(rng) % ARRAY_SIZE(words)],
+                                      i,
+                                      exts[uf_workload_rand(rng) % ARRAY_SIZE(exts)]) ||
+                    !uf_string_append_c(&blob, '\0')) {
+                        goto out;
+                }
+        }
+        ret = uf_workload_string_keys(self, &blob);
+out:
+        uf_string_clear(&blob);
+        return ret;
+}
+
+/**
+ * DJB computes h * 33 + c, so "Ez" and "FY" hash alike from any starting
+ * state. Any concatenation of k such blocks therefore collides with all
+ * 2^k others, giving a single chain in a chained hashmap.
+ */
+static bool uf_workload_collision_keys(UfWorkload *self)
+{
+        static const char *blocks[] = { "Ez", "FY" };
+        size_t bits = 1;
+        UfString blob;
+        bool ret = false;
+
+        while (((size_t)1 << bits) < self->n_keys) {
+                bits++;
+        }
+        if (bits > UF_WORKLOAD_COLLISION_BITS) {
+                return false;
+        }
+
+        uf_string_init(&blob);
+        for (size_t i = 0; i < self->n_keys; i++) {
+                self->keys[i] = UF_INT_TO_PTR(uf_string_len(&blob));
+                for (size_t b = 0; b < bits; b++) {
+                        if (!uf_string_append_len(&blob, blocks[(i >> b) & 1], 2)) {
+                                goto out;
+                        }
+                }
+                if (!uf_string_append_c(&blob, '\0')) {
+                        goto out;
+                }
+        }
+        ret = uf_workload_string_keys(self, &blob);
+out:
+        uf_string_clear(&blob);
+        return ret;
+}
+
+/**
+ * Zipf sampling by inverse CDF over a cumulative table. Any skew works,
+ * and generation is off the measured path so O(log n) draws are fine.
+ */
+static double *uf_workload_zipf_table(size_t n, double skew)
+{
+        double *cdf = NULL;
+        double sum = 0.0;
+
+        cdf = malloc(n * sizeof(double));
+        if (!cdf) {
+                return NULL;
+        }
+        for (size_t i = 0; i < n; i++) {
+                sum += 1.0 / pow((double)(i + 1), skew);
+                cdf[i] = sum;
+        }
+        for (size_t i = 0; i < n; i++) {
+                cdf[i] /= sum;
+        }
+        return cdf;
+}
+
+static size_t uf_workload_zipf_draw(const double *cdf, size_t n, uint64_t *rng)
+{
+        double u = uf_workload_rand_double(rng);
+        size_t lo = 0, hi = n - 1;
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (cdf[mid] < u) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+/**
+ * Build the operation trace. Zipf ranks are mapped through a random
+ * permutation so the hot keys aren't simply the first ones generated.
+ */
+static bool uf_workload_trace(UfWorkload *self, const UfWorkloadOptions *options, uint64_t *rng)
+{
+        double *cdf = NULL;
+        uint32_t *rank = NULL;
+        bool ret = false;
+
+        if (options->access == UF_WORKLOAD_ZIPF) {
+                cdf = uf_workload_zipf_table(self->n_keys, options->zipf_skew);
+                rank = malloc(self->n_keys * sizeof(uint32_t));
+                if (!cdf || !rank) {
+                        goto out;
+                }
+                for (size_t i = 0; i < self->n_keys; i++) {
+                        rank[i] = (uint32_t)i;
+                }
+                for (size_t i = self->n_keys - 1; i > 0; i--) {
+                        size_t j = uf_workload_rand(rng) % (i + 1);
+                        uint32_t t = rank[i];
+                        rank[i] = rank[j];
+                        rank[j] = t;
+                }
+        }
+
+        for (size_t i = 0; i < self->n_ops; i++) {
+                unsigned int roll = (unsigned int)(uf_workload_rand(rng) % 100);
+                size_t key;
+
+                switch (options->access) {
+                case UF_WORKLOAD_ZIPF:
+                        key = rank[uf_workload_zipf_draw(cdf, self->n_keys, rng)];
+                        break;
+                case UF_WORKLOAD_SEQUENTIAL:
+                        key = i % self->n_keys;
+                        break;
+                case UF_WORKLOAD_UNIFORM:
+                default:
+                        key = (size_t)(uf_workload_rand(rng) % self->n_keys);
+                        break;
+                }
+
+                self->ops[i].key = (uint32_t)key;
+                if (roll < options->get_percent) {
+                        self->ops[i].kind = UF_WORKLOAD_GET;
+                } else if (roll < options->get_percent + options->remove_percent) {
+                        self->ops[i].kind = UF_WORKLOAD_REMOVE;
+                } else {
+                        self->ops[i].kind = UF_WORKLOAD_PUT;
+                }
+        }
+        ret = true;
+out:
+        free(cdf);
+        free(rank);
+        return ret;
+}
+
+UfWorkload *uf_workload_new(const UfWorkloadOptions *options)
+{
+        UfWorkload *ret = NULL;
+        uint64_t rng = options->seed;
+        bool ok = false;
+
+        if (options->n_keys == 0 || options->n_keys > UINT32_MAX ||
+            options->get_percent + options->remove_percent > 100) {
+                return NULL;
+        }
+
+        ret = calloc(1, sizeof(struct UfWorkload));
+        if (!ret) {
+                return NULL;
+        }
+        ret->n_keys = options->n_keys;
+        ret->n_ops = options->n_ops;
+        ret->keys = calloc(ret->n_keys, sizeof(void *));
+        ret->ops = calloc(ret->n_ops ? ret->n_ops : 1, sizeof(UfWorkloadOp));
+        if (!ret->keys || !ret->ops) {
+                goto out;
+        }
+
+        switch (options->keys) {
+        case UF_WORKLOAD_KEYS_RANDOM:
+        case UF_WORKLOAD_KEYS_SEQUENTIAL:
+                ok = uf_workload_int_keys(ret, options->keys, options->seed);
+                break;
+        case UF_WORKLOAD_KEYS_PATHS:
+                ok = uf_workload_path_keys(ret, &rng);
+                break;
+        case UF_WORKLOAD_KEYS_COLLISIONS:
+                ok = uf_workload_collision_keys(ret);
+                break;
+        default:
+                break;
+        }
+
+        if (ok && uf_workload_trace(ret, options, &rng)) {
+                return ret;
+        }
+out:
+        uf_workload_free(ret);
+        return NULL;
+}
+
+void uf_workload_free(UfWorkload *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        free(self->keys);
+        free(self->ops);
+        free(self->strings);
+        free(self);
+}
+
+const char *uf_workload_keys_name(UfWorkloadKeys keys)
+{
+        static const char *names[] = {
+                [UF_WORKLOAD_KEYS_RANDOM] = "random",
+                [UF_WORKLOAD_KEYS_SEQUENTIAL] = "sequential",
+                [UF_WORKLOAD_KEYS_PATHS] = "paths",
+                [UF_WORKLOAD_KEYS_COLLISIONS] = "collisions",
+        };
+        return keys < UF_WORKLOAD_N_KEYS ? names[keys] : "unknown";
+}
+
+const char *uf_workload_access_name(UfWorkloadAccess access)
+{
+        static const char *names[] = {
+                [UF_WORKLOAD_UNIFORM] = "uniform",
+                [UF_WORKLOAD_ZIPF] = "zipf",
+                [UF_WORKLOAD_SEQUENTIAL] = "sequential",
+        };
+        return access < UF_WORKLOAD_N_ACCESS ? names[access] : "unknown";
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
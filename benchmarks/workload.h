@@ -0,0 +1,107 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfWorkload is a pregenerated trace of map operations, so every map
+ * variant can be benchmarked against exactly the same keys and access
+ * order, with generation cost kept out of the measurement.
+ */
+
+/**
+ * The shape of the key set
+ */
+typedef enum {
+        UF_WORKLOAD_KEYS_RANDOM = 0,  /**<Distinct random integers */
+        UF_WORKLOAD_KEYS_SEQUENTIAL,  /**<Integers 1..n, worst case for uf_hashmap_simple_hash */
+        UF_WORKLOAD_KEYS_PATHS,       /**<Filesystem paths sharing long prefixes */
+        UF_WORKLOAD_KEYS_COLLISIONS,  /**<Strings which all share one uf_hashmap_string_hash */
+        UF_WORKLOAD_N_KEYS,
+} UfWorkloadKeys;
+
+/**
+ * Which keys the operations touch
+ */
+typedef enum {
+        UF_WORKLOAD_UNIFORM = 0,   /**<Every key equally likely */
+        UF_WORKLOAD_ZIPF,          /**<Few hot keys, see zipf_skew */
+        UF_WORKLOAD_SEQUENTIAL,    /**<Keys in generation order, wrapping around */
+        UF_WORKLOAD_N_ACCESS,
+} UfWorkloadAccess;
+
+typedef enum {
+        UF_WORKLOAD_GET = 0,
+        UF_WORKLOAD_PUT,
+        UF_WORKLOAD_REMOVE,
+} UfWorkloadOpKind;
+
+typedef struct UfWorkloadOptions {
+        UfWorkloadKeys keys;
+        UfWorkloadAccess access;
+        size_t n_keys;
+        size_t n_ops;
+        double zipf_skew;        /**<Zipf exponent, 0.99 is the usual "hot" setting */
+        unsigned int get_percent;    /**<Share of gets in the trace */
+        unsigned int remove_percent; /**<Share of removes, the rest are puts */
+        uint64_t seed;
+} UfWorkloadOptions;
+
+typedef struct UfWorkloadOp {
+        uint32_t kind; /**<UfWorkloadOpKind */
+        uint32_t key;  /**<Index into UfWorkload.keys */
+} UfWorkloadOp;
+
+typedef struct UfWorkload {
+        void **keys;         /**<Integer keys via UF_INT_TO_PTR, or C strings */
+        size_t n_keys;
+        bool string_keys;    /**<True if keys are C strings */
+        UfWorkloadOp *ops;
+        size_t n_ops;
+        char *strings;       /**<Storage for string keys */
+} UfWorkload;
+
+/**
+ * Generate a workload. The same options (including seed) always produce
+ * the same trace.
+ *
+ * @note Free with uf_workload_free
+ *
+ * @returns A newly allocated UfWorkload, or NULL on OOM or bad options
+ */
+UfWorkload *uf_workload_new(const UfWorkloadOptions *options);
+
+/**
+ * Free a previously generated workload
+ */
+void uf_workload_free(UfWorkload *workload);
+
+/**
+ * Short names for reports
+ */
+const char *uf_workload_keys_name(UfWorkloadKeys keys);
+const char *uf_workload_access_name(UfWorkloadAccess access);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,44 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdlib.h>
+
+#include "allocator.h"
+#include "util.h"
+
+static void *uf_allocator_malloc_alloc(__uf_unused__ void *userdata, size_t size)
+{
+        return malloc(size);
+}
+
+static void uf_allocator_malloc_free(__uf_unused__ void *userdata, void *ptr,
+                                     __uf_unused__ size_t size)
+{
+        free(ptr);
+}
+
+const UfAllocator uf_allocator_malloc = {
+        .alloc = uf_allocator_malloc_alloc,
+        .free = uf_allocator_malloc_free,
+        .userdata = NULL,
+};
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,70 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * UfAllocator lets a container obtain its small, fixed-size internal
+ * allocations (such as hashmap collision nodes) from somewhere other than
+ * malloc, typically a UfPool.
+ *
+ * Implementations must be safe to call from every thread that uses the
+ * owning container.
+ */
+typedef struct UfAllocator {
+        /**
+         * Allocate @size bytes, returning NULL on failure. Memory need not
+         * be zeroed.
+         */
+        void *(*alloc)(void *userdata, size_t size);
+
+        /**
+         * Release @ptr, previously returned by alloc with the same @size
+         */
+        void (*free)(void *userdata, void *ptr, size_t size);
+
+        void *userdata; /**<Passed as the first argument to alloc/free */
+} UfAllocator;
+
+/**
+ * The default allocator, backed by malloc/free
+ */
+extern const UfAllocator uf_allocator_malloc;
+
+/**
+ * Allocate @size bytes from @allocator
+ */
+static inline void *uf_allocator_alloc(const UfAllocator *allocator, size_t size)
+{
+        return allocator->alloc(allocator->userdata, size);
+}
+
+/**
+ * Return @ptr of @size bytes to @allocator
+ */
+static inline void uf_allocator_free(const UfAllocator *allocator, void *ptr, size_t size)
+{
+        allocator->free(allocator->userdata, ptr, size);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
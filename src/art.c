@@ -0,0 +1,1052 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "art.h"
+#include "util.h"
+
+/**
+ * Number of prefix bytes stored inline in each inner node. Longer compressed
+ * paths are verified optimistically against the minimum leaf.
+ */
+#define UF_ART_MAX_PREFIX 8
+
+/**
+ * Leaves are tagged in the low bit of child pointers so that we don't need
+ * a type header on every leaf.
+ */
+#define UF_ART_IS_LEAF(x) (((uintptr_t)(x)) & 1)
+#define UF_ART_SET_LEAF(x) ((UfArtNode *)((uintptr_t)(x) | 1))
+#define UF_ART_LEAF_RAW(x) ((UfArtLeaf *)((uintptr_t)(x) & ~(uintptr_t)1))
+
+#define uf_art_min(x, y) ((x) < (y) ? (x) : (y))
+
+typedef enum {
+        UF_ART_NODE4 = 1,
+        UF_ART_NODE16,
+        UF_ART_NODE48,
+        UF_ART_NODE256,
+} UfArtNodeType;
+
+/**
+ * Common header for all inner nodes, 16 bytes.
+ */
+typedef struct UfArtNode {
+        uint8_t type;                              /**<UfArtNodeType */
+        uint8_t reserved;                          /**<Padding */
+        uint16_t num_children;                     /**<Number of occupied children */
+        uint32_t partial_len;                      /**<Full length of the compressed path */
+        unsigned char partial[UF_ART_MAX_PREFIX]; /**<Compressed path, truncated */
+} UfArtNode;
+
+typedef struct UfArtNode4 {
+        UfArtNode n;
+        unsigned char keys[4];
+        UfArtNode *children[4];
+} UfArtNode4;
+
+typedef struct UfArtNode16 {
+        UfArtNode n;
+        unsigned char keys[16];
+        UfArtNode *children[16];
+} UfArtNode16;
+
+/**
+ * keys maps a byte to a 1-based index into children, 0 being empty.
+ */
+typedef struct UfArtNode48 {
+        UfArtNode n;
+        unsigned char keys[256];
+        UfArtNode *children[48];
+} UfArtNode48;
+
+typedef struct UfArtNode256 {
+        UfArtNode n;
+        UfArtNode *children[256];
+} UfArtNode256;
+
+/**
+ * Leaves store the key inline, including the NUL terminator. The terminator
+ * guarantees that no stored key is a prefix of another stored key, so a
+ * leaf is always reached at a distinct byte.
+ */
+typedef struct UfArtLeaf {
+        void *value;
+        uint32_t key_len;
+        unsigned char key[];
+} UfArtLeaf;
+
+struct UfArt {
+        UfArtNode *root;
+        size_t size;
+        uf_hashmap_free_func value_free;
+};
+
+UfArt *uf_art_new(void)
+{
+        return uf_art_new_full(NULL);
+}
+
+UfArt *uf_art_new_full(uf_hashmap_free_func value_free)
+{
+        UfArt *ret = NULL;
+
+        ret = calloc(1, sizeof(struct UfArt));
+        if (!ret) {
+                return NULL;
+        }
+        ret->value_free = value_free;
+        return ret;
+}
+
+static UfArtNode *uf_art_node_new(UfArtNodeType type)
+{
+        UfArtNode *node = NULL;
+
+        switch (type) {
+        case UF_ART_NODE4:
+                node = calloc(1, sizeof(UfArtNode4));
+                break;
+        case UF_ART_NODE16:
+                node = calloc(1, sizeof(UfArtNode16));
+                break;
+        case UF_ART_NODE48:
+                node = calloc(1, sizeof(UfArtNode48));
+                break;
+        case UF_ART_NODE256:
+        default:
+                node = calloc(1, sizeof(UfArtNode256));
+                break;
+        }
+        if (node) {
+                node->type = (uint8_t)type;
+        }
+        return node;
+}
+
+static UfArtLeaf *uf_art_leaf_new(const unsigned char *key, uint32_t key_len, void *value)
+{
+        UfArtLeaf *leaf = malloc(sizeof(UfArtLeaf) + key_len);
+        if (!leaf) {
+                return NULL;
+        }
+        leaf->value = value;
+        leaf->key_len = key_len;
+        memcpy(leaf->key, key, key_len);
+        return leaf;
+}
+
+static void uf_art_node_free(UfArt *self, UfArtNode *node)
+{
+        if (!node) {
+                return;
+        }
+
+        if (UF_ART_IS_LEAF(node)) {
+                UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                if (self->value_free) {
+                        self->value_free(leaf->value);
+                }
+                free(leaf);
+                return;
+        }
+
+        switch (node->type) {
+        case UF_ART_NODE4:
+                for (int i = 0; i < node->num_children; i++) {
+                        uf_art_node_free(self, ((UfArtNode4 *)node)->children[i]);
+                }
+                break;
+        case UF_ART_NODE16:
+                for (int i = 0; i < node->num_children; i++) {
+                        uf_art_node_free(self, ((UfArtNode16 *)node)->children[i]);
+                }
+                break;
+        case UF_ART_NODE48:
+                for (int i = 0; i < 48; i++) {
+                        uf_art_node_free(self, ((UfArtNode48 *)node)->children[i]);
+                }
+                break;
+        case UF_ART_NODE256:
+        default:
+                for (int i = 0; i < 256; i++) {
+                        uf_art_node_free(self, ((UfArtNode256 *)node)->children[i]);
+                }
+                break;
+        }
+        free(node);
+}
+
+void uf_art_free(UfArt *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        uf_art_node_free(self, self->root);
+        free(self);
+}
+
+size_t uf_art_size(UfArt *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return self->size;
+}
+
+/**
+ * Find the child slot for byte @c, or NULL if there isn't one.
+ */
+static UfArtNode **uf_art_find_child(UfArtNode *node, unsigned char c)
+{
+        switch (node->type) {
+        case UF_ART_NODE4: {
+                UfArtNode4 *n = (UfArtNode4 *)node;
+                for (int i = 0; i < node->num_children; i++) {
+                        if (n->keys[i] == c) {
+                                return &n->children[i];
+                        }
+                }
+                return NULL;
+        }
+        case UF_ART_NODE16: {
+                UfArtNode16 *n = (UfArtNode16 *)node;
+#if defined(__SSE2__)
+                /* Compare all 16 keys at once, mask off the unused tail */
+                __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                                             _mm_loadu_si128((const __m128i *)n->keys));
+                unsigned int bits = (unsigned int)_mm_movemask_epi8(cmp) &
+                                    ((1U << node->num_children) - 1);
+                if (bits) {
+                        return &n->children[__builtin_ctz(bits)];
+                }
+#else
+                for (int i = 0; i < node->num_children; i++) {
+                        if (n->keys[i] == c) {
+                                return &n->children[i];
+                        }
+                }
+#endif
+                return NULL;
+        }
+        case UF_ART_NODE48: {
+                UfArtNode48 *n = (UfArtNode48 *)node;
+                if (n->keys[c]) {
+                        return &n->children[n->keys[c] - 1];
+                }
+                return NULL;
+        }
+        case UF_ART_NODE256:
+        default: {
+                UfArtNode256 *n = (UfArtNode256 *)node;
+                if (n->children[c]) {
+                        return &n->children[c];
+                }
+                return NULL;
+        }
+        }
+}
+
+/**
+ * Return the leftmost (smallest) leaf under @node
+ */
+static UfArtLeaf *uf_art_minimum(UfArtNode *node)
+{
+        while (node && !UF_ART_IS_LEAF(node)) {
+                switch (node->type) {
+                case UF_ART_NODE4:
+                        node = ((UfArtNode4 *)node)->children[0];
+                        break;
+                case UF_ART_NODE16:
+                        node = ((UfArtNode16 *)node)->children[0];
+                        break;
+                case UF_ART_NODE48: {
+                        UfArtNode48 *n = (UfArtNode48 *)node;
+                        int i = 0;
+                        while (!n->keys[i]) {
+                                i++;
+                        }
+                        node = n->children[n->keys[i] - 1];
+                        break;
+                }
+                case UF_ART_NODE256:
+                default: {
+                        UfArtNode256 *n = (UfArtNode256 *)node;
+                        int i = 0;
+                        while (!n->children[i]) {
+                                i++;
+                        }
+                        node = n->children[i];
+                        break;
+                }
+                }
+        }
+        return node ? UF_ART_LEAF_RAW(node) : NULL;
+}
+
+static inline bool uf_art_leaf_matches(const UfArtLeaf *leaf, const unsigned char *key,
+                                       uint32_t key_len)
+{
+        return leaf->key_len == key_len && memcmp(leaf->key, key, key_len) == 0;
+}
+
+/**
+ * Number of inline prefix bytes of @node matching @key from @depth
+ */
+static uint32_t uf_art_check_prefix(const UfArtNode *node, const unsigned char *key,
+                                    uint32_t key_len, uint32_t depth)
+{
+        uint32_t max = uf_art_min(uf_art_min(node->partial_len, UF_ART_MAX_PREFIX),
+                                  key_len - depth);
+        uint32_t i;
+
+        for (i = 0; i < max; i++) {
+                if (node->partial[i] != key[depth + i]) {
+                        return i;
+                }
+        }
+        return i;
+}
+
+/**
+ * Like uf_art_check_prefix, but resolves the full compressed path by
+ * consulting the minimum leaf when the prefix is longer than we store.
+ */
+static uint32_t uf_art_prefix_mismatch(UfArtNode *node, const unsigned char *key,
+                                       uint32_t key_len, uint32_t depth)
+{
+        uint32_t max = uf_art_min(uf_art_min(node->partial_len, UF_ART_MAX_PREFIX),
+                                  key_len - depth);
+        uint32_t i;
+        UfArtLeaf *leaf = NULL;
+
+        for (i = 0; i < max; i++) {
+                if (node->partial[i] != key[depth + i]) {
+                        return i;
+                }
+        }
+
+        if (node->partial_len > UF_ART_MAX_PREFIX) {
+                leaf = uf_art_minimum(node);
+                max = uf_art_min(leaf->key_len, key_len) - depth;
+                for (; i < max; i++) {
+                        if (leaf->key[depth + i] != key[depth + i]) {
+                                return i;
+                        }
+                }
+        }
+        return i;
+}
+
+void *uf_art_get(UfArt *self, const char *key)
+{
+        const unsigned char *k = (const unsigned char *)key;
+        uint32_t key_len;
+        uint32_t depth = 0;
+        UfArtNode *node = NULL;
+
+        if (uf_unlikely(!self || !key)) {
+                return NULL;
+        }
+
+        key_len = (uint32_t)strlen(key) + 1;
+        node = self->root;
+
+        while (node) {
+                UfArtNode **child = NULL;
+
+                if (UF_ART_IS_LEAF(node)) {
+                        UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                        return uf_art_leaf_matches(leaf, k, key_len) ? leaf->value : NULL;
+                }
+
+                /* Optimistic: the leaf comparison validates any skipped bytes */
+                if (node->partial_len) {
+                        if (uf_art_check_prefix(node, k, key_len, depth) !=
+                            uf_art_min(node->partial_len, UF_ART_MAX_PREFIX)) {
+                                return NULL;
+                        }
+                        depth += node->partial_len;
+                }
+                if (depth >= key_len) {
+                        return NULL;
+                }
+
+                child = uf_art_find_child(node, k[depth]);
+                node = child ? *child : NULL;
+                depth++;
+        }
+
+        return NULL;
+}
+
+static void uf_art_copy_header(UfArtNode *dest, const UfArtNode *src)
+{
+        dest->num_children = src->num_children;
+        dest->partial_len = src->partial_len;
+        memcpy(dest->partial, src->partial, uf_art_min(UF_ART_MAX_PREFIX, src->partial_len));
+}
+
+static bool uf_art_add_child256(UfArtNode256 *n, unsigned char c, UfArtNode *child)
+{
+        n->n.num_children++;
+        n->children[c] = child;
+        return true;
+}
+
+static bool uf_art_add_child48(UfArtNode48 *n, UfArtNode **ref, unsigned char c, UfArtNode *child)
+{
+        UfArtNode256 *grown = NULL;
+
+        if (n->n.num_children < 48) {
+                int pos = 0;
+                while (n->children[pos]) {
+                        pos++;
+                }
+                n->children[pos] = child;
+                n->keys[c] = (unsigned char)(pos + 1);
+                n->n.num_children++;
+                return true;
+        }
+
+        grown = (UfArtNode256 *)uf_art_node_new(UF_ART_NODE256);
+        if (!grown) {
+                return false;
+        }
+        for (int i = 0; i < 256; i++) {
+                if (n->keys[i]) {
+                        grown->children[i] = n->children[n->keys[i] - 1];
+                }
+        }
+        uf_art_copy_header(&grown->n, &n->n);
+        *ref = &grown->n;
+        free(n);
+        return uf_art_add_child256(grown, c, child);
+}
+
+static bool uf_art_add_child16(UfArtNode16 *n, UfArtNode **ref, unsigned char c, UfArtNode *child)
+{
+        UfArtNode48 *grown = NULL;
+
+        if (n->n.num_children < 16) {
+                int pos = 0;
+                /* Keep keys sorted for ordered iteration */
+                while (pos < n->n.num_children && n->keys[pos] < c) {
+                        pos++;
+                }
+                memmove(n->keys + pos + 1, n->keys + pos, (size_t)(n->n.num_children - pos));
+                memmove(n->children + pos + 1,
+                        n->children + pos,
+                        (size_t)(n->n.num_children - pos) * sizeof(void *));
+                n->keys[pos] = c;
+                n->children[pos] = child;
+                n->n.num_children++;
+                return true;
+        }
+
+        grown = (UfArtNode48 *)uf_art_node_new(UF_ART_NODE48);
+        if (!grown) {
+                return false;
+        }
+        memcpy(grown->children, n->children, sizeof(void *) * 16);
+        for (int i = 0; i < 16; i++) {
+                grown->keys[n->keys[i]] = (unsigned char)(i + 1);
+        }
+        uf_art_copy_header(&grown->n, &n->n);
+        *ref = &grown->n;
+        free(n);
+        return uf_art_add_child48(grown, ref, c, child);
+}
+
+static bool uf_art_add_child4(UfArtNode4 *n, UfArtNode **ref, unsigned char c, UfArtNode *child)
+{
+        UfArtNode16 *grown = NULL;
+
+        if (n->n.num_children < 4) {
+                int pos = 0;
+                while (pos < n->n.num_children && n->keys[pos] < c) {
+                        pos++;
+                }
+                memmove(n->keys + pos + 1, n->keys + pos, (size_t)(n->n.num_children - pos));
+                memmove(n->children + pos + 1,
+                        n->children + pos,
+                        (size_t)(n->n.num_children - pos) * sizeof(void *));
+                n->keys[pos] = c;
+                n->children[pos] = child;
+                n->n.num_children++;
+                return true;
+        }
+
+        grown = (UfArtNode16 *)uf_art_node_new(UF_ART_NODE16);
+        if (!grown) {
+                return false;
+        }
+        memcpy(grown->children, n->children, sizeof(void *) * 4);
+        memcpy(grown->keys, n->keys, 4);
+        uf_art_copy_header(&grown->n, &n->n);
+        *ref = &grown->n;
+        free(n);
+        return uf_art_add_child16(grown, ref, c, child);
+}
+
+static bool uf_art_add_child(UfArtNode *n, UfArtNode **ref, unsigned char c, UfArtNode *child)
+{
+        switch (n->type) {
+        case UF_ART_NODE4:
+                return uf_art_add_child4((UfArtNode4 *)n, ref, c, child);
+        case UF_ART_NODE16:
+                return uf_art_add_child16((UfArtNode16 *)n, ref, c, child);
+        case UF_ART_NODE48:
+                return uf_art_add_child48((UfArtNode48 *)n, ref, c, child);
+        case UF_ART_NODE256:
+        default:
+                return uf_art_add_child256((UfArtNode256 *)n, c, child);
+        }
+}
+
+/**
+ * Recursive insert helper. All allocations happen before the tree is
+ * modified so that a failure leaves the tree intact.
+ */
+static bool uf_art_insert_node(UfArt *self, UfArtNode *node, UfArtNode **ref,
+                               const unsigned char *key, uint32_t key_len, uint32_t depth,
+                               void *value)
+{
+        UfArtLeaf *leaf = NULL;
+        UfArtNode4 *split = NULL;
+        UfArtNode **child = NULL;
+
+        if (!node) {
+                leaf = uf_art_leaf_new(key, key_len, value);
+                if (!leaf) {
+                        return false;
+                }
+                *ref = UF_ART_SET_LEAF(leaf);
+                self->size++;
+                return true;
+        }
+
+        /* Replace the existing leaf, or split it into a new Node4 */
+        if (UF_ART_IS_LEAF(node)) {
+                UfArtLeaf *existing = UF_ART_LEAF_RAW(node);
+                uint32_t prefix = 0;
+                uint32_t max;
+
+                if (uf_art_leaf_matches(existing, key, key_len)) {
+                        if (self->value_free) {
+                                self->value_free(existing->value);
+                        }
+                        existing->value = value;
+                        return true;
+                }
+
+                leaf = uf_art_leaf_new(key, key_len, value);
+                split = (UfArtNode4 *)uf_art_node_new(UF_ART_NODE4);
+                if (!leaf || !split) {
+                        free(leaf);
+                        free(split);
+                        return false;
+                }
+
+                max = uf_art_min(existing->key_len, key_len) - depth;
+                while (prefix < max && existing->key[depth + prefix] == key[depth + prefix]) {
+                        prefix++;
+                }
+                split->n.partial_len = prefix;
+                memcpy(split->n.partial, key + depth, uf_art_min(UF_ART_MAX_PREFIX, prefix));
+
+                *ref = &split->n;
+                uf_art_add_child4(split, ref, existing->key[depth + prefix], node);
+                uf_art_add_child4(split, ref, key[depth + prefix], UF_ART_SET_LEAF(leaf));
+                self->size++;
+                return true;
+        }
+
+        /* Split the compressed path if we diverge inside it */
+        if (node->partial_len) {
+                uint32_t diff = uf_art_prefix_mismatch(node, key, key_len, depth);
+
+                if (diff < node->partial_len) {
+                        leaf = uf_art_leaf_new(key, key_len, value);
+                        split = (UfArtNode4 *)uf_art_node_new(UF_ART_NODE4);
+                        if (!leaf || !split) {
+                                free(leaf);
+                                free(split);
+                                return false;
+                        }
+
+                        *ref = &split->n;
+                        split->n.partial_len = diff;
+                        memcpy(split->n.partial,
+                               node->partial,
+                               uf_art_min(UF_ART_MAX_PREFIX, diff));
+
+                        if (node->partial_len <= UF_ART_MAX_PREFIX) {
+                                uf_art_add_child4(split, ref, node->partial[diff], node);
+                                node->partial_len -= diff + 1;
+                                memmove(node->partial,
+                                        node->partial + diff + 1,
+                                        uf_art_min(UF_ART_MAX_PREFIX, node->partial_len));
+                        } else {
+                                UfArtLeaf *min = uf_art_minimum(node);
+                                node->partial_len -= diff + 1;
+                                uf_art_add_child4(split, ref, min->key[depth + diff], node);
+                                memcpy(node->partial,
+                                       min->key + depth + diff + 1,
+                                       uf_art_min(UF_ART_MAX_PREFIX, node->partial_len));
+                        }
+
+                        uf_art_add_child4(split, ref, key[depth + diff], UF_ART_SET_LEAF(leaf));
+                        self->size++;
+                        return true;
+                }
+                depth += node->partial_len;
+        }
+
+        child = uf_art_find_child(node, key[depth]);
+        if (child) {
+                return uf_art_insert_node(self, *child, child, key, key_len, depth + 1, value);
+        }
+
+        leaf = uf_art_leaf_new(key, key_len, value);
+        if (!leaf) {
+                return false;
+        }
+        if (!uf_art_add_child(node, ref, key[depth], UF_ART_SET_LEAF(leaf))) {
+                free(leaf);
+                return false;
+        }
+        self->size++;
+        return true;
+}
+
+bool uf_art_put(UfArt *self, const char *key, void *value)
+{
+        if (uf_unlikely(!self || !key)) {
+                return false;
+        }
+
+        return uf_art_insert_node(self,
+                                  self->root,
+                                  &self->root,
+                                  (const unsigned char *)key,
+                                  (uint32_t)strlen(key) + 1,
+                                  0,
+                                  value);
+}
+
+/**
+ * Shrinking is best effort: if we can't allocate the smaller node we simply
+ * keep the larger one, which is still valid.
+ */
+static void uf_art_remove_child256(UfArtNode256 *n, UfArtNode **ref, unsigned char c)
+{
+        UfArtNode48 *shrunk = NULL;
+        int pos = 0;
+
+        n->children[c] = NULL;
+        n->n.num_children--;
+
+        if (n->n.num_children != 37) {
+                return;
+        }
+        shrunk = (UfArtNode48 *)uf_art_node_new(UF_ART_NODE48);
+        if (!shrunk) {
+                return;
+        }
+        uf_art_copy_header(&shrunk->n, &n->n);
+        for (int i = 0; i < 256; i++) {
+                if (n->children[i]) {
+                        shrunk->children[pos] = n->children[i];
+                        shrunk->keys[i] = (unsigned char)(pos + 1);
+                        pos++;
+                }
+        }
+        *ref = &shrunk->n;
+        free(n);
+}
+
+static void uf_art_remove_child48(UfArtNode48 *n, UfArtNode **ref, unsigned char c)
+{
+        UfArtNode16 *shrunk = NULL;
+        int pos = n->keys[c];
+        int child = 0;
+
+        n->keys[c] = 0;
+        n->children[pos - 1] = NULL;
+        n->n.num_children--;
+
+        if (n->n.num_children != 12) {
+                return;
+        }
+        shrunk = (UfArtNode16 *)uf_art_node_new(UF_ART_NODE16);
+        if (!shrunk) {
+                return;
+        }
+        uf_art_copy_header(&shrunk->n, &n->n);
+        for (int i = 0; i < 256; i++) {
+                if (n->keys[i]) {
+                        shrunk->keys[child] = (unsigned char)i;
+                        shrunk->children[child] = n->children[n->keys[i] - 1];
+                        child++;
+                }
+        }
+        *ref = &shrunk->n;
+        free(n);
+}
+
+static void uf_art_remove_child16(UfArtNode16 *n, UfArtNode **ref, UfArtNode **slot)
+{
+        UfArtNode4 *shrunk = NULL;
+        int pos = (int)(slot - n->children);
+
+        memmove(n->keys + pos, n->keys + pos + 1, (size_t)(n->n.num_children - 1 - pos));
+        memmove(n->children + pos,
+                n->children + pos + 1,
+                (size_t)(n->n.num_children - 1 - pos) * sizeof(void *));
+        n->n.num_children--;
+
+        if (n->n.num_children != 3) {
+                return;
+        }
+        shrunk = (UfArtNode4 *)uf_art_node_new(UF_ART_NODE4);
+        if (!shrunk) {
+                return;
+        }
+        uf_art_copy_header(&shrunk->n, &n->n);
+        memcpy(shrunk->keys, n->keys, 4);
+        memcpy(shrunk->children, n->children, 4 * sizeof(void *));
+        *ref = &shrunk->n;
+        free(n);
+}
+
+static void uf_art_remove_child4(UfArtNode4 *n, UfArtNode **ref, UfArtNode **slot)
+{
+        UfArtNode *child = NULL;
+        int pos = (int)(slot - n->children);
+
+        memmove(n->keys + pos, n->keys + pos + 1, (size_t)(n->n.num_children - 1 - pos));
+        memmove(n->children + pos,
+                n->children + pos + 1,
+                (size_t)(n->n.num_children - 1 - pos) * sizeof(void *));
+        n->n.num_children--;
+
+        if (n->n.num_children != 1) {
+                return;
+        }
+
+        /* Collapse the single remaining path into the child */
+        child = n->children[0];
+        if (!UF_ART_IS_LEAF(child)) {
+                uint32_t prefix = n->n.partial_len;
+                if (prefix < UF_ART_MAX_PREFIX) {
+                        n->n.partial[prefix] = n->keys[0];
+                        prefix++;
+                }
+                if (prefix < UF_ART_MAX_PREFIX) {
+                        uint32_t sub = uf_art_min(child->partial_len, UF_ART_MAX_PREFIX - prefix);
+                        memcpy(n->n.partial + prefix, child->partial, sub);
+                        prefix += sub;
+                }
+                memcpy(child->partial, n->n.partial, uf_art_min(prefix, UF_ART_MAX_PREFIX));
+                child->partial_len += n->n.partial_len + 1;
+        }
+        *ref = child;
+        free(n);
+}
+
+static void uf_art_remove_child(UfArtNode *n, UfArtNode **ref, unsigned char c, UfArtNode **slot)
+{
+        switch (n->type) {
+        case UF_ART_NODE4:
+                uf_art_remove_child4((UfArtNode4 *)n, ref, slot);
+                break;
+        case UF_ART_NODE16:
+                uf_art_remove_child16((UfArtNode16 *)n, ref, slot);
+                break;
+        case UF_ART_NODE48:
+                uf_art_remove_child48((UfArtNode48 *)n, ref, c);
+                break;
+        case UF_ART_NODE256:
+        default:
+                uf_art_remove_child256((UfArtNode256 *)n, ref, c);
+                break;
+        }
+}
+
+/**
+ * Recursive delete helper, returns the unlinked leaf
+ */
+static UfArtLeaf *uf_art_remove_node(UfArtNode *node, UfArtNode **ref, const unsigned char *key,
+                                     uint32_t key_len, uint32_t depth)
+{
+        UfArtNode **child = NULL;
+
+        if (!node) {
+                return NULL;
+        }
+
+        if (UF_ART_IS_LEAF(node)) {
+                UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                if (uf_art_leaf_matches(leaf, key, key_len)) {
+                        *ref = NULL;
+                        return leaf;
+                }
+                return NULL;
+        }
+
+        if (node->partial_len) {
+                if (uf_art_check_prefix(node, key, key_len, depth) !=
+                    uf_art_min(node->partial_len, UF_ART_MAX_PREFIX)) {
+                        return NULL;
+                }
+                depth += node->partial_len;
+        }
+        if (depth >= key_len) {
+                return NULL;
+        }
+
+        child = uf_art_find_child(node, key[depth]);
+        if (!child) {
+                return NULL;
+        }
+
+        if (UF_ART_IS_LEAF(*child)) {
+                UfArtLeaf *leaf = UF_ART_LEAF_RAW(*child);
+                if (!uf_art_leaf_matches(leaf, key, key_len)) {
+                        return NULL;
+                }
+                uf_art_remove_child(node, ref, key[depth], child);
+                return leaf;
+        }
+
+        return uf_art_remove_node(*child, child, key, key_len, depth + 1);
+}
+
+bool uf_art_remove(UfArt *self, const char *key)
+{
+        UfArtLeaf *leaf = NULL;
+
+        if (uf_unlikely(!self || !key)) {
+                return false;
+        }
+
+        leaf = uf_art_remove_node(self->root,
+                                  &self->root,
+                                  (const unsigned char *)key,
+                                  (uint32_t)strlen(key) + 1,
+                                  0);
+        if (!leaf) {
+                return false;
+        }
+
+        if (self->value_free) {
+                self->value_free(leaf->value);
+        }
+        free(leaf);
+        self->size--;
+        return true;
+}
+
+/**
+ * Is the stored key (sans terminator) a prefix of @key?
+ */
+static inline bool uf_art_leaf_is_prefix(const UfArtLeaf *leaf, const unsigned char *key,
+                                         uint32_t key_len)
+{
+        return leaf->key_len <= key_len && memcmp(leaf->key, key, leaf->key_len - 1) == 0;
+}
+
+void *uf_art_longest_prefix(UfArt *self, const char *key, size_t *match_len)
+{
+        const unsigned char *k = (const unsigned char *)key;
+        uint32_t key_len;
+        uint32_t depth = 0;
+        UfArtNode *node = NULL;
+        UfArtLeaf *best = NULL;
+
+        if (uf_unlikely(!self || !key)) {
+                return NULL;
+        }
+
+        key_len = (uint32_t)strlen(key) + 1;
+        node = self->root;
+
+        while (node) {
+                UfArtNode **child = NULL;
+
+                if (UF_ART_IS_LEAF(node)) {
+                        UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                        if (uf_art_leaf_is_prefix(leaf, k, key_len)) {
+                                best = leaf;
+                        }
+                        break;
+                }
+
+                if (node->partial_len) {
+                        if (uf_art_check_prefix(node, k, key_len, depth) !=
+                            uf_art_min(node->partial_len, UF_ART_MAX_PREFIX)) {
+                                break;
+                        }
+                        depth += node->partial_len;
+                }
+                if (depth >= key_len) {
+                        break;
+                }
+
+                /* A key terminating at this depth hangs off the NUL edge */
+                child = uf_art_find_child(node, '\0');
+                if (child && UF_ART_IS_LEAF(*child)) {
+                        UfArtLeaf *leaf = UF_ART_LEAF_RAW(*child);
+                        if (uf_art_leaf_is_prefix(leaf, k, key_len)) {
+                                best = leaf;
+                        }
+                }
+                if (k[depth] == '\0') {
+                        break;
+                }
+
+                child = uf_art_find_child(node, k[depth]);
+                node = child ? *child : NULL;
+                depth++;
+        }
+
+        if (!best) {
+                return NULL;
+        }
+        if (match_len) {
+                *match_len = best->key_len - 1;
+        }
+        return best->value;
+}
+
+/**
+ * In-order walk of a subtree, returns false if iteration was stopped.
+ */
+static bool uf_art_walk(UfArtNode *node, uf_art_iter_func func, void *userdata)
+{
+        if (!node) {
+                return true;
+        }
+
+        if (UF_ART_IS_LEAF(node)) {
+                UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                return func((const char *)leaf->key, leaf->value, userdata);
+        }
+
+        switch (node->type) {
+        case UF_ART_NODE4:
+                for (int i = 0; i < node->num_children; i++) {
+                        if (!uf_art_walk(((UfArtNode4 *)node)->children[i], func, userdata)) {
+                                return false;
+                        }
+                }
+                break;
+        case UF_ART_NODE16:
+                for (int i = 0; i < node->num_children; i++) {
+                        if (!uf_art_walk(((UfArtNode16 *)node)->children[i], func, userdata)) {
+                                return false;
+                        }
+                }
+                break;
+        case UF_ART_NODE48: {
+                UfArtNode48 *n = (UfArtNode48 *)node;
+                for (int i = 0; i < 256; i++) {
+                        if (!n->keys[i]) {
+                                continue;
+                        }
+                        if (!uf_art_walk(n->children[n->keys[i] - 1], func, userdata)) {
+                                return false;
+                        }
+                }
+                break;
+        }
+        case UF_ART_NODE256:
+        default:
+                for (int i = 0; i < 256; i++) {
+                        if (!uf_art_walk(((UfArtNode256 *)node)->children[i], func, userdata)) {
+                                return false;
+                        }
+                }
+                break;
+        }
+        return true;
+}
+
+void uf_art_foreach_prefix(UfArt *self, const char *prefix, uf_art_iter_func func, void *userdata)
+{
+        const unsigned char *k = (const unsigned char *)prefix;
+        uint32_t prefix_len;
+        uint32_t depth = 0;
+        UfArtNode *node = NULL;
+
+        if (uf_unlikely(!self || !prefix || !func)) {
+                return;
+        }
+
+        /* Note we match against the prefix *without* its terminator */
+        prefix_len = (uint32_t)strlen(prefix);
+        node = self->root;
+
+        while (node) {
+                UfArtNode **child = NULL;
+
+                if (UF_ART_IS_LEAF(node)) {
+                        UfArtLeaf *leaf = UF_ART_LEAF_RAW(node);
+                        if (leaf->key_len > prefix_len && memcmp(leaf->key, k, prefix_len) == 0) {
+                                func((const char *)leaf->key, leaf->value, userdata);
+                        }
+                        return;
+                }
+
+                /* Entire prefix consumed, everything below matches */
+                if (depth == prefix_len) {
+                        uf_art_walk(node, func, userdata);
+                        return;
+                }
+
+                if (node->partial_len) {
+                        uint32_t matched = uf_art_prefix_mismatch(node, k, prefix_len, depth);
+                        if (depth + matched == prefix_len) {
+                                uf_art_walk(node, func, userdata);
+                                return;
+                        }
+                        if (matched < node->partial_len) {
+                                return;
+                        }
+                        depth += node->partial_len;
+                }
+
+                child = uf_art_find_child(node, k[depth]);
+                node = child ? *child : NULL;
+                depth++;
+        }
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
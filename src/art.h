@@ -0,0 +1,139 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * UfArt is an adaptive radix tree keyed by NUL terminated strings, suited
+ * to prefix oriented lookups such as paths. Unlike UfHashmap it can answer
+ * longest-prefix queries and walk all keys under a prefix in sorted order.
+ *
+ * Keys are copied into the tree, values are stored as-is.
+ */
+typedef struct UfArt UfArt;
+
+/**
+ * Callback for ordered iteration
+ *
+ * @param key The full (NUL terminated) key of the current entry
+ * @param value The value stored for @key
+ * @param userdata User data passed to the iteration function
+ *
+ * @returns true to continue iterating, false to stop
+ */
+typedef bool (*uf_art_iter_func)(const char *key, void *value, void *userdata);
+
+/**
+ * Construct a new UfArt
+ *
+ * @note Free with uf_art_free
+ *
+ * @return A newly allocated UfArt
+ */
+UfArt *uf_art_new(void);
+
+/**
+ * Construct a new UfArt with a value free function
+ *
+ * @param value_free Function to call to free any values when replaced or the tree is freed
+ *
+ * @note Free with uf_art_free
+ *
+ * @return A newly allocated UfArt
+ */
+UfArt *uf_art_new_full(uf_hashmap_free_func value_free);
+
+/**
+ * Free a previously allocated tree
+ *
+ * @param art Pointer to a previously allocated tree
+ */
+void uf_art_free(UfArt *art);
+
+/**
+ * Store a key/value mapping within the tree
+ *
+ * @note The key is copied, the value is not.
+ *
+ * @param art Pointer to a valid UfArt instance
+ * @param key Key for the new mapping
+ * @param value Value for the new mapping
+ *
+ * @returns True if the key/value pair could be stored
+ */
+bool uf_art_put(UfArt *art, const char *key, void *value);
+
+/**
+ * Attempt to retrieve the value from the tree associated with @key
+ *
+ * @param art Pointer to an allocated tree
+ * @param key Key to lookup a value for
+ *
+ * @returns The stored value, if found.
+ */
+void *uf_art_get(UfArt *art, const char *key);
+
+/**
+ * Remove the key from the tree that matches the given key
+ *
+ * @param art Pointer to an allocated tree
+ * @param key Key to remove
+ *
+ * @returns True if we deleted a matching key/value
+ */
+bool uf_art_remove(UfArt *art, const char *key);
+
+/**
+ * Find the longest stored key that is a prefix of @key, i.e. "which rule
+ * owns this path?"
+ *
+ * @param art Pointer to an allocated tree
+ * @param key Key to match against
+ * @param match_len If not NULL, set to the length of the matching key
+ *
+ * @returns The value for the longest matching key, if any.
+ */
+void *uf_art_longest_prefix(UfArt *art, const char *key, size_t *match_len);
+
+/**
+ * Walk every key beginning with @prefix in ascending byte order.
+ *
+ * @note The tree must not be modified during iteration.
+ *
+ * @param art Pointer to an allocated tree
+ * @param prefix Prefix to match, or "" to walk the whole tree
+ * @param func Callback for each matching entry
+ * @param userdata User data to pass to @func
+ */
+void uf_art_foreach_prefix(UfArt *art, const char *prefix, uf_art_iter_func func, void *userdata);
+
+/**
+ * Return the number of keys stored in the tree
+ */
+size_t uf_art_size(UfArt *art);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
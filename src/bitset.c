@@ -0,0 +1,415 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if UF_CPU_X86
+#include <immintrin.h>
+#endif
+
+#include "bitset.h"
+#include "util.h"
+
+/**
+ * Storage is always a whole number of 64 byte cache lines, so the vector
+ * kernels never need to handle a ragged tail for UfBitset.
+ */
+#define UF_BITSET_LINE_WORDS 8
+
+#define UF_BITSET_WORD(x) ((x) / 64)
+#define UF_BITSET_MASK(x) (((uint64_t)1) << ((x) % 64))
+
+struct UfBitset {
+        uint64_t *words; /**<Cache line aligned storage */
+        size_t n_words;  /**<Number of allocated words */
+};
+
+/**
+ * Round @n_words up to whole cache lines
+ */
+static inline size_t uf_bitset_round(size_t n_words)
+{
+        return (n_words + UF_BITSET_LINE_WORDS - 1) & ~(size_t)(UF_BITSET_LINE_WORDS - 1);
+}
+
+/**
+ * Grow to at least @n_words, doubling to amortise repeated growth.
+ */
+static bool uf_bitset_grow(UfBitset *self, size_t n_words)
+{
+        uint64_t *words = NULL;
+        size_t size;
+
+        if (n_words <= self->n_words) {
+                return true;
+        }
+
+        if (n_words < self->n_words * 2) {
+                n_words = self->n_words * 2;
+        }
+        n_words = uf_bitset_round(n_words);
+        size = n_words * sizeof(uint64_t);
+
+        words = aligned_alloc(UF_BITSET_LINE_WORDS * sizeof(uint64_t), size);
+        if (!words) {
+                return false;
+        }
+        if (self->words) {
+                memcpy(words, self->words, self->n_words * sizeof(uint64_t));
+        }
+        memset(words + self->n_words, 0, (n_words - self->n_words) * sizeof(uint64_t));
+        free(self->words);
+        self->words = words;
+        self->n_words = n_words;
+
+        return true;
+}
+
+UfBitset *uf_bitset_new(size_t n_bits)
+{
+        UfBitset *ret = NULL;
+
+        ret = calloc(1, sizeof(struct UfBitset));
+        if (!ret) {
+                return NULL;
+        }
+
+        if (n_bits > 0 && !uf_bitset_grow(ret, UF_BITSET_WORD(n_bits - 1) + 1)) {
+                uf_bitset_free(ret);
+                return NULL;
+        }
+
+        return ret;
+}
+
+void uf_bitset_free(UfBitset *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        free(self->words);
+        free(self);
+}
+
+bool uf_bitset_set(UfBitset *self, size_t bit)
+{
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+        if (uf_unlikely(!uf_bitset_grow(self, UF_BITSET_WORD(bit) + 1))) {
+                return false;
+        }
+        self->words[UF_BITSET_WORD(bit)] |= UF_BITSET_MASK(bit);
+        return true;
+}
+
+void uf_bitset_clear(UfBitset *self, size_t bit)
+{
+        if (uf_unlikely(!self) || UF_BITSET_WORD(bit) >= self->n_words) {
+                return;
+        }
+        self->words[UF_BITSET_WORD(bit)] &= ~UF_BITSET_MASK(bit);
+}
+
+bool uf_bitset_test(UfBitset *self, size_t bit)
+{
+        if (uf_unlikely(!self) || UF_BITSET_WORD(bit) >= self->n_words) {
+                return false;
+        }
+        return (self->words[UF_BITSET_WORD(bit)] & UF_BITSET_MASK(bit)) != 0;
+}
+
+bool uf_bitset_next(UfBitset *self, size_t from, size_t *bit)
+{
+        size_t i = UF_BITSET_WORD(from);
+        uint64_t word;
+
+        if (uf_unlikely(!self) || i >= self->n_words) {
+                return false;
+        }
+
+        /* Mask off the bits below from in the first word */
+        word = self->words[i] & (~(uint64_t)0 << (from % 64));
+        while (!word) {
+                if (++i >= self->n_words) {
+                        return false;
+                }
+                word = self->words[i];
+        }
+
+        *bit = i * 64 + (size_t)__builtin_ctzll(word);
+        return true;
+}
+
+size_t uf_bitset_count(UfBitset *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return uf_bits_popcount(self->words, self->n_words);
+}
+
+void uf_bitset_and(UfBitset *self, UfBitset *other)
+{
+        size_t n;
+
+        if (uf_unlikely(!self || !other)) {
+                return;
+        }
+
+        n = self->n_words < other->n_words ? self->n_words : other->n_words;
+        uf_bits_and(self->words, other->words, n);
+        if (self->n_words > n) {
+                memset(self->words + n, 0, (self->n_words - n) * sizeof(uint64_t));
+        }
+}
+
+bool uf_bitset_or(UfBitset *self, UfBitset *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (!uf_bitset_grow(self, other->n_words)) {
+                return false;
+        }
+        uf_bits_or(self->words, other->words, other->n_words);
+        return true;
+}
+
+bool uf_bitset_xor(UfBitset *self, UfBitset *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (!uf_bitset_grow(self, other->n_words)) {
+                return false;
+        }
+        uf_bits_xor(self->words, other->words, other->n_words);
+        return true;
+}
+
+void uf_bitset_andnot(UfBitset *self, UfBitset *other)
+{
+        size_t n;
+
+        if (uf_unlikely(!self || !other)) {
+                return;
+        }
+        n = self->n_words < other->n_words ? self->n_words : other->n_words;
+        uf_bits_andnot(self->words, other->words, n);
+}
+
+/**
+ * Portable SWAR population count for a single word
+ */
+static inline size_t uf_bits_popcount_word(uint64_t v)
+{
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (size_t)((v * 0x0101010101010101ULL) >> 56);
+}
+
+#if defined(__SSE2__)
+/**
+ * SWAR popcount of each byte within a vector. Baseline x86_64 has no
+ * popcnt instruction, so this beats a per-word libgcc call.
+ */
+static inline __m128i uf_bits_popcount_bytes(__m128i v)
+{
+        const __m128i m1 = _mm_set1_epi8(0x55);
+        const __m128i m2 = _mm_set1_epi8(0x33);
+        const __m128i m4 = _mm_set1_epi8(0x0F);
+
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi64(v, 2), m2));
+        return _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);
+}
+
+static inline size_t uf_bits_sum_epi64(__m128i sum)
+{
+        uint64_t lanes[2];
+
+        _mm_storeu_si128((__m128i *)lanes, sum);
+        return (size_t)(lanes[0] + lanes[1]);
+}
+#endif
+
+/**
+ * Each kernel processes a vector at a time and finishes any odd word
+ * with scalar code.
+ */
+#if defined(__SSE2__)
+#define UF_BITS_KERNEL(name, vop, sop)                                                             \
+        void name(uint64_t *dst, const uint64_t *src, size_t n)                                    \
+        {                                                                                          \
+                size_t i = 0;                                                                      \
+                for (; i + 2 <= n; i += 2) {                                                       \
+                        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));                   \
+                        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));                   \
+                        _mm_storeu_si128((__m128i *)(dst + i), vop);                               \
+                }                                                                                  \
+                for (; i < n; i++) {                                                               \
+                        dst[i] = sop;                                                              \
+                }                                                                                  \
+        }
+#else
+#define UF_BITS_KERNEL(name, vop, sop)                                                             \
+        void name(uint64_t *dst, const uint64_t *src, size_t n)                                    \
+        {                                                                                          \
+                for (size_t i = 0; i < n; i++) {                                                   \
+                        dst[i] = sop;                                                              \
+                }                                                                                  \
+        }
+#endif
+
+UF_BITS_KERNEL(uf_bits_and, _mm_and_si128(a, b), dst[i] & src[i])
+UF_BITS_KERNEL(uf_bits_or, _mm_or_si128(a, b), dst[i] | src[i])
+UF_BITS_KERNEL(uf_bits_xor, _mm_xor_si128(a, b), dst[i] ^ src[i])
+UF_BITS_KERNEL(uf_bits_andnot, _mm_andnot_si128(b, a), dst[i] & ~src[i])
+
+static size_t uf_bits_popcount_scalar(const uint64_t *words, size_t n)
+{
+        size_t count = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                count += uf_bits_popcount_word(words[i]);
+        }
+        return count;
+}
+
+#if defined(__SSE2__)
+static size_t uf_bits_popcount_sse2(const uint64_t *words, size_t n)
+{
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+        size_t i = 0;
+
+        for (; i + 2 <= n; i += 2) {
+                __m128i v = _mm_loadu_si128((const __m128i *)(words + i));
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(uf_bits_popcount_bytes(v), zero));
+        }
+        return uf_bits_sum_epi64(sum) + uf_bits_popcount_scalar(words + i, n - i);
+}
+#endif
+
+#if UF_CPU_X86
+__attribute__((target("popcnt"))) static size_t uf_bits_popcount_popcnt(const uint64_t *words,
+                                                                         size_t n)
+{
+        size_t count = 0;
+
+        for (size_t i = 0; i < n; i++) {
+                count += (size_t)__builtin_popcountll(words[i]);
+        }
+        return count;
+}
+
+/**
+ * Nibble lookup through vpshufb, summed per lane with vpsadbw
+ */
+__attribute__((target("avx2"))) static size_t uf_bits_popcount_avx2(const uint64_t *words,
+                                                                     size_t n)
+{
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i sum = zero;
+        uint64_t lanes[4];
+        size_t i = 0;
+
+        for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_loadu_si256((const __m256i *)(words + i));
+                __m256i lo = _mm256_and_si256(v, low);
+                __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+                __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                            _mm256_shuffle_epi8(lookup, hi));
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(c, zero));
+        }
+        _mm256_storeu_si256((__m256i *)lanes, sum);
+
+        return (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+               uf_bits_popcount_scalar(words + i, n - i);
+}
+#endif
+
+static uf_bits_popcount_func uf_bits_popcount_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_bits_popcount_avx2;
+        }
+        if (features & UF_CPU_POPCNT) {
+                return uf_bits_popcount_popcnt;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_bits_popcount_sse2;
+#else
+        return uf_bits_popcount_scalar;
+#endif
+}
+
+uf_bits_popcount_func uf_bits_popcount_select(unsigned int features)
+{
+        return uf_bits_popcount_choose(features);
+}
+
+UF_CPU_DISPATCH(size_t, uf_bits_popcount, (const uint64_t *words, size_t n), (words, n),
+                uf_bits_popcount_choose)
+
+size_t uf_bitset_and_count(UfBitset *a, UfBitset *b)
+{
+        size_t n;
+        size_t count = 0;
+        size_t i = 0;
+
+        if (uf_unlikely(!a || !b)) {
+                return 0;
+        }
+        n = a->n_words < b->n_words ? a->n_words : b->n_words;
+
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+
+        for (; i + 2 <= n; i += 2) {
+                __m128i v = _mm_and_si128(_mm_load_si128((const __m128i *)(a->words + i)),
+                                          _mm_load_si128((const __m128i *)(b->words + i)));
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(uf_bits_popcount_bytes(v), zero));
+        }
+        count = uf_bits_sum_epi64(sum);
+#endif
+        for (; i < n; i++) {
+                count += uf_bits_popcount_word(a->words[i] & b->words[i]);
+        }
+        return count;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
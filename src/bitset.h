@@ -0,0 +1,142 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfBitset is a dense, growable set of small integers (i.e. IDs) stored
+ * as cache line aligned 64-bit words. Set algebra and population counts
+ * operate a whole vector at a time.
+ */
+typedef struct UfBitset UfBitset;
+
+/**
+ * Construct a new UfBitset
+ *
+ * @param n_bits Initial capacity in bits, the set grows as required
+ *
+ * @note Free with uf_bitset_free
+ *
+ * @return A newly allocated UfBitset
+ */
+UfBitset *uf_bitset_new(size_t n_bits);
+
+/**
+ * Free a previously allocated bitset
+ *
+ * @param bitset Pointer to a previously allocated bitset
+ */
+void uf_bitset_free(UfBitset *bitset);
+
+/**
+ * Set @bit, growing the set if needed
+ *
+ * @returns True if the bit could be set
+ */
+bool uf_bitset_set(UfBitset *bitset, size_t bit);
+
+/**
+ * Clear @bit
+ */
+void uf_bitset_clear(UfBitset *bitset, size_t bit);
+
+/**
+ * Test whether @bit is set
+ */
+bool uf_bitset_test(UfBitset *bitset, size_t bit);
+
+/**
+ * Find the first set bit at or after @from, i.e. for iteration:
+ *
+ *      for (bool ok = uf_bitset_next(set, 0, &i); ok; ok = uf_bitset_next(set, i + 1, &i))
+ *
+ * @param bitset Pointer to an allocated bitset
+ * @param from Bit to start searching from
+ * @param bit Set to the found bit
+ *
+ * @returns True if a set bit was found
+ */
+bool uf_bitset_next(UfBitset *bitset, size_t from, size_t *bit);
+
+/**
+ * Return the number of set bits
+ */
+size_t uf_bitset_count(UfBitset *bitset);
+
+/**
+ * Return the number of bits set in both @a and @b, without
+ * constructing the intersection.
+ */
+size_t uf_bitset_and_count(UfBitset *a, UfBitset *b);
+
+/**
+ * In place intersection, @bitset &= @other
+ */
+void uf_bitset_and(UfBitset *bitset, UfBitset *other);
+
+/**
+ * In place union, @bitset |= @other
+ *
+ * @returns True if @bitset could grow to hold the result
+ */
+bool uf_bitset_or(UfBitset *bitset, UfBitset *other);
+
+/**
+ * In place symmetric difference, @bitset ^= @other
+ *
+ * @returns True if @bitset could grow to hold the result
+ */
+bool uf_bitset_xor(UfBitset *bitset, UfBitset *other);
+
+/**
+ * In place difference, @bitset &= ~@other
+ */
+void uf_bitset_andnot(UfBitset *bitset, UfBitset *other);
+
+/**
+ * Low level kernels over @n 64-bit words, shared with UfRoaring.
+ * @dst is updated in place with the result.
+ */
+void uf_bits_and(uint64_t *dst, const uint64_t *src, size_t n);
+void uf_bits_or(uint64_t *dst, const uint64_t *src, size_t n);
+void uf_bits_xor(uint64_t *dst, const uint64_t *src, size_t n);
+void uf_bits_andnot(uint64_t *dst, const uint64_t *src, size_t n);
+
+/**
+ * Population count across @n 64-bit words. The implementation is picked
+ * for the running CPU, see cpu.h.
+ */
+size_t uf_bits_popcount(const uint64_t *words, size_t n);
+
+typedef size_t (*uf_bits_popcount_func)(const uint64_t *words, size_t n);
+
+/**
+ * Return the popcount kernel used on a CPU with @features. Exposed so
+ * tests and benchmarks can exercise every variant.
+ */
+uf_bits_popcount_func uf_bits_popcount_select(unsigned int features);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,748 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree.h"
+#include "util.h"
+
+/**
+ * Every node occupies 512 bytes: 8 cache lines, aligned to its own size so
+ * that no node ever straddles a page boundary.
+ */
+#define UF_BTREE_NODE_SIZE 512
+
+/**
+ * Keys per leaf, leaving room for the header and sibling links.
+ */
+#define UF_BTREE_LEAF_KEYS 30
+
+/**
+ * Keys per inner node, each inner node has one more child than keys.
+ */
+#define UF_BTREE_INNER_KEYS 30
+
+typedef struct UfBTreeNode {
+        uint16_t count; /**<Number of keys in this node */
+        bool leaf;      /**<Whether this is a UfBTreeLeaf */
+} UfBTreeNode;
+
+typedef struct UfBTreeLeaf {
+        UfBTreeNode n;
+        struct UfBTreeLeaf *prev; /**<Previous leaf in key order */
+        struct UfBTreeLeaf *next; /**<Next leaf in key order */
+        void *keys[UF_BTREE_LEAF_KEYS];
+        void *values[UF_BTREE_LEAF_KEYS];
+} UfBTreeLeaf;
+
+typedef struct UfBTreeInner {
+        UfBTreeNode n;
+        void *keys[UF_BTREE_INNER_KEYS];
+        UfBTreeNode *children[UF_BTREE_INNER_KEYS + 1];
+} UfBTreeInner;
+
+_Static_assert(sizeof(UfBTreeLeaf) <= UF_BTREE_NODE_SIZE, "UfBTreeLeaf exceeds node size");
+_Static_assert(sizeof(UfBTreeInner) <= UF_BTREE_NODE_SIZE, "UfBTreeInner exceeds node size");
+
+struct UfBTree {
+        UfBTreeNode *root;
+        size_t size;
+        unsigned int height; /**<Number of levels, 0 when empty */
+        struct {
+                void *head;         /**<Spare nodes, linked through their first word */
+                unsigned int count; /**<Number of spare nodes */
+        } spare;
+        bool integer_keys; /**<Keys are UF_INT_TO_PTR values, compare inline */
+        uf_hashmap_compare_func compare;
+        struct {
+                uf_hashmap_free_func key;   /**<Key free function */
+                uf_hashmap_free_func value; /**<Value free function */
+        } free;
+};
+
+/**
+ * Result of splitting a node, to be inserted into the parent.
+ */
+typedef struct UfBTreeSplit {
+        void *key;
+        UfBTreeNode *right;
+} UfBTreeSplit;
+
+UfBTree *uf_btree_new(uf_hashmap_compare_func compare)
+{
+        return uf_btree_new_full(compare, NULL, NULL);
+}
+
+UfBTree *uf_btree_new_full(uf_hashmap_compare_func compare, uf_hashmap_free_func key_free,
+                           uf_hashmap_free_func value_free)
+{
+        UfBTree *ret = NULL;
+
+        assert(compare);
+
+        ret = calloc(1, sizeof(struct UfBTree));
+        if (!ret) {
+                return NULL;
+        }
+        ret->compare = compare;
+        ret->integer_keys = compare == uf_hashmap_simple_compare;
+        ret->free.key = key_free;
+        ret->free.value = value_free;
+
+        return ret;
+}
+
+static UfBTreeNode *uf_btree_node_new(bool leaf)
+{
+        UfBTreeNode *node = aligned_alloc(UF_BTREE_NODE_SIZE, UF_BTREE_NODE_SIZE);
+        if (!node) {
+                return NULL;
+        }
+        memset(node, 0, UF_BTREE_NODE_SIZE);
+        node->leaf = leaf;
+        return node;
+}
+
+/**
+ * An insert can split one node per level plus a new root. We keep that
+ * many spare nodes around so that a split, once started, can never fail
+ * halfway up the tree and lose the right hand side.
+ */
+static bool uf_btree_reserve_spares(UfBTree *self)
+{
+        while (self->spare.count < self->height + 1) {
+                void **node = aligned_alloc(UF_BTREE_NODE_SIZE, UF_BTREE_NODE_SIZE);
+                if (!node) {
+                        return false;
+                }
+                *node = self->spare.head;
+                self->spare.head = node;
+                self->spare.count++;
+        }
+        return true;
+}
+
+static UfBTreeNode *uf_btree_node_take(UfBTree *self, bool leaf)
+{
+        void **spare = self->spare.head;
+        UfBTreeNode *node = NULL;
+
+        assert(spare);
+
+        self->spare.head = *spare;
+        self->spare.count--;
+        node = (UfBTreeNode *)spare;
+        memset(node, 0, UF_BTREE_NODE_SIZE);
+        node->leaf = leaf;
+        return node;
+}
+
+static void uf_btree_node_free(UfBTree *self, UfBTreeNode *node, bool free_values)
+{
+        if (!node) {
+                return;
+        }
+
+        if (node->leaf) {
+                UfBTreeLeaf *leaf = (UfBTreeLeaf *)node;
+                for (unsigned int i = 0; free_values && i < node->count; i++) {
+                        if (self->free.key) {
+                                self->free.key(leaf->keys[i]);
+                        }
+                        if (self->free.value) {
+                                self->free.value(leaf->values[i]);
+                        }
+                }
+        } else {
+                UfBTreeInner *inner = (UfBTreeInner *)node;
+                for (unsigned int i = 0; i <= node->count; i++) {
+                        uf_btree_node_free(self, inner->children[i], free_values);
+                }
+        }
+        free(node);
+}
+
+void uf_btree_free(UfBTree *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        uf_btree_node_free(self, self->root, true);
+        while (self->spare.head) {
+                void **spare = self->spare.head;
+                self->spare.head = *spare;
+                free(spare);
+        }
+        free(self);
+}
+
+size_t uf_btree_size(UfBTree *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return self->size;
+}
+
+/**
+ * Position of the first key >= @key.
+ *
+ * Integer keys skip the callback and use a branchless counting scan which
+ * the compiler can vectorise, as nodes are small enough that this beats a
+ * binary search.
+ */
+static inline unsigned int uf_btree_lower_bound(UfBTree *self, void *const *keys,
+                                                unsigned int count, const void *key)
+{
+        unsigned int lo = 0;
+        unsigned int hi = count;
+
+        if (self->integer_keys) {
+                uintptr_t k = (uintptr_t)key;
+                for (unsigned int i = 0; i < count; i++) {
+                        lo += (uintptr_t)keys[i] < k;
+                }
+                return lo;
+        }
+
+        while (lo < hi) {
+                unsigned int mid = lo + (hi - lo) / 2;
+                if (self->compare(keys[mid], key) < 0) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+/**
+ * Position of the first key > @key, i.e. the child to descend into.
+ */
+static inline unsigned int uf_btree_upper_bound(UfBTree *self, void *const *keys,
+                                                unsigned int count, const void *key)
+{
+        unsigned int lo = 0;
+        unsigned int hi = count;
+
+        if (self->integer_keys) {
+                uintptr_t k = (uintptr_t)key;
+                for (unsigned int i = 0; i < count; i++) {
+                        lo += (uintptr_t)keys[i] <= k;
+                }
+                return lo;
+        }
+
+        while (lo < hi) {
+                unsigned int mid = lo + (hi - lo) / 2;
+                if (self->compare(keys[mid], key) <= 0) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+static inline bool uf_btree_equal(UfBTree *self, const void *a, const void *b)
+{
+        if (self->integer_keys) {
+                return a == b;
+        }
+        return self->compare(a, b) == 0;
+}
+
+/**
+ * Find the leaf that would contain @key
+ */
+static UfBTreeLeaf *uf_btree_find_leaf(UfBTree *self, const void *key)
+{
+        UfBTreeNode *node = self->root;
+
+        while (node && !node->leaf) {
+                UfBTreeInner *inner = (UfBTreeInner *)node;
+                node = inner->children[uf_btree_upper_bound(self, inner->keys, node->count, key)];
+        }
+        return (UfBTreeLeaf *)node;
+}
+
+void *uf_btree_get(UfBTree *self, const void *key)
+{
+        UfBTreeLeaf *leaf = NULL;
+        unsigned int pos;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        leaf = uf_btree_find_leaf(self, key);
+        if (!leaf) {
+                return NULL;
+        }
+
+        pos = uf_btree_lower_bound(self, leaf->keys, leaf->n.count, key);
+        if (pos < leaf->n.count && uf_btree_equal(self, leaf->keys[pos], key)) {
+                return leaf->values[pos];
+        }
+        return NULL;
+}
+
+/**
+ * Insert into a leaf, splitting it in half if it is full.
+ *
+ * @returns 0 if inserted, 1 if split
+ */
+static int uf_btree_insert_leaf(UfBTree *self, UfBTreeLeaf *leaf, void *key, void *value,
+                                UfBTreeSplit *split)
+{
+        unsigned int pos = uf_btree_lower_bound(self, leaf->keys, leaf->n.count, key);
+        UfBTreeLeaf *right = NULL;
+        UfBTreeLeaf *target = leaf;
+        unsigned int mid = UF_BTREE_LEAF_KEYS / 2;
+
+        /* Replace existing */
+        if (pos < leaf->n.count && uf_btree_equal(self, leaf->keys[pos], key)) {
+                if (self->free.key) {
+                        self->free.key(leaf->keys[pos]);
+                }
+                if (self->free.value) {
+                        self->free.value(leaf->values[pos]);
+                }
+                leaf->keys[pos] = key;
+                leaf->values[pos] = value;
+                return 0;
+        }
+
+        if (leaf->n.count == UF_BTREE_LEAF_KEYS) {
+                right = (UfBTreeLeaf *)uf_btree_node_take(self, true);
+
+                /* Move the upper half across */
+                right->n.count = (uint16_t)(UF_BTREE_LEAF_KEYS - mid);
+                memcpy(right->keys, leaf->keys + mid, right->n.count * sizeof(void *));
+                memcpy(right->values, leaf->values + mid, right->n.count * sizeof(void *));
+                leaf->n.count = (uint16_t)mid;
+
+                right->next = leaf->next;
+                if (right->next) {
+                        right->next->prev = right;
+                }
+                right->prev = leaf;
+                leaf->next = right;
+
+                if (pos > mid) {
+                        target = right;
+                        pos -= mid;
+                }
+        }
+
+        memmove(target->keys + pos + 1,
+                target->keys + pos,
+                (target->n.count - pos) * sizeof(void *));
+        memmove(target->values + pos + 1,
+                target->values + pos,
+                (target->n.count - pos) * sizeof(void *));
+        target->keys[pos] = key;
+        target->values[pos] = value;
+        target->n.count++;
+        self->size++;
+
+        if (!right) {
+                return 0;
+        }
+        split->key = right->keys[0];
+        split->right = &right->n;
+        return 1;
+}
+
+/**
+ * Recursive insert helper
+ *
+ * @returns 0 if inserted, 1 if @node split
+ */
+static int uf_btree_insert_node(UfBTree *self, UfBTreeNode *node, void *key, void *value,
+                                UfBTreeSplit *split)
+{
+        UfBTreeInner *inner = (UfBTreeInner *)node;
+        UfBTreeInner *right = NULL;
+        UfBTreeSplit child_split = { 0 };
+        void *keys[UF_BTREE_INNER_KEYS + 1];
+        UfBTreeNode *children[UF_BTREE_INNER_KEYS + 2];
+        unsigned int pos;
+        unsigned int total;
+        unsigned int mid;
+
+        if (node->leaf) {
+                return uf_btree_insert_leaf(self, (UfBTreeLeaf *)node, key, value, split);
+        }
+
+        pos = uf_btree_upper_bound(self, inner->keys, node->count, key);
+        if (uf_btree_insert_node(self, inner->children[pos], key, value, &child_split) == 0) {
+                return 0;
+        }
+
+        if (node->count < UF_BTREE_INNER_KEYS) {
+                memmove(inner->keys + pos + 1,
+                        inner->keys + pos,
+                        (node->count - pos) * sizeof(void *));
+                memmove(inner->children + pos + 2,
+                        inner->children + pos + 1,
+                        (node->count - pos) * sizeof(void *));
+                inner->keys[pos] = child_split.key;
+                inner->children[pos + 1] = child_split.right;
+                node->count++;
+                return 0;
+        }
+
+        /* Full, split around the middle key */
+        right = (UfBTreeInner *)uf_btree_node_take(self, false);
+        total = UF_BTREE_INNER_KEYS + 1;
+        memcpy(keys, inner->keys, pos * sizeof(void *));
+        keys[pos] = child_split.key;
+        memcpy(keys + pos + 1, inner->keys + pos, (UF_BTREE_INNER_KEYS - pos) * sizeof(void *));
+        memcpy(children, inner->children, (pos + 1) * sizeof(void *));
+        children[pos + 1] = child_split.right;
+        memcpy(children + pos + 2,
+               inner->children + pos + 1,
+               (UF_BTREE_INNER_KEYS - pos) * sizeof(void *));
+
+        /* keys[mid] moves up into the parent */
+        mid = total / 2;
+        node->count = (uint16_t)mid;
+        memcpy(inner->keys, keys, mid * sizeof(void *));
+        memcpy(inner->children, children, (mid + 1) * sizeof(void *));
+
+        right->n.count = (uint16_t)(total - mid - 1);
+        memcpy(right->keys, keys + mid + 1, right->n.count * sizeof(void *));
+        memcpy(right->children, children + mid + 1, (right->n.count + 1U) * sizeof(void *));
+
+        split->key = keys[mid];
+        split->right = &right->n;
+        return 1;
+}
+
+bool uf_btree_put(UfBTree *self, void *key, void *value)
+{
+        UfBTreeSplit split = { 0 };
+        UfBTreeInner *root = NULL;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        if (!uf_btree_reserve_spares(self)) {
+                return false;
+        }
+
+        if (!self->root) {
+                self->root = uf_btree_node_take(self, true);
+                self->height = 1;
+        }
+
+        if (uf_btree_insert_node(self, self->root, key, value, &split) == 0) {
+                return true;
+        }
+
+        /* Root split, grow a level */
+        root = (UfBTreeInner *)uf_btree_node_take(self, false);
+        root->n.count = 1;
+        root->keys[0] = split.key;
+        root->children[0] = self->root;
+        root->children[1] = split.right;
+        self->root = &root->n;
+        self->height++;
+
+        return true;
+}
+
+/**
+ * Recursive remove helper
+ *
+ * @returns 0 if not found, 1 if removed, 2 if removed and @node is now
+ * empty and has been freed.
+ */
+static int uf_btree_remove_node(UfBTree *self, UfBTreeNode *node, const void *key)
+{
+        unsigned int pos;
+        int ret;
+
+        if (node->leaf) {
+                UfBTreeLeaf *leaf = (UfBTreeLeaf *)node;
+
+                pos = uf_btree_lower_bound(self, leaf->keys, node->count, key);
+                if (pos >= node->count || !uf_btree_equal(self, leaf->keys[pos], key)) {
+                        return 0;
+                }
+
+                if (self->free.key) {
+                        self->free.key(leaf->keys[pos]);
+                }
+                if (self->free.value) {
+                        self->free.value(leaf->values[pos]);
+                }
+                memmove(leaf->keys + pos,
+                        leaf->keys + pos + 1,
+                        (node->count - pos - 1) * sizeof(void *));
+                memmove(leaf->values + pos,
+                        leaf->values + pos + 1,
+                        (node->count - pos - 1) * sizeof(void *));
+                node->count--;
+                self->size--;
+
+                if (node->count > 0) {
+                        return 1;
+                }
+
+                /* Unlink the empty leaf from the chain */
+                if (leaf->prev) {
+                        leaf->prev->next = leaf->next;
+                }
+                if (leaf->next) {
+                        leaf->next->prev = leaf->prev;
+                }
+                free(leaf);
+                return 2;
+        } else {
+                UfBTreeInner *inner = (UfBTreeInner *)node;
+
+                pos = uf_btree_upper_bound(self, inner->keys, node->count, key);
+                ret = uf_btree_remove_node(self, inner->children[pos], key);
+                if (ret != 2) {
+                        return ret;
+                }
+
+                /* Child is gone, drop it along with its separator */
+                if (node->count == 0) {
+                        free(node);
+                        return 2;
+                }
+                if (pos > 0) {
+                        memmove(inner->keys + pos - 1,
+                                inner->keys + pos,
+                                (node->count - pos) * sizeof(void *));
+                } else {
+                        memmove(inner->keys,
+                                inner->keys + 1,
+                                (node->count - 1U) * sizeof(void *));
+                }
+                memmove(inner->children + pos,
+                        inner->children + pos + 1,
+                        (node->count - pos) * sizeof(void *));
+                node->count--;
+                return 1;
+        }
+}
+
+bool uf_btree_remove(UfBTree *self, const void *key)
+{
+        int ret;
+
+        if (uf_unlikely(!self || !self->root)) {
+                return false;
+        }
+
+        ret = uf_btree_remove_node(self, self->root, key);
+        if (ret == 2) {
+                self->root = NULL;
+                self->height = 0;
+                return true;
+        }
+
+        /* Collapse single-child roots */
+        while (self->root && !self->root->leaf && self->root->count == 0) {
+                UfBTreeNode *child = ((UfBTreeInner *)self->root)->children[0];
+                free(self->root);
+                self->root = child;
+                self->height--;
+        }
+
+        return ret != 0;
+}
+
+bool uf_btree_bulk_load(UfBTree *self, void **keys, void **values, size_t n)
+{
+        UfBTreeNode **level = NULL;
+        void **mins = NULL;
+        size_t n_nodes;
+        size_t offset = 0;
+        UfBTreeLeaf *prev = NULL;
+
+        if (uf_unlikely(!self || self->root)) {
+                return false;
+        }
+        if (n == 0) {
+                return true;
+        }
+
+        for (size_t i = 1; i < n; i++) {
+                if (self->compare(keys[i - 1], keys[i]) >= 0) {
+                        return false;
+                }
+        }
+
+        /* Spread keys evenly so the last leaf isn't left near empty */
+        n_nodes = (n + UF_BTREE_LEAF_KEYS - 1) / UF_BTREE_LEAF_KEYS;
+        level = calloc(n_nodes, sizeof(UfBTreeNode *));
+        mins = calloc(n_nodes, sizeof(void *));
+        if (!level || !mins) {
+                goto failed;
+        }
+
+        for (size_t i = 0; i < n_nodes; i++) {
+                UfBTreeLeaf *leaf = (UfBTreeLeaf *)uf_btree_node_new(true);
+                size_t count = n / n_nodes + (i < n % n_nodes ? 1 : 0);
+
+                if (!leaf) {
+                        goto failed;
+                }
+                leaf->n.count = (uint16_t)count;
+                memcpy(leaf->keys, keys + offset, count * sizeof(void *));
+                memcpy(leaf->values, values + offset, count * sizeof(void *));
+                leaf->prev = prev;
+                if (prev) {
+                        prev->next = leaf;
+                }
+                prev = leaf;
+                level[i] = &leaf->n;
+                mins[i] = keys[offset];
+                offset += count;
+        }
+
+        self->height = 1;
+
+        /* Build each inner level from the one below, in place */
+        while (n_nodes > 1) {
+                size_t n_parents = (n_nodes + UF_BTREE_INNER_KEYS) / (UF_BTREE_INNER_KEYS + 1);
+                size_t child = 0;
+
+                for (size_t i = 0; i < n_parents; i++) {
+                        UfBTreeInner *inner = (UfBTreeInner *)uf_btree_node_new(false);
+                        size_t count = n_nodes / n_parents + (i < n_nodes % n_parents ? 1 : 0);
+                        void *min = mins[child];
+
+                        if (!inner) {
+                                /* Nodes below child still live in level[] */
+                                for (size_t j = 0; j < i; j++) {
+                                        uf_btree_node_free(self, level[j], false);
+                                }
+                                for (size_t j = child; j < n_nodes; j++) {
+                                        uf_btree_node_free(self, level[j], false);
+                                }
+                                n_nodes = 0;
+                                self->height = 0;
+                                goto failed;
+                        }
+
+                        inner->n.count = (uint16_t)(count - 1);
+                        for (size_t j = 0; j < count; j++) {
+                                inner->children[j] = level[child + j];
+                                if (j > 0) {
+                                        inner->keys[j - 1] = mins[child + j];
+                                }
+                        }
+                        child += count;
+                        level[i] = &inner->n;
+                        mins[i] = min;
+                }
+                n_nodes = n_parents;
+                self->height++;
+        }
+
+        self->root = level[0];
+        self->size = n;
+        free(level);
+        free(mins);
+        return true;
+
+failed:
+        for (size_t i = 0; level && i < n_nodes; i++) {
+                uf_btree_node_free(self, level[i], false);
+        }
+        free(level);
+        free(mins);
+        return false;
+}
+
+void uf_btree_iter_init(UfBTree *self, UfBTreeIter *iter)
+{
+        UfBTreeNode *node = NULL;
+
+        *iter = (UfBTreeIter){ .tree = self };
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        node = self->root;
+        while (node && !node->leaf) {
+                node = ((UfBTreeInner *)node)->children[0];
+        }
+        iter->leaf = node;
+}
+
+void uf_btree_iter_init_range(UfBTree *self, UfBTreeIter *iter, const void *lo, const void *hi)
+{
+        UfBTreeLeaf *leaf = NULL;
+
+        *iter = (UfBTreeIter){ .tree = self, .bounded = true, .hi = hi };
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        leaf = uf_btree_find_leaf(self, lo);
+        if (!leaf) {
+                return;
+        }
+        iter->leaf = leaf;
+        iter->pos = uf_btree_lower_bound(self, leaf->keys, leaf->n.count, lo);
+}
+
+bool uf_btree_iter_next(UfBTreeIter *iter, void **key, void **value)
+{
+        UfBTreeLeaf *leaf = iter->leaf;
+
+        while (leaf && iter->pos >= leaf->n.count) {
+                leaf = leaf->next;
+                iter->pos = 0;
+        }
+        iter->leaf = leaf;
+        if (!leaf) {
+                return false;
+        }
+
+        if (iter->bounded && iter->tree->compare(leaf->keys[iter->pos], iter->hi) >= 0) {
+                iter->leaf = NULL;
+                return false;
+        }
+
+        if (key) {
+                *key = leaf->keys[iter->pos];
+        }
+        if (value) {
+                *value = leaf->values[iter->pos];
+        }
+        iter->pos++;
+        return true;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
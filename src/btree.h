@@ -0,0 +1,167 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * UfBTree is an ordered key-value map implemented as a B+tree. Nodes are
+ * sized and aligned to a whole number of cache lines, and leaves are linked
+ * so that ordered and range iteration never has to revisit inner nodes.
+ */
+typedef struct UfBTree UfBTree;
+
+/**
+ * Iterator over a UfBTree, typically allocated on the stack.
+ *
+ * @note The fields are private, and the tree must not be modified
+ * while an iterator is in use.
+ */
+typedef struct UfBTreeIter {
+        UfBTree *tree;    /**<Tree being iterated */
+        void *leaf;       /**<Current leaf node */
+        unsigned int pos; /**<Position within the current leaf */
+        bool bounded;     /**<Whether hi is set */
+        const void *hi;   /**<Exclusive upper bound */
+} UfBTreeIter;
+
+/**
+ * Construct a new UfBTree with the given @compare function
+ *
+ * @param compare A key ordering function
+ *
+ * @note Free with uf_btree_free
+ *
+ * @return A newly allocated UfBTree
+ */
+UfBTree *uf_btree_new(uf_hashmap_compare_func compare);
+
+/**
+ * Construct a new UfBTree with key/value free functions
+ *
+ * @param compare A key ordering function
+ * @param key_free Function to call to free any keys when replaced or the tree is freed
+ * @param value_free Function to call to free any values when replaced or the tree is freed
+ *
+ * @note Free with uf_btree_free
+ *
+ * @return A newly allocated UfBTree
+ */
+UfBTree *uf_btree_new_full(uf_hashmap_compare_func compare, uf_hashmap_free_func key_free,
+                           uf_hashmap_free_func value_free);
+
+/**
+ * Free a previously allocated tree
+ *
+ * @param tree Pointer to a previously allocated tree
+ */
+void uf_btree_free(UfBTree *tree);
+
+/**
+ * Store a key/value mapping within the tree
+ *
+ * @note This will not copy the key or value. Do this before insert
+ *
+ * @param tree Pointer to a valid UfBTree instance
+ * @param key Key for the new mapping
+ * @param value Value for the new mapping
+ *
+ * @returns True if the key/value pair could be stored
+ */
+bool uf_btree_put(UfBTree *tree, void *key, void *value);
+
+/**
+ * Attempt to retrieve the value from the tree associated with @key
+ *
+ * @param tree Pointer to an allocated tree
+ * @param key Key to lookup a value for
+ *
+ * @returns The stored value, if found.
+ */
+void *uf_btree_get(UfBTree *tree, const void *key);
+
+/**
+ * Remove the key from the tree that matches the given key
+ *
+ * @note Nodes are reclaimed once they become empty rather than being
+ * merged with their siblings.
+ *
+ * @param tree Pointer to an allocated tree
+ * @param key Key to remove
+ *
+ * @returns True if we deleted a matching key/value
+ */
+bool uf_btree_remove(UfBTree *tree, const void *key);
+
+/**
+ * Return the number of keys stored in the tree
+ */
+size_t uf_btree_size(UfBTree *tree);
+
+/**
+ * Build the tree in one pass from already sorted input. Each level uses
+ * as few nodes as possible, with keys spread evenly between them so no
+ * node is left near empty. This is much faster than repeated uf_btree_put
+ * and yields a smaller tree.
+ *
+ * @note The tree must be empty, and @keys strictly ascending.
+ *
+ * @param tree Pointer to an allocated, empty tree
+ * @param keys Sorted array of @n keys
+ * @param values Array of @n values
+ * @param n Number of key/value pairs
+ *
+ * @returns True if the tree could be built
+ */
+bool uf_btree_bulk_load(UfBTree *tree, void **keys, void **values, size_t n);
+
+/**
+ * Initialise @iter to walk the whole tree in ascending order
+ */
+void uf_btree_iter_init(UfBTree *tree, UfBTreeIter *iter);
+
+/**
+ * Initialise @iter to walk the keys in the range [@lo, @hi) in ascending order
+ *
+ * @param tree Pointer to an allocated tree
+ * @param iter Iterator to initialise
+ * @param lo Inclusive lower bound
+ * @param hi Exclusive upper bound
+ */
+void uf_btree_iter_init_range(UfBTree *tree, UfBTreeIter *iter, const void *lo, const void *hi);
+
+/**
+ * Advance the iterator
+ *
+ * @param iter An initialised iterator
+ * @param key If not NULL, set to the next key
+ * @param value If not NULL, set to the next value
+ *
+ * @returns True if there was another key/value pair
+ */
+bool uf_btree_iter_next(UfBTreeIter *iter, void **key, void **value);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,450 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "countmap.h"
+#include "pool.h"
+#include "util.h"
+
+/**
+ * Number of independent shards, a power of two
+ */
+#define UF_COUNT_MAP_SHARDS 64
+#define UF_COUNT_MAP_SHARD_BITS 6
+
+/**
+ * Initial slots per shard, a power of two
+ */
+#define UF_COUNT_MAP_INITIAL_SIZE 16
+
+/**
+ * A counted key. Nodes are never moved or freed before the map, so a
+ * pointer found by a lock-free lookup stays valid.
+ */
+typedef struct UfCountNode {
+        void *key;
+        uint32_t hash;
+        _Atomic uint64_t count;
+} UfCountNode;
+
+/**
+ * Open addressed table of node pointers. A grown table keeps its
+ * predecessor alive, as lock-free readers may still be probing it.
+ */
+typedef struct UfCountTable {
+        struct UfCountTable *retired; /**<Previous, smaller table */
+        size_t mask;
+        _Atomic(UfCountNode *) slots[];
+} UfCountTable;
+
+typedef struct UfCountShard {
+        _Alignas(64) _Atomic(UfCountTable *) table;
+        atomic_size_t n_keys; /**<Written under lock, read anywhere */
+        mtx_t lock;           /**<Serialises inserts */
+} UfCountShard;
+
+struct UfCountMap {
+        UfCountShard shards[UF_COUNT_MAP_SHARDS];
+        UfPool *nodes;
+        uf_hashmap_hash_func hash;
+        uf_hashmap_equal_func compare;
+        uf_hashmap_dup_func key_dup;
+        uf_hashmap_free_func key_free;
+};
+
+UfCountMap *uf_count_map_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare)
+{
+        return uf_count_map_new_full(hash, compare, NULL, NULL);
+}
+
+static UfCountTable *uf_count_table_new(size_t size)
+{
+        UfCountTable *ret = calloc(1, sizeof(UfCountTable) + size * sizeof(UfCountNode *));
+
+        if (!ret) {
+                return NULL;
+        }
+        ret->mask = size - 1;
+        return ret;
+}
+
+UfCountMap *uf_count_map_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                  uf_hashmap_dup_func key_dup, uf_hashmap_free_func key_free)
+{
+        UfCountMap *ret = NULL;
+        size_t i;
+
+        if (!hash || !compare) {
+                return NULL;
+        }
+
+        /* Keep every shard on its own cache line */
+        ret = aligned_alloc(_Alignof(struct UfCountMap), sizeof(struct UfCountMap));
+        if (!ret) {
+                return NULL;
+        }
+        memset(ret, 0, sizeof(struct UfCountMap));
+        ret->hash = hash;
+        ret->compare = compare;
+        ret->key_dup = key_dup;
+        ret->key_free = key_free;
+
+        ret->nodes = uf_pool_new(sizeof(UfCountNode));
+        if (!ret->nodes) {
+                free(ret);
+                return NULL;
+        }
+
+        for (i = 0; i < UF_COUNT_MAP_SHARDS; i++) {
+                UfCountShard *shard = &ret->shards[i];
+                UfCountTable *table = uf_count_table_new(UF_COUNT_MAP_INITIAL_SIZE);
+
+                if (!table || mtx_init(&shard->lock, mtx_plain) != thrd_success) {
+                        free(table);
+                        break;
+                }
+                atomic_init(&shard->table, table);
+                atomic_init(&shard->n_keys, 0);
+        }
+        if (i != UF_COUNT_MAP_SHARDS) {
+                while (i-- > 0) {
+                        free(atomic_load(&ret->shards[i].table));
+                        mtx_destroy(&ret->shards[i].lock);
+                }
+                uf_pool_free(ret->nodes);
+                free(ret);
+                return NULL;
+        }
+
+        return ret;
+}
+
+void uf_count_map_free(UfCountMap *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        for (size_t i = 0; i < UF_COUNT_MAP_SHARDS; i++) {
+                UfCountShard *shard = &self->shards[i];
+                UfCountTable *table = atomic_load(&shard->table);
+
+                /* The current table holds every node */
+                if (self->key_free) {
+                        for (size_t j = 0; j <= table->mask; j++) {
+                                UfCountNode *node = atomic_load_explicit(&table->slots[j],
+                                                                         memory_order_relaxed);
+                                if (node) {
+                                        self->key_free(node->key);
+                                }
+                        }
+                }
+                while (table) {
+                        UfCountTable *retired = table->retired;
+                        free(table);
+                        table = retired;
+                }
+                mtx_destroy(&shard->lock);
+        }
+
+        uf_pool_free(self->nodes);
+        free(self);
+}
+
+/**
+ * Spread the key hash over 64 bits: the top bits pick the shard, and the
+ * bits below them the home slot, so the two are independent.
+ */
+static inline uint64_t uf_count_map_mix(uint32_t hash)
+{
+        return (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline UfCountShard *uf_count_map_shard(UfCountMap *self, uint64_t mixed)
+{
+        return &self->shards[mixed >> (64 - UF_COUNT_MAP_SHARD_BITS)];
+}
+
+static inline size_t uf_count_map_home(UfCountTable *table, uint64_t mixed)
+{
+        return (size_t)(mixed >> (32 - UF_COUNT_MAP_SHARD_BITS)) & table->mask;
+}
+
+/**
+ * Lock-free lookup, also used under the shard lock
+ */
+static UfCountNode *uf_count_map_find(UfCountMap *self, UfCountTable *table, uint64_t mixed,
+                                      uint32_t hash, const void *key)
+{
+        for (size_t i = uf_count_map_home(table, mixed);; i = (i + 1) & table->mask) {
+                UfCountNode *node = atomic_load_explicit(&table->slots[i], memory_order_acquire);
+                if (!node) {
+                        return NULL;
+                }
+                if (node->hash == hash && self->compare(node->key, key)) {
+                        return node;
+                }
+        }
+}
+
+static void uf_count_table_place(UfCountTable *table, uint64_t mixed, UfCountNode *node)
+{
+        size_t i = uf_count_map_home(table, mixed);
+
+        while (atomic_load_explicit(&table->slots[i], memory_order_relaxed)) {
+                i = (i + 1) & table->mask;
+        }
+        atomic_store_explicit(&table->slots[i], node, memory_order_release);
+}
+
+/**
+ * Double the shard's table. Readers still probing the old table may miss
+ * keys added from here on, but then fall back to the locked path.
+ */
+static UfCountTable *uf_count_map_grow(UfCountShard *shard, UfCountTable *old)
+{
+        UfCountTable *table = uf_count_table_new((old->mask + 1) * 2);
+
+        if (!table) {
+                return NULL;
+        }
+        for (size_t i = 0; i <= old->mask; i++) {
+                UfCountNode *node = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+                if (node) {
+                        uf_count_table_place(table, uf_count_map_mix(node->hash), node);
+                }
+        }
+        table->retired = old;
+        atomic_store_explicit(&shard->table, table, memory_order_release);
+        return table;
+}
+
+/**
+ * Insert @key with a zero count. Called with the shard lock held, once
+ * the key is known to be missing.
+ */
+static UfCountNode *uf_count_map_insert(UfCountMap *self, UfCountShard *shard, UfCountTable *table,
+                                        uint64_t mixed, uint32_t hash, const void *key)
+{
+        size_t n_keys = atomic_load_explicit(&shard->n_keys, memory_order_relaxed);
+        UfCountNode *node = NULL;
+
+        /* Stay under 3/4 full so probes always meet an empty slot */
+        if ((n_keys + 1) * 4 > (table->mask + 1) * 3) {
+                table = uf_count_map_grow(shard, table);
+                if (!table) {
+                        return NULL;
+                }
+        }
+
+        node = uf_pool_alloc(self->nodes);
+        if (!node) {
+                return NULL;
+        }
+        node->key = self->key_dup ? self->key_dup(key) : (void *)key;
+        if (self->key_dup && !node->key) {
+                uf_pool_release(self->nodes, node);
+                return NULL;
+        }
+        node->hash = hash;
+        atomic_init(&node->count, 0);
+
+        uf_count_table_place(table, mixed, node);
+        atomic_store_explicit(&shard->n_keys, n_keys + 1, memory_order_relaxed);
+        return node;
+}
+
+bool uf_count_map_add(UfCountMap *self, const void *key, uint64_t delta)
+{
+        UfCountShard *shard = NULL;
+        UfCountTable *table = NULL;
+        UfCountNode *node = NULL;
+        uint32_t hash;
+        uint64_t mixed;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        hash = self->hash(key);
+        mixed = uf_count_map_mix(hash);
+        shard = uf_count_map_shard(self, mixed);
+
+        /* Fast path, the key has been seen before */
+        table = atomic_load_explicit(&shard->table, memory_order_acquire);
+        node = uf_count_map_find(self, table, mixed, hash, key);
+        if (uf_likely(node != NULL)) {
+                atomic_fetch_add_explicit(&node->count, delta, memory_order_relaxed);
+                return true;
+        }
+
+        /* Another thread may have inserted it since */
+        mtx_lock(&shard->lock);
+        table = atomic_load_explicit(&shard->table, memory_order_acquire);
+        node = uf_count_map_find(self, table, mixed, hash, key);
+        if (!node) {
+                node = uf_count_map_insert(self, shard, table, mixed, hash, key);
+        }
+        mtx_unlock(&shard->lock);
+
+        if (!node) {
+                return false;
+        }
+        atomic_fetch_add_explicit(&node->count, delta, memory_order_relaxed);
+        return true;
+}
+
+uint64_t uf_count_map_get(UfCountMap *self, const void *key)
+{
+        UfCountShard *shard = NULL;
+        UfCountNode *node = NULL;
+        uint32_t hash;
+        uint64_t mixed;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+
+        hash = self->hash(key);
+        mixed = uf_count_map_mix(hash);
+        shard = uf_count_map_shard(self, mixed);
+        node = uf_count_map_find(self,
+                                 atomic_load_explicit(&shard->table, memory_order_acquire),
+                                 mixed,
+                                 hash,
+                                 key);
+
+        return node ? atomic_load_explicit(&node->count, memory_order_relaxed) : 0;
+}
+
+size_t uf_count_map_size(UfCountMap *self)
+{
+        size_t ret = 0;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        for (size_t i = 0; i < UF_COUNT_MAP_SHARDS; i++) {
+                ret += atomic_load_explicit(&self->shards[i].n_keys, memory_order_relaxed);
+        }
+        return ret;
+}
+
+void uf_count_map_foreach(UfCountMap *self, uf_count_map_iter_func func, void *userdata)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        /* Tables and nodes outlive any reader, so no lock is needed */
+        for (size_t i = 0; i < UF_COUNT_MAP_SHARDS; i++) {
+                UfCountTable *table = atomic_load_explicit(&self->shards[i].table,
+                                                           memory_order_acquire);
+
+                for (size_t j = 0; j <= table->mask; j++) {
+                        UfCountNode *node = atomic_load_explicit(&table->slots[j],
+                                                                 memory_order_acquire);
+                        if (!node) {
+                                continue;
+                        }
+                        if (!func(node->key,
+                                  atomic_load_explicit(&node->count, memory_order_relaxed),
+                                  userdata)) {
+                                return;
+                        }
+                }
+        }
+}
+
+/**
+ * Min-heap of the best entries seen so far, the smallest at the root
+ */
+typedef struct UfCountTop {
+        UfCountMapEntry *heap;
+        size_t n;
+        size_t k;
+} UfCountTop;
+
+static void uf_count_top_sift_down(UfCountMapEntry *heap, size_t n, size_t i)
+{
+        UfCountMapEntry entry = heap[i];
+
+        for (;;) {
+                size_t child = i * 2 + 1;
+                if (child >= n) {
+                        break;
+                }
+                if (child + 1 < n && heap[child + 1].count < heap[child].count) {
+                        child++;
+                }
+                if (heap[child].count >= entry.count) {
+                        break;
+                }
+                heap[i] = heap[child];
+                i = child;
+        }
+        heap[i] = entry;
+}
+
+static bool uf_count_top_visit(void *key, uint64_t count, void *userdata)
+{
+        UfCountTop *top = userdata;
+        size_t i;
+
+        if (top->n < top->k) {
+                /* Sift up */
+                for (i = top->n++; i > 0 && top->heap[(i - 1) / 2].count > count; i = (i - 1) / 2) {
+                        top->heap[i] = top->heap[(i - 1) / 2];
+                }
+                top->heap[i] = (UfCountMapEntry){ .key = key, .count = count };
+        } else if (count > top->heap[0].count) {
+                top->heap[0] = (UfCountMapEntry){ .key = key, .count = count };
+                uf_count_top_sift_down(top->heap, top->n, 0);
+        }
+        return true;
+}
+
+size_t uf_count_map_top(UfCountMap *self, UfCountMapEntry *top, size_t k)
+{
+        UfCountTop state = { .heap = top, .n = 0, .k = k };
+
+        if (uf_unlikely(!self) || k == 0) {
+                return 0;
+        }
+
+        uf_count_map_foreach(self, uf_count_top_visit, &state);
+
+        /* Heap sort: popping the minimum to the back leaves the highest first */
+        for (size_t n = state.n; n > 1; n--) {
+                UfCountMapEntry min = top[0];
+                top[0] = top[n - 1];
+                top[n - 1] = min;
+                uf_count_top_sift_down(top, n - 1, 0);
+        }
+
+        return state.n;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
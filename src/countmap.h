@@ -0,0 +1,132 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+/**
+ * UfCountMap counts occurrences of keys from many threads at once.
+ *
+ * Keys are spread over independent shards. Incrementing a key that is
+ * already present takes no lock: the lookup is lock-free and the counter
+ * is bumped with an atomic add, so threads only contend when they hit
+ * the very same key. A shard lock is taken only to insert a new key.
+ *
+ * Keys are never removed, the map is meant for aggregating statistics
+ * such as hits per path or per package across worker threads.
+ */
+typedef struct UfCountMap UfCountMap;
+
+/**
+ * A key and its count, as returned by uf_count_map_top
+ */
+typedef struct UfCountMapEntry {
+        void *key;
+        uint64_t count;
+} UfCountMapEntry;
+
+/**
+ * Callback for uf_count_map_foreach
+ *
+ * @returns false to stop iterating
+ */
+typedef bool (*uf_count_map_iter_func)(void *key, uint64_t count, void *userdata);
+
+/**
+ * Construct a new UfCountMap for keys owned by the caller, which must
+ * outlive the map
+ *
+ * @note Free with uf_count_map_free
+ *
+ * @return A newly allocated UfCountMap
+ */
+UfCountMap *uf_count_map_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare);
+
+/**
+ * Construct a new UfCountMap which copies keys on first insertion
+ *
+ * Callers can then count transient keys, such as a path in a stack
+ * buffer, and only pay for a copy the first time a key is seen.
+ *
+ * @param key_dup Copies a key the first time it is seen, or NULL to store it as is
+ * @param key_free Frees stored keys when the map is freed, or NULL
+ *
+ * @note Free with uf_count_map_free
+ *
+ * @return A newly allocated UfCountMap
+ */
+UfCountMap *uf_count_map_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                  uf_hashmap_dup_func key_dup, uf_hashmap_free_func key_free);
+
+/**
+ * Free the map and its keys
+ *
+ * @note No other thread may be using the map at this point.
+ */
+void uf_count_map_free(UfCountMap *map);
+
+/**
+ * Add @delta to the count for @key, inserting it at zero if needed.
+ * Safe to call from any number of threads.
+ *
+ * @returns False if the key was new and could not be stored
+ */
+bool uf_count_map_add(UfCountMap *map, const void *key, uint64_t delta);
+
+/**
+ * Add one to the count for @key, see uf_count_map_add
+ */
+static inline bool uf_count_map_increment(UfCountMap *map, const void *key)
+{
+        return uf_count_map_add(map, key, 1);
+}
+
+/**
+ * Return the current count for @key, 0 if never seen
+ */
+uint64_t uf_count_map_get(UfCountMap *map, const void *key);
+
+/**
+ * Return the number of distinct keys
+ */
+size_t uf_count_map_size(UfCountMap *map);
+
+/**
+ * Call @func for every key and its count, in no particular order.
+ *
+ * Counts are read while other threads may still be adding, so each is
+ * accurate only at the time it was read.
+ */
+void uf_count_map_foreach(UfCountMap *map, uf_count_map_iter_func func, void *userdata);
+
+/**
+ * Fill @top with the @k keys having the highest counts, highest first
+ *
+ * @returns The number of entries written, less than @k if the map is smaller
+ */
+size_t uf_count_map_top(UfCountMap *map, UfCountMapEntry *top, size_t k);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
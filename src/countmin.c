@@ -0,0 +1,166 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "countmin.h"
+#include "util.h"
+
+struct UfCountMin {
+        size_t width; /**<Power of two */
+        unsigned int depth;
+        uint64_t total;
+        uint32_t counters[]; /**<depth rows of width counters */
+};
+
+UfCountMin *uf_count_min_new(size_t width, unsigned int depth)
+{
+        UfCountMin *ret = NULL;
+        size_t rounded = 1;
+
+        if (width == 0 || depth == 0 || depth > UF_COUNT_MIN_MAX_DEPTH) {
+                return NULL;
+        }
+        while (rounded < width) {
+                if (rounded > SIZE_MAX / 2 / sizeof(uint32_t) / depth) {
+                        return NULL;
+                }
+                rounded <<= 1;
+        }
+
+        ret = calloc(1, sizeof(struct UfCountMin) + rounded * depth * sizeof(uint32_t));
+        if (!ret) {
+                return NULL;
+        }
+        ret->width = rounded;
+        ret->depth = depth;
+
+        return ret;
+}
+
+void uf_count_min_free(UfCountMin *self)
+{
+        free(self);
+}
+
+/**
+ * Derive one counter per row from a single mixed hash, by double hashing
+ */
+static inline void uf_count_min_slots(UfCountMin *self, uint32_t hash, size_t *slots)
+{
+        uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+        uint32_t h1;
+        uint32_t h2;
+
+        mixed ^= mixed >> 29;
+        mixed *= 0xBF58476D1CE4E5B9ULL;
+        mixed ^= mixed >> 32;
+        h1 = (uint32_t)mixed;
+        h2 = (uint32_t)(mixed >> 32) | 1;
+
+        for (unsigned int i = 0; i < self->depth; i++) {
+                slots[i] = i * self->width + ((h1 + i * h2) & (self->width - 1));
+        }
+}
+
+uint32_t uf_count_min_add(UfCountMin *self, uint32_t hash, uint32_t count)
+{
+        size_t slots[UF_COUNT_MIN_MAX_DEPTH];
+        uint32_t estimate = UINT32_MAX;
+        uint32_t target;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+
+        uf_count_min_slots(self, hash, slots);
+        for (unsigned int i = 0; i < self->depth; i++) {
+                if (self->counters[slots[i]] < estimate) {
+                        estimate = self->counters[slots[i]];
+                }
+        }
+
+        /* Conservative update: no counter needs to exceed the new estimate */
+        target = estimate > UINT32_MAX - count ? UINT32_MAX : estimate + count;
+        for (unsigned int i = 0; i < self->depth; i++) {
+                if (self->counters[slots[i]] < target) {
+                        self->counters[slots[i]] = target;
+                }
+        }
+        self->total += count;
+
+        return target;
+}
+
+uint32_t uf_count_min_estimate(UfCountMin *self, uint32_t hash)
+{
+        size_t slots[UF_COUNT_MIN_MAX_DEPTH];
+        uint32_t estimate = UINT32_MAX;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+
+        uf_count_min_slots(self, hash, slots);
+        for (unsigned int i = 0; i < self->depth; i++) {
+                if (self->counters[slots[i]] < estimate) {
+                        estimate = self->counters[slots[i]];
+                }
+        }
+        return estimate;
+}
+
+uint64_t uf_count_min_total(UfCountMin *self)
+{
+        return self ? self->total : 0;
+}
+
+bool uf_count_min_merge(UfCountMin *self, UfCountMin *other)
+{
+        size_t n;
+
+        if (uf_unlikely(!self || !other) || self->width != other->width ||
+            self->depth != other->depth) {
+                return false;
+        }
+
+        /* Sums of upper bounds are still upper bounds */
+        n = self->width * self->depth;
+        for (size_t i = 0; i < n; i++) {
+                uint32_t sum = self->counters[i] + other->counters[i];
+                self->counters[i] = sum < self->counters[i] ? UINT32_MAX : sum;
+        }
+        self->total += other->total;
+
+        return true;
+}
+
+void uf_count_min_clear(UfCountMin *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        memset(self->counters, 0, self->width * self->depth * sizeof(uint32_t));
+        self->total = 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
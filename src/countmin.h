@@ -0,0 +1,98 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfCountMin is a count-min sketch: approximate per-key counts in fixed
+ * memory, which never undercount.
+ *
+ * Keys are identified by the hashes the libuf hash functions produce.
+ * Each of @depth rows maps a key to one of @width counters, and the
+ * estimate is the smallest of them. Updates are conservative, raising a
+ * counter only as far as the new estimate, which sharply reduces
+ * overcounting of cold keys sharing counters with hot ones.
+ *
+ * With N the total of all additions, an estimate exceeds the true count
+ * by more than e * N / width with probability at most e^-depth.
+ *
+ * Updates never allocate or block and take a fixed number of steps. A
+ * sketch has a single writer: give each thread its own and merge them
+ * for reading. Counters saturate at UINT32_MAX.
+ */
+typedef struct UfCountMin UfCountMin;
+
+/**
+ * Rows beyond this add memory traffic without useful accuracy
+ */
+#define UF_COUNT_MIN_MAX_DEPTH 16
+
+/**
+ * Construct a new, zeroed UfCountMin
+ *
+ * @param width Counters per row, rounded up to a power of two
+ * @param depth Number of rows, from 1 to UF_COUNT_MIN_MAX_DEPTH
+ *
+ * @note Free with uf_count_min_free
+ *
+ * @return A newly allocated UfCountMin
+ */
+UfCountMin *uf_count_min_new(size_t width, unsigned int depth);
+
+/**
+ * Free a previously allocated sketch
+ */
+void uf_count_min_free(UfCountMin *sketch);
+
+/**
+ * Add @count occurrences of the key with @hash
+ *
+ * @returns The key's estimated count after the update
+ */
+uint32_t uf_count_min_add(UfCountMin *sketch, uint32_t hash, uint32_t count);
+
+/**
+ * Return the estimated count for the key with @hash
+ */
+uint32_t uf_count_min_estimate(UfCountMin *sketch, uint32_t hash);
+
+/**
+ * Return the total of every count added, including merged sketches
+ */
+uint64_t uf_count_min_total(UfCountMin *sketch);
+
+/**
+ * Add the counters of @other into @sketch
+ *
+ * @returns False if the dimensions differ
+ */
+bool uf_count_min_merge(UfCountMin *sketch, UfCountMin *other);
+
+/**
+ * Reset every counter to zero
+ */
+void uf_count_min_clear(UfCountMin *sketch);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,46 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdatomic.h>
+
+#include "cpu.h"
+
+/**
+ * Bit 31 marks the cache as filled, so a CPU with no features still only
+ * gets probed once
+ */
+#define UF_CPU_DETECTED (1u << 31)
+
+static atomic_uint uf_cpu_cache;
+
+unsigned int uf_cpu_features(void)
+{
+        unsigned int features = atomic_load_explicit(&uf_cpu_cache, memory_order_relaxed);
+
+        if (features & UF_CPU_DETECTED) {
+                return features & ~UF_CPU_DETECTED;
+        }
+        features = uf_cpu_detect();
+        atomic_store_explicit(&uf_cpu_cache, features | UF_CPU_DETECTED, memory_order_relaxed);
+        return features;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,83 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+/**
+ * CPU features relevant to our vector kernels
+ */
+typedef enum {
+        UF_CPU_SSE2 = 1 << 0,
+        UF_CPU_SSSE3 = 1 << 1,
+        UF_CPU_SSE4_2 = 1 << 2,
+        UF_CPU_POPCNT = 1 << 3,
+        UF_CPU_AVX2 = 1 << 4,
+        UF_CPU_AVX512BW = 1 << 5,
+} UfCpuFeature;
+
+/**
+ * Kernels for other instruction sets are only built for x86 with a
+ * compiler supporting per-function target attributes.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define UF_CPU_X86 1
+#else
+#define UF_CPU_X86 0
+#endif
+
+/**
+ * Query the CPU directly. This is safe to call from an ifunc resolver, so
+ * it is inline and touches nothing needing relocation.
+ */
+static inline unsigned int uf_cpu_detect(void)
+{
+        unsigned int ret = 0;
+
+#if UF_CPU_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) {
+                ret |= UF_CPU_SSE2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+                ret |= UF_CPU_SSSE3;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+                ret |= UF_CPU_SSE4_2;
+        }
+        if (__builtin_cpu_supports("popcnt")) {
+                ret |= UF_CPU_POPCNT;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+                ret |= UF_CPU_AVX2;
+        }
+        if (__builtin_cpu_supports("avx512bw")) {
+                ret |= UF_CPU_AVX512BW;
+        }
+#endif
+        return ret;
+}
+
+/**
+ * Return the features of the running CPU, as a mask of UfCpuFeature
+ */
+unsigned int uf_cpu_features(void);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
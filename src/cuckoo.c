@@ -0,0 +1,578 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cuckoo.h"
+#include "util.h"
+
+/**
+ * Entries per bucket. Four 32-bit hashes fill half a cache line, and the
+ * whole bucket is 80 bytes.
+ */
+#define UF_CUCKOO_SLOTS 4
+
+/**
+ * Buckets allocated by the first put
+ */
+#define UF_CUCKOO_INITIAL_BUCKETS 16
+
+/**
+ * Grow by half again, rather than doubling like most tables
+ */
+#define UF_CUCKOO_GROWTH 1.5
+
+/**
+ * Grow before more than 95% of the slots are in use. Two choices of four
+ * slots insert reliably up to ~98%, past which eviction paths get long.
+ */
+#define UF_CUCKOO_MAX_LOAD 0.95
+
+/**
+ * If no eviction path exists while the table is less than half full, the
+ * hash function is to blame and growing won't help. Such keys go to the
+ * stash instead, a plain array searched linearly.
+ */
+#define UF_CUCKOO_MIN_GROW_LOAD 0.5
+
+/**
+ * Bound on the breadth first search, reaching 4 evictions deep
+ */
+#define UF_CUCKOO_BFS_NODES 256
+
+typedef struct UfCuckooBucket {
+        uint32_t hash[UF_CUCKOO_SLOTS]; /**<Stored hashes, 0 for an empty slot */
+        void *key[UF_CUCKOO_SLOTS];
+        void *value[UF_CUCKOO_SLOTS];
+} UfCuckooBucket;
+
+typedef struct UfCuckooEntry {
+        void *key;
+        void *value;
+        uint32_t hash;
+} UfCuckooEntry;
+
+struct UfCuckooMap {
+        UfCuckooBucket *buckets;
+        size_t n_buckets;
+        size_t count; /**<Entries in buckets and stash */
+        struct {
+                UfCuckooEntry *entries;
+                size_t count;
+                size_t max;
+        } stash;
+        struct {
+                uf_hashmap_hash_func hash;
+                uf_hashmap_equal_func compare;
+        } key;
+        struct {
+                uf_hashmap_free_func key;
+                uf_hashmap_free_func value;
+        } free;
+};
+
+/**
+ * A bucket reached by the eviction search. The item at @slot of the
+ * @parent node's bucket would move here.
+ */
+typedef struct UfCuckooPath {
+        size_t bucket;
+        int parent;
+        unsigned int slot;
+} UfCuckooPath;
+
+static bool uf_cuckoo_rehash(UfCuckooMap *self, size_t n_buckets);
+
+UfCuckooMap *uf_cuckoo_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare)
+{
+        return uf_cuckoo_new_full(hash, compare, NULL, NULL);
+}
+
+UfCuckooMap *uf_cuckoo_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                uf_hashmap_free_func key_free, uf_hashmap_free_func value_free)
+{
+        UfCuckooMap *ret = NULL;
+
+        if (!hash || !compare) {
+                return NULL;
+        }
+
+        ret = calloc(1, sizeof(struct UfCuckooMap));
+        if (!ret) {
+                return NULL;
+        }
+        ret->key.hash = hash;
+        ret->key.compare = compare;
+        ret->free.key = key_free;
+        ret->free.value = value_free;
+
+        /* Buckets are allocated on first put */
+        return ret;
+}
+
+static inline void uf_cuckoo_entry_free(UfCuckooMap *self, void *key, void *value)
+{
+        if (self->free.key) {
+                self->free.key(key);
+        }
+        if (self->free.value) {
+                self->free.value(value);
+        }
+}
+
+void uf_cuckoo_free(UfCuckooMap *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        for (size_t i = 0; i < self->n_buckets; i++) {
+                UfCuckooBucket *bucket = &self->buckets[i];
+                for (unsigned int s = 0; s < UF_CUCKOO_SLOTS; s++) {
+                        if (bucket->hash[s] != 0) {
+                                uf_cuckoo_entry_free(self, bucket->key[s], bucket->value[s]);
+                        }
+                }
+        }
+        for (size_t i = 0; i < self->stash.count; i++) {
+                uf_cuckoo_entry_free(self, self->stash.entries[i].key, self->stash.entries[i].value);
+        }
+
+        free(self->stash.entries);
+        free(self->buckets);
+        free(self);
+}
+
+/**
+ * Zero marks an empty slot, so fold it into 1
+ */
+static inline uint32_t uf_cuckoo_hash(UfCuckooMap *self, const void *key)
+{
+        uint32_t hash = self->key.hash(key);
+
+        return hash ? hash : 1;
+}
+
+/**
+ * Both candidate buckets for @hash. The hash is mixed out to 64 bits (so
+ * weak hashes like uf_hashmap_simple_hash work well), and each half is
+ * mapped onto the table by multiply-shift, which works for any table size.
+ */
+static inline void uf_cuckoo_candidates(UfCuckooMap *self, uint32_t hash, size_t *first,
+                                        size_t *second)
+{
+        uint64_t x = (uint64_t)hash * 0xFF51AFD7ED558CCDULL;
+        uint64_t n = self->n_buckets;
+
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ULL;
+        x ^= x >> 33;
+
+        *first = (size_t)(((x >> 32) * n) >> 32);
+        *second = (size_t)(((x & 0xFFFFFFFFULL) * n) >> 32);
+        if (uf_unlikely(*second == *first)) {
+                *second = (*first + 1) % self->n_buckets;
+        }
+}
+
+/**
+ * The other candidate bucket of an entry currently held in @bucket
+ */
+static inline size_t uf_cuckoo_alternate(UfCuckooMap *self, size_t bucket, uint32_t hash)
+{
+        size_t first, second;
+
+        uf_cuckoo_candidates(self, hash, &first, &second);
+        return bucket == first ? second : first;
+}
+
+static inline int uf_cuckoo_bucket_find(UfCuckooMap *self, UfCuckooBucket *bucket, uint32_t hash,
+                                        const void *key)
+{
+        for (unsigned int s = 0; s < UF_CUCKOO_SLOTS; s++) {
+                if (bucket->hash[s] == hash && self->key.compare(bucket->key[s], key)) {
+                        return (int)s;
+                }
+        }
+        return -1;
+}
+
+static inline int uf_cuckoo_bucket_free_slot(UfCuckooBucket *bucket)
+{
+        for (unsigned int s = 0; s < UF_CUCKOO_SLOTS; s++) {
+                if (bucket->hash[s] == 0) {
+                        return (int)s;
+                }
+        }
+        return -1;
+}
+
+static inline void uf_cuckoo_bucket_set(UfCuckooBucket *bucket, unsigned int slot, uint32_t hash,
+                                        void *key, void *value)
+{
+        bucket->hash[slot] = hash;
+        bucket->key[slot] = key;
+        bucket->value[slot] = value;
+}
+
+static inline size_t uf_cuckoo_stash_find(UfCuckooMap *self, uint32_t hash, const void *key)
+{
+        for (size_t i = 0; i < self->stash.count; i++) {
+                UfCuckooEntry *entry = &self->stash.entries[i];
+                if (entry->hash == hash && self->key.compare(entry->key, key)) {
+                        return i;
+                }
+        }
+        return SIZE_MAX;
+}
+
+static bool uf_cuckoo_stash_push(UfCuckooMap *self, uint32_t hash, void *key, void *value)
+{
+        if (self->stash.count == self->stash.max) {
+                size_t max = self->stash.max ? self->stash.max * 2 : 4;
+                UfCuckooEntry *entries = realloc(self->stash.entries, max * sizeof(UfCuckooEntry));
+                if (!entries) {
+                        return false;
+                }
+                self->stash.entries = entries;
+                self->stash.max = max;
+        }
+        self->stash.entries[self->stash.count++] =
+            (UfCuckooEntry){ .key = key, .value = value, .hash = hash };
+        return true;
+}
+
+/**
+ * Returns true if @bucket already appears on the path ending at @node
+ */
+static inline bool uf_cuckoo_on_path(UfCuckooPath *queue, int node, size_t bucket)
+{
+        for (; node >= 0; node = queue[node].parent) {
+                if (queue[node].bucket == bucket) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Place a new entry in one of its candidate buckets, evicting entries to
+ * their alternates along the shortest path to a free slot.
+ *
+ * The search only reads the table, and the path never revisits a bucket,
+ * so the moves can be applied from the free slot backwards with every
+ * entry landing in its other candidate bucket.
+ */
+static bool uf_cuckoo_place(UfCuckooMap *self, uint32_t hash, void *key, void *value)
+{
+        UfCuckooPath queue[UF_CUCKOO_BFS_NODES];
+        size_t first, second;
+        int n_queue = 0;
+        int slot;
+
+        uf_cuckoo_candidates(self, hash, &first, &second);
+
+        if ((slot = uf_cuckoo_bucket_free_slot(&self->buckets[first])) >= 0) {
+                uf_cuckoo_bucket_set(&self->buckets[first], (unsigned int)slot, hash, key, value);
+                return true;
+        }
+        if ((slot = uf_cuckoo_bucket_free_slot(&self->buckets[second])) >= 0) {
+                uf_cuckoo_bucket_set(&self->buckets[second], (unsigned int)slot, hash, key, value);
+                return true;
+        }
+
+        queue[n_queue++] = (UfCuckooPath){ .bucket = first, .parent = -1 };
+        queue[n_queue++] = (UfCuckooPath){ .bucket = second, .parent = -1 };
+
+        for (int head = 0; head < n_queue; head++) {
+                UfCuckooBucket *bucket = &self->buckets[queue[head].bucket];
+
+                for (unsigned int s = 0; s < UF_CUCKOO_SLOTS; s++) {
+                        size_t alt = uf_cuckoo_alternate(self, queue[head].bucket, bucket->hash[s]);
+                        size_t dst_bucket;
+                        unsigned int dst_slot, move_slot;
+                        int node;
+
+                        slot = uf_cuckoo_bucket_free_slot(&self->buckets[alt]);
+                        if (slot < 0) {
+                                if (n_queue < UF_CUCKOO_BFS_NODES &&
+                                    !uf_cuckoo_on_path(queue, head, alt)) {
+                                        queue[n_queue++] = (UfCuckooPath){ .bucket = alt,
+                                                                           .parent = head,
+                                                                           .slot = s };
+                                }
+                                continue;
+                        }
+
+                        /* Found a free slot, shift each entry on the path along by one */
+                        dst_bucket = alt;
+                        dst_slot = (unsigned int)slot;
+                        move_slot = s;
+                        for (node = head; node >= 0; node = queue[node].parent) {
+                                UfCuckooBucket *src = &self->buckets[queue[node].bucket];
+
+                                uf_cuckoo_bucket_set(&self->buckets[dst_bucket],
+                                                     dst_slot,
+                                                     src->hash[move_slot],
+                                                     src->key[move_slot],
+                                                     src->value[move_slot]);
+                                dst_bucket = queue[node].bucket;
+                                dst_slot = move_slot;
+                                move_slot = queue[node].slot;
+                        }
+                        uf_cuckoo_bucket_set(&self->buckets[dst_bucket], dst_slot, hash, key, value);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+static inline double uf_cuckoo_load(UfCuckooMap *self, size_t extra)
+{
+        size_t capacity = self->n_buckets * UF_CUCKOO_SLOTS;
+
+        return (double)(self->count - self->stash.count + extra) / (double)capacity;
+}
+
+static inline size_t uf_cuckoo_grown(size_t n_buckets)
+{
+        size_t n = (size_t)((double)n_buckets * UF_CUCKOO_GROWTH);
+
+        return n > n_buckets ? n : n_buckets + 1;
+}
+
+/**
+ * Insert a key known not to be present, growing as required
+ */
+static bool uf_cuckoo_insert(UfCuckooMap *self, uint32_t hash, void *key, void *value)
+{
+        if (uf_cuckoo_load(self, 1) > UF_CUCKOO_MAX_LOAD &&
+            !uf_cuckoo_rehash(self, uf_cuckoo_grown(self->n_buckets))) {
+                return false;
+        }
+
+        while (!uf_cuckoo_place(self, hash, key, value)) {
+                if (uf_cuckoo_load(self, 0) < UF_CUCKOO_MIN_GROW_LOAD) {
+                        if (!uf_cuckoo_stash_push(self, hash, key, value)) {
+                                return false;
+                        }
+                        break;
+                }
+                if (!uf_cuckoo_rehash(self, uf_cuckoo_grown(self->n_buckets))) {
+                        return false;
+                }
+        }
+
+        self->count++;
+        return true;
+}
+
+/**
+ * Move every entry into a table of @n_buckets, reusing the stored hashes
+ */
+static bool uf_cuckoo_rehash(UfCuckooMap *self, size_t n_buckets)
+{
+        UfCuckooBucket *old = self->buckets;
+        size_t old_n = self->n_buckets;
+        UfCuckooEntry *old_stash = self->stash.entries;
+        size_t old_stash_count = self->stash.count;
+        size_t old_stash_max = self->stash.max;
+        bool ok = true;
+
+        if (n_buckets > UINT32_MAX) {
+                return false;
+        }
+
+        self->buckets = calloc(n_buckets, sizeof(UfCuckooBucket));
+        if (!self->buckets) {
+                self->buckets = old;
+                return false;
+        }
+        self->n_buckets = n_buckets;
+        self->stash.entries = NULL;
+        self->stash.count = 0;
+        self->stash.max = 0;
+
+        /* Entries with no path in the new table fall back to its stash */
+        for (size_t i = 0; ok && i < old_n; i++) {
+                for (unsigned int s = 0; ok && s < UF_CUCKOO_SLOTS; s++) {
+                        uint32_t hash = old[i].hash[s];
+                        if (hash == 0) {
+                                continue;
+                        }
+                        ok = uf_cuckoo_place(self, hash, old[i].key[s], old[i].value[s]) ||
+                             uf_cuckoo_stash_push(self, hash, old[i].key[s], old[i].value[s]);
+                }
+        }
+        for (size_t i = 0; ok && i < old_stash_count; i++) {
+                UfCuckooEntry *entry = &old_stash[i];
+                ok = uf_cuckoo_place(self, entry->hash, entry->key, entry->value) ||
+                     uf_cuckoo_stash_push(self, entry->hash, entry->key, entry->value);
+        }
+
+        if (uf_unlikely(!ok)) {
+                free(self->buckets);
+                free(self->stash.entries);
+                self->buckets = old;
+                self->n_buckets = old_n;
+                self->stash.entries = old_stash;
+                self->stash.count = old_stash_count;
+                self->stash.max = old_stash_max;
+                return false;
+        }
+
+        free(old);
+        free(old_stash);
+        return true;
+}
+
+bool uf_cuckoo_put(UfCuckooMap *self, void *key, void *value)
+{
+        UfCuckooBucket *bucket = NULL;
+        size_t first, second, index;
+        uint32_t hash;
+        int slot;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+        if (uf_unlikely(!self->buckets) && !uf_cuckoo_rehash(self, UF_CUCKOO_INITIAL_BUCKETS)) {
+                return false;
+        }
+
+        hash = uf_cuckoo_hash(self, key);
+        uf_cuckoo_candidates(self, hash, &first, &second);
+
+        /* Replace an existing mapping in place */
+        bucket = &self->buckets[first];
+        if ((slot = uf_cuckoo_bucket_find(self, bucket, hash, key)) < 0) {
+                bucket = &self->buckets[second];
+                slot = uf_cuckoo_bucket_find(self, bucket, hash, key);
+        }
+        if (slot >= 0) {
+                uf_cuckoo_entry_free(self, bucket->key[slot], bucket->value[slot]);
+                uf_cuckoo_bucket_set(bucket, (unsigned int)slot, hash, key, value);
+                return true;
+        }
+        if (uf_unlikely(self->stash.count > 0) &&
+            (index = uf_cuckoo_stash_find(self, hash, key)) != SIZE_MAX) {
+                UfCuckooEntry *entry = &self->stash.entries[index];
+                uf_cuckoo_entry_free(self, entry->key, entry->value);
+                entry->key = key;
+                entry->value = value;
+                return true;
+        }
+
+        return uf_cuckoo_insert(self, hash, key, value);
+}
+
+void *uf_cuckoo_get(UfCuckooMap *self, const void *key)
+{
+        size_t first, second, index;
+        uint32_t hash;
+        int slot;
+
+        if (uf_unlikely(!self) || uf_unlikely(self->count == 0)) {
+                return NULL;
+        }
+
+        hash = uf_cuckoo_hash(self, key);
+        uf_cuckoo_candidates(self, hash, &first, &second);
+
+        if ((slot = uf_cuckoo_bucket_find(self, &self->buckets[first], hash, key)) >= 0) {
+                return self->buckets[first].value[slot];
+        }
+        if ((slot = uf_cuckoo_bucket_find(self, &self->buckets[second], hash, key)) >= 0) {
+                return self->buckets[second].value[slot];
+        }
+        if (uf_unlikely(self->stash.count > 0) &&
+            (index = uf_cuckoo_stash_find(self, hash, key)) != SIZE_MAX) {
+                return self->stash.entries[index].value;
+        }
+        return NULL;
+}
+
+bool uf_cuckoo_remove(UfCuckooMap *self, const void *key)
+{
+        size_t candidates[2], index;
+        uint32_t hash;
+
+        if (uf_unlikely(!self) || uf_unlikely(self->count == 0)) {
+                return false;
+        }
+
+        hash = uf_cuckoo_hash(self, key);
+        uf_cuckoo_candidates(self, hash, &candidates[0], &candidates[1]);
+
+        for (size_t i = 0; i < 2; i++) {
+                UfCuckooBucket *bucket = &self->buckets[candidates[i]];
+                int slot = uf_cuckoo_bucket_find(self, bucket, hash, key);
+                if (slot < 0) {
+                        continue;
+                }
+                uf_cuckoo_entry_free(self, bucket->key[slot], bucket->value[slot]);
+                uf_cuckoo_bucket_set(bucket, (unsigned int)slot, 0, NULL, NULL);
+                self->count--;
+                return true;
+        }
+
+        if (uf_unlikely(self->stash.count > 0) &&
+            (index = uf_cuckoo_stash_find(self, hash, key)) != SIZE_MAX) {
+                UfCuckooEntry *entry = &self->stash.entries[index];
+                uf_cuckoo_entry_free(self, entry->key, entry->value);
+                *entry = self->stash.entries[--self->stash.count];
+                self->count--;
+                return true;
+        }
+        return false;
+}
+
+bool uf_cuckoo_reserve(UfCuckooMap *self, size_t n_items)
+{
+        size_t n_buckets;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        n_buckets = (size_t)((double)n_items / (UF_CUCKOO_SLOTS * UF_CUCKOO_MAX_LOAD)) + 1;
+        if (n_buckets < UF_CUCKOO_INITIAL_BUCKETS) {
+                n_buckets = UF_CUCKOO_INITIAL_BUCKETS;
+        }
+        if (n_buckets <= self->n_buckets) {
+                return true;
+        }
+        return uf_cuckoo_rehash(self, n_buckets);
+}
+
+size_t uf_cuckoo_size(UfCuckooMap *self)
+{
+        return self ? self->count : 0;
+}
+
+size_t uf_cuckoo_capacity(UfCuckooMap *self)
+{
+        return self ? self->n_buckets * UF_CUCKOO_SLOTS : 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,115 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * UfCuckooMap is a hash map for memory constrained use, keeping 90-95% of
+ * its slots occupied where UfHashmap may be only 15% full after a resize.
+ *
+ * Buckets hold 4 entries, and every key may live in one of two buckets so
+ * a lookup inspects at most 8 slots. When both are full an insert moves
+ * existing entries to their alternate buckets, along the shortest path
+ * found by breadth first search. Tables grow by 1.5x.
+ *
+ * It takes the same hash and equality functions as UfHashmap.
+ */
+typedef struct UfCuckooMap UfCuckooMap;
+
+/**
+ * Construct a new UfCuckooMap
+ *
+ * @param hash Key hash generator
+ * @param compare Key equality function
+ *
+ * @note Free with uf_cuckoo_free
+ *
+ * @return A newly allocated UfCuckooMap
+ */
+UfCuckooMap *uf_cuckoo_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare);
+
+/**
+ * Construct a new UfCuckooMap with key/value free functions
+ *
+ * @param hash Key hash generator
+ * @param compare Key equality function
+ * @param key_free Function to call to free any keys when replaced or the map is freed
+ * @param value_free Function to call to free any values when replaced or the map is freed
+ *
+ * @note Free with uf_cuckoo_free
+ *
+ * @return A newly allocated UfCuckooMap
+ */
+UfCuckooMap *uf_cuckoo_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                uf_hashmap_free_func key_free, uf_hashmap_free_func value_free);
+
+/**
+ * Free a previously allocated map, and any keys and values
+ *
+ * @param map Pointer to a previously allocated map
+ */
+void uf_cuckoo_free(UfCuckooMap *map);
+
+/**
+ * Store a key/value mapping, replacing any existing mapping for @key
+ *
+ * @returns True if the key/value pair could be stored
+ */
+bool uf_cuckoo_put(UfCuckooMap *map, void *key, void *value);
+
+/**
+ * Attempt to retrieve the value associated with @key
+ *
+ * @returns The stored value, if found.
+ */
+void *uf_cuckoo_get(UfCuckooMap *map, const void *key);
+
+/**
+ * Remove the mapping for @key, freeing its key and value
+ *
+ * @returns True if we deleted a matching key/value
+ */
+bool uf_cuckoo_remove(UfCuckooMap *map, const void *key);
+
+/**
+ * Ensure the map can hold @n_items without growing again
+ *
+ * @returns True if the map has room for @n_items
+ */
+bool uf_cuckoo_reserve(UfCuckooMap *map, size_t n_items);
+
+/**
+ * Return the number of entries in the map
+ */
+size_t uf_cuckoo_size(UfCuckooMap *map);
+
+/**
+ * Return the number of slots in the table, so size / capacity is the
+ * current load factor
+ */
+size_t uf_cuckoo_capacity(UfCuckooMap *map);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
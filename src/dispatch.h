@@ -0,0 +1,77 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "config.h"
+#include "cpu.h"
+
+/**
+ * Define the exported function @name, forwarding to the implementation
+ * that @choose (a static function taking the feature mask) picks for the
+ * running CPU.
+ *
+ * The shared library on glibc binds it once at load time with an ifunc,
+ * so calls cost the same as any other PLT call. Elsewhere (static builds,
+ * musl) it resolves on first call into an atomic function pointer.
+ *
+ * Resolvers run during relocation, before the address and thread
+ * sanitizer runtimes are initialised, so sanitized builds take the
+ * function pointer path too.
+ */
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define UF_CPU_IFUNC 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define UF_CPU_IFUNC 0
+#endif
+#endif
+#ifndef UF_CPU_IFUNC
+#define UF_CPU_IFUNC UF_ENABLE_IFUNC
+#endif
+
+#if UF_CPU_IFUNC
+#define UF_CPU_DISPATCH(ret, name, params, args, choose)                                            \
+        static ret (*name##_resolve(void)) params                                                   \
+        {                                                                                           \
+                return choose(uf_cpu_detect());                                                     \
+        }                                                                                           \
+        ret name params __attribute__((ifunc(#name "_resolve")));
+#else
+#define UF_CPU_DISPATCH(ret, name, params, args, choose)                                            \
+        static ret name##_first params;                                                             \
+        static ret (*_Atomic name##_impl) params = name##_first;                                    \
+        static ret name##_first params                                                              \
+        {                                                                                           \
+                ret(*impl) params = choose(uf_cpu_features());                                      \
+                atomic_store_explicit(&name##_impl, impl, memory_order_relaxed);                    \
+                return impl args;                                                                   \
+        }                                                                                           \
+        ret name params                                                                             \
+        {                                                                                           \
+                return atomic_load_explicit(&name##_impl, memory_order_relaxed) args;               \
+        }
+#endif
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
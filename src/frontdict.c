@@ -0,0 +1,430 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "frontdict.h"
+#include "map.h"
+#include "util.h"
+
+/**
+ * Strings per bucket. Longer buckets compress better but every decode
+ * walks half a bucket on average.
+ */
+#define UF_FRONT_DICT_BUCKET 16
+
+/**
+ * Index slots per string, at 80% load. Tags keep the probes that miss
+ * from decoding anything.
+ */
+#define UF_FRONT_DICT_SLOTS(n) ((n) + (n) / 4 + 1)
+
+struct UfFrontDict {
+        size_t n;              /**<Distinct strings */
+        size_t n_buckets;      /**<Buckets of UF_FRONT_DICT_BUCKET strings */
+        size_t slots;          /**<Index slots */
+        size_t bytes;          /**<Size of the whole allocation */
+        size_t *buckets;       /**<Offset of each bucket within data */
+        uint32_t *ids;         /**<Index of id + 1, 0 for an empty slot */
+        uint8_t *tags;         /**<Low hash bits of each index slot */
+        unsigned char *data;   /**<Front coded strings */
+};
+
+static inline size_t uf_varint_size(size_t v)
+{
+        size_t ret = 1;
+
+        while (v >= 0x80) {
+                v >>= 7;
+                ret++;
+        }
+        return ret;
+}
+
+static inline unsigned char *uf_varint_put(unsigned char *p, size_t v)
+{
+        while (v >= 0x80) {
+                *p++ = (unsigned char)(v | 0x80);
+                v >>= 7;
+        }
+        *p++ = (unsigned char)v;
+        return p;
+}
+
+static inline const unsigned char *uf_varint_get(const unsigned char *p, size_t *v)
+{
+        size_t ret = 0;
+        unsigned int shift = 0;
+
+        while (*p & 0x80) {
+                ret |= (size_t)(*p++ & 0x7F) << shift;
+                shift += 7;
+        }
+        *v = ret | ((size_t)*p++ << shift);
+        return p;
+}
+
+static inline size_t uf_front_dict_common(const unsigned char *a, size_t a_len,
+                                          const unsigned char *b, size_t b_len)
+{
+        size_t max = a_len < b_len ? a_len : b_len;
+        size_t i = 0;
+
+        /* Shared prefixes run long, so compare a word at a time first */
+        for (; i + sizeof(uint64_t) <= max; i += sizeof(uint64_t)) {
+                uint64_t x, y;
+
+                memcpy(&x, a + i, sizeof(x));
+                memcpy(&y, b + i, sizeof(y));
+                if (x != y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                        return i + (size_t)__builtin_ctzll(x ^ y) / 8;
+#else
+                        return i + (size_t)__builtin_clzll(x ^ y) / 8;
+#endif
+                }
+        }
+        while (i < max && a[i] == b[i]) {
+                i++;
+        }
+        return i;
+}
+
+/**
+ * The map string hash spreads poorly over long shared prefixes, so
+ * finish it with the murmur3 finaliser before taking slot and tag.
+ */
+static inline uint32_t uf_front_dict_hash(const char *key)
+{
+        uint32_t h = uf_hashmap_string_hash(key);
+
+        h ^= h >> 16;
+        h *= 0x85EBCA6B;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35;
+        h ^= h >> 16;
+        return h;
+}
+
+static inline size_t uf_front_dict_slot(UfFrontDict *self, uint32_t hash)
+{
+        return (size_t)(((uint64_t)hash * self->slots) >> 32);
+}
+
+static inline size_t uf_front_dict_bucket_count(UfFrontDict *self, size_t b)
+{
+        size_t left = self->n - b * UF_FRONT_DICT_BUCKET;
+        return left < UF_FRONT_DICT_BUCKET ? left : UF_FRONT_DICT_BUCKET;
+}
+
+static int uf_front_dict_sort(const void *a, const void *b)
+{
+        return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+UfFrontDict *uf_front_dict_new(const char *const *strings, size_t n)
+{
+        UfFrontDict *ret = NULL;
+        const char **sorted = NULL;
+        size_t m = 0;
+        size_t n_buckets;
+        size_t slots;
+        size_t data_len = 0;
+        size_t bytes;
+        unsigned char *p = NULL;
+
+        if (n > ((size_t)UINT32_MAX / 5) * 4) {
+                return NULL;
+        }
+
+        sorted = malloc((n ? n : 1) * sizeof(char *));
+        if (!sorted) {
+                return NULL;
+        }
+        if (n > 0) {
+                memcpy(sorted, strings, n * sizeof(char *));
+        }
+        qsort(sorted, n, sizeof(char *), uf_front_dict_sort);
+        for (size_t i = 0; i < n; i++) {
+                if (m == 0 || strcmp(sorted[m - 1], sorted[i]) != 0) {
+                        sorted[m++] = sorted[i];
+                }
+        }
+
+        /* Size the encoding first so everything fits one allocation */
+        for (size_t i = 0; i < m; i++) {
+                size_t len = strlen(sorted[i]);
+                size_t shared = 0;
+
+                if (i % UF_FRONT_DICT_BUCKET == 0) {
+                        data_len += uf_varint_size(len) + len;
+                        continue;
+                }
+                shared = uf_front_dict_common((const unsigned char *)sorted[i - 1],
+                                              strlen(sorted[i - 1]),
+                                              (const unsigned char *)sorted[i],
+                                              len);
+                data_len += uf_varint_size(shared) + uf_varint_size(len - shared) + len - shared;
+        }
+
+        n_buckets = (m + UF_FRONT_DICT_BUCKET - 1) / UF_FRONT_DICT_BUCKET;
+        slots = UF_FRONT_DICT_SLOTS(m);
+        bytes = sizeof(struct UfFrontDict) + n_buckets * sizeof(size_t) +
+                slots * sizeof(uint32_t) + slots + data_len;
+        ret = calloc(1, bytes);
+        if (!ret) {
+                free(sorted);
+                return NULL;
+        }
+        ret->n = m;
+        ret->n_buckets = n_buckets;
+        ret->slots = slots;
+        ret->bytes = bytes;
+        ret->buckets = (size_t *)(void *)(ret + 1);
+        ret->ids = (uint32_t *)(void *)(ret->buckets + n_buckets);
+        ret->tags = (uint8_t *)(ret->ids + slots);
+        ret->data = ret->tags + slots;
+
+        p = ret->data;
+        for (size_t i = 0; i < m; i++) {
+                const unsigned char *s = (const unsigned char *)sorted[i];
+                size_t len = strlen(sorted[i]);
+                size_t shared = 0;
+                uint32_t hash = uf_front_dict_hash(sorted[i]);
+                size_t slot = uf_front_dict_slot(ret, hash);
+
+                if (i % UF_FRONT_DICT_BUCKET == 0) {
+                        ret->buckets[i / UF_FRONT_DICT_BUCKET] = (size_t)(p - ret->data);
+                        p = uf_varint_put(p, len);
+                } else {
+                        shared = uf_front_dict_common((const unsigned char *)sorted[i - 1],
+                                                      strlen(sorted[i - 1]),
+                                                      s,
+                                                      len);
+                        p = uf_varint_put(p, shared);
+                        p = uf_varint_put(p, len - shared);
+                }
+                memcpy(p, s + shared, len - shared);
+                p += len - shared;
+
+                /* Strings are distinct, so each takes the first free slot */
+                while (ret->ids[slot] != 0) {
+                        if (++slot == slots) {
+                                slot = 0;
+                        }
+                }
+                ret->ids[slot] = (uint32_t)(i + 1);
+                ret->tags[slot] = (uint8_t)hash;
+        }
+
+        free(sorted);
+        return ret;
+}
+
+void uf_front_dict_free(UfFrontDict *self)
+{
+        free(self);
+}
+
+size_t uf_front_dict_size(UfFrontDict *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return self->n;
+}
+
+size_t uf_front_dict_memory(UfFrontDict *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return self->bytes;
+}
+
+/**
+ * Walk bucket @b comparing each string with @key, without decoding any.
+ *
+ * Only the length of the prefix the current string shares with @key is
+ * tracked: a string sharing more with its predecessor than the
+ * predecessor did with @key differs from @key at the same byte, and
+ * compares the same way.
+ *
+ * Stops at entry @stop, or at the first string not sorting before @key.
+ *
+ * @returns The entry stopped at, with @cmp set to the order of that
+ * string against @key, or the bucket count if none qualified
+ */
+static size_t uf_front_dict_scan(UfFrontDict *self, size_t b, const unsigned char *key,
+                                 size_t key_len, size_t stop, int *cmp)
+{
+        const unsigned char *p = self->data + self->buckets[b];
+        size_t count = uf_front_dict_bucket_count(self, b);
+        size_t matched = 0;
+
+        for (size_t j = 0; j < count; j++) {
+                size_t shared = 0;
+                size_t suffix_len = 0;
+
+                if (j != 0) {
+                        p = uf_varint_get(p, &shared);
+                }
+                p = uf_varint_get(p, &suffix_len);
+
+                if (j == 0 || shared <= matched) {
+                        size_t len = shared + suffix_len;
+
+                        matched = shared + uf_front_dict_common(p,
+                                                                suffix_len,
+                                                                key + shared,
+                                                                key_len - shared);
+                        if (matched == len) {
+                                *cmp = matched == key_len ? 0 : -1;
+                        } else if (matched == key_len) {
+                                *cmp = 1;
+                        } else {
+                                *cmp = p[matched - shared] < key[matched] ? -1 : 1;
+                        }
+                }
+                p += suffix_len;
+
+                if (j == stop || *cmp >= 0) {
+                        return j;
+                }
+        }
+
+        return count;
+}
+
+size_t uf_front_dict_lookup(UfFrontDict *self, const char *key)
+{
+        uint32_t hash;
+        size_t slot;
+        size_t key_len;
+
+        if (uf_unlikely(!self || !key) || self->n == 0) {
+                return UF_FRONT_DICT_NOT_FOUND;
+        }
+
+        hash = uf_front_dict_hash(key);
+        key_len = strlen(key);
+        for (slot = uf_front_dict_slot(self, hash); self->ids[slot] != 0;) {
+                if (self->tags[slot] == (uint8_t)hash) {
+                        size_t id = self->ids[slot] - 1;
+                        size_t entry = id % UF_FRONT_DICT_BUCKET;
+                        int cmp = 1;
+
+                        if (uf_front_dict_scan(self,
+                                               id / UF_FRONT_DICT_BUCKET,
+                                               (const unsigned char *)key,
+                                               key_len,
+                                               entry,
+                                               &cmp) == entry &&
+                            cmp == 0) {
+                                return id;
+                        }
+                }
+                if (++slot == self->slots) {
+                        slot = 0;
+                }
+        }
+
+        return UF_FRONT_DICT_NOT_FOUND;
+}
+
+size_t uf_front_dict_lower_bound(UfFrontDict *self, const char *key)
+{
+        const unsigned char *k = (const unsigned char *)key;
+        size_t key_len;
+        size_t lo = 0;
+        size_t hi;
+        int cmp = 1;
+
+        if (uf_unlikely(!self || !key)) {
+                return 0;
+        }
+
+        /* Find the last bucket whose first string sorts at or before key */
+        key_len = strlen(key);
+        hi = self->n_buckets;
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                const unsigned char *head = self->data + self->buckets[mid];
+                size_t len = 0;
+                int order;
+
+                head = uf_varint_get(head, &len);
+                order = memcmp(head, k, len < key_len ? len : key_len);
+                if (order < 0 || (order == 0 && len <= key_len)) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        if (lo == 0) {
+                return 0;
+        }
+
+        lo--;
+        return lo * UF_FRONT_DICT_BUCKET +
+               uf_front_dict_scan(self, lo, k, key_len, UF_FRONT_DICT_BUCKET, &cmp);
+}
+
+size_t uf_front_dict_get(UfFrontDict *self, size_t id, char *buf, size_t len)
+{
+        const unsigned char *p = NULL;
+        size_t entry;
+        size_t str_len = 0;
+
+        if (uf_unlikely(!self) || id >= self->n) {
+                return UF_FRONT_DICT_NOT_FOUND;
+        }
+
+        /*
+         * Each string only reuses bytes its predecessors wrote, so writing
+         * what fits of every suffix leaves the wanted prefix in place.
+         */
+        p = self->data + self->buckets[id / UF_FRONT_DICT_BUCKET];
+        entry = id % UF_FRONT_DICT_BUCKET;
+        for (size_t j = 0; j <= entry; j++) {
+                size_t shared = 0;
+                size_t suffix_len = 0;
+
+                if (j != 0) {
+                        p = uf_varint_get(p, &shared);
+                }
+                p = uf_varint_get(p, &suffix_len);
+                if (len > 0 && shared < len - 1) {
+                        size_t room = len - 1 - shared;
+                        memcpy(buf + shared, p, suffix_len < room ? suffix_len : room);
+                }
+                p += suffix_len;
+                str_len = shared + suffix_len;
+        }
+
+        if (len > 0) {
+                buf[str_len < len - 1 ? str_len : len - 1] = '\0';
+        }
+        return str_len;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
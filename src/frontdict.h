@@ -0,0 +1,100 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfFrontDict is an immutable set of strings, built once and then shared
+ * between readers, for large key sets with long common prefixes such as
+ * file paths.
+ *
+ * Strings are sorted and front coded in buckets of 16: the first string
+ * of a bucket is stored whole and each following one as the length of
+ * the prefix it shares with its predecessor plus the remaining suffix.
+ * Every string has an id, its position in sorted order, and any id is
+ * decoded by walking at most one bucket. A compact hash index maps
+ * strings back to ids for exact lookups.
+ *
+ * Nothing is allocated or modified after construction, so any number of
+ * threads may read a dictionary at once.
+ */
+typedef struct UfFrontDict UfFrontDict;
+
+/**
+ * Returned by lookups for strings not in the dictionary
+ */
+#define UF_FRONT_DICT_NOT_FOUND SIZE_MAX
+
+/**
+ * Construct a new UfFrontDict holding a copy of the @n @strings, in any
+ * order. Duplicates are stored once.
+ *
+ * @note Free with uf_front_dict_free
+ *
+ * @return A newly allocated UfFrontDict, or NULL on OOM or if there are
+ * too many strings for 32 bit ids
+ */
+UfFrontDict *uf_front_dict_new(const char *const *strings, size_t n);
+
+/**
+ * Free a previously allocated dictionary
+ */
+void uf_front_dict_free(UfFrontDict *dict);
+
+/**
+ * Return the number of distinct strings in @dict
+ */
+size_t uf_front_dict_size(UfFrontDict *dict);
+
+/**
+ * Return the total bytes held by @dict, including its index
+ */
+size_t uf_front_dict_memory(UfFrontDict *dict);
+
+/**
+ * Find the id of @key through the hash index
+ *
+ * @returns The id of @key, or UF_FRONT_DICT_NOT_FOUND
+ */
+size_t uf_front_dict_lookup(UfFrontDict *dict, const char *key);
+
+/**
+ * Find the id of the first string not sorting before @key, by bytes as
+ * strcmp does. Strings starting with a prefix are found from the lower
+ * bound of that prefix onwards.
+ *
+ * @returns An id, or uf_front_dict_size if every string sorts before @key
+ */
+size_t uf_front_dict_lower_bound(UfFrontDict *dict, const char *key);
+
+/**
+ * Decode the string with @id into @buf, snprintf style: at most @len - 1
+ * bytes are written, always followed by a NUL when @len is not 0.
+ *
+ * @returns The full length of the string, or UF_FRONT_DICT_NOT_FOUND if
+ * @id is out of range
+ */
+size_t uf_front_dict_get(UfFrontDict *dict, size_t id, char *buf, size_t len);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
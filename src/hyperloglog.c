@@ -0,0 +1,411 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if UF_CPU_X86
+#include <immintrin.h>
+#endif
+
+#include "hyperloglog.h"
+#include "util.h"
+
+/**
+ * Sparse entries pack the register index above its rank
+ */
+#define UF_HLL_SPARSE_ENTRY(index, rank) (((uint32_t)(index) << 8) | (rank))
+#define UF_HLL_SPARSE_INDEX(entry) ((entry) >> 8)
+#define UF_HLL_SPARSE_RANK(entry) ((uint8_t)((entry)&0xFF))
+
+/**
+ * Initial sparse capacity in entries
+ */
+#define UF_HLL_SPARSE_INITIAL 16
+
+struct UfHyperLogLog {
+        unsigned int precision;
+        size_t n_registers;
+        uint8_t *registers; /**<Dense registers, NULL while sparse */
+        struct {
+                uint32_t *entries; /**<Sorted unique prefix, then unsorted additions */
+                size_t n_sorted;
+                size_t n_entries;
+                size_t capacity;
+                size_t limit; /**<Largest capacity, same bytes as the dense registers */
+        } sparse;
+};
+
+UfHyperLogLog *uf_hyperloglog_new(unsigned int precision)
+{
+        UfHyperLogLog *ret = NULL;
+
+        if (precision < UF_HYPERLOGLOG_MIN_PRECISION || precision > UF_HYPERLOGLOG_MAX_PRECISION) {
+                return NULL;
+        }
+
+        ret = calloc(1, sizeof(struct UfHyperLogLog));
+        if (!ret) {
+                return NULL;
+        }
+        ret->precision = precision;
+        ret->n_registers = (size_t)1 << precision;
+        ret->sparse.limit = ret->n_registers / sizeof(uint32_t);
+
+        /* Storage is allocated on first add */
+        return ret;
+}
+
+void uf_hyperloglog_free(UfHyperLogLog *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        free(self->registers);
+        free(self->sparse.entries);
+        free(self);
+}
+
+void uf_hyperloglog_clear(UfHyperLogLog *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        free(self->registers);
+        free(self->sparse.entries);
+        self->registers = NULL;
+        memset(&self->sparse, 0, sizeof(self->sparse));
+        self->sparse.limit = self->n_registers / sizeof(uint32_t);
+}
+
+bool uf_hyperloglog_is_sparse(UfHyperLogLog *self)
+{
+        return self && !self->registers;
+}
+
+static int uf_hll_entry_compare(const void *a, const void *b)
+{
+        uint32_t x = *(const uint32_t *)a;
+        uint32_t y = *(const uint32_t *)b;
+
+        return (x > y) - (x < y);
+}
+
+/**
+ * Sort the sparse entries and keep the highest rank for each register
+ */
+static void uf_hll_sparse_compact(UfHyperLogLog *self)
+{
+        uint32_t *entries = self->sparse.entries;
+        size_t n = 0;
+
+        if (self->sparse.n_sorted == self->sparse.n_entries) {
+                return;
+        }
+
+        qsort(entries, self->sparse.n_entries, sizeof(uint32_t), uf_hll_entry_compare);
+        for (size_t i = 0; i < self->sparse.n_entries; i++) {
+                /* Equal indexes sort by rank, so the last one wins */
+                if (n > 0 && UF_HLL_SPARSE_INDEX(entries[n - 1]) == UF_HLL_SPARSE_INDEX(entries[i])) {
+                        entries[n - 1] = entries[i];
+                } else {
+                        entries[n++] = entries[i];
+                }
+        }
+        self->sparse.n_sorted = self->sparse.n_entries = n;
+}
+
+/**
+ * Switch to dense registers, folding in the sparse entries
+ */
+static bool uf_hll_to_dense(UfHyperLogLog *self)
+{
+        uint8_t *registers = NULL;
+
+        /* Aligned for the vector merge kernels */
+        registers = aligned_alloc(64, self->n_registers < 64 ? 64 : self->n_registers);
+        if (!registers) {
+                return false;
+        }
+        memset(registers, 0, self->n_registers);
+
+        for (size_t i = 0; i < self->sparse.n_entries; i++) {
+                uint32_t entry = self->sparse.entries[i];
+                uint8_t *reg = &registers[UF_HLL_SPARSE_INDEX(entry)];
+                if (UF_HLL_SPARSE_RANK(entry) > *reg) {
+                        *reg = UF_HLL_SPARSE_RANK(entry);
+                }
+        }
+
+        free(self->sparse.entries);
+        self->sparse.entries = NULL;
+        self->sparse.n_sorted = self->sparse.n_entries = self->sparse.capacity = 0;
+        self->registers = registers;
+        return true;
+}
+
+/**
+ * Make room for one more sparse entry, compacting, growing or going
+ * dense as needed. Returns false on OOM.
+ */
+static bool uf_hll_sparse_reserve(UfHyperLogLog *self)
+{
+        uint32_t *entries = NULL;
+        size_t capacity;
+
+        if (self->sparse.n_entries < self->sparse.capacity) {
+                return true;
+        }
+
+        uf_hll_sparse_compact(self);
+
+        /* Compaction alone must free at least half, or every add would sort */
+        if (self->sparse.capacity > 0 && self->sparse.n_entries * 2 <= self->sparse.capacity) {
+                return true;
+        }
+        if (self->sparse.capacity >= self->sparse.limit) {
+                return uf_hll_to_dense(self);
+        }
+
+        capacity = self->sparse.capacity ? self->sparse.capacity * 2 : UF_HLL_SPARSE_INITIAL;
+        if (capacity > self->sparse.limit) {
+                capacity = self->sparse.limit;
+        }
+        entries = realloc(self->sparse.entries, capacity * sizeof(uint32_t));
+        if (!entries) {
+                return false;
+        }
+        self->sparse.entries = entries;
+        self->sparse.capacity = capacity;
+        return true;
+}
+
+/**
+ * Record @rank for register @index
+ */
+static bool uf_hll_set(UfHyperLogLog *self, size_t index, uint8_t rank)
+{
+        if (uf_likely(self->registers != NULL)) {
+                if (rank > self->registers[index]) {
+                        self->registers[index] = rank;
+                }
+                return true;
+        }
+
+        if (!uf_hll_sparse_reserve(self)) {
+                return false;
+        }
+        /* Reserving may have gone dense */
+        if (self->registers) {
+                return uf_hll_set(self, index, rank);
+        }
+        self->sparse.entries[self->sparse.n_entries++] = UF_HLL_SPARSE_ENTRY(index, rank);
+        return true;
+}
+
+/**
+ * Finaliser from MurmurHash3, so every input bit affects every output bit
+ */
+static inline uint64_t uf_hll_mix(uint64_t h)
+{
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ULL;
+        h ^= h >> 33;
+        return h;
+}
+
+bool uf_hyperloglog_add_hash64(UfHyperLogLog *self, uint64_t hash)
+{
+        uint64_t rest;
+        size_t index;
+        uint8_t rank;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        /* The top bits pick the register, the rest give the rank */
+        hash = uf_hll_mix(hash);
+        index = (size_t)(hash >> (64 - self->precision));
+        rest = hash << self->precision;
+        rank = rest ? (uint8_t)(__builtin_clzll(rest) + 1) : (uint8_t)(64 - self->precision + 1);
+
+        return uf_hll_set(self, index, rank);
+}
+
+bool uf_hyperloglog_add_hash(UfHyperLogLog *self, uint32_t hash)
+{
+        return uf_hyperloglog_add_hash64(self, hash);
+}
+
+uint64_t uf_hyperloglog_estimate(UfHyperLogLog *self)
+{
+        double m;
+        double sum = 0.0;
+        double alpha;
+        double estimate;
+        size_t zeros = 0;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        m = (double)self->n_registers;
+
+        /* Few registers are touched, linear counting is the better estimate */
+        if (!self->registers) {
+                uf_hll_sparse_compact(self);
+                if (self->sparse.n_entries == 0) {
+                        return 0;
+                }
+                estimate = m * log(m / (m - (double)self->sparse.n_entries));
+                return (uint64_t)(estimate + 0.5);
+        }
+
+        for (size_t i = 0; i < self->n_registers; i++) {
+                sum += ldexp(1.0, -(int)self->registers[i]);
+                zeros += self->registers[i] == 0;
+        }
+
+        switch (self->n_registers) {
+        case 16:
+                alpha = 0.673;
+                break;
+        case 32:
+                alpha = 0.697;
+                break;
+        case 64:
+                alpha = 0.709;
+                break;
+        default:
+                alpha = 0.7213 / (1.0 + 1.079 / m);
+                break;
+        }
+
+        estimate = alpha * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0) {
+                estimate = m * log(m / (double)zeros);
+        }
+        return (uint64_t)(estimate + 0.5);
+}
+
+#if !defined(__SSE2__)
+static uint8_t *uf_hll_merge_scalar(uint8_t *dst, const uint8_t *src, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                dst[i] = src[i] > dst[i] ? src[i] : dst[i];
+        }
+        return dst;
+}
+#endif
+
+#if defined(__SSE2__)
+static uint8_t *uf_hll_merge_sse2(uint8_t *dst, const uint8_t *src, size_t n)
+{
+        size_t i = 0;
+
+        for (; i + 16 <= n; i += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(dst + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+                _mm_storeu_si128((__m128i *)(void *)(dst + i), _mm_max_epu8(a, b));
+        }
+        for (; i < n; i++) {
+                dst[i] = src[i] > dst[i] ? src[i] : dst[i];
+        }
+        return dst;
+}
+#endif
+
+#if UF_CPU_X86
+__attribute__((target("avx2"))) static uint8_t *uf_hll_merge_avx2(uint8_t *dst,
+                                                                  const uint8_t *src, size_t n)
+{
+        size_t i = 0;
+
+        for (; i + 32 <= n; i += 32) {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(dst + i));
+                __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(src + i));
+                _mm256_storeu_si256((__m256i *)(void *)(dst + i), _mm256_max_epu8(a, b));
+        }
+        for (; i < n; i++) {
+                dst[i] = src[i] > dst[i] ? src[i] : dst[i];
+        }
+        return dst;
+}
+#endif
+
+static uf_hyperloglog_merge_func uf_hll_merge_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_hll_merge_avx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_hll_merge_sse2;
+#else
+        return uf_hll_merge_scalar;
+#endif
+}
+
+uf_hyperloglog_merge_func uf_hyperloglog_merge_select(unsigned int features)
+{
+        return uf_hll_merge_choose(features);
+}
+
+UF_CPU_DISPATCH(uint8_t *, uf_hyperloglog_merge_registers,
+                (uint8_t *dst, const uint8_t *src, size_t n), (dst, src, n),
+                uf_hll_merge_choose)
+
+bool uf_hyperloglog_merge(UfHyperLogLog *self, UfHyperLogLog *other)
+{
+        if (uf_unlikely(!self || !other) || self->precision != other->precision) {
+                return false;
+        }
+        if (self == other) {
+                return true;
+        }
+
+        if (other->registers) {
+                if (!self->registers && !uf_hll_to_dense(self)) {
+                        return false;
+                }
+                uf_hyperloglog_merge_registers(self->registers, other->registers, self->n_registers);
+                return true;
+        }
+
+        for (size_t i = 0; i < other->sparse.n_entries; i++) {
+                uint32_t entry = other->sparse.entries[i];
+                if (!uf_hll_set(self, UF_HLL_SPARSE_INDEX(entry), UF_HLL_SPARSE_RANK(entry))) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
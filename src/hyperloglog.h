@@ -0,0 +1,122 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfHyperLogLog estimates the number of distinct items in a stream, in
+ * fixed memory, from their hashes alone.
+ *
+ * It takes the same 32-bit hashes a UfHashmap computes, so a streaming
+ * first pass can count distinct keys and size a map once:
+ *
+ *      uf_hyperloglog_add_hash(hll, uf_hashmap_string_hash(key));
+ *      ...
+ *      uf_hashmap_reserve(map, uf_hyperloglog_estimate(hll));
+ *
+ * Hashes are mixed internally, so weak ones such as
+ * uf_hashmap_simple_hash are fine. With 2^p registers the standard error
+ * is about 1.04 / sqrt(2^p), e.g. 0.8% at the default precision of 14.
+ *
+ * Small sets are kept sparse, as a sorted list of the registers they
+ * touch, which is far smaller than the 2^p byte register array used once
+ * the set grows. Estimators of the same precision can be merged, e.g.
+ * one per worker thread.
+ */
+typedef struct UfHyperLogLog UfHyperLogLog;
+
+#define UF_HYPERLOGLOG_MIN_PRECISION 4
+#define UF_HYPERLOGLOG_MAX_PRECISION 16
+#define UF_HYPERLOGLOG_DEFAULT_PRECISION 14
+
+/**
+ * Construct a new, empty UfHyperLogLog with 2^@precision registers
+ *
+ * @note Free with uf_hyperloglog_free
+ *
+ * @return A newly allocated UfHyperLogLog, or NULL if @precision is out
+ * of range
+ */
+UfHyperLogLog *uf_hyperloglog_new(unsigned int precision);
+
+/**
+ * Free a previously allocated estimator
+ */
+void uf_hyperloglog_free(UfHyperLogLog *hll);
+
+/**
+ * Record an item by its 32-bit hash, as produced by a uf_hashmap_hash_func
+ *
+ * @returns False if memory ran out, in which case the item was dropped
+ */
+bool uf_hyperloglog_add_hash(UfHyperLogLog *hll, uint32_t hash);
+
+/**
+ * Record an item by its 64-bit hash, for streams that may exceed 2^32
+ * distinct items
+ *
+ * @returns False if memory ran out, in which case the item was dropped
+ */
+bool uf_hyperloglog_add_hash64(UfHyperLogLog *hll, uint64_t hash);
+
+/**
+ * Return the estimated number of distinct items added
+ */
+uint64_t uf_hyperloglog_estimate(UfHyperLogLog *hll);
+
+/**
+ * Fold @other into @hll, so it estimates the union of both streams
+ *
+ * @returns False if the precisions differ or memory ran out
+ */
+bool uf_hyperloglog_merge(UfHyperLogLog *hll, UfHyperLogLog *other);
+
+/**
+ * Forget every item, returning to the sparse representation
+ */
+void uf_hyperloglog_clear(UfHyperLogLog *hll);
+
+/**
+ * Return true while the estimator still uses the sparse representation
+ */
+bool uf_hyperloglog_is_sparse(UfHyperLogLog *hll);
+
+/**
+ * Register merge kernel: @dst[i] = max(@dst[i], @src[i]) over @n bytes.
+ * The implementation is picked for the running CPU, see cpu.h.
+ *
+ * @returns @dst
+ */
+uint8_t *uf_hyperloglog_merge_registers(uint8_t *dst, const uint8_t *src, size_t n);
+
+typedef uint8_t *(*uf_hyperloglog_merge_func)(uint8_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * Return the merge kernel used on a CPU with @features. Exposed so tests
+ * and benchmarks can exercise every variant.
+ */
+uf_hyperloglog_merge_func uf_hyperloglog_merge_select(unsigned int features);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
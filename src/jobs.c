@@ -0,0 +1,355 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "probes.h"
+#include "util.h"
+
+/**
+ * Poll interval while any running child lacks a pidfd
+ */
+#define UF_JOB_FALLBACK_INTERVAL 10
+
+/**
+ * Each running job polls at most two pipes and a pidfd
+ */
+#define UF_JOB_MAX_FDS 3
+
+typedef enum {
+        UF_JOB_PENDING = 0,
+        UF_JOB_RUNNING,
+        UF_JOB_DONE,
+        UF_JOB_FAILED, /**<Could not be launched, captured or was killed */
+} UfJobState;
+
+typedef struct UfJob {
+        UfSpawnOptions options;
+        UfSpawn *spawn;
+        UfJobState state;
+        int pidfd;  /**<-1 once exited, or if unavailable */
+        int status; /**<Wait status, or errno if FAILED */
+        int error;  /**<errno from capturing output, fails the job once reaped */
+        bool reaped;
+} UfJob;
+
+struct UfJobRunner {
+        UfJob *jobs;
+        size_t n_jobs;
+        size_t max_jobs;
+        unsigned int max_parallel;
+};
+
+UfJobRunner *uf_job_runner_new(unsigned int max_parallel)
+{
+        UfJobRunner *ret = NULL;
+
+        ret = calloc(1, sizeof(struct UfJobRunner));
+        if (!ret) {
+                return NULL;
+        }
+        ret->max_parallel = max_parallel ? max_parallel : 1;
+        return ret;
+}
+
+/**
+ * Kill and reap a running job so that nothing outlives the runner
+ */
+static void uf_job_kill(UfJob *job, int error)
+{
+        pid_t pid = uf_spawn_pid(job->spawn);
+        pid_t r;
+
+        if (!job->reaped) {
+                kill(pid, SIGKILL);
+                do {
+                        r = waitpid(pid, NULL, 0);
+                } while (r < 0 && errno == EINTR);
+                job->reaped = true;
+        }
+        if (job->pidfd >= 0) {
+                close(job->pidfd);
+                job->pidfd = -1;
+        }
+        job->state = UF_JOB_FAILED;
+        job->status = error;
+}
+
+void uf_job_runner_free(UfJobRunner *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        for (size_t i = 0; i < self->n_jobs; i++) {
+                if (self->jobs[i].state == UF_JOB_RUNNING) {
+                        uf_job_kill(&self->jobs[i], ECANCELED);
+                }
+                if (self->jobs[i].pidfd >= 0) {
+                        close(self->jobs[i].pidfd);
+                }
+                uf_spawn_free(self->jobs[i].spawn);
+        }
+        free(self->jobs);
+        free(self);
+}
+
+bool uf_job_runner_add(UfJobRunner *self, const UfSpawnOptions *options, size_t *job)
+{
+        if (uf_unlikely(!self || !options)) {
+                return false;
+        }
+
+        if (self->n_jobs == self->max_jobs) {
+                size_t max = self->max_jobs ? self->max_jobs * 2 : 16;
+                UfJob *jobs = realloc(self->jobs, max * sizeof(UfJob));
+                if (!jobs) {
+                        return false;
+                }
+                self->jobs = jobs;
+                self->max_jobs = max;
+        }
+
+        self->jobs[self->n_jobs] = (UfJob){.options = *options, .pidfd = -1 };
+        if (job) {
+                *job = self->n_jobs;
+        }
+        self->n_jobs++;
+
+        return true;
+}
+
+size_t uf_job_runner_size(UfJobRunner *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return self->n_jobs;
+}
+
+/**
+ * Obtain a pidfd for exit notification. The child is still ours until
+ * reaped, so its pid cannot be recycled underneath us.
+ */
+static int uf_job_pidfd_open(pid_t pid)
+{
+#if defined(SYS_pidfd_open)
+        long fd = syscall(SYS_pidfd_open, pid, 0);
+        return fd < 0 ? -1 : (int)fd;
+#else
+        (void)pid;
+        return -1;
+#endif
+}
+
+static bool uf_job_start(UfJob *job)
+{
+        job->spawn = uf_spawn_new(&job->options);
+        if (!job->spawn) {
+                job->state = UF_JOB_FAILED;
+                job->status = errno;
+                return false;
+        }
+        job->state = UF_JOB_RUNNING;
+        job->pidfd = uf_job_pidfd_open(uf_spawn_pid(job->spawn));
+        return true;
+}
+
+/**
+ * Reap the job if it has exited
+ */
+static void uf_job_try_reap(UfJob *job)
+{
+        if (job->reaped || !uf_spawn_try_reap(job->spawn, &job->status)) {
+                return;
+        }
+        job->reaped = true;
+        if (job->pidfd >= 0) {
+                close(job->pidfd);
+                job->pidfd = -1;
+        }
+}
+
+bool uf_job_runner_run(UfJobRunner *self, uf_job_done_func done, void *userdata)
+{
+        struct pollfd *fds = NULL;
+        size_t *owners = NULL;
+        size_t next = 0;
+        size_t running = 0;
+        bool ok = true;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        fds = calloc(self->max_parallel * UF_JOB_MAX_FDS, sizeof(struct pollfd));
+        owners = calloc(self->max_parallel * UF_JOB_MAX_FDS, sizeof(size_t));
+        if (!fds || !owners) {
+                free(fds);
+                free(owners);
+                return false;
+        }
+
+        while (next < self->n_jobs || running > 0) {
+                size_t n_fds = 0;
+                int timeout = -1;
+
+                /* Top up to the concurrency limit */
+                while (running < self->max_parallel && next < self->n_jobs) {
+                        UfJob *job = &self->jobs[next];
+                        if (job->state == UF_JOB_PENDING) {
+                                if (uf_job_start(job)) {
+                                        UF_PROBE2(job_start, next, uf_spawn_pid(job->spawn));
+                                        running++;
+                                } else {
+                                        ok = false;
+                                        if (done) {
+                                                done(self, next, userdata);
+                                        }
+                                }
+                        }
+                        next++;
+                }
+
+                /* Collect everything worth waking up for */
+                for (size_t i = 0; i < next; i++) {
+                        UfJob *job = &self->jobs[i];
+                        size_t n;
+
+                        if (job->state != UF_JOB_RUNNING) {
+                                continue;
+                        }
+                        n = uf_spawn_pollfds(job->spawn, fds + n_fds);
+                        if (job->pidfd >= 0) {
+                                fds[n_fds + n++] = (struct pollfd){.fd = job->pidfd, .events = POLLIN };
+                        } else if (!job->reaped) {
+                                timeout = UF_JOB_FALLBACK_INTERVAL;
+                        }
+                        for (size_t j = 0; j < n; j++) {
+                                owners[n_fds + j] = i;
+                        }
+                        n_fds += n;
+                }
+
+                if (n_fds > 0 || timeout >= 0) {
+                        if (poll(fds, (nfds_t)n_fds, timeout) < 0 && errno != EINTR) {
+                                int error = errno;
+
+                                /* Don't leave zombies or open pidfds behind */
+                                for (size_t i = 0; i < next; i++) {
+                                        if (self->jobs[i].state != UF_JOB_RUNNING) {
+                                                continue;
+                                        }
+                                        uf_job_kill(&self->jobs[i], error);
+                                        if (done) {
+                                                done(self, i, userdata);
+                                        }
+                                }
+                                ok = false;
+                                break;
+                        }
+                }
+
+                for (size_t i = 0; i < n_fds; i++) {
+                        UfJob *job = &self->jobs[owners[i]];
+
+                        if (!fds[i].revents) {
+                                continue;
+                        }
+                        if (fds[i].fd == job->pidfd) {
+                                uf_job_try_reap(job);
+                        } else if (!uf_spawn_handle(job->spawn, &fds[i])) {
+                                /* The pipe is closed, finish once the child is reaped */
+                                job->error = errno;
+                                ok = false;
+                        }
+                }
+
+                /* A job is complete once reaped and all output is drained */
+                for (size_t i = 0; i < next; i++) {
+                        UfJob *job = &self->jobs[i];
+                        struct pollfd unused[2];
+
+                        if (job->state != UF_JOB_RUNNING) {
+                                continue;
+                        }
+                        if (job->pidfd < 0) {
+                                uf_job_try_reap(job);
+                        }
+                        if (!job->reaped || uf_spawn_pollfds(job->spawn, unused) > 0) {
+                                continue;
+                        }
+                        if (job->error) {
+                                job->state = UF_JOB_FAILED;
+                                job->status = job->error;
+                        } else {
+                                job->state = UF_JOB_DONE;
+                        }
+                        UF_PROBE2(job_done, i, job->status);
+                        running--;
+                        if (done) {
+                                done(self, i, userdata);
+                        }
+                }
+        }
+
+        free(fds);
+        free(owners);
+
+        return ok;
+}
+
+bool uf_job_runner_status(UfJobRunner *self, size_t job, int *status)
+{
+        if (uf_unlikely(!self || job >= self->n_jobs)) {
+                return false;
+        }
+        if (status) {
+                *status = self->jobs[job].status;
+        }
+        return self->jobs[job].state == UF_JOB_DONE;
+}
+
+const char *uf_job_runner_stdout(UfJobRunner *self, size_t job, size_t *len)
+{
+        if (uf_unlikely(!self || job >= self->n_jobs || !self->jobs[job].spawn)) {
+                return NULL;
+        }
+        return uf_spawn_stdout(self->jobs[job].spawn, len);
+}
+
+const char *uf_job_runner_stderr(UfJobRunner *self, size_t job, size_t *len)
+{
+        if (uf_unlikely(!self || job >= self->n_jobs || !self->jobs[job].spawn)) {
+                return NULL;
+        }
+        return uf_spawn_stderr(self->jobs[job].spawn, len);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
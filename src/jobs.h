@@ -0,0 +1,110 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "process.h"
+
+/**
+ * UfJobRunner runs a list of commands with at most N in flight at once.
+ *
+ * A single poll loop services every running child: capture pipes are
+ * drained as they fill and exits are noticed through a pidfd. On kernels
+ * without pidfd_open we fall back to a short poll timeout with
+ * non-blocking reaping. No threads are created.
+ */
+typedef struct UfJobRunner UfJobRunner;
+
+/**
+ * Called as each job completes, in completion order
+ *
+ * @param runner The runner owning the job
+ * @param job Index of the job, as returned by uf_job_runner_add
+ * @param userdata User data passed to uf_job_runner_run
+ */
+typedef void (*uf_job_done_func)(UfJobRunner *runner, size_t job, void *userdata);
+
+/**
+ * Construct a new UfJobRunner running at most @max_parallel jobs at once
+ *
+ * @note Free with uf_job_runner_free
+ *
+ * @return A newly allocated UfJobRunner
+ */
+UfJobRunner *uf_job_runner_new(unsigned int max_parallel);
+
+/**
+ * Free the runner and all job results. Any job still running is killed
+ * and reaped.
+ */
+void uf_job_runner_free(UfJobRunner *runner);
+
+/**
+ * Queue a job. The options are copied, but the strings and arrays they
+ * point to must remain valid until uf_job_runner_run returns.
+ *
+ * @param job Set to the index of the new job, if not NULL
+ *
+ * @returns True if the job was queued
+ */
+bool uf_job_runner_add(UfJobRunner *runner, const UfSpawnOptions *options, size_t *job);
+
+/**
+ * Run every queued job to completion
+ *
+ * @param done Optional completion callback
+ * @param userdata User data for @done
+ *
+ * If polling fails, every running job is killed and reaped, and reported
+ * through @done as failed, before returning.
+ *
+ * @returns True if every job was launched, captured and reaped
+ */
+bool uf_job_runner_run(UfJobRunner *runner, uf_job_done_func done, void *userdata);
+
+/**
+ * Return the number of queued jobs
+ */
+size_t uf_job_runner_size(UfJobRunner *runner);
+
+/**
+ * Retrieve the raw wait status of a completed job, see waitpid(2)
+ *
+ * @returns False if the job could not be launched, its output could not
+ * be captured, or it was killed. @status is then set to the errno of the
+ * failure.
+ */
+bool uf_job_runner_status(UfJobRunner *runner, size_t job, int *status);
+
+/**
+ * Return the captured stdout of a completed job, or NULL
+ */
+const char *uf_job_runner_stdout(UfJobRunner *runner, size_t job, size_t *len);
+
+/**
+ * Return the captured stderr of a completed job, or NULL
+ */
+const char *uf_job_runner_stderr(UfJobRunner *runner, size_t job, size_t *len);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
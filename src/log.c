@@ -0,0 +1,383 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+
+/**
+ * Number of records in the ring, must be a power of 2
+ */
+#define UF_LOG_RING_SIZE 4096
+
+/**
+ * Records per writev, each uses two iovecs (prefix and message)
+ */
+#define UF_LOG_BATCH 64
+
+/**
+ * Room for "YYYY-MM-DDTHH:MM:SS.mmmZ CRITICAL: "
+ */
+#define UF_LOG_PREFIX_SIZE 48
+
+/**
+ * Upper bound on how long the idle writer sleeps between checks
+ */
+#define UF_LOG_IDLE_NSEC 100000000L
+
+/**
+ * A slot in the ring. @seq follows the bounded MPMC queue scheme: the
+ * slot is free for position p when seq == p, and ready when seq == p + 1.
+ */
+typedef struct UfLogRecord {
+        atomic_size_t seq;
+        struct timespec ts;
+        uint16_t len;
+        uint8_t level;
+        char message[UF_LOG_MESSAGE_SIZE];
+} UfLogRecord;
+
+struct UfLog {
+        UfLogFilter filter; /**<Must be first, see uf_log_enabled */
+        int fd;
+
+        _Alignas(64) atomic_size_t enqueue_pos; /**<Shared by producers */
+        _Alignas(64) atomic_size_t written;     /**<Records consumed by the writer */
+        atomic_uint_fast64_t dropped;
+
+        /* Writer wakeup, producers only take the lock if it's asleep */
+        atomic_bool sleeping;
+        atomic_bool stopping;
+        mtx_t lock;
+        cnd_t wake;
+        thrd_t thread;
+
+        UfLogRecord ring[UF_LOG_RING_SIZE];
+};
+
+static const char *uf_log_level_names[] = {
+        [UF_LOG_DEBUG] = "DEBUG",
+        [UF_LOG_INFO] = "INFO",
+        [UF_LOG_WARNING] = "WARNING",
+        [UF_LOG_ERROR] = "ERROR",
+        [UF_LOG_CRITICAL] = "CRITICAL",
+};
+
+/**
+ * Per-thread formatting buffer, so only the memcpy happens while a ring
+ * slot is claimed
+ */
+static _Thread_local char uf_log_buffer[UF_LOG_MESSAGE_SIZE];
+
+static int uf_log_writer(void *data);
+
+UfLog *uf_log_new(int fd, UfLogLevel level)
+{
+        UfLog *ret = NULL;
+
+        ret = aligned_alloc(_Alignof(struct UfLog), sizeof(struct UfLog));
+        if (!ret) {
+                return NULL;
+        }
+        memset(ret, 0, sizeof(struct UfLog));
+
+        atomic_init(&ret->filter.level, (int)level);
+        ret->fd = fd;
+        atomic_init(&ret->enqueue_pos, 0);
+        atomic_init(&ret->written, 0);
+        atomic_init(&ret->dropped, 0);
+        atomic_init(&ret->sleeping, false);
+        atomic_init(&ret->stopping, false);
+        for (size_t i = 0; i < UF_LOG_RING_SIZE; i++) {
+                atomic_init(&ret->ring[i].seq, i);
+        }
+
+        if (mtx_init(&ret->lock, mtx_plain) != thrd_success) {
+                goto fail_lock;
+        }
+        if (cnd_init(&ret->wake) != thrd_success) {
+                goto fail_cnd;
+        }
+        if (thrd_create(&ret->thread, uf_log_writer, ret) != thrd_success) {
+                goto fail_thread;
+        }
+
+        return ret;
+
+fail_thread:
+        cnd_destroy(&ret->wake);
+fail_cnd:
+        mtx_destroy(&ret->lock);
+fail_lock:
+        free(ret);
+        return NULL;
+}
+
+static void uf_log_wake(UfLog *self)
+{
+        mtx_lock(&self->lock);
+        cnd_signal(&self->wake);
+        mtx_unlock(&self->lock);
+}
+
+void uf_log_free(UfLog *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        atomic_store(&self->stopping, true);
+        uf_log_wake(self);
+        thrd_join(self->thread, NULL);
+
+        cnd_destroy(&self->wake);
+        mtx_destroy(&self->lock);
+        free(self);
+}
+
+void uf_log_set_level(UfLog *self, UfLogLevel level)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        atomic_store_explicit(&self->filter.level, (int)level, memory_order_relaxed);
+}
+
+uint64_t uf_log_dropped(UfLog *self)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return atomic_load(&self->dropped);
+}
+
+void uf_log_write(UfLog *self, UfLogLevel level, const char *fmt, ...)
+{
+        UfLogRecord *record = NULL;
+        struct timespec ts;
+        va_list ap;
+        size_t pos;
+        size_t len;
+        int n;
+
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        /* Leave room for the newline */
+        va_start(ap, fmt);
+        n = vsnprintf(uf_log_buffer, sizeof(uf_log_buffer) - 1, fmt, ap);
+        va_end(ap);
+        if (uf_unlikely(n < 0)) {
+                return;
+        }
+        len = (size_t)n < sizeof(uf_log_buffer) - 2 ? (size_t)n : sizeof(uf_log_buffer) - 2;
+        uf_log_buffer[len++] = '\n';
+
+        /* Claim a slot */
+        pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+        for (;;) {
+                size_t seq;
+
+                record = &self->ring[pos & (UF_LOG_RING_SIZE - 1)];
+                seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+                if (seq == pos) {
+                        if (atomic_compare_exchange_weak_explicit(&self->enqueue_pos,
+                                                                  &pos,
+                                                                  pos + 1,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed)) {
+                                break;
+                        }
+                } else if ((intptr_t)(seq - pos) < 0) {
+                        /* Writer is a full lap behind */
+                        atomic_fetch_add_explicit(&self->dropped, 1, memory_order_relaxed);
+                        return;
+                } else {
+                        pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+                }
+        }
+
+        record->ts = ts;
+        record->len = (uint16_t)len;
+        record->level = (uint8_t)level;
+        memcpy(record->message, uf_log_buffer, len);
+        atomic_store_explicit(&record->seq, pos + 1, memory_order_release);
+
+        if (atomic_load(&self->sleeping)) {
+                uf_log_wake(self);
+        }
+}
+
+void uf_log_flush(UfLog *self)
+{
+        size_t target;
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = 1000000L };
+
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        target = atomic_load(&self->enqueue_pos);
+        while (atomic_load(&self->written) < target) {
+                uf_log_wake(self);
+                thrd_sleep(&pause, NULL);
+        }
+}
+
+/**
+ * writev every iovec, coping with short writes
+ */
+static void uf_log_writev_all(int fd, struct iovec *iov, int n_iov)
+{
+        while (n_iov > 0) {
+                ssize_t r = writev(fd, iov, n_iov);
+                size_t done;
+
+                if (r < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        /* Nowhere left to report this */
+                        return;
+                }
+                done = (size_t)r;
+                while (n_iov > 0 && done >= iov->iov_len) {
+                        done -= iov->iov_len;
+                        iov++;
+                        n_iov--;
+                }
+                if (n_iov > 0) {
+                        iov->iov_base = (char *)iov->iov_base + done;
+                        iov->iov_len -= done;
+                }
+        }
+}
+
+static size_t uf_log_format_prefix(char *prefix, const UfLogRecord *record)
+{
+        struct tm tm;
+        size_t len;
+        int n;
+
+        gmtime_r(&record->ts.tv_sec, &tm);
+        len = strftime(prefix, UF_LOG_PREFIX_SIZE, "%Y-%m-%dT%H:%M:%S", &tm);
+        n = snprintf(prefix + len,
+                     UF_LOG_PREFIX_SIZE - len,
+                     ".%03ldZ %s: ",
+                     record->ts.tv_nsec / 1000000L,
+                     record->level <= UF_LOG_CRITICAL ? uf_log_level_names[record->level] : "?");
+        if (n < 0) {
+                return len;
+        }
+        len += (size_t)n;
+        return len < UF_LOG_PREFIX_SIZE ? len : UF_LOG_PREFIX_SIZE - 1;
+}
+
+/**
+ * Write out a batch of ready records
+ *
+ * @returns The number of records written
+ */
+static size_t uf_log_drain(UfLog *self, size_t *pos)
+{
+        struct iovec iov[UF_LOG_BATCH * 2];
+        char prefixes[UF_LOG_BATCH][UF_LOG_PREFIX_SIZE];
+        size_t n = 0;
+
+        while (n < UF_LOG_BATCH) {
+                UfLogRecord *record = &self->ring[(*pos + n) & (UF_LOG_RING_SIZE - 1)];
+                if (atomic_load_explicit(&record->seq, memory_order_acquire) != *pos + n + 1) {
+                        break;
+                }
+                iov[n * 2].iov_base = prefixes[n];
+                iov[n * 2].iov_len = uf_log_format_prefix(prefixes[n], record);
+                iov[n * 2 + 1].iov_base = record->message;
+                iov[n * 2 + 1].iov_len = record->len;
+                n++;
+        }
+        if (!n) {
+                return 0;
+        }
+
+        uf_log_writev_all(self->fd, iov, (int)(n * 2));
+
+        /* Hand the slots back for the next lap */
+        for (size_t i = 0; i < n; i++) {
+                UfLogRecord *record = &self->ring[(*pos + i) & (UF_LOG_RING_SIZE - 1)];
+                atomic_store_explicit(&record->seq, *pos + i + UF_LOG_RING_SIZE, memory_order_release);
+        }
+        *pos += n;
+        atomic_store(&self->written, *pos);
+
+        return n;
+}
+
+static int uf_log_writer(void *data)
+{
+        UfLog *self = data;
+        size_t pos = 0;
+
+        for (;;) {
+                bool stopping = atomic_load(&self->stopping);
+
+                if (uf_log_drain(self, &pos) > 0) {
+                        continue;
+                }
+                if (stopping) {
+                        break;
+                }
+
+                /* Announce we're going to sleep, then re-check before waiting
+                 * so that a producer can't slip in between unnoticed */
+                mtx_lock(&self->lock);
+                atomic_store(&self->sleeping, true);
+                if (atomic_load(&self->enqueue_pos) == pos && !atomic_load(&self->stopping)) {
+                        struct timespec deadline;
+                        timespec_get(&deadline, TIME_UTC);
+                        deadline.tv_nsec += UF_LOG_IDLE_NSEC;
+                        if (deadline.tv_nsec >= 1000000000L) {
+                                deadline.tv_sec++;
+                                deadline.tv_nsec -= 1000000000L;
+                        }
+                        cnd_timedwait(&self->wake, &self->lock, &deadline);
+                }
+                atomic_store(&self->sleeping, false);
+                mtx_unlock(&self->lock);
+        }
+
+        return 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
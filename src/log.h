@@ -0,0 +1,128 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * UfLog is an asynchronous logger for hot paths.
+ *
+ * The calling thread formats into a thread local buffer, and pushes a fixed
+ * size record through a lock-free ring. A background thread batches ready
+ * records into writev calls. Callers never block: when the ring is full
+ * the record is dropped and counted.
+ *
+ * Use the uf_log_* macros so that disabled levels cost a single branch and
+ * never evaluate their arguments.
+ */
+typedef struct UfLog UfLog;
+
+/**
+ * Log severities, in increasing order
+ */
+typedef enum {
+        UF_LOG_DEBUG = 0,
+        UF_LOG_INFO,
+        UF_LOG_WARNING,
+        UF_LOG_ERROR,
+        UF_LOG_CRITICAL,
+} UfLogLevel;
+
+/**
+ * Leading member of every UfLog, public only so the level check can be
+ * inlined. Do not access directly.
+ */
+typedef struct UfLogFilter {
+        atomic_int level;
+} UfLogFilter;
+
+/**
+ * Messages longer than this are truncated
+ */
+#define UF_LOG_MESSAGE_SIZE 224
+
+/**
+ * Construct a new UfLog writing to @fd, and start its writer thread
+ *
+ * @param fd Destination descriptor, not owned by the log
+ * @param level Minimum level to record
+ *
+ * @note Free with uf_log_free
+ *
+ * @return A newly allocated UfLog
+ */
+UfLog *uf_log_new(int fd, UfLogLevel level);
+
+/**
+ * Write out all pending records, stop the writer thread and free the log
+ */
+void uf_log_free(UfLog *log);
+
+/**
+ * Change the minimum recorded level. Safe to call from any thread.
+ */
+void uf_log_set_level(UfLog *log, UfLogLevel level);
+
+/**
+ * Test whether @level is currently recorded
+ */
+static inline bool uf_log_enabled(UfLog *log, UfLogLevel level)
+{
+        return (int)level >= atomic_load_explicit(&((UfLogFilter *)log)->level,
+                                                  memory_order_relaxed);
+}
+
+/**
+ * Record a message without checking the level, see uf_log
+ */
+void uf_log_write(UfLog *log, UfLogLevel level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Block until every record logged before this call has been written
+ */
+void uf_log_flush(UfLog *log);
+
+/**
+ * Return the number of records dropped because the ring was full
+ */
+uint64_t uf_log_dropped(UfLog *log);
+
+/**
+ * Log a printf style message at @level, if enabled
+ */
+#define uf_log(log, level, ...)                                                                     \
+        do {                                                                                        \
+                if (uf_log_enabled((log), (level))) {                                               \
+                        uf_log_write((log), (level), __VA_ARGS__);                                  \
+                }                                                                                   \
+        } while (0)
+
+#define uf_log_debug(log, ...) uf_log((log), UF_LOG_DEBUG, __VA_ARGS__)
+#define uf_log_info(log, ...) uf_log((log), UF_LOG_INFO, __VA_ARGS__)
+#define uf_log_warning(log, ...) uf_log((log), UF_LOG_WARNING, __VA_ARGS__)
+#define uf_log_error(log, ...) uf_log((log), UF_LOG_ERROR, __VA_ARGS__)
+#define uf_log_critical(log, ...) uf_log((log), UF_LOG_CRITICAL, __VA_ARGS__)
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
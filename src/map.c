@@ -10,17 +10,28 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "dispatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if UF_CPU_X86
+#include <immintrin.h>
+#endif
+
 #include "map.h"
+#include "probes.h"
 #include "util.h"
 
 typedef struct UfHashmapNode UfHashmapNode;
 
 /**
- * Initial size of 256 items. Slight overcommit but prevents too much future
- * growth as our growth ratio and algorithm is ^2 based.
+ * Promoting a small map gives it 256 buckets. Slight overcommit but prevents
+ * too much future growth as our growth ratio and algorithm is ^2 based.
  */
 #define UF_HASH_INITIAL_SIZE 256
 
@@ -35,6 +46,17 @@ typedef struct UfHashmapNode UfHashmapNode;
  */
 #define UF_HASH_GROWTH 4
 
+/**
+ * Maps hold up to this many entries in a flat array within the UfHashmap
+ * itself, and only allocate buckets once they outgrow it.
+ */
+#define UF_HASH_SMALL_SIZE 8
+
+/**
+ * Lookups walking more nodes than this fire the hashmap_slow_chain probe
+ */
+#define UF_HASH_SLOW_CHAIN 4
+
 /**
  * Construct a new internal hashmap from the given hashmap and copy
  * all the relevant components.
@@ -43,6 +65,16 @@ static void uf_hashmap_from(UfHashmap *map, UfHashmap *target);
 static bool uf_hashmap_resize(UfHashmap *self);
 static bool uf_hashmap_insert_map(UfHashmap *self, const uint32_t hash, void *key, void *value);
 static UfHashmapNode *uf_hashmap_get_node(UfHashmap *self, void *key);
+static bool uf_hashmap_rehash(UfHashmap *self, unsigned int max);
+
+/**
+ * Entry in the small map array
+ */
+typedef struct UfHashmapEntry {
+        void *key;
+        void *value;
+        uint32_t hash;
+} UfHashmapEntry;
 
 /**
  * Opaque UfHashmap implementation, simply an organised header for the
@@ -64,8 +96,18 @@ struct UfHashmap {
                 uf_hashmap_free_func key;   /**<Key free function */
                 uf_hashmap_free_func value; /**<Value free function */
         } free;
+        const UfAllocator *allocator; /**<Source of collision nodes */
+        UfHashmapEntry small[UF_HASH_SMALL_SIZE]; /**<Entries until buckets.blob exists */
 };
 
+/**
+ * Small maps have no buckets, and keep buckets.current entries in small[]
+ */
+static inline bool uf_hashmap_is_small(UfHashmap *self)
+{
+        return self->buckets.blob == NULL;
+}
+
 /**
  * A UfHashmapNode is simply a single bucket within a UfHashmap and can have
  * a key/value. This is a chained mechanism.
@@ -84,6 +126,18 @@ UfHashmap *uf_hashmap_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compa
 
 UfHashmap *uf_hashmap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
                                uf_hashmap_free_func key_free, uf_hashmap_free_func value_free)
+{
+        return uf_hashmap_new_with_allocator(hash,
+                                             compare,
+                                             key_free,
+                                             value_free,
+                                             &uf_allocator_malloc);
+}
+
+UfHashmap *uf_hashmap_new_with_allocator(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                         uf_hashmap_free_func key_free,
+                                         uf_hashmap_free_func value_free,
+                                         const UfAllocator *allocator)
 {
         UfHashmap *ret = NULL;
 
@@ -92,16 +146,15 @@ UfHashmap *uf_hashmap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func
                 .key.compare = compare,
                 .free.key = key_free,
                 .free.value = value_free,
+                .allocator = allocator,
                 .buckets.blob = NULL,
                 .buckets.current = 0,
-                .buckets.max = UF_HASH_INITIAL_SIZE,
-                .buckets.mask = UF_HASH_INITIAL_SIZE - 1,
-                .buckets.next_resize = (int)(((double)UF_HASH_INITIAL_SIZE) * UF_HASH_FILL_RATE),
         };
 
         /* Some things we actually do need, sorry programmer. */
         assert(clone.key.hash);
         assert(clone.key.compare);
+        assert(clone.allocator);
 
         ret = calloc(1, sizeof(struct UfHashmap));
         if (!ret) {
@@ -109,25 +162,25 @@ UfHashmap *uf_hashmap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func
         }
         *ret = clone;
 
-        ret->buckets.blob = calloc((size_t)clone.buckets.max, sizeof(struct UfHashmapNode));
-        if (!ret->buckets.blob) {
-                uf_hashmap_free(ret);
-                return NULL;
-        }
-
+        /* Buckets are only allocated once we outgrow the small array */
         return ret;
 }
 
-static inline void bucket_free_one(UfHashmap *self, UfHashmapNode *node)
+static inline void entry_free(UfHashmap *self, void *key, void *value)
 {
         if (self->free.key) {
-                self->free.key(node->key);
+                self->free.key(key);
         }
         if (self->free.value) {
-                self->free.value(node->value);
+                self->free.value(value);
         }
 }
 
+static inline void bucket_free_one(UfHashmap *self, UfHashmapNode *node)
+{
+        entry_free(self, node->key, node->value);
+}
+
 static inline void bucket_free(UfHashmap *self, UfHashmapNode *node, bool free_values)
 {
         if (!node) {
@@ -137,11 +190,18 @@ static inline void bucket_free(UfHashmap *self, UfHashmapNode *node, bool free_v
         if (free_values) {
                 bucket_free_one(self, node);
         }
-        free(node);
+        uf_allocator_free(self->allocator, node, sizeof(UfHashmapNode));
 }
 
 static void uf_hashmap_free_internal(UfHashmap *self, bool free_blobs)
 {
+        if (uf_hashmap_is_small(self)) {
+                for (unsigned int i = 0; free_blobs && i < self->buckets.current; i++) {
+                        entry_free(self, self->small[i].key, self->small[i].value);
+                }
+                return;
+        }
+
         for (size_t i = 0; i < self->buckets.max; i++) {
                 UfHashmapNode *node = &self->buckets.blob[i];
                 if (free_blobs) {
@@ -175,6 +235,14 @@ uint32_t uf_hashmap_simple_hash(const void *v)
         return UF_PTR_TO_INT(v) + 1;
 }
 
+int uf_hashmap_simple_compare(const void *a, const void *b)
+{
+        uintptr_t x = (uintptr_t)a;
+        uintptr_t y = (uintptr_t)b;
+
+        return (x > y) - (x < y);
+}
+
 bool uf_hashmap_string_equal(const void *a, const void *b)
 {
         if (!a || !b) {
@@ -183,6 +251,11 @@ bool uf_hashmap_string_equal(const void *a, const void *b)
         return strcmp((const char *)a, (const char *)b) == 0;
 }
 
+int uf_hashmap_string_compare(const void *a, const void *b)
+{
+        return strcmp((const char *)a, (const char *)b);
+}
+
 /**
  * Currently this is just a version of the well known DJB hash so that
  * I can do some direct fair comparisons with the old libnica hashmap
@@ -202,6 +275,264 @@ uint32_t uf_hashmap_string_hash(const void *v)
         return (uint32_t)hash;
 }
 
+/**
+ * Case-insensitive keys are hashed a word at a time after folding, and
+ * every kernel feeds the same words in the same order: whole 8 byte
+ * words of the key, then the zero padded tail. Only the folding differs.
+ */
+static inline uint64_t uf_case_hash_word(uint64_t hash, uint64_t word)
+{
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        return hash ^ (hash >> 32);
+}
+
+static inline uint32_t uf_case_hash_finish(uint64_t hash)
+{
+        hash ^= hash >> 33;
+        hash *= 0xC4CEB9FE1A85EC53ULL;
+        hash ^= hash >> 33;
+        return (uint32_t)hash;
+}
+
+/**
+ * ASCII lowercase of 8 bytes at once: each byte in A-Z gains 0x20. Bytes
+ * are masked to 7 bits first, so no addition carries into its neighbour.
+ */
+static inline uint64_t uf_case_fold64(uint64_t word)
+{
+        uint64_t low = word & 0x7F7F7F7F7F7F7F7FULL;
+        uint64_t from_a = low + 0x3F3F3F3F3F3F3F3FULL;  /* High bit set if >= 'A' */
+        uint64_t after_z = low + 0x2525252525252525ULL; /* High bit set if > 'Z' */
+
+        return word | ((from_a & ~after_z & ~word & 0x8080808080808080ULL) >> 2);
+}
+
+static inline unsigned char uf_case_fold8(unsigned char c)
+{
+        return c >= 'A' && c <= 'Z' ? (unsigned char)(c | 0x20) : c;
+}
+
+/**
+ * Hash the last @n bytes, fewer than 32, as zero padded words
+ */
+static inline uint64_t uf_case_hash_tail(uint64_t hash, const char *s, size_t n)
+{
+        uint64_t words[4] = { 0 };
+
+        memcpy(words, s, n);
+        for (size_t i = 0; i < (n + 7) / 8; i++) {
+                hash = uf_case_hash_word(hash, uf_case_fold64(words[i]));
+        }
+        return hash;
+}
+
+static inline bool uf_case_equal_tail(const char *a, const char *b, size_t n)
+{
+        for (size_t i = 0; i < n; i++) {
+                if (uf_case_fold8((unsigned char)a[i]) != uf_case_fold8((unsigned char)b[i])) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+#if !defined(__SSE2__)
+static uint32_t uf_case_hash_scalar(const void *v)
+{
+        const char *s = v;
+        size_t len = strlen(s);
+        uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+        size_t i = 0;
+
+        for (; i + 8 <= len; i += 8) {
+                uint64_t word;
+                memcpy(&word, s + i, sizeof(word));
+                hash = uf_case_hash_word(hash, uf_case_fold64(word));
+        }
+        return uf_case_hash_finish(uf_case_hash_tail(hash, s + i, len - i));
+}
+
+static bool uf_case_equal_scalar(const void *va, const void *vb)
+{
+        const char *a = va;
+        const char *b = vb;
+        size_t len;
+        size_t i = 0;
+
+        if (!a || !b) {
+                return false;
+        }
+        len = strlen(a);
+        if (len != strlen(b)) {
+                return false;
+        }
+
+        for (; i + 8 <= len; i += 8) {
+                uint64_t x;
+                uint64_t y;
+                memcpy(&x, a + i, sizeof(x));
+                memcpy(&y, b + i, sizeof(y));
+                if (uf_case_fold64(x) != uf_case_fold64(y)) {
+                        return false;
+                }
+        }
+        return uf_case_equal_tail(a + i, b + i, len - i);
+}
+#endif
+
+#if defined(__SSE2__)
+/**
+ * Signed compares leave bytes >= 0x80 alone, as they read as negative
+ */
+static inline __m128i uf_case_fold_sse2(__m128i x)
+{
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+
+        return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+static uint32_t uf_case_hash_sse2(const void *v)
+{
+        const char *s = v;
+        size_t len = strlen(s);
+        uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16) {
+                uint64_t words[2];
+                __m128i x = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+                _mm_storeu_si128((__m128i *)(void *)words, uf_case_fold_sse2(x));
+                hash = uf_case_hash_word(hash, words[0]);
+                hash = uf_case_hash_word(hash, words[1]);
+        }
+        return uf_case_hash_finish(uf_case_hash_tail(hash, s + i, len - i));
+}
+
+static bool uf_case_equal_sse2(const void *va, const void *vb)
+{
+        const char *a = va;
+        const char *b = vb;
+        size_t len;
+        size_t i = 0;
+
+        if (!a || !b) {
+                return false;
+        }
+        len = strlen(a);
+        if (len != strlen(b)) {
+                return false;
+        }
+
+        for (; i + 16 <= len; i += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i *)(const void *)(a + i));
+                __m128i y = _mm_loadu_si128((const __m128i *)(const void *)(b + i));
+                __m128i eq = _mm_cmpeq_epi8(uf_case_fold_sse2(x), uf_case_fold_sse2(y));
+                if (_mm_movemask_epi8(eq) != 0xFFFF) {
+                        return false;
+                }
+        }
+        return uf_case_equal_tail(a + i, b + i, len - i);
+}
+#endif
+
+#if UF_CPU_X86
+__attribute__((target("avx2"))) static inline __m256i uf_case_fold_avx2(__m256i x)
+{
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8('A' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), x));
+
+        return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2"))) static uint32_t uf_case_hash_avx2(const void *v)
+{
+        const char *s = v;
+        size_t len = strlen(s);
+        uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32) {
+                uint64_t words[4];
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)(s + i));
+                _mm256_storeu_si256((__m256i *)(void *)words, uf_case_fold_avx2(x));
+                for (size_t w = 0; w < 4; w++) {
+                        hash = uf_case_hash_word(hash, words[w]);
+                }
+        }
+        return uf_case_hash_finish(uf_case_hash_tail(hash, s + i, len - i));
+}
+
+__attribute__((target("avx2"))) static bool uf_case_equal_avx2(const void *va, const void *vb)
+{
+        const char *a = va;
+        const char *b = vb;
+        size_t len;
+        size_t i = 0;
+
+        if (!a || !b) {
+                return false;
+        }
+        len = strlen(a);
+        if (len != strlen(b)) {
+                return false;
+        }
+
+        for (; i + 32 <= len; i += 32) {
+                __m256i x = _mm256_loadu_si256((const __m256i *)(const void *)(a + i));
+                __m256i y = _mm256_loadu_si256((const __m256i *)(const void *)(b + i));
+                __m256i eq = _mm256_cmpeq_epi8(uf_case_fold_avx2(x), uf_case_fold_avx2(y));
+                if ((uint32_t)_mm256_movemask_epi8(eq) != 0xFFFFFFFFU) {
+                        return false;
+                }
+        }
+        return uf_case_equal_tail(a + i, b + i, len - i);
+}
+#endif
+
+static uf_hashmap_hash_func uf_case_hash_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_case_hash_avx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_case_hash_sse2;
+#else
+        return uf_case_hash_scalar;
+#endif
+}
+
+static uf_hashmap_equal_func uf_case_equal_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_case_equal_avx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_case_equal_sse2;
+#else
+        return uf_case_equal_scalar;
+#endif
+}
+
+uf_hashmap_hash_func uf_hashmap_string_case_hash_select(unsigned int features)
+{
+        return uf_case_hash_choose(features);
+}
+
+uf_hashmap_equal_func uf_hashmap_string_case_equal_select(unsigned int features)
+{
+        return uf_case_equal_choose(features);
+}
+
+UF_CPU_DISPATCH(uint32_t, uf_hashmap_string_case_hash, (const void *v), (v), uf_case_hash_choose)
+
+UF_CPU_DISPATCH(bool, uf_hashmap_string_case_equal, (const void *a, const void *b), (a, b),
+                uf_case_equal_choose)
+
 /**
  * Find the base bucket to work from
  */
@@ -249,7 +580,8 @@ static bool uf_hashmap_insert_map(UfHashmap *self, const uint32_t hash, void *ke
         }
 
         /* Construct a new input node */
-        candidate = calloc(1, sizeof(UfHashmapNode));
+        UF_PROBE2(hashmap_collision_alloc, self, hash);
+        candidate = uf_allocator_alloc(self->allocator, sizeof(UfHashmapNode));
         if (!candidate) {
                 return false;
         }
@@ -265,6 +597,45 @@ static bool uf_hashmap_insert_map(UfHashmap *self, const uint32_t hash, void *ke
         return true;
 }
 
+/**
+ * Find the index of @key in the small array, comparing the stored hash
+ * first to avoid calling out to key.compare
+ */
+static inline int uf_hashmap_small_find(UfHashmap *self, const uint32_t hash, void *key)
+{
+        for (unsigned int i = 0; i < self->buckets.current; i++) {
+                if (self->small[i].hash == hash && self->key.compare(self->small[i].key, key)) {
+                        return (int)i;
+                }
+        }
+        return -1;
+}
+
+/**
+ * Insert into the small array, promoting to a hashed table once full
+ */
+static bool uf_hashmap_small_put(UfHashmap *self, const uint32_t hash, void *key, void *value)
+{
+        int i = uf_hashmap_small_find(self, hash, key);
+
+        if (i >= 0) {
+                entry_free(self, self->small[i].key, self->small[i].value);
+                self->small[i] = (UfHashmapEntry){ .key = key, .value = value, .hash = hash };
+                return true;
+        }
+
+        if (self->buckets.current < UF_HASH_SMALL_SIZE) {
+                self->small[self->buckets.current++] =
+                    (UfHashmapEntry){ .key = key, .value = value, .hash = hash };
+                return true;
+        }
+
+        if (!uf_hashmap_rehash(self, UF_HASH_INITIAL_SIZE)) {
+                return false;
+        }
+        return uf_hashmap_insert_map(self, hash, key, value);
+}
+
 bool uf_hashmap_put(UfHashmap *self, void *key, void *value)
 {
         uint32_t hash;
@@ -273,6 +644,14 @@ bool uf_hashmap_put(UfHashmap *self, void *key, void *value)
                 return false;
         }
 
+        if (uf_hashmap_is_small(self)) {
+                hash = self->key.hash(key);
+                if (uf_unlikely(!key && !value)) {
+                        return true;
+                }
+                return uf_hashmap_small_put(self, hash, key, value);
+        }
+
         /* Check if we need a resize before the insert */
         if (!uf_hashmap_resize(self)) {
                 return false;
@@ -294,18 +673,25 @@ bool uf_hashmap_put(UfHashmap *self, void *key, void *value)
 static UfHashmapNode *uf_hashmap_get_node(UfHashmap *self, void *key)
 {
         UfHashmapNode *bucket = NULL;
+        UfHashmapNode *ret = NULL;
         uint32_t hash;
+        unsigned int depth = 0;
 
         hash = self->key.hash(key);
         bucket = uf_hashmap_initial_bucket(self, hash);
 
         for (UfHashmapNode *node = bucket; node; node = node->next) {
+                ++depth;
                 if (node->hash != 0 && self->key.compare(node->key, key)) {
-                        return node;
+                        ret = node;
+                        break;
                 }
         }
 
-        return NULL;
+        if (uf_unlikely(depth > UF_HASH_SLOW_CHAIN)) {
+                UF_PROBE2(hashmap_slow_chain, self, depth);
+        }
+        return ret;
 }
 
 void *uf_hashmap_get(UfHashmap *self, void *key)
@@ -316,6 +702,11 @@ void *uf_hashmap_get(UfHashmap *self, void *key)
                 return NULL;
         }
 
+        if (uf_hashmap_is_small(self)) {
+                int i = uf_hashmap_small_find(self, self->key.hash(key), key);
+                return i >= 0 ? self->small[i].value : NULL;
+        }
+
         node = uf_hashmap_get_node(self, key);
         if (uf_unlikely(!node)) {
                 return NULL;
@@ -330,30 +721,34 @@ static void uf_hashmap_from(UfHashmap *source, UfHashmap *target)
 }
 
 /**
- * Check if our current count is at the resize count, and start our
- * resize if at all possible.
+ * Move every entry into a fresh blob of @max buckets, preserving the
+ * stored hashes so nothing needs rehashing.
  */
-static bool uf_hashmap_resize(UfHashmap *self)
+static bool uf_hashmap_rehash(UfHashmap *self, unsigned int max)
 {
         UfHashmap target = { 0 };
 
-        /* Continue unimpeded */
-        if (uf_likely(self->buckets.next_resize != self->buckets.current)) {
-                return true;
-        }
+        UF_PROBE2(hashmap_resize_start, self, self->buckets.max);
 
         /* Set up the target from the source and bind up new blobs.. */
         uf_hashmap_from(self, &target);
-        target.buckets.max = UF_HASH_GROWTH * self->buckets.max;
+        target.buckets.max = max;
         target.buckets.mask = target.buckets.max - 1;
         target.buckets.next_resize =
             (unsigned int)(((double)target.buckets.max) * UF_HASH_FILL_RATE),
         target.buckets.blob = calloc(target.buckets.max, sizeof(struct UfHashmapNode));
         if (uf_unlikely(!target.buckets.blob)) {
+                UF_PROBE2(hashmap_resize_end, self, 0);
                 return false;
         }
 
         /* Start moving everything across and preserve the hash (no need to rehash) */
+        for (unsigned int i = 0; uf_hashmap_is_small(self) && i < self->buckets.current; i++) {
+                UfHashmapEntry *entry = &self->small[i];
+                if (!uf_hashmap_insert_map(&target, entry->hash, entry->key, entry->value)) {
+                        goto failed;
+                }
+        }
         for (unsigned int i = 0; i < self->buckets.max; i++) {
                 for (UfHashmapNode *node = &self->buckets.blob[i]; node; node = node->next) {
                         uint32_t hash = node->hash;
@@ -371,13 +766,207 @@ static bool uf_hashmap_resize(UfHashmap *self)
         /* Woot, we won */
         uf_hashmap_free_internal(self, false);
         *self = target;
+        UF_PROBE2(hashmap_resize_end, self, self->buckets.max);
 
         return true;
 failed:
         uf_hashmap_free_internal(&target, false);
+        UF_PROBE2(hashmap_resize_end, self, 0);
         return false;
 }
 
+/**
+ * Check if our current count is at the resize count, and start our
+ * resize if at all possible.
+ */
+static bool uf_hashmap_resize(UfHashmap *self)
+{
+        /* Continue unimpeded */
+        if (uf_likely(self->buckets.next_resize != self->buckets.current)) {
+                return true;
+        }
+
+        return uf_hashmap_rehash(self, UF_HASH_GROWTH * self->buckets.max);
+}
+
+bool uf_hashmap_reserve(UfHashmap *self, size_t n_items)
+{
+        unsigned int max;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        if (uf_hashmap_is_small(self) && n_items <= UF_HASH_SMALL_SIZE) {
+                return true;
+        }
+
+        /* Grow in powers of two until n_items stays below the fill rate */
+        max = uf_hashmap_is_small(self) ? UF_HASH_INITIAL_SIZE : self->buckets.max;
+        while ((double)n_items >= ((double)max) * UF_HASH_FILL_RATE) {
+                if (uf_unlikely(max > UINT_MAX / 2)) {
+                        return false;
+                }
+                max *= 2;
+        }
+
+        if (max == self->buckets.max) {
+                return true;
+        }
+
+        return uf_hashmap_rehash(self, max);
+}
+
+/**
+ * Duplicate one entry of @self into @key/@value of @copy, leaving NULL
+ * pointers alone. A key duplicated before the value fails is released
+ * again, so nothing is left half-copied.
+ */
+static bool uf_hashmap_copy_entry(UfHashmap *copy, void *key, void *value, void **key_out,
+                                  void **value_out, uf_hashmap_dup_func key_dup,
+                                  uf_hashmap_dup_func value_dup)
+{
+        void *new_key = key;
+        void *new_value = value;
+
+        if (key_dup && key) {
+                new_key = key_dup(key);
+                if (uf_unlikely(!new_key)) {
+                        return false;
+                }
+        }
+        if (value_dup && value) {
+                new_value = value_dup(value);
+                if (uf_unlikely(!new_value)) {
+                        if (key_dup && key && copy->free.key) {
+                                copy->free.key(new_key);
+                        }
+                        return false;
+                }
+        }
+
+        *key_out = new_key;
+        *value_out = new_value;
+        return true;
+}
+
+UfHashmap *uf_hashmap_copy(UfHashmap *self, uf_hashmap_dup_func key_dup,
+                           uf_hashmap_dup_func value_dup)
+{
+        UfHashmap *ret = NULL;
+        bool dup = key_dup || value_dup;
+        unsigned int i = 0;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        /* The copy keeps our free functions, so it must own whatever they free */
+        if (uf_unlikely(!key_dup != !self->free.key || !value_dup != !self->free.value)) {
+                return NULL;
+        }
+
+        ret = malloc(sizeof(struct UfHashmap));
+        if (uf_unlikely(!ret)) {
+                return NULL;
+        }
+        *ret = *self;
+
+        /* small[] came across with the struct, only duplicates remain */
+        if (uf_hashmap_is_small(self)) {
+                ret->buckets.current = 0;
+                for (i = 0; i < self->buckets.current; i++) {
+                        UfHashmapEntry *from = &self->small[i];
+                        UfHashmapEntry *to = &ret->small[i];
+                        if (dup && !uf_hashmap_copy_entry(ret,
+                                                          from->key,
+                                                          from->value,
+                                                          &to->key,
+                                                          &to->value,
+                                                          key_dup,
+                                                          value_dup)) {
+                                goto failed;
+                        }
+                        ret->buckets.current++;
+                }
+                return ret;
+        }
+
+        /* Same size and stored hashes, so every entry keeps its bucket */
+        ret->buckets.blob = malloc(self->buckets.max * sizeof(struct UfHashmapNode));
+        if (uf_unlikely(!ret->buckets.blob)) {
+                free(ret);
+                return NULL;
+        }
+        if (dup) {
+                memset(ret->buckets.blob, 0, self->buckets.max * sizeof(struct UfHashmapNode));
+        } else {
+                memcpy(ret->buckets.blob,
+                       self->buckets.blob,
+                       self->buckets.max * sizeof(struct UfHashmapNode));
+        }
+
+        for (i = 0; i < self->buckets.max; i++) {
+                UfHashmapNode *from = &self->buckets.blob[i];
+                UfHashmapNode *tail = &ret->buckets.blob[i];
+
+                tail->next = NULL;
+                if (dup && from->hash != 0) {
+                        if (!uf_hashmap_copy_entry(ret,
+                                                   from->key,
+                                                   from->value,
+                                                   &tail->key,
+                                                   &tail->value,
+                                                   key_dup,
+                                                   value_dup)) {
+                                goto failed;
+                        }
+                        tail->hash = from->hash;
+                }
+
+                /* Chains are rebuilt in order, dropping removed nodes */
+                for (UfHashmapNode *node = from->next; node; node = node->next) {
+                        UfHashmapNode *clone = NULL;
+
+                        if (node->hash == 0) {
+                                continue;
+                        }
+                        clone = uf_allocator_alloc(ret->allocator, sizeof(UfHashmapNode));
+                        if (uf_unlikely(!clone)) {
+                                goto failed;
+                        }
+                        *clone = (UfHashmapNode){ .key = node->key,
+                                                  .value = node->value,
+                                                  .hash = node->hash };
+                        if (dup && !uf_hashmap_copy_entry(ret,
+                                                          node->key,
+                                                          node->value,
+                                                          &clone->key,
+                                                          &clone->value,
+                                                          key_dup,
+                                                          value_dup)) {
+                                uf_allocator_free(ret->allocator, clone, sizeof(UfHashmapNode));
+                                goto failed;
+                        }
+                        tail->next = clone;
+                        tail = clone;
+                }
+        }
+
+        return ret;
+
+failed:
+        /* Later buckets may still point into the source chains */
+        if (!uf_hashmap_is_small(ret)) {
+                for (unsigned int j = i + 1; j < ret->buckets.max; j++) {
+                        ret->buckets.blob[j].next = NULL;
+                }
+        }
+        uf_hashmap_free_internal(ret, dup);
+        free(ret);
+        return NULL;
+}
+
 bool uf_hashmap_remove(UfHashmap *self, void *key)
 {
         UfHashmapNode *node = NULL;
@@ -386,6 +975,16 @@ bool uf_hashmap_remove(UfHashmap *self, void *key)
                 return false;
         }
 
+        if (uf_hashmap_is_small(self)) {
+                int i = uf_hashmap_small_find(self, self->key.hash(key), key);
+                if (i < 0) {
+                        return false;
+                }
+                entry_free(self, self->small[i].key, self->small[i].value);
+                self->small[i] = self->small[--self->buckets.current];
+                return true;
+        }
+
         node = uf_hashmap_get_node(self, key);
         if (uf_unlikely(!node)) {
                 return false;
@@ -14,6 +14,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "allocator.h"
+
 /**
  * UfHashmap is an in-memory hashed key-value data structure (dict/map)
  * typically suited to string key/value pairs.
@@ -25,6 +27,14 @@ typedef struct UfHashmap UfHashmap;
  */
 typedef void (*uf_hashmap_free_func)(void *v);
 
+/**
+ * Required definition for a copy function
+ *
+ * @param v Item to be copied
+ * @returns A newly allocated copy of v, or NULL on OOM
+ */
+typedef void *(*uf_hashmap_dup_func)(const void *v);
+
 /**
  * Required definition for a hash generator function
  *
@@ -42,6 +52,16 @@ typedef uint32_t (*uf_hashmap_hash_func)(const void *v);
  */
 typedef bool (*uf_hashmap_equal_func)(const void *a, const void *b);
 
+/**
+ * Required definition for key ordering function, used by the ordered
+ * containers.
+ *
+ * @param a first item to be compared
+ * @param b second item to be compared
+ * @returns negative, zero or positive if a sorts before, equal to or after b
+ */
+typedef int (*uf_hashmap_compare_func)(const void *a, const void *b);
+
 /**
  * Simple comparison for pointer types.
  */
@@ -52,16 +72,49 @@ bool uf_hashmap_simple_equal(const void *a, const void *b);
  */
 uint32_t uf_hashmap_simple_hash(const void *v);
 
+/**
+ * Simple ordering for pointer types, i.e. UF_INT_TO_PTR integers.
+ */
+int uf_hashmap_simple_compare(const void *a, const void *b);
+
 /**
  * Comparison for string keys
  */
 bool uf_hashmap_string_equal(const void *a, const void *b);
 
+/**
+ * Ordering for string keys
+ */
+int uf_hashmap_string_compare(const void *a, const void *b);
+
 /**
  * Slow hash for string keys
  */
 uint32_t uf_hashmap_string_hash(const void *v);
 
+/**
+ * ASCII case-insensitive comparison for string keys, for INI keys,
+ * environment names and the like. Bytes outside A-Z compare exactly.
+ */
+bool uf_hashmap_string_case_equal(const void *a, const void *b);
+
+/**
+ * ASCII case-insensitive hash for string keys, to pair with
+ * uf_hashmap_string_case_equal. Keys are folded 8 to 32 bytes at a time
+ * and nothing is allocated, so there is no need to lowercase them first.
+ *
+ * @note The result differs from uf_hashmap_string_hash of the lowercased key
+ */
+uint32_t uf_hashmap_string_case_hash(const void *v);
+
+/**
+ * Return the case-insensitive hash and equality kernels used on a CPU
+ * with @features, see cpu.h. Exposed so tests and benchmarks can
+ * exercise every variant, which all agree.
+ */
+uf_hashmap_hash_func uf_hashmap_string_case_hash_select(unsigned int features);
+uf_hashmap_equal_func uf_hashmap_string_case_equal_select(unsigned int features);
+
 /**
  * Construct a new UfHashmap with the given @hash and @compare functions.
  *
@@ -89,6 +142,24 @@ UfHashmap *uf_hashmap_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compa
 UfHashmap *uf_hashmap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
                                uf_hashmap_free_func key_free, uf_hashmap_free_func value_free);
 
+/**
+ * Construct a new UfHashmap drawing its collision nodes from @allocator
+ *
+ * @param hash A hash generator function
+ * @param compare A key equality function
+ * @param key_free Function to call to free any keys when replaced or the table is freed
+ * @param value_free Function to call to free any values when replaced or the table is freed
+ * @param allocator Allocator for collision nodes, which must outlive the map
+ *
+ * @note Free with uf_hashmap_free
+ *
+ * @return A newly allocated UfHashmap
+ */
+UfHashmap *uf_hashmap_new_with_allocator(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                         uf_hashmap_free_func key_free,
+                                         uf_hashmap_free_func value_free,
+                                         const UfAllocator *allocator);
+
 /**
  * Free a previously allocated hashmap
  *
@@ -118,6 +189,44 @@ bool uf_hashmap_put(UfHashmap *map, void *key, void *b);
  */
 void *uf_hashmap_get(UfHashmap *map, void *key);
 
+/**
+ * Ensure the map can hold @n_items in total without growing again, so a
+ * bulk insert of known size costs a single bucket allocation up front.
+ *
+ * @note Entries whose hashes collide still allocate a chain node each
+ *
+ * @param map Pointer to an allocated map
+ * @param n_items Number of entries the map should hold
+ *
+ * @returns True if the map has room for @n_items
+ */
+bool uf_hashmap_reserve(UfHashmap *map, size_t n_items);
+
+/**
+ * Copy @map for a copy-and-modify update, such as building the next
+ * configuration from the current one. The bucket table is copied as is,
+ * stored hashes included, so no key is hashed or compared again and only
+ * collision nodes need allocating.
+ *
+ * The copy inherits the free functions of @map and owns every key and
+ * value it frees, including those put into it later. @key_dup is
+ * therefore required exactly when @map has a key free function, and
+ * likewise @value_dup for values. Without them the copy shares pointers
+ * that neither map frees. Duplicating with callbacks that match the free
+ * functions makes it possible to copy into an arena or pool.
+ *
+ * @param map Pointer to an allocated map
+ * @param key_dup Function to duplicate each key, if @map frees keys
+ * @param value_dup Function to duplicate each value, if @map frees values
+ *
+ * @note Free with uf_hashmap_free
+ *
+ * @returns A newly allocated copy of @map, or NULL on OOM or if the dup
+ * functions don't match the free functions of @map
+ */
+UfHashmap *uf_hashmap_copy(UfHashmap *map, uf_hashmap_dup_func key_dup,
+                           uf_hashmap_dup_func value_dup);
+
 /**
  * Remove key from the map that matches the given key
  *
@@ -0,0 +1,595 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "multimap.h"
+#include "util.h"
+
+/**
+ * Slots allocated by the first append, always a power of two
+ */
+#define UF_MULTIMAP_INITIAL_SIZE 16
+
+/**
+ * Linear probing stays fast up to 3/4 full
+ */
+#define UF_MULTIMAP_FILL_NUM 3
+#define UF_MULTIMAP_FILL_DEN 4
+
+/**
+ * Set in a build target once the entry's array has its final size
+ */
+#define UF_MULTIMAP_SIZED 0x80000000U
+
+/**
+ * A key with its values. One value lives inline in the slot, two or more
+ * live in a malloc'd array of uf_multimap_capacity(count) entries.
+ */
+typedef struct UfMultimapEntry {
+        void *key;
+        union {
+                void *one;
+                void **many;
+        } values;
+        uint32_t hash;  /**<Stored hash, 0 for an empty slot */
+        uint32_t count; /**<Number of values */
+} UfMultimapEntry;
+
+struct UfMultimap {
+        UfMultimapEntry *slots;
+        size_t max;         /**<Number of slots */
+        size_t n_keys;      /**<Occupied slots */
+        unsigned int shift; /**<32 - log2(max), see uf_multimap_home */
+        struct {
+                uf_hashmap_hash_func hash;
+                uf_hashmap_equal_func compare;
+        } key;
+        struct {
+                uf_hashmap_free_func key;
+                uf_hashmap_free_func value;
+        } free;
+};
+
+UfMultimap *uf_multimap_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare)
+{
+        return uf_multimap_new_full(hash, compare, NULL, NULL);
+}
+
+UfMultimap *uf_multimap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                 uf_hashmap_free_func key_free, uf_hashmap_free_func value_free)
+{
+        UfMultimap *ret = NULL;
+
+        if (!hash || !compare) {
+                return NULL;
+        }
+
+        ret = calloc(1, sizeof(struct UfMultimap));
+        if (!ret) {
+                return NULL;
+        }
+        ret->key.hash = hash;
+        ret->key.compare = compare;
+        ret->free.key = key_free;
+        ret->free.value = value_free;
+
+        /* Slots are allocated on first append */
+        return ret;
+}
+
+/**
+ * Array size for @count values, only meaningful for count >= 2
+ */
+static inline size_t uf_multimap_capacity(size_t count)
+{
+        size_t cap = 2;
+
+        while (cap < count) {
+                cap <<= 1;
+        }
+        return cap;
+}
+
+static inline void *const *uf_multimap_values(UfMultimapEntry *entry)
+{
+        return entry->count == 1 ? &entry->values.one : entry->values.many;
+}
+
+/**
+ * Free the values of @entry and its array, leaving the key alone
+ */
+static void uf_multimap_entry_clear(UfMultimap *self, UfMultimapEntry *entry)
+{
+        void *const *values = uf_multimap_values(entry);
+
+        if (self->free.value) {
+                for (uint32_t i = 0; i < entry->count; i++) {
+                        self->free.value(values[i]);
+                }
+        }
+        if (entry->count >= 2) {
+                free(entry->values.many);
+        }
+        entry->count = 0;
+}
+
+void uf_multimap_free(UfMultimap *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        for (size_t i = 0; i < self->max; i++) {
+                UfMultimapEntry *entry = &self->slots[i];
+                if (entry->hash == 0) {
+                        continue;
+                }
+                uf_multimap_entry_clear(self, entry);
+                if (self->free.key) {
+                        self->free.key(entry->key);
+                }
+        }
+
+        free(self->slots);
+        free(self);
+}
+
+/**
+ * Zero marks an empty slot, so fold it into 1
+ */
+static inline uint32_t uf_multimap_hash(UfMultimap *self, const void *key)
+{
+        uint32_t hash = self->key.hash(key);
+
+        return hash ? hash : 1;
+}
+
+/**
+ * Fibonacci hashing picks the home slot from the high bits, so keys
+ * from uf_hashmap_simple_hash with a common stride don't cluster.
+ */
+static inline size_t uf_multimap_home(UfMultimap *self, uint32_t hash)
+{
+        return (size_t)((uint32_t)(hash * 0x9E3779B1U) >> self->shift);
+}
+
+/**
+ * Returns the slot holding @key, or SIZE_MAX
+ */
+static size_t uf_multimap_find(UfMultimap *self, uint32_t hash, const void *key)
+{
+        size_t mask = self->max - 1;
+
+        if (uf_unlikely(self->n_keys == 0)) {
+                return SIZE_MAX;
+        }
+
+        for (size_t i = uf_multimap_home(self, hash);; i = (i + 1) & mask) {
+                UfMultimapEntry *entry = &self->slots[i];
+                if (entry->hash == 0) {
+                        return SIZE_MAX;
+                }
+                if (entry->hash == hash && self->key.compare(entry->key, key)) {
+                        return i;
+                }
+        }
+}
+
+/**
+ * Claim the first free slot for @hash, which must not be present. The
+ * caller guarantees room.
+ */
+static size_t uf_multimap_claim(UfMultimap *self, uint32_t hash, void *key)
+{
+        size_t mask = self->max - 1;
+        size_t i = uf_multimap_home(self, hash);
+
+        while (self->slots[i].hash != 0) {
+                i = (i + 1) & mask;
+        }
+        self->slots[i] = (UfMultimapEntry){ .key = key, .hash = hash };
+        self->n_keys++;
+        return i;
+}
+
+/**
+ * Make room for @extra more keys, rehashing into a larger table if need be
+ */
+static bool uf_multimap_reserve_keys(UfMultimap *self, size_t extra)
+{
+        UfMultimapEntry *old = self->slots;
+        size_t old_max = self->max;
+        size_t need = self->n_keys + extra;
+        size_t max = old_max ? old_max : UF_MULTIMAP_INITIAL_SIZE;
+        unsigned int shift = 32;
+
+        while (need * UF_MULTIMAP_FILL_DEN > max * UF_MULTIMAP_FILL_NUM) {
+                if (max > UINT32_MAX / 2) {
+                        return false;
+                }
+                max <<= 1;
+        }
+        if (max == old_max) {
+                return true;
+        }
+        for (size_t m = max; m > 1; m >>= 1) {
+                shift--;
+        }
+
+        self->slots = calloc(max, sizeof(UfMultimapEntry));
+        if (!self->slots) {
+                self->slots = old;
+                return false;
+        }
+        self->max = max;
+        self->shift = shift;
+        self->n_keys = 0;
+
+        /* Stored hashes mean no key is hashed again */
+        for (size_t i = 0; i < old_max; i++) {
+                if (old[i].hash != 0) {
+                        size_t slot = uf_multimap_claim(self, old[i].hash, old[i].key);
+                        self->slots[slot] = old[i];
+                }
+        }
+        free(old);
+        return true;
+}
+
+/**
+ * Backward shift deletion: pull later entries of the probe run into the
+ * hole, so lookups never need tombstones.
+ */
+static void uf_multimap_delete_slot(UfMultimap *self, size_t hole)
+{
+        size_t mask = self->max - 1;
+
+        for (size_t j = (hole + 1) & mask; self->slots[j].hash != 0; j = (j + 1) & mask) {
+                size_t home = uf_multimap_home(self, self->slots[j].hash);
+
+                /* Only move entries whose home isn't between the hole and here */
+                if (((j - home) & mask) >= ((j - hole) & mask)) {
+                        self->slots[hole] = self->slots[j];
+                        hole = j;
+                }
+        }
+        memset(&self->slots[hole], 0, sizeof(UfMultimapEntry));
+        self->n_keys--;
+}
+
+static bool uf_multimap_entry_append(UfMultimapEntry *entry, void *value)
+{
+        void **many = NULL;
+
+        if (entry->count == 0) {
+                entry->values.one = value;
+                entry->count = 1;
+                return true;
+        }
+        if (uf_unlikely(entry->count >= UF_MULTIMAP_SIZED - 1)) {
+                return false;
+        }
+
+        if (entry->count == 1) {
+                many = malloc(2 * sizeof(void *));
+                if (!many) {
+                        return false;
+                }
+                many[0] = entry->values.one;
+                entry->values.many = many;
+        } else if (entry->count == uf_multimap_capacity(entry->count)) {
+                many = realloc(entry->values.many, 2 * entry->count * sizeof(void *));
+                if (!many) {
+                        return false;
+                }
+                entry->values.many = many;
+        }
+
+        entry->values.many[entry->count++] = value;
+        return true;
+}
+
+bool uf_multimap_append(UfMultimap *self, void *key, void *value)
+{
+        UfMultimapEntry *entry = NULL;
+        uint32_t hash;
+        size_t slot;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        /* Only a new key can grow the table */
+        hash = uf_multimap_hash(self, key);
+        slot = uf_multimap_find(self, hash, key);
+        if (slot == SIZE_MAX) {
+                if (!uf_multimap_reserve_keys(self, 1)) {
+                        return false;
+                }
+                slot = uf_multimap_claim(self, hash, key);
+        }
+        entry = &self->slots[slot];
+
+        if (!uf_multimap_entry_append(entry, value)) {
+                return false;
+        }
+
+        /* The map already owns an equal key */
+        if (entry->key != key && self->free.key) {
+                self->free.key(key);
+        }
+        return true;
+}
+
+/**
+ * Give a key about to receive @target values in total an array of its
+ * final size
+ */
+static bool uf_multimap_entry_size(UfMultimapEntry *entry, uint32_t target)
+{
+        size_t cap = uf_multimap_capacity(target);
+        void **many = NULL;
+
+        if (entry->count < 2) {
+                many = malloc(cap * sizeof(void *));
+                if (!many) {
+                        return false;
+                }
+                if (entry->count == 1) {
+                        many[0] = entry->values.one;
+                }
+                entry->values.many = many;
+        } else if (uf_multimap_capacity(entry->count) < cap) {
+                many = realloc(entry->values.many, cap * sizeof(void *));
+                if (!many) {
+                        return false;
+                }
+                entry->values.many = many;
+        }
+        return true;
+}
+
+/**
+ * Undo a failed build, before any value was appended: arrays sized for
+ * entries that still hold one value go back to inline storage, and keys
+ * claimed by the build are removed again. Keys still belong to the
+ * caller, so none are freed.
+ */
+static void uf_multimap_build_abort(UfMultimap *self, uint32_t *target)
+{
+        bool again = true;
+
+        for (size_t i = 0; i < self->max; i++) {
+                UfMultimapEntry *entry = &self->slots[i];
+                if (!(target[i] & UF_MULTIMAP_SIZED) || entry->count >= 2) {
+                        continue;
+                }
+                if (entry->count == 1) {
+                        void **many = entry->values.many;
+                        entry->values.one = many[0];
+                        free(many);
+                } else {
+                        free(entry->values.many);
+                        entry->values.many = NULL;
+                }
+        }
+
+        /* Deletion moves entries, so rescan until nothing is left */
+        while (again) {
+                again = false;
+                for (size_t i = 0; i < self->max; i++) {
+                        if (self->slots[i].hash != 0 && self->slots[i].count == 0) {
+                                uf_multimap_delete_slot(self, i);
+                                again = true;
+                        }
+                }
+        }
+}
+
+bool uf_multimap_build(UfMultimap *self, void **keys, void **values, size_t n)
+{
+        size_t *slots = NULL;
+        uint32_t *target = NULL;
+        bool ret = false;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+        if (n == 0) {
+                return true;
+        }
+
+        /* No growth from here on, so slot numbers stay put */
+        if (!uf_multimap_reserve_keys(self, n)) {
+                return false;
+        }
+        slots = malloc(n * sizeof(size_t));
+        target = calloc(self->max, sizeof(uint32_t));
+        if (!slots || !target) {
+                goto out;
+        }
+
+        /* Find or claim every key, counting the values each will end up with */
+        for (size_t i = 0; i < n; i++) {
+                uint32_t hash = uf_multimap_hash(self, keys[i]);
+                size_t slot = uf_multimap_find(self, hash, keys[i]);
+
+                if (slot == SIZE_MAX) {
+                        slot = uf_multimap_claim(self, hash, keys[i]);
+                }
+                if (target[slot] == 0) {
+                        target[slot] = self->slots[slot].count;
+                }
+                if (uf_unlikely(++target[slot] >= UF_MULTIMAP_SIZED)) {
+                        uf_multimap_build_abort(self, target);
+                        goto out;
+                }
+                slots[i] = slot;
+        }
+
+        /* Size every array up front, the only step that can fail */
+        for (size_t i = 0; i < n; i++) {
+                uint32_t *t = &target[slots[i]];
+
+                if (*t < 2 || (*t & UF_MULTIMAP_SIZED)) {
+                        continue;
+                }
+                if (!uf_multimap_entry_size(&self->slots[slots[i]], *t)) {
+                        uf_multimap_build_abort(self, target);
+                        goto out;
+                }
+                *t |= UF_MULTIMAP_SIZED;
+        }
+
+        /* Commit: append in order, and take ownership of the keys */
+        for (size_t i = 0; i < n; i++) {
+                UfMultimapEntry *entry = &self->slots[slots[i]];
+
+                if (target[slots[i]] == 1) {
+                        entry->values.one = values[i];
+                        entry->count = 1;
+                } else {
+                        entry->values.many[entry->count++] = values[i];
+                }
+
+                /* The map already owns an equal key */
+                if (entry->key != keys[i] && self->free.key) {
+                        self->free.key(keys[i]);
+                }
+        }
+        ret = true;
+
+out:
+        free(slots);
+        free(target);
+        return ret;
+}
+
+void *const *uf_multimap_get(UfMultimap *self, const void *key, size_t *n_values)
+{
+        size_t slot;
+
+        *n_values = 0;
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        slot = uf_multimap_find(self, uf_multimap_hash(self, key), key);
+        if (slot == SIZE_MAX) {
+                return NULL;
+        }
+        *n_values = self->slots[slot].count;
+        return uf_multimap_values(&self->slots[slot]);
+}
+
+bool uf_multimap_remove_value(UfMultimap *self, const void *key, const void *value)
+{
+        UfMultimapEntry *entry = NULL;
+        void *const *values = NULL;
+        size_t slot;
+        uint32_t i;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        slot = uf_multimap_find(self, uf_multimap_hash(self, key), key);
+        if (slot == SIZE_MAX) {
+                return false;
+        }
+        entry = &self->slots[slot];
+        values = uf_multimap_values(entry);
+
+        for (i = 0; i < entry->count && values[i] != value; i++) {
+        }
+        if (i == entry->count) {
+                return false;
+        }
+
+        if (entry->count == 1) {
+                return uf_multimap_remove(self, key);
+        }
+
+        if (self->free.value) {
+                self->free.value(values[i]);
+        }
+        if (entry->count == 2) {
+                void **many = entry->values.many;
+                entry->values.one = many[1 - i];
+                free(many);
+        } else {
+                memmove(&entry->values.many[i],
+                        &entry->values.many[i + 1],
+                        (entry->count - i - 1) * sizeof(void *));
+        }
+        entry->count--;
+        return true;
+}
+
+bool uf_multimap_remove(UfMultimap *self, const void *key)
+{
+        UfMultimapEntry *entry = NULL;
+        size_t slot;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        slot = uf_multimap_find(self, uf_multimap_hash(self, key), key);
+        if (slot == SIZE_MAX) {
+                return false;
+        }
+        entry = &self->slots[slot];
+
+        uf_multimap_entry_clear(self, entry);
+        if (self->free.key) {
+                self->free.key(entry->key);
+        }
+        uf_multimap_delete_slot(self, slot);
+        return true;
+}
+
+void uf_multimap_foreach(UfMultimap *self, uf_multimap_iter_func func, void *userdata)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        for (size_t i = 0; i < self->max; i++) {
+                UfMultimapEntry *entry = &self->slots[i];
+                if (entry->hash == 0) {
+                        continue;
+                }
+                if (!func(entry->key, uf_multimap_values(entry), entry->count, userdata)) {
+                        return;
+                }
+        }
+}
+
+size_t uf_multimap_size(UfMultimap *self)
+{
+        return self ? self->n_keys : 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,138 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * UfMultimap maps each key to an ordered list of values, such as the
+ * files owned by a package.
+ *
+ * A key's values are always contiguous: a single value is stored inline
+ * in the table, so single-valued keys cost no more than a plain map
+ * entry, and a second value moves them into a growable array.
+ */
+typedef struct UfMultimap UfMultimap;
+
+/**
+ * Callback for uf_multimap_foreach
+ *
+ * @param key Key of the current entry
+ * @param values The values for @key, in insertion order
+ * @param n_values Number of values, always at least 1
+ * @param userdata User data passed to uf_multimap_foreach
+ *
+ * @returns true to continue iterating, false to stop
+ */
+typedef bool (*uf_multimap_iter_func)(void *key, void *const *values, size_t n_values,
+                                      void *userdata);
+
+/**
+ * Construct a new UfMultimap
+ *
+ * @note Free with uf_multimap_free
+ *
+ * @return A newly allocated UfMultimap
+ */
+UfMultimap *uf_multimap_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare);
+
+/**
+ * Construct a new UfMultimap with key/value free functions
+ *
+ * @param key_free Function to call to free keys when their last value is removed
+ * @param value_free Function to call to free each value when removed
+ *
+ * @note Free with uf_multimap_free
+ *
+ * @return A newly allocated UfMultimap
+ */
+UfMultimap *uf_multimap_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                                 uf_hashmap_free_func key_free, uf_hashmap_free_func value_free);
+
+/**
+ * Free a previously allocated map, with all keys and values
+ */
+void uf_multimap_free(UfMultimap *map);
+
+/**
+ * Append @value to the values for @key
+ *
+ * @note If @key is already present, the map keeps its existing key and
+ * frees @key with key_free (unless it is the same pointer).
+ *
+ * @returns True if the value could be stored
+ */
+bool uf_multimap_append(UfMultimap *map, void *key, void *value);
+
+/**
+ * Append @n pairs of @keys[i] -> @values[i] at once, with each key's
+ * values in the order given. Each array is allocated once at its final
+ * size, rather than grown value by value.
+ *
+ * @note On success key ownership is as for uf_multimap_append. On failure
+ * the map is left unchanged and the caller still owns every key and value.
+ *
+ * @returns True if every pair was stored
+ */
+bool uf_multimap_build(UfMultimap *map, void **keys, void **values, size_t n);
+
+/**
+ * Get the values stored for @key
+ *
+ * @param n_values Set to the number of values, 0 if @key is not present
+ *
+ * @returns A contiguous array of @n_values values, valid until the map is
+ * next modified, or NULL if @key is not present
+ */
+void *const *uf_multimap_get(UfMultimap *map, const void *key, size_t *n_values);
+
+/**
+ * Remove the first occurrence of @value (by pointer) from the values of
+ * @key, preserving the order of the rest. The key is removed with its
+ * last value.
+ *
+ * @returns True if the value was found and removed
+ */
+bool uf_multimap_remove_value(UfMultimap *map, const void *key, const void *value);
+
+/**
+ * Remove @key with all of its values
+ *
+ * @returns True if the key was present
+ */
+bool uf_multimap_remove(UfMultimap *map, const void *key);
+
+/**
+ * Visit every key with its values, in no particular order. The map must
+ * not be modified during iteration.
+ */
+void uf_multimap_foreach(UfMultimap *map, uf_multimap_iter_func func, void *userdata);
+
+/**
+ * Return the number of keys in the map
+ */
+size_t uf_multimap_size(UfMultimap *map);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,367 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "pool.h"
+#include "util.h"
+
+/**
+ * Slabs are a single page unless the objects are large, in which case
+ * they grow to hold at least UF_POOL_MIN_OBJECTS.
+ */
+#define UF_POOL_SLAB_SIZE 4096
+#define UF_POOL_MIN_OBJECTS 8
+
+/**
+ * Objects are aligned as malloc would align them
+ */
+#define UF_POOL_ALIGN 16
+
+/**
+ * Objects cached per thread, per pool. Refills and drains move half of
+ * this at a time so that alternating alloc/release never thrashes.
+ */
+#define UF_POOL_MAGAZINE_SIZE 32
+
+/**
+ * Number of per-thread magazines, pools are mapped to one by their id.
+ */
+#define UF_POOL_MAGAZINE_SLOTS 16
+
+typedef struct UfPoolObject {
+        struct UfPoolObject *next; /**<Intrusive link, only valid while free */
+} UfPoolObject;
+
+typedef struct UfPoolSlab {
+        _Alignas(UF_POOL_ALIGN) struct UfPoolSlab *next;
+} UfPoolSlab;
+
+/**
+ * A per-thread object cache. It belongs to the pool with the matching id,
+ * and may be taken over once empty or once any pool sharing the slot has
+ * been freed.
+ */
+typedef struct UfPoolMagazine {
+        uint64_t pool_id;
+        uint64_t deaths; /**<uf_pool_deaths[slot] when claimed */
+        UfPoolObject *head;
+        unsigned int count;
+} UfPoolMagazine;
+
+struct UfPool {
+        UfAllocator allocator; /**<Adapter handed to containers */
+        uint64_t id;           /**<Unique, never reused */
+        size_t object_size;
+        size_t slab_size;
+        size_t per_slab; /**<Objects carved from each slab */
+        mtx_t lock;      /**<Guards everything below */
+        UfPoolObject *free_list;
+        size_t n_free;
+        UfPoolSlab *slabs;
+        size_t n_slabs;
+        uint64_t n_refills;
+        uint64_t n_drains;
+};
+
+static _Thread_local UfPoolMagazine uf_pool_magazines[UF_POOL_MAGAZINE_SLOTS];
+static atomic_uint_fast64_t uf_pool_next_id = 1;
+static atomic_uint_fast64_t uf_pool_deaths[UF_POOL_MAGAZINE_SLOTS];
+
+static void *uf_pool_allocator_alloc(void *userdata, size_t size)
+{
+        UfPool *self = userdata;
+
+        if (uf_unlikely(size > self->object_size)) {
+                return NULL;
+        }
+        return uf_pool_alloc(self);
+}
+
+static void uf_pool_allocator_free(void *userdata, void *ptr, __uf_unused__ size_t size)
+{
+        uf_pool_release(userdata, ptr);
+}
+
+UfPool *uf_pool_new(size_t object_size)
+{
+        UfPool *ret = NULL;
+        size_t min_slab;
+
+        if (object_size < sizeof(UfPoolObject)) {
+                object_size = sizeof(UfPoolObject);
+        }
+        object_size = (object_size + UF_POOL_ALIGN - 1) & ~(size_t)(UF_POOL_ALIGN - 1);
+
+        ret = calloc(1, sizeof(struct UfPool));
+        if (!ret) {
+                return NULL;
+        }
+
+        if (mtx_init(&ret->lock, mtx_plain) != thrd_success) {
+                free(ret);
+                return NULL;
+        }
+
+        min_slab = sizeof(UfPoolSlab) + UF_POOL_MIN_OBJECTS * object_size;
+        ret->slab_size = (min_slab + UF_POOL_SLAB_SIZE - 1) & ~(size_t)(UF_POOL_SLAB_SIZE - 1);
+        ret->object_size = object_size;
+        ret->per_slab = (ret->slab_size - sizeof(UfPoolSlab)) / object_size;
+        ret->id = atomic_fetch_add(&uf_pool_next_id, 1);
+        ret->allocator.alloc = uf_pool_allocator_alloc;
+        ret->allocator.free = uf_pool_allocator_free;
+        ret->allocator.userdata = ret;
+
+        return ret;
+}
+
+void uf_pool_free(UfPool *self)
+{
+        unsigned int slot;
+        UfPoolMagazine *mag = NULL;
+
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        /* Our own cache can be dropped directly, other threads notice the
+         * death counter and reclaim their magazine for this slot lazily */
+        slot = (unsigned int)(self->id % UF_POOL_MAGAZINE_SLOTS);
+        mag = &uf_pool_magazines[slot];
+        if (mag->pool_id == self->id) {
+                *mag = (UfPoolMagazine){ 0 };
+        }
+        atomic_fetch_add(&uf_pool_deaths[slot], 1);
+
+        while (self->slabs) {
+                UfPoolSlab *next = self->slabs->next;
+                free(self->slabs);
+                self->slabs = next;
+        }
+        mtx_destroy(&self->lock);
+        free(self);
+}
+
+/**
+ * Find the calling thread's magazine for this pool, claiming the slot if
+ * it is unused or stale.
+ *
+ * @returns NULL if the slot is in use by another live pool
+ */
+static inline UfPoolMagazine *uf_pool_magazine(UfPool *self)
+{
+        unsigned int slot = (unsigned int)(self->id % UF_POOL_MAGAZINE_SLOTS);
+        UfPoolMagazine *mag = &uf_pool_magazines[slot];
+        uint64_t deaths;
+
+        if (uf_likely(mag->pool_id == self->id)) {
+                return mag;
+        }
+
+        /* A death may be an unrelated pool, in which case up to a magazine
+         * of its objects stay stranded until that pool is freed. */
+        deaths = atomic_load_explicit(&uf_pool_deaths[slot], memory_order_relaxed);
+        if (mag->count == 0 || mag->deaths != deaths) {
+                *mag = (UfPoolMagazine){ .pool_id = self->id, .deaths = deaths };
+                return mag;
+        }
+        return NULL;
+}
+
+/**
+ * Carve a new slab onto the shared free list. Called with the lock held.
+ */
+static bool uf_pool_grow(UfPool *self)
+{
+        UfPoolSlab *slab = NULL;
+        char *base = NULL;
+
+        slab = malloc(self->slab_size);
+        if (!slab) {
+                return false;
+        }
+        slab->next = self->slabs;
+        self->slabs = slab;
+        self->n_slabs++;
+
+        /* Push in reverse so objects are handed out in address order */
+        base = (char *)slab + sizeof(UfPoolSlab);
+        for (size_t i = self->per_slab; i > 0; i--) {
+                UfPoolObject *object = (UfPoolObject *)(void *)(base + (i - 1) * self->object_size);
+                object->next = self->free_list;
+                self->free_list = object;
+        }
+        self->n_free += self->per_slab;
+
+        return true;
+}
+
+/**
+ * Slow path: take one object from the shared list, plus a batch for @mag
+ */
+static UfPoolObject *uf_pool_refill(UfPool *self, UfPoolMagazine *mag)
+{
+        UfPoolObject *object = NULL;
+
+        mtx_lock(&self->lock);
+
+        if (!self->free_list && !uf_pool_grow(self)) {
+                mtx_unlock(&self->lock);
+                return NULL;
+        }
+
+        object = self->free_list;
+        self->free_list = object->next;
+        self->n_free--;
+
+        if (mag) {
+                while (self->free_list && mag->count < UF_POOL_MAGAZINE_SIZE / 2) {
+                        UfPoolObject *next = self->free_list;
+                        self->free_list = next->next;
+                        next->next = mag->head;
+                        mag->head = next;
+                        mag->count++;
+                        self->n_free--;
+                }
+                self->n_refills++;
+        }
+
+        mtx_unlock(&self->lock);
+
+        return object;
+}
+
+void *uf_pool_alloc(UfPool *self)
+{
+        UfPoolMagazine *mag = NULL;
+        UfPoolObject *object = NULL;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        mag = uf_pool_magazine(self);
+        if (uf_likely(mag && mag->head)) {
+                object = mag->head;
+                mag->head = object->next;
+                mag->count--;
+                return object;
+        }
+
+        return uf_pool_refill(self, mag);
+}
+
+/**
+ * Move @count objects from the head of @mag back to the shared list
+ */
+static void uf_pool_drain(UfPool *self, UfPoolMagazine *mag, unsigned int count)
+{
+        UfPoolObject *head = mag->head;
+        UfPoolObject *tail = head;
+
+        if (!count) {
+                return;
+        }
+        for (unsigned int i = 1; i < count; i++) {
+                tail = tail->next;
+        }
+        mag->head = tail->next;
+        mag->count -= count;
+
+        mtx_lock(&self->lock);
+        tail->next = self->free_list;
+        self->free_list = head;
+        self->n_free += count;
+        self->n_drains++;
+        mtx_unlock(&self->lock);
+}
+
+void uf_pool_release(UfPool *self, void *object)
+{
+        UfPoolMagazine *mag = NULL;
+        UfPoolObject *obj = object;
+
+        if (uf_unlikely(!self || !object)) {
+                return;
+        }
+
+        mag = uf_pool_magazine(self);
+        if (uf_unlikely(!mag)) {
+                mtx_lock(&self->lock);
+                obj->next = self->free_list;
+                self->free_list = obj;
+                self->n_free++;
+                mtx_unlock(&self->lock);
+                return;
+        }
+
+        obj->next = mag->head;
+        mag->head = obj;
+        if (uf_unlikely(++mag->count > UF_POOL_MAGAZINE_SIZE)) {
+                uf_pool_drain(self, mag, UF_POOL_MAGAZINE_SIZE / 2);
+        }
+}
+
+void uf_pool_flush(UfPool *self)
+{
+        UfPoolMagazine *mag = NULL;
+
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        mag = &uf_pool_magazines[self->id % UF_POOL_MAGAZINE_SLOTS];
+        if (mag->pool_id == self->id) {
+                uf_pool_drain(self, mag, mag->count);
+        }
+}
+
+void uf_pool_stats(UfPool *self, UfPoolStats *stats)
+{
+        if (uf_unlikely(!self || !stats)) {
+                return;
+        }
+
+        mtx_lock(&self->lock);
+        *stats = (UfPoolStats){
+                .object_size = self->object_size,
+                .slab_size = self->slab_size,
+                .n_slabs = self->n_slabs,
+                .n_objects = self->n_slabs * self->per_slab,
+                .n_free = self->n_free,
+                .n_refills = self->n_refills,
+                .n_drains = self->n_drains,
+        };
+        mtx_unlock(&self->lock);
+}
+
+const UfAllocator *uf_pool_allocator(UfPool *self)
+{
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+        return &self->allocator;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,104 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+/**
+ * UfPool hands out fixed-size objects carved from page sized slabs.
+ *
+ * Free objects are kept on an intrusive free list, and each thread keeps a
+ * small cache (magazine) of objects per pool so that allocation and release
+ * normally touch no shared state. The shared list is only visited to refill
+ * or drain a magazine in batches.
+ *
+ * Memory is only returned to the system when the pool is freed.
+ */
+typedef struct UfPool UfPool;
+
+/**
+ * Snapshot of pool statistics, see uf_pool_stats
+ */
+typedef struct UfPoolStats {
+        size_t object_size; /**<Rounded size of each object */
+        size_t slab_size;   /**<Size of each slab in bytes */
+        size_t n_slabs;     /**<Number of slabs allocated */
+        size_t n_objects;   /**<Total objects carved from slabs */
+        size_t n_free;      /**<Objects on the shared free list */
+        uint64_t n_refills; /**<Times a thread visited the shared list to allocate */
+        uint64_t n_drains;  /**<Times a thread returned a batch to the shared list */
+} UfPoolStats;
+
+/**
+ * Construct a new UfPool handing out objects of @object_size bytes
+ *
+ * @note Free with uf_pool_free
+ *
+ * @return A newly allocated UfPool
+ */
+UfPool *uf_pool_new(size_t object_size);
+
+/**
+ * Free the pool and every object allocated from it.
+ *
+ * @note No other thread may be using the pool at this point.
+ *
+ * @param pool Pointer to a previously allocated pool
+ */
+void uf_pool_free(UfPool *pool);
+
+/**
+ * Allocate a single object. The contents are undefined.
+ *
+ * @returns A new object, or NULL if memory is exhausted
+ */
+void *uf_pool_alloc(UfPool *pool);
+
+/**
+ * Return an object to the pool. Objects may be released from any thread,
+ * not just the one that allocated them.
+ */
+void uf_pool_release(UfPool *pool, void *object);
+
+/**
+ * Return every object cached by the calling thread to the shared list.
+ * Long lived threads that stop using a pool may call this before exiting.
+ */
+void uf_pool_flush(UfPool *pool);
+
+/**
+ * Fill @stats with a snapshot of the current pool statistics
+ */
+void uf_pool_stats(UfPool *pool, UfPoolStats *stats);
+
+/**
+ * Return a UfAllocator backed by this pool, suitable for handing to
+ * containers. Requests larger than the object size fail.
+ *
+ * @note The allocator is owned by the pool and shares its lifetime.
+ */
+const UfAllocator *uf_pool_allocator(UfPool *pool);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,59 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include "config.h"
+
+/**
+ * Static tracepoints for production tracing, enabled with -Dwith-usdt=true.
+ *
+ * Each probe is a single nop in the instruction stream plus an ELF note,
+ * so it costs nothing until a tracer attaches, e.g.:
+ *
+ *      bpftrace -l 'usdt:/usr/lib/libuf.so.0:libuf:*'
+ *
+ * Without the option the macros only evaluate their arguments.
+ */
+#if UF_ENABLE_USDT
+#include <sys/sdt.h>
+#define UF_PROBE1(name, a) DTRACE_PROBE1(libuf, name, a)
+#define UF_PROBE2(name, a, b) DTRACE_PROBE2(libuf, name, a, b)
+#define UF_PROBE3(name, a, b, c) DTRACE_PROBE3(libuf, name, a, b, c)
+#else
+#define UF_PROBE1(name, a)                                                                          \
+        do {                                                                                        \
+                (void)(a);                                                                          \
+        } while (0)
+#define UF_PROBE2(name, a, b)                                                                       \
+        do {                                                                                        \
+                (void)(a);                                                                          \
+                (void)(b);                                                                          \
+        } while (0)
+#define UF_PROBE3(name, a, b, c)                                                                    \
+        do {                                                                                        \
+                (void)(a);                                                                          \
+                (void)(b);                                                                          \
+                (void)(c);                                                                          \
+        } while (0)
+#endif
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,384 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "process.h"
+#include "str.h"
+#include "util.h"
+
+extern char **environ;
+
+/**
+ * Pipes are drained in chunks of this size
+ */
+#define UF_SPAWN_READ_SIZE 16384
+
+typedef struct UfSpawnPipe {
+        int fd;          /**<Read end, -1 once closed */
+        UfString output; /**<Everything read so far */
+} UfSpawnPipe;
+
+struct UfSpawn {
+        pid_t pid;
+        bool reaped;
+        int status;
+        UfSpawnPipe pipes[2]; /**<stdout, stderr */
+};
+
+static void uf_spawn_close_pipe(UfSpawnPipe *capture)
+{
+        if (capture->fd >= 0) {
+                close(capture->fd);
+                capture->fd = -1;
+        }
+}
+
+/**
+ * Open a capture pipe, both ends close-on-exec. The write end is dup'd
+ * into place in the child, which clears the flag on the copy.
+ *
+ * The write end is moved to at least @min_fd so that none of the caller's
+ * descriptor mappings can overwrite it in the child before it is used.
+ */
+static bool uf_spawn_open_pipe(UfSpawnPipe *capture, int *write_fd, int min_fd)
+{
+        int fds[2];
+        int moved;
+
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0) {
+                return false;
+        }
+        /* Only the read end should be non-blocking */
+        if (fcntl(fds[1], F_SETFL, 0) != 0) {
+                goto fail;
+        }
+        if (fds[1] < min_fd) {
+                moved = fcntl(fds[1], F_DUPFD_CLOEXEC, min_fd);
+                if (moved < 0) {
+                        goto fail;
+                }
+                close(fds[1]);
+                fds[1] = moved;
+        }
+        capture->fd = fds[0];
+        *write_fd = fds[1];
+        return true;
+
+fail:
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+}
+
+UfSpawn *uf_spawn_new(const UfSpawnOptions *options)
+{
+        UfSpawn *ret = NULL;
+        posix_spawn_file_actions_t actions;
+        posix_spawnattr_t attr;
+        sigset_t mask;
+        int write_fds[2] = { -1, -1 };
+        int min_fd = STDERR_FILENO + 1;
+        int err = 0;
+        const unsigned int capture[2] = { UF_SPAWN_CAPTURE_STDOUT, UF_SPAWN_CAPTURE_STDERR };
+
+        if (uf_unlikely(!options || !options->argv || !options->argv[0])) {
+                errno = EINVAL;
+                return NULL;
+        }
+
+        ret = calloc(1, sizeof(struct UfSpawn));
+        if (!ret) {
+                return NULL;
+        }
+        ret->pid = -1;
+        for (size_t i = 0; i < 2; i++) {
+                ret->pipes[i].fd = -1;
+                uf_string_init(&ret->pipes[i].output);
+        }
+
+        if ((err = posix_spawn_file_actions_init(&actions)) != 0) {
+                goto out_actions;
+        }
+        if ((err = posix_spawnattr_init(&attr)) != 0) {
+                goto out_attr;
+        }
+
+        /* Keep the capture pipes clear of every descriptor the mapping touches */
+        for (size_t i = 0; i < options->n_fds; i++) {
+                if (options->fds[i].parent_fd >= min_fd) {
+                        min_fd = options->fds[i].parent_fd + 1;
+                }
+                if (options->fds[i].child_fd >= min_fd) {
+                        min_fd = options->fds[i].child_fd + 1;
+                }
+        }
+        for (int i = 0; i < 2; i++) {
+                if (!(options->flags & capture[i])) {
+                        continue;
+                }
+                if (!uf_spawn_open_pipe(&ret->pipes[i], &write_fds[i], min_fd)) {
+                        err = errno;
+                        goto out;
+                }
+        }
+
+        for (size_t i = 0; i < options->n_fds; i++) {
+                err = posix_spawn_file_actions_adddup2(&actions,
+                                                       options->fds[i].parent_fd,
+                                                       options->fds[i].child_fd);
+                if (err != 0) {
+                        goto out;
+                }
+        }
+        for (int i = 0; i < 2; i++) {
+                if (write_fds[i] < 0) {
+                        continue;
+                }
+                err = posix_spawn_file_actions_adddup2(&actions, write_fds[i], i + 1);
+                if (err != 0) {
+                        goto out;
+                }
+        }
+
+        /* Don't leak our signal state into the child */
+        sigemptyset(&mask);
+        posix_spawnattr_setsigmask(&attr, &mask);
+        sigfillset(&mask);
+        sigdelset(&mask, SIGKILL);
+        sigdelset(&mask, SIGSTOP);
+        posix_spawnattr_setsigdefault(&attr, &mask);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+        if (options->flags & UF_SPAWN_SEARCH_PATH) {
+                err = posix_spawnp(&ret->pid,
+                                   options->argv[0],
+                                   &actions,
+                                   &attr,
+                                   (char *const *)options->argv,
+                                   options->envp ? (char *const *)options->envp : environ);
+        } else {
+                err = posix_spawn(&ret->pid,
+                                  options->argv[0],
+                                  &actions,
+                                  &attr,
+                                  (char *const *)options->argv,
+                                  options->envp ? (char *const *)options->envp : environ);
+        }
+
+out:
+        for (int i = 0; i < 2; i++) {
+                if (write_fds[i] >= 0) {
+                        close(write_fds[i]);
+                }
+        }
+        posix_spawnattr_destroy(&attr);
+out_attr:
+        posix_spawn_file_actions_destroy(&actions);
+out_actions:
+        if (err != 0) {
+                ret->pid = -1;
+                uf_spawn_free(ret);
+                errno = err;
+                return NULL;
+        }
+
+        return ret;
+}
+
+void uf_spawn_free(UfSpawn *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        for (size_t i = 0; i < 2; i++) {
+                uf_spawn_close_pipe(&self->pipes[i]);
+                uf_string_clear(&self->pipes[i].output);
+        }
+        free(self);
+}
+
+pid_t uf_spawn_pid(UfSpawn *self)
+{
+        if (uf_unlikely(!self)) {
+                return -1;
+        }
+        return self->pid;
+}
+
+size_t uf_spawn_pollfds(UfSpawn *self, struct pollfd *fds)
+{
+        size_t n = 0;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        for (size_t i = 0; i < 2; i++) {
+                if (self->pipes[i].fd < 0) {
+                        continue;
+                }
+                fds[n++] = (struct pollfd){.fd = self->pipes[i].fd, .events = POLLIN };
+        }
+        return n;
+}
+
+bool uf_spawn_handle(UfSpawn *self, const struct pollfd *pfd)
+{
+        UfSpawnPipe *capture = NULL;
+        char buf[UF_SPAWN_READ_SIZE];
+
+        if (uf_unlikely(!self || !pfd)) {
+                return false;
+        }
+        for (size_t i = 0; i < 2; i++) {
+                if (self->pipes[i].fd >= 0 && self->pipes[i].fd == pfd->fd) {
+                        capture = &self->pipes[i];
+                        break;
+                }
+        }
+        if (!capture || !(pfd->revents & (POLLIN | POLLHUP | POLLERR))) {
+                return true;
+        }
+
+        /* Drain everything available, the pipe is non-blocking */
+        for (;;) {
+                ssize_t r = read(capture->fd, buf, sizeof(buf));
+                if (r > 0) {
+                        if (!uf_string_append_len(&capture->output, buf, (size_t)r)) {
+                                /* Stop capturing, or callers would poll it forever */
+                                uf_spawn_close_pipe(capture);
+                                errno = ENOMEM;
+                                return false;
+                        }
+                        continue;
+                }
+                if (r == 0) {
+                        uf_spawn_close_pipe(capture);
+                        return true;
+                }
+                if (errno == EINTR) {
+                        continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        return true;
+                }
+                uf_spawn_close_pipe(capture);
+                return false;
+        }
+}
+
+static bool uf_spawn_reap(UfSpawn *self, int flags, int *status)
+{
+        pid_t r;
+
+        if (self->reaped) {
+                goto done;
+        }
+        if (self->pid < 0) {
+                return false;
+        }
+
+        do {
+                r = waitpid(self->pid, &self->status, flags);
+        } while (r < 0 && errno == EINTR);
+
+        if (r != self->pid) {
+                return false;
+        }
+        self->reaped = true;
+
+done:
+        if (status) {
+                *status = self->status;
+        }
+        return true;
+}
+
+bool uf_spawn_try_reap(UfSpawn *self, int *status)
+{
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+        return uf_spawn_reap(self, WNOHANG, status);
+}
+
+bool uf_spawn_wait(UfSpawn *self, int *status)
+{
+        struct pollfd fds[2];
+        size_t n;
+        bool ok = true;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        while ((n = uf_spawn_pollfds(self, fds)) > 0) {
+                if (poll(fds, (nfds_t)n, -1) < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        ok = false;
+                        break;
+                }
+                for (size_t i = 0; i < n; i++) {
+                        if (!uf_spawn_handle(self, &fds[i])) {
+                                ok = false;
+                        }
+                }
+        }
+
+        /* Always reap, even if capture failed, to avoid a zombie */
+        return uf_spawn_reap(self, 0, status) && ok;
+}
+
+static const char *uf_spawn_output(UfSpawn *self, size_t index, size_t *len)
+{
+        if (uf_unlikely(!self)) {
+                if (len) {
+                        *len = 0;
+                }
+                return NULL;
+        }
+        if (len) {
+                *len = uf_string_len(&self->pipes[index].output);
+        }
+        return uf_string_str(&self->pipes[index].output);
+}
+
+const char *uf_spawn_stdout(UfSpawn *self, size_t *len)
+{
+        return uf_spawn_output(self, 0, len);
+}
+
+const char *uf_spawn_stderr(UfSpawn *self, size_t *len)
+{
+        return uf_spawn_output(self, 1, len);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
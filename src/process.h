@@ -0,0 +1,141 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * UfSpawn launches a child process with posix_spawn, which on glibc and
+ * musl uses CLONE_VM|CLONE_VFORK rather than fork. The cost of launching
+ * is therefore independent of the parent's RSS.
+ *
+ * Optionally stdout and/or stderr are captured through pipes that are
+ * serviced with poll, so a chatty child can never deadlock against us.
+ */
+typedef struct UfSpawn UfSpawn;
+
+/**
+ * Behaviour flags for UfSpawnOptions
+ */
+typedef enum {
+        UF_SPAWN_CAPTURE_STDOUT = 1 << 0, /**<Collect the child's stdout */
+        UF_SPAWN_CAPTURE_STDERR = 1 << 1, /**<Collect the child's stderr */
+        UF_SPAWN_SEARCH_PATH = 1 << 2,    /**<Look argv[0] up in PATH */
+} UfSpawnFlags;
+
+/**
+ * Make @parent_fd available as @child_fd in the child
+ */
+typedef struct UfSpawnFd {
+        int parent_fd;
+        int child_fd;
+} UfSpawnFd;
+
+/**
+ * Describes the process to launch
+ *
+ * @note Descriptors not marked close-on-exec are inherited, in addition
+ * to the explicit @fds mapping. Captured streams override any mapping for
+ * fd 1 or 2.
+ */
+typedef struct UfSpawnOptions {
+        const char *const *argv; /**<NULL terminated, argv[0] is the program */
+        const char *const *envp; /**<NULL terminated environment, or NULL to inherit */
+        const UfSpawnFd *fds;    /**<Explicit descriptor mapping, applied in order */
+        size_t n_fds;            /**<Number of entries in @fds */
+        unsigned int flags;      /**<Bitwise OR of UfSpawnFlags */
+} UfSpawnOptions;
+
+/**
+ * Launch a new child process. The child starts with an empty signal mask
+ * and default signal dispositions.
+ *
+ * @note Free with uf_spawn_free, after uf_spawn_wait to avoid a zombie
+ *
+ * @returns A new UfSpawn, or NULL with errno set if the launch failed
+ */
+UfSpawn *uf_spawn_new(const UfSpawnOptions *options);
+
+/**
+ * Free a UfSpawn and close any capture pipes. This does not wait for the
+ * child.
+ */
+void uf_spawn_free(UfSpawn *spawn);
+
+/**
+ * Return the process ID of the child
+ */
+pid_t uf_spawn_pid(UfSpawn *spawn);
+
+/**
+ * Service capture pipes and wait for the child to exit
+ *
+ * @param status Set to the raw wait status, see waitpid(2)
+ *
+ * @returns True if the child was reaped
+ */
+bool uf_spawn_wait(UfSpawn *spawn, int *status);
+
+/**
+ * Return the captured stdout. The buffer is owned by @spawn.
+ *
+ * @param len Set to the length of the output, if not NULL
+ */
+const char *uf_spawn_stdout(UfSpawn *spawn, size_t *len);
+
+/**
+ * Return the captured stderr. The buffer is owned by @spawn.
+ *
+ * @param len Set to the length of the output, if not NULL
+ */
+const char *uf_spawn_stderr(UfSpawn *spawn, size_t *len);
+
+/**
+ * Fill @fds with up to 2 entries for the still open capture pipes, for
+ * callers multiplexing many children in their own poll loop.
+ *
+ * @returns The number of entries stored
+ */
+size_t uf_spawn_pollfds(UfSpawn *spawn, struct pollfd *fds);
+
+/**
+ * Consume the readiness reported in @pfd, which must be one of the entries
+ * from uf_spawn_pollfds. Pipes are closed once they reach EOF, or when
+ * reading from them fails.
+ *
+ * @returns False on a read or allocation error
+ */
+bool uf_spawn_handle(UfSpawn *spawn, const struct pollfd *pfd);
+
+/**
+ * Reap the child if it has exited, without blocking
+ *
+ * @param status Set to the raw wait status when reaped
+ *
+ * @returns True if the child has been reaped
+ */
+bool uf_spawn_try_reap(UfSpawn *spawn, int *status);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,697 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "roaring.h"
+#include "util.h"
+
+/**
+ * Past 4096 entries a uint16_t array is larger than the 8KiB bitmap, so
+ * that's where we switch representation.
+ */
+#define UF_ROARING_ARRAY_MAX 4096
+
+/**
+ * 65536 bits per container
+ */
+#define UF_ROARING_BITMAP_WORDS 1024
+
+typedef enum {
+        UF_ROARING_AND = 0,
+        UF_ROARING_OR,
+        UF_ROARING_XOR,
+        UF_ROARING_ANDNOT,
+} UfRoaringOp;
+
+/**
+ * A container holds every value sharing the same upper 16 bits. Exactly
+ * one of array or bitmap is set.
+ */
+typedef struct UfRoaringContainer {
+        uint16_t *array;   /**<Sorted low 16 bits, when sparse */
+        uint64_t *bitmap;  /**<UF_ROARING_BITMAP_WORDS words, when dense */
+        uint32_t count;    /**<Number of values in this container */
+        uint32_t capacity; /**<Allocated array entries */
+        uint16_t key;      /**<Upper 16 bits */
+} UfRoaringContainer;
+
+struct UfRoaring {
+        UfRoaringContainer *containers; /**<Sorted by key */
+        uint32_t n_containers;
+        uint32_t capacity;
+};
+
+UfRoaring *uf_roaring_new(void)
+{
+        return calloc(1, sizeof(struct UfRoaring));
+}
+
+static void uf_roaring_container_free(UfRoaringContainer *c)
+{
+        free(c->array);
+        free(c->bitmap);
+}
+
+void uf_roaring_free(UfRoaring *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        for (uint32_t i = 0; i < self->n_containers; i++) {
+                uf_roaring_container_free(&self->containers[i]);
+        }
+        free(self->containers);
+        free(self);
+}
+
+/**
+ * Binary search for the container with @key, setting @pos to where it
+ * is (or should be inserted).
+ */
+static bool uf_roaring_find(UfRoaring *self, uint16_t key, uint32_t *pos)
+{
+        uint32_t lo = 0;
+        uint32_t hi = self->n_containers;
+
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (self->containers[mid].key < key) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        *pos = lo;
+        return lo < self->n_containers && self->containers[lo].key == key;
+}
+
+/**
+ * Open a gap at @pos and return it, the caller populates the container.
+ */
+static UfRoaringContainer *uf_roaring_insert_at(UfRoaring *self, uint32_t pos, uint16_t key)
+{
+        UfRoaringContainer *c = NULL;
+
+        if (self->n_containers == self->capacity) {
+                uint32_t capacity = self->capacity ? self->capacity * 2 : 4;
+                c = realloc(self->containers, capacity * sizeof(UfRoaringContainer));
+                if (!c) {
+                        return NULL;
+                }
+                self->containers = c;
+                self->capacity = capacity;
+        }
+
+        c = &self->containers[pos];
+        memmove(c + 1, c, (self->n_containers - pos) * sizeof(UfRoaringContainer));
+        memset(c, 0, sizeof(UfRoaringContainer));
+        c->key = key;
+        self->n_containers++;
+        return c;
+}
+
+static void uf_roaring_remove_at(UfRoaring *self, uint32_t pos)
+{
+        UfRoaringContainer *c = &self->containers[pos];
+
+        uf_roaring_container_free(c);
+        memmove(c, c + 1, (self->n_containers - pos - 1) * sizeof(UfRoaringContainer));
+        self->n_containers--;
+}
+
+/**
+ * Lower bound of @low within an array container
+ */
+static uint32_t uf_roaring_array_find(const UfRoaringContainer *c, uint16_t low)
+{
+        uint32_t lo = 0;
+        uint32_t hi = c->count;
+
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (c->array[mid] < low) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+static bool uf_roaring_to_bitmap(UfRoaringContainer *c)
+{
+        uint64_t *bitmap = calloc(UF_ROARING_BITMAP_WORDS, sizeof(uint64_t));
+
+        if (!bitmap) {
+                return false;
+        }
+        for (uint32_t i = 0; i < c->count; i++) {
+                bitmap[c->array[i] / 64] |= ((uint64_t)1) << (c->array[i] % 64);
+        }
+        free(c->array);
+        c->array = NULL;
+        c->capacity = 0;
+        c->bitmap = bitmap;
+        return true;
+}
+
+/**
+ * Convert back to an array once a bitmap becomes sparse. Failing to
+ * allocate is harmless, we just stay a bitmap.
+ */
+static void uf_roaring_to_array(UfRoaringContainer *c)
+{
+        uint16_t *array = NULL;
+        uint32_t n = 0;
+
+        if (!c->bitmap || c->count > UF_ROARING_ARRAY_MAX) {
+                return;
+        }
+
+        array = malloc((c->count ? c->count : 1) * sizeof(uint16_t));
+        if (!array) {
+                return;
+        }
+        for (uint32_t i = 0; i < UF_ROARING_BITMAP_WORDS; i++) {
+                uint64_t word = c->bitmap[i];
+                while (word) {
+                        array[n++] = (uint16_t)(i * 64 + (uint32_t)__builtin_ctzll(word));
+                        word &= word - 1;
+                }
+        }
+        free(c->bitmap);
+        c->bitmap = NULL;
+        c->array = array;
+        c->capacity = c->count ? c->count : 1;
+}
+
+static bool uf_roaring_container_add(UfRoaringContainer *c, uint16_t low)
+{
+        uint32_t pos;
+
+        if (c->bitmap) {
+                uint64_t mask = ((uint64_t)1) << (low % 64);
+                if (!(c->bitmap[low / 64] & mask)) {
+                        c->bitmap[low / 64] |= mask;
+                        c->count++;
+                }
+                return true;
+        }
+
+        pos = uf_roaring_array_find(c, low);
+        if (pos < c->count && c->array[pos] == low) {
+                return true;
+        }
+
+        if (c->count == UF_ROARING_ARRAY_MAX) {
+                if (!uf_roaring_to_bitmap(c)) {
+                        return false;
+                }
+                return uf_roaring_container_add(c, low);
+        }
+
+        if (c->count == c->capacity) {
+                uint32_t capacity = c->capacity ? c->capacity * 2 : 4;
+                uint16_t *array = NULL;
+
+                if (capacity > UF_ROARING_ARRAY_MAX) {
+                        capacity = UF_ROARING_ARRAY_MAX;
+                }
+                array = realloc(c->array, capacity * sizeof(uint16_t));
+                if (!array) {
+                        return false;
+                }
+                c->array = array;
+                c->capacity = capacity;
+        }
+
+        memmove(c->array + pos + 1, c->array + pos, (c->count - pos) * sizeof(uint16_t));
+        c->array[pos] = low;
+        c->count++;
+        return true;
+}
+
+bool uf_roaring_add(UfRoaring *self, uint32_t value)
+{
+        UfRoaringContainer *c = NULL;
+        uint16_t key = (uint16_t)(value >> 16);
+        uint32_t pos;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        if (uf_roaring_find(self, key, &pos)) {
+                c = &self->containers[pos];
+        } else {
+                c = uf_roaring_insert_at(self, pos, key);
+                if (!c) {
+                        return false;
+                }
+        }
+
+        if (!uf_roaring_container_add(c, (uint16_t)value)) {
+                if (c->count == 0) {
+                        uf_roaring_remove_at(self, pos);
+                }
+                return false;
+        }
+        return true;
+}
+
+bool uf_roaring_remove(UfRoaring *self, uint32_t value)
+{
+        UfRoaringContainer *c = NULL;
+        uint16_t low = (uint16_t)value;
+        uint32_t pos;
+
+        if (uf_unlikely(!self) || !uf_roaring_find(self, (uint16_t)(value >> 16), &pos)) {
+                return false;
+        }
+        c = &self->containers[pos];
+
+        if (c->bitmap) {
+                uint64_t mask = ((uint64_t)1) << (low % 64);
+                if (!(c->bitmap[low / 64] & mask)) {
+                        return false;
+                }
+                c->bitmap[low / 64] &= ~mask;
+                c->count--;
+                uf_roaring_to_array(c);
+        } else {
+                uint32_t i = uf_roaring_array_find(c, low);
+                if (i >= c->count || c->array[i] != low) {
+                        return false;
+                }
+                memmove(c->array + i, c->array + i + 1, (c->count - i - 1) * sizeof(uint16_t));
+                c->count--;
+
+                /* Give memory back once the array is mostly empty */
+                if (c->count > 0 && c->count < c->capacity / 4) {
+                        uint16_t *array = realloc(c->array, c->capacity / 2 * sizeof(uint16_t));
+                        if (array) {
+                                c->array = array;
+                                c->capacity /= 2;
+                        }
+                }
+        }
+
+        if (c->count == 0) {
+                uf_roaring_remove_at(self, pos);
+        }
+        return true;
+}
+
+bool uf_roaring_contains(UfRoaring *self, uint32_t value)
+{
+        UfRoaringContainer *c = NULL;
+        uint16_t low = (uint16_t)value;
+        uint32_t pos;
+
+        if (uf_unlikely(!self) || !uf_roaring_find(self, (uint16_t)(value >> 16), &pos)) {
+                return false;
+        }
+        c = &self->containers[pos];
+
+        if (c->bitmap) {
+                return (c->bitmap[low / 64] & (((uint64_t)1) << (low % 64))) != 0;
+        }
+        pos = uf_roaring_array_find(c, low);
+        return pos < c->count && c->array[pos] == low;
+}
+
+uint64_t uf_roaring_count(UfRoaring *self)
+{
+        uint64_t count = 0;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        for (uint32_t i = 0; i < self->n_containers; i++) {
+                count += self->containers[i].count;
+        }
+        return count;
+}
+
+/**
+ * First value >= @low within a container
+ */
+static bool uf_roaring_container_next(const UfRoaringContainer *c, uint32_t low, uint32_t *out)
+{
+        if (c->bitmap) {
+                uint32_t i = low / 64;
+                uint64_t word;
+
+                if (i >= UF_ROARING_BITMAP_WORDS) {
+                        return false;
+                }
+                word = c->bitmap[i] & (~(uint64_t)0 << (low % 64));
+                while (!word) {
+                        if (++i >= UF_ROARING_BITMAP_WORDS) {
+                                return false;
+                        }
+                        word = c->bitmap[i];
+                }
+                *out = i * 64 + (uint32_t)__builtin_ctzll(word);
+                return true;
+        } else {
+                uint32_t pos = uf_roaring_array_find(c, (uint16_t)low);
+                if (low > UINT16_MAX || pos >= c->count) {
+                        return false;
+                }
+                *out = c->array[pos];
+                return true;
+        }
+}
+
+bool uf_roaring_next(UfRoaring *self, uint32_t from, uint32_t *value)
+{
+        uint16_t key = (uint16_t)(from >> 16);
+        uint32_t pos;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        uf_roaring_find(self, key, &pos);
+        for (; pos < self->n_containers; pos++) {
+                UfRoaringContainer *c = &self->containers[pos];
+                uint32_t low = c->key == key ? (from & 0xFFFF) : 0;
+                uint32_t found;
+
+                if (uf_roaring_container_next(c, low, &found)) {
+                        *value = ((uint32_t)c->key << 16) | found;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Merge two sorted arrays according to @op. @out must have room for
+ * a->count + b->count entries.
+ */
+static uint32_t uf_roaring_merge(const UfRoaringContainer *a, const UfRoaringContainer *b,
+                                 UfRoaringOp op, uint16_t *out)
+{
+        uint32_t i = 0;
+        uint32_t j = 0;
+        uint32_t n = 0;
+
+        while (i < a->count && j < b->count) {
+                if (a->array[i] < b->array[j]) {
+                        if (op != UF_ROARING_AND) {
+                                out[n++] = a->array[i];
+                        }
+                        i++;
+                } else if (a->array[i] > b->array[j]) {
+                        if (op == UF_ROARING_OR || op == UF_ROARING_XOR) {
+                                out[n++] = b->array[j];
+                        }
+                        j++;
+                } else {
+                        if (op == UF_ROARING_AND || op == UF_ROARING_OR) {
+                                out[n++] = a->array[i];
+                        }
+                        i++;
+                        j++;
+                }
+        }
+        if (op != UF_ROARING_AND) {
+                for (; i < a->count; i++) {
+                        out[n++] = a->array[i];
+                }
+        }
+        if (op == UF_ROARING_OR || op == UF_ROARING_XOR) {
+                for (; j < b->count; j++) {
+                        out[n++] = b->array[j];
+                }
+        }
+        return n;
+}
+
+/**
+ * Apply @op to @a in place with @b. Arrays are merged directly, anything
+ * involving a bitmap runs through the word kernels.
+ */
+static bool uf_roaring_container_op(UfRoaringContainer *a, const UfRoaringContainer *b,
+                                    UfRoaringOp op)
+{
+        uint64_t *scratch = NULL;
+        const uint64_t *words = NULL;
+
+        if (!a->bitmap && !b->bitmap) {
+                uint32_t capacity = a->count + b->count + 1;
+                uint16_t *out = malloc(capacity * sizeof(uint16_t));
+                if (!out) {
+                        return false;
+                }
+                a->count = uf_roaring_merge(a, b, op, out);
+                free(a->array);
+                a->array = out;
+                a->capacity = capacity;
+                if (a->count > UF_ROARING_ARRAY_MAX) {
+                        return uf_roaring_to_bitmap(a);
+                }
+                return true;
+        }
+
+        /* Sparse & dense only needs to filter the array */
+        if (op == UF_ROARING_AND && !a->bitmap) {
+                uint32_t n = 0;
+                for (uint32_t i = 0; i < a->count; i++) {
+                        uint16_t v = a->array[i];
+                        if (b->bitmap[v / 64] & (((uint64_t)1) << (v % 64))) {
+                                a->array[n++] = v;
+                        }
+                }
+                a->count = n;
+                return true;
+        }
+
+        if (!a->bitmap && !uf_roaring_to_bitmap(a)) {
+                return false;
+        }
+
+        if (b->bitmap) {
+                words = b->bitmap;
+        } else {
+                scratch = calloc(UF_ROARING_BITMAP_WORDS, sizeof(uint64_t));
+                if (!scratch) {
+                        return false;
+                }
+                for (uint32_t i = 0; i < b->count; i++) {
+                        scratch[b->array[i] / 64] |= ((uint64_t)1) << (b->array[i] % 64);
+                }
+                words = scratch;
+        }
+
+        switch (op) {
+        case UF_ROARING_AND:
+                uf_bits_and(a->bitmap, words, UF_ROARING_BITMAP_WORDS);
+                break;
+        case UF_ROARING_OR:
+                uf_bits_or(a->bitmap, words, UF_ROARING_BITMAP_WORDS);
+                break;
+        case UF_ROARING_XOR:
+                uf_bits_xor(a->bitmap, words, UF_ROARING_BITMAP_WORDS);
+                break;
+        case UF_ROARING_ANDNOT:
+        default:
+                uf_bits_andnot(a->bitmap, words, UF_ROARING_BITMAP_WORDS);
+                break;
+        }
+        free(scratch);
+
+        a->count = (uint32_t)uf_bits_popcount(a->bitmap, UF_ROARING_BITMAP_WORDS);
+        uf_roaring_to_array(a);
+        return true;
+}
+
+static bool uf_roaring_container_copy(UfRoaringContainer *dest, const UfRoaringContainer *src)
+{
+        *dest = *src;
+        if (src->bitmap) {
+                dest->bitmap = malloc(UF_ROARING_BITMAP_WORDS * sizeof(uint64_t));
+                if (!dest->bitmap) {
+                        return false;
+                }
+                memcpy(dest->bitmap, src->bitmap, UF_ROARING_BITMAP_WORDS * sizeof(uint64_t));
+        } else {
+                dest->array = malloc((src->count ? src->count : 1) * sizeof(uint16_t));
+                if (!dest->array) {
+                        return false;
+                }
+                memcpy(dest->array, src->array, src->count * sizeof(uint16_t));
+                dest->capacity = src->count ? src->count : 1;
+        }
+        return true;
+}
+
+/**
+ * Drop every container, for ops where @self is its own operand.
+ */
+static void uf_roaring_clear(UfRoaring *self)
+{
+        for (uint32_t i = 0; i < self->n_containers; i++) {
+                uf_roaring_container_free(&self->containers[i]);
+        }
+        self->n_containers = 0;
+}
+
+/**
+ * AND and ANDNOT only ever shrink @self, so we walk our own containers.
+ */
+static bool uf_roaring_op_shrink(UfRoaring *self, UfRoaring *other, UfRoaringOp op)
+{
+        uint32_t i = 0;
+
+        while (i < self->n_containers) {
+                UfRoaringContainer *c = &self->containers[i];
+                uint32_t pos;
+
+                if (!uf_roaring_find(other, c->key, &pos)) {
+                        if (op == UF_ROARING_AND) {
+                                uf_roaring_remove_at(self, i);
+                        } else {
+                                i++;
+                        }
+                        continue;
+                }
+
+                if (!uf_roaring_container_op(c, &other->containers[pos], op)) {
+                        return false;
+                }
+                if (c->count == 0) {
+                        uf_roaring_remove_at(self, i);
+                } else {
+                        i++;
+                }
+        }
+        return true;
+}
+
+/**
+ * OR and XOR pull in containers from @other that we don't have.
+ */
+static bool uf_roaring_op_grow(UfRoaring *self, UfRoaring *other, UfRoaringOp op)
+{
+        for (uint32_t i = 0; i < other->n_containers; i++) {
+                UfRoaringContainer *theirs = &other->containers[i];
+                UfRoaringContainer *c = NULL;
+                uint32_t pos;
+
+                if (!uf_roaring_find(self, theirs->key, &pos)) {
+                        c = uf_roaring_insert_at(self, pos, theirs->key);
+                        if (!c) {
+                                return false;
+                        }
+                        if (!uf_roaring_container_copy(c, theirs)) {
+                                c->array = NULL;
+                                c->bitmap = NULL;
+                                uf_roaring_remove_at(self, pos);
+                                return false;
+                        }
+                        continue;
+                }
+
+                c = &self->containers[pos];
+                if (!uf_roaring_container_op(c, theirs, op)) {
+                        return false;
+                }
+                if (c->count == 0) {
+                        uf_roaring_remove_at(self, pos);
+                }
+        }
+        return true;
+}
+
+bool uf_roaring_and(UfRoaring *self, UfRoaring *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (self == other) {
+                return true;
+        }
+        return uf_roaring_op_shrink(self, other, UF_ROARING_AND);
+}
+
+bool uf_roaring_andnot(UfRoaring *self, UfRoaring *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (self == other) {
+                uf_roaring_clear(self);
+                return true;
+        }
+        return uf_roaring_op_shrink(self, other, UF_ROARING_ANDNOT);
+}
+
+bool uf_roaring_or(UfRoaring *self, UfRoaring *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (self == other) {
+                return true;
+        }
+        return uf_roaring_op_grow(self, other, UF_ROARING_OR);
+}
+
+bool uf_roaring_xor(UfRoaring *self, UfRoaring *other)
+{
+        if (uf_unlikely(!self || !other)) {
+                return false;
+        }
+        if (self == other) {
+                uf_roaring_clear(self);
+                return true;
+        }
+        return uf_roaring_op_grow(self, other, UF_ROARING_XOR);
+}
+
+size_t uf_roaring_memory(UfRoaring *self)
+{
+        size_t size;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+
+        size = sizeof(struct UfRoaring) + self->capacity * sizeof(UfRoaringContainer);
+        for (uint32_t i = 0; i < self->n_containers; i++) {
+                UfRoaringContainer *c = &self->containers[i];
+                if (c->bitmap) {
+                        size += UF_ROARING_BITMAP_WORDS * sizeof(uint64_t);
+                } else {
+                        size += c->capacity * sizeof(uint16_t);
+                }
+        }
+        return size;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,119 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfRoaring is a compressed set of 32-bit integers, in the style of
+ * Roaring bitmaps. IDs are grouped by their upper 16 bits, and each group
+ * is stored either as a sorted array (sparse) or a 8KiB bitmap (dense),
+ * whichever is smaller.
+ *
+ * Use it over UfBitset when the ID space is large and sparsely populated.
+ */
+typedef struct UfRoaring UfRoaring;
+
+/**
+ * Construct a new, empty UfRoaring
+ *
+ * @note Free with uf_roaring_free
+ *
+ * @return A newly allocated UfRoaring
+ */
+UfRoaring *uf_roaring_new(void);
+
+/**
+ * Free a previously allocated set
+ *
+ * @param set Pointer to a previously allocated set
+ */
+void uf_roaring_free(UfRoaring *set);
+
+/**
+ * Add @value to the set
+ *
+ * @returns True if the value could be stored
+ */
+bool uf_roaring_add(UfRoaring *set, uint32_t value);
+
+/**
+ * Remove @value from the set
+ *
+ * @returns True if the value was present
+ */
+bool uf_roaring_remove(UfRoaring *set, uint32_t value);
+
+/**
+ * Test whether @value is in the set
+ */
+bool uf_roaring_contains(UfRoaring *set, uint32_t value);
+
+/**
+ * Return the number of values in the set
+ */
+uint64_t uf_roaring_count(UfRoaring *set);
+
+/**
+ * Find the first value at or after @from, see uf_bitset_next
+ *
+ * @returns True if a value was found
+ */
+bool uf_roaring_next(UfRoaring *set, uint32_t from, uint32_t *value);
+
+/**
+ * In place intersection, @set &= @other
+ *
+ * @returns True if the result could be stored
+ */
+bool uf_roaring_and(UfRoaring *set, UfRoaring *other);
+
+/**
+ * In place union, @set |= @other
+ *
+ * @returns True if the result could be stored
+ */
+bool uf_roaring_or(UfRoaring *set, UfRoaring *other);
+
+/**
+ * In place symmetric difference, @set ^= @other
+ *
+ * @returns True if the result could be stored
+ */
+bool uf_roaring_xor(UfRoaring *set, UfRoaring *other);
+
+/**
+ * In place difference, @set &= ~@other
+ *
+ * @returns True if the result could be stored
+ */
+bool uf_roaring_andnot(UfRoaring *set, UfRoaring *other);
+
+/**
+ * Return the approximate number of bytes used by @set
+ */
+size_t uf_roaring_memory(UfRoaring *set);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
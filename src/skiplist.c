@@ -0,0 +1,632 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "skiplist.h"
+#include "util.h"
+
+/**
+ * With a 1/4 promotion rate, 16 levels comfortably covers 2^32 entries.
+ */
+#define UF_SKIPLIST_MAX_LEVEL 16
+
+/**
+ * Number of epoch reservation slots. Each operation claims a free slot for
+ * its duration. Once all are taken, further operations share the overflow
+ * slot instead of waiting for one to free up.
+ */
+#define UF_SKIPLIST_SLOTS 64
+
+/**
+ * The overflow slot packs the number of operations using it into the low
+ * bits and the epoch they announced above. 24 bits covers the Linux
+ * PID_MAX_LIMIT, so it cannot saturate. Only the low bits of the epoch
+ * are kept, which is enough for the equality test in try_advance.
+ */
+#define UF_SKIPLIST_OVERFLOW_BITS 24
+#define UF_SKIPLIST_OVERFLOW_MASK ((((uint_fast64_t)1) << UF_SKIPLIST_OVERFLOW_BITS) - 1)
+#define UF_SKIPLIST_OVERFLOW_COUNT(x) ((x)&UF_SKIPLIST_OVERFLOW_MASK)
+#define UF_SKIPLIST_OVERFLOW_EPOCH(x) ((x) >> UF_SKIPLIST_OVERFLOW_BITS)
+#define UF_SKIPLIST_EPOCH_MASK ((((uint_fast64_t)1) << (64 - UF_SKIPLIST_OVERFLOW_BITS)) - 1)
+
+/**
+ * Attempt reclamation after this many retirements.
+ */
+#define UF_SKIPLIST_COLLECT_INTERVAL 64
+
+/**
+ * The low bit of a next pointer marks the *owning* node as logically
+ * deleted at that level. Marked pointers are never modified again.
+ */
+#define UF_SKIPLIST_IS_MARKED(x) ((x)&1)
+#define UF_SKIPLIST_MARK(x) ((x) | 1)
+#define UF_SKIPLIST_PTR(x) ((UfSkipListNode *)((x) & ~(uintptr_t)1))
+
+typedef struct UfSkipListNode {
+        void *key;
+        void *value;
+        struct UfSkipListNode *retired_next; /**<Link in the retire list */
+        uint_fast64_t retired_epoch;         /**<Global epoch at retirement */
+        atomic_uint refs;                    /**<Held by the inserter and the remover */
+        unsigned int level;                  /**<Number of levels in next */
+        _Atomic(uintptr_t) next[];           /**<Tagged successor per level */
+} UfSkipListNode;
+
+/**
+ * An epoch reservation slot: 0 when free, otherwise (epoch << 1) | 1.
+ * Padded to a cache line to avoid false sharing between threads.
+ */
+typedef struct UfSkipListSlot {
+        _Alignas(64) _Atomic(uint_fast64_t) state;
+} UfSkipListSlot;
+
+struct UfSkipList {
+        UfSkipListSlot slots[UF_SKIPLIST_SLOTS];
+        UfSkipListSlot overflow;                    /**<Shared once every slot is taken */
+        _Alignas(64) _Atomic(uint_fast64_t) epoch;  /**<Global epoch */
+        _Atomic(UfSkipListNode *) retired;          /**<Unlinked nodes awaiting reclamation */
+        atomic_uint n_retired;                      /**<Retirement counter */
+        UfSkipListNode *head;                       /**<Sentinel, never compared */
+        uf_hashmap_compare_func compare;
+        struct {
+                uf_hashmap_free_func key;   /**<Key free function */
+                uf_hashmap_free_func value; /**<Value free function */
+        } free;
+};
+
+static _Thread_local uint64_t uf_skiplist_rng;
+
+UfSkipList *uf_skiplist_new(uf_hashmap_compare_func compare)
+{
+        return uf_skiplist_new_full(compare, NULL, NULL);
+}
+
+static UfSkipListNode *uf_skiplist_node_new(void *key, void *value, unsigned int level)
+{
+        UfSkipListNode *node = NULL;
+
+        node = calloc(1, sizeof(UfSkipListNode) + level * sizeof(_Atomic(uintptr_t)));
+        if (!node) {
+                return NULL;
+        }
+        node->key = key;
+        node->value = value;
+        node->level = level;
+        atomic_init(&node->refs, 2);
+        for (unsigned int i = 0; i < level; i++) {
+                atomic_init(&node->next[i], 0);
+        }
+        return node;
+}
+
+UfSkipList *uf_skiplist_new_full(uf_hashmap_compare_func compare, uf_hashmap_free_func key_free,
+                                 uf_hashmap_free_func value_free)
+{
+        UfSkipList *ret = NULL;
+
+        assert(compare);
+
+        ret = aligned_alloc(_Alignof(struct UfSkipList), sizeof(struct UfSkipList));
+        if (!ret) {
+                return NULL;
+        }
+        memset(ret, 0, sizeof(struct UfSkipList));
+
+        for (unsigned int i = 0; i < UF_SKIPLIST_SLOTS; i++) {
+                atomic_init(&ret->slots[i].state, 0);
+        }
+        atomic_init(&ret->overflow.state, 0);
+        atomic_init(&ret->epoch, 0);
+        atomic_init(&ret->retired, NULL);
+        atomic_init(&ret->n_retired, 0);
+        ret->compare = compare;
+        ret->free.key = key_free;
+        ret->free.value = value_free;
+
+        ret->head = uf_skiplist_node_new(NULL, NULL, UF_SKIPLIST_MAX_LEVEL);
+        if (!ret->head) {
+                free(ret);
+                return NULL;
+        }
+
+        return ret;
+}
+
+static void uf_skiplist_node_free(UfSkipList *self, UfSkipListNode *node)
+{
+        if (self->free.key) {
+                self->free.key(node->key);
+        }
+        if (self->free.value) {
+                self->free.value(node->value);
+        }
+        free(node);
+}
+
+void uf_skiplist_free(UfSkipList *self)
+{
+        UfSkipListNode *node = NULL;
+
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        /* Quiescent: everything left is either linked at level 0 or retired */
+        node = UF_SKIPLIST_PTR(atomic_load(&self->head->next[0]));
+        while (node) {
+                UfSkipListNode *next = UF_SKIPLIST_PTR(atomic_load(&node->next[0]));
+                uf_skiplist_node_free(self, node);
+                node = next;
+        }
+
+        node = atomic_load(&self->retired);
+        while (node) {
+                UfSkipListNode *next = node->retired_next;
+                uf_skiplist_node_free(self, node);
+                node = next;
+        }
+
+        free(self->head);
+        free(self);
+}
+
+/**
+ * Claim an epoch slot for the duration of an operation, announcing the
+ * epoch we observed. Start probing from a per-thread position so that
+ * threads rarely contend on the same slot.
+ *
+ * If every slot is busy, join the overflow slot and return
+ * UF_SKIPLIST_SLOTS. The first operation in announces the current epoch
+ * and later ones inherit it. An inherited epoch may be older than the one
+ * they observed, which only holds back reclamation until the overflow
+ * slot drains.
+ */
+static unsigned int uf_skiplist_enter(UfSkipList *self)
+{
+        static _Thread_local char token;
+        unsigned int start =
+            (unsigned int)((((uint64_t)(uintptr_t)&token) * 0x9E3779B97F4A7C15ULL) >> 58);
+        uint_fast64_t state;
+
+        for (unsigned int i = 0; i < UF_SKIPLIST_SLOTS; i++) {
+                unsigned int slot = (start + i) % UF_SKIPLIST_SLOTS;
+                uint_fast64_t expected = 0;
+                uint_fast64_t epoch = atomic_load(&self->epoch);
+
+                if (atomic_load_explicit(&self->slots[slot].state, memory_order_relaxed)) {
+                        continue;
+                }
+                if (atomic_compare_exchange_strong(&self->slots[slot].state,
+                                                   &expected,
+                                                   (epoch << 1) | 1)) {
+                        return slot;
+                }
+        }
+
+        state = atomic_load(&self->overflow.state);
+        for (;;) {
+                uint_fast64_t next = state + 1;
+
+                if (UF_SKIPLIST_OVERFLOW_COUNT(state) == 0) {
+                        uint_fast64_t epoch = atomic_load(&self->epoch);
+                        next = ((epoch & UF_SKIPLIST_EPOCH_MASK) << UF_SKIPLIST_OVERFLOW_BITS) | 1;
+                }
+                if (atomic_compare_exchange_weak(&self->overflow.state, &state, next)) {
+                        return UF_SKIPLIST_SLOTS;
+                }
+        }
+}
+
+static inline void uf_skiplist_exit(UfSkipList *self, unsigned int slot)
+{
+        if (uf_unlikely(slot == UF_SKIPLIST_SLOTS)) {
+                atomic_fetch_sub(&self->overflow.state, 1);
+                return;
+        }
+        atomic_store(&self->slots[slot].state, 0);
+}
+
+/**
+ * Advance the global epoch if every active operation has observed the
+ * current one.
+ */
+static void uf_skiplist_try_advance(UfSkipList *self)
+{
+        uint_fast64_t epoch = atomic_load(&self->epoch);
+        uint_fast64_t overflow;
+
+        for (unsigned int i = 0; i < UF_SKIPLIST_SLOTS; i++) {
+                uint_fast64_t state = atomic_load(&self->slots[i].state);
+                if ((state & 1) && (state >> 1) != epoch) {
+                        return;
+                }
+        }
+        overflow = atomic_load(&self->overflow.state);
+        if (UF_SKIPLIST_OVERFLOW_COUNT(overflow) &&
+            UF_SKIPLIST_OVERFLOW_EPOCH(overflow) != (epoch & UF_SKIPLIST_EPOCH_MASK)) {
+                return;
+        }
+        atomic_compare_exchange_strong(&self->epoch, &epoch, epoch + 1);
+}
+
+/**
+ * Free anything retired at least two epochs ago. No operation that could
+ * have seen those nodes can still be running.
+ */
+static void uf_skiplist_collect(UfSkipList *self)
+{
+        UfSkipListNode *node = NULL;
+        UfSkipListNode *keep = NULL;
+        UfSkipListNode *tail = NULL;
+        uint_fast64_t epoch;
+
+        uf_skiplist_try_advance(self);
+        epoch = atomic_load(&self->epoch);
+
+        node = atomic_exchange(&self->retired, NULL);
+        while (node) {
+                UfSkipListNode *next = node->retired_next;
+                if (node->retired_epoch + 2 <= epoch) {
+                        uf_skiplist_node_free(self, node);
+                } else {
+                        node->retired_next = keep;
+                        keep = node;
+                        if (!tail) {
+                                tail = node;
+                        }
+                }
+                node = next;
+        }
+
+        /* Splice the survivors back in */
+        if (keep) {
+                UfSkipListNode *head = atomic_load(&self->retired);
+                do {
+                        tail->retired_next = head;
+                } while (!atomic_compare_exchange_weak(&self->retired, &head, keep));
+        }
+}
+
+/**
+ * Drop a reference. The inserter and the remover both hold one, so the
+ * node is only retired once it is guaranteed to be unlinked everywhere.
+ */
+static void uf_skiplist_release(UfSkipList *self, UfSkipListNode *node)
+{
+        UfSkipListNode *head = NULL;
+
+        if (atomic_fetch_sub(&node->refs, 1) != 1) {
+                return;
+        }
+
+        node->retired_epoch = atomic_load(&self->epoch);
+        head = atomic_load(&self->retired);
+        do {
+                node->retired_next = head;
+        } while (!atomic_compare_exchange_weak(&self->retired, &head, node));
+
+        if ((atomic_fetch_add(&self->n_retired, 1) + 1) % UF_SKIPLIST_COLLECT_INTERVAL == 0) {
+                uf_skiplist_collect(self);
+        }
+}
+
+static unsigned int uf_skiplist_random_level(void)
+{
+        uint64_t x = uf_skiplist_rng;
+        unsigned int level = 1;
+
+        if (uf_unlikely(!x)) {
+                x = ((uint64_t)(uintptr_t)&uf_skiplist_rng * 0x9E3779B97F4A7C15ULL) | 1;
+        }
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        uf_skiplist_rng = x;
+
+        while (level < UF_SKIPLIST_MAX_LEVEL && (x & 3) == 0) {
+                level++;
+                x >>= 2;
+        }
+        return level;
+}
+
+/**
+ * Locate the predecessors and successors of @key at every level, unlinking
+ * any marked nodes encountered along the way.
+ *
+ * With @past_equal set we also walk past nodes equal to @key, which the
+ * remover uses to guarantee its node has been unlinked even if a new node
+ * with the same key was linked in front of it.
+ *
+ * @returns True if an unmarked node with @key was found at level 0
+ */
+static bool uf_skiplist_find(UfSkipList *self, const void *key, UfSkipListNode **preds,
+                             UfSkipListNode **succs, bool past_equal)
+{
+        bool retry;
+
+        do {
+                UfSkipListNode *pred = self->head;
+                retry = false;
+
+                for (int level = UF_SKIPLIST_MAX_LEVEL - 1; level >= 0 && !retry; level--) {
+                        UfSkipListNode *curr = UF_SKIPLIST_PTR(atomic_load(&pred->next[level]));
+
+                        while (curr) {
+                                uintptr_t succ = atomic_load(&curr->next[level]);
+                                int cmp;
+
+                                if (UF_SKIPLIST_IS_MARKED(succ)) {
+                                        uintptr_t expected = (uintptr_t)curr;
+                                        if (!atomic_compare_exchange_strong(&pred->next[level],
+                                                                            &expected,
+                                                                            succ & ~(uintptr_t)1)) {
+                                                retry = true;
+                                                break;
+                                        }
+                                        curr = UF_SKIPLIST_PTR(succ);
+                                        continue;
+                                }
+
+                                cmp = self->compare(curr->key, key);
+                                if (cmp > 0 || (cmp == 0 && !past_equal)) {
+                                        break;
+                                }
+                                pred = curr;
+                                curr = UF_SKIPLIST_PTR(succ);
+                        }
+
+                        preds[level] = pred;
+                        succs[level] = curr;
+                }
+        } while (retry);
+
+        return succs[0] && self->compare(succs[0]->key, key) == 0;
+}
+
+bool uf_skiplist_insert(UfSkipList *self, void *key, void *value)
+{
+        UfSkipListNode *preds[UF_SKIPLIST_MAX_LEVEL];
+        UfSkipListNode *succs[UF_SKIPLIST_MAX_LEVEL];
+        UfSkipListNode *node = NULL;
+        unsigned int slot;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        slot = uf_skiplist_enter(self);
+
+        /* Linking level 0 is the linearisation point */
+        for (;;) {
+                uintptr_t expected;
+
+                if (uf_skiplist_find(self, key, preds, succs, false)) {
+                        uf_skiplist_exit(self, slot);
+                        free(node);
+                        return false;
+                }
+                if (!node) {
+                        node = uf_skiplist_node_new(key, value, uf_skiplist_random_level());
+                        if (!node) {
+                                uf_skiplist_exit(self, slot);
+                                return false;
+                        }
+                }
+                for (unsigned int i = 0; i < node->level; i++) {
+                        atomic_store_explicit(&node->next[i],
+                                              (uintptr_t)succs[i],
+                                              memory_order_relaxed);
+                }
+                expected = (uintptr_t)succs[0];
+                if (atomic_compare_exchange_strong(&preds[0]->next[0],
+                                                   &expected,
+                                                   (uintptr_t)node)) {
+                        break;
+                }
+        }
+
+        /* Link the upper levels, giving up if we're removed in the meantime */
+        for (unsigned int i = 1; i < node->level; i++) {
+                for (;;) {
+                        uintptr_t next = atomic_load(&node->next[i]);
+                        uintptr_t expected = (uintptr_t)succs[i];
+
+                        if (UF_SKIPLIST_IS_MARKED(next)) {
+                                goto linked;
+                        }
+                        if (next != expected &&
+                            !atomic_compare_exchange_strong(&node->next[i], &next, expected)) {
+                                continue;
+                        }
+                        if (atomic_compare_exchange_strong(&preds[i]->next[i],
+                                                           &expected,
+                                                           (uintptr_t)node)) {
+                                break;
+                        }
+                        uf_skiplist_find(self, key, preds, succs, false);
+                }
+        }
+
+linked:
+        /* If a remover marked us while we were linking, its cleanup may
+         * have run before our last link, so sweep again ourselves */
+        if (UF_SKIPLIST_IS_MARKED(atomic_load(&node->next[0]))) {
+                uf_skiplist_find(self, key, preds, succs, true);
+        }
+        uf_skiplist_exit(self, slot);
+        uf_skiplist_release(self, node);
+
+        return true;
+}
+
+bool uf_skiplist_remove(UfSkipList *self, const void *key)
+{
+        UfSkipListNode *preds[UF_SKIPLIST_MAX_LEVEL];
+        UfSkipListNode *succs[UF_SKIPLIST_MAX_LEVEL];
+        UfSkipListNode *node = NULL;
+        uintptr_t next;
+        unsigned int slot;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        slot = uf_skiplist_enter(self);
+
+        if (!uf_skiplist_find(self, key, preds, succs, false)) {
+                uf_skiplist_exit(self, slot);
+                return false;
+        }
+        node = succs[0];
+
+        /* Mark top down, the level 0 mark decides who removed it */
+        for (unsigned int i = node->level - 1; i >= 1; i--) {
+                next = atomic_load(&node->next[i]);
+                while (!UF_SKIPLIST_IS_MARKED(next)) {
+                        atomic_compare_exchange_weak(&node->next[i], &next, UF_SKIPLIST_MARK(next));
+                }
+        }
+
+        next = atomic_load(&node->next[0]);
+        for (;;) {
+                if (UF_SKIPLIST_IS_MARKED(next)) {
+                        uf_skiplist_exit(self, slot);
+                        return false;
+                }
+                if (atomic_compare_exchange_strong(&node->next[0], &next, UF_SKIPLIST_MARK(next))) {
+                        break;
+                }
+        }
+
+        /* Physically unlink at every level */
+        uf_skiplist_find(self, key, preds, succs, true);
+        uf_skiplist_exit(self, slot);
+        uf_skiplist_release(self, node);
+
+        return true;
+}
+
+/**
+ * Read-only descent to the first node at level 0 with a key >= @key.
+ * The result may be marked, callers skip those.
+ */
+static UfSkipListNode *uf_skiplist_lower_bound(UfSkipList *self, const void *key)
+{
+        UfSkipListNode *pred = self->head;
+        UfSkipListNode *curr = NULL;
+
+        for (int level = UF_SKIPLIST_MAX_LEVEL - 1; level >= 0; level--) {
+                curr = UF_SKIPLIST_PTR(atomic_load(&pred->next[level]));
+                while (curr) {
+                        uintptr_t succ = atomic_load(&curr->next[level]);
+                        if (!UF_SKIPLIST_IS_MARKED(succ) && self->compare(curr->key, key) >= 0) {
+                                break;
+                        }
+                        if (!UF_SKIPLIST_IS_MARKED(succ)) {
+                                pred = curr;
+                        }
+                        curr = UF_SKIPLIST_PTR(succ);
+                }
+        }
+        return curr;
+}
+
+void *uf_skiplist_get(UfSkipList *self, const void *key)
+{
+        UfSkipListNode *node = NULL;
+        void *ret = NULL;
+        unsigned int slot;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        slot = uf_skiplist_enter(self);
+        node = uf_skiplist_lower_bound(self, key);
+        if (node && self->compare(node->key, key) == 0) {
+                ret = node->value;
+        }
+        uf_skiplist_exit(self, slot);
+
+        return ret;
+}
+
+/**
+ * Walk level 0 from @node, skipping logically deleted entries.
+ */
+static void uf_skiplist_walk(UfSkipList *self, UfSkipListNode *node, const void *hi, bool bounded,
+                             uf_skiplist_iter_func func, void *userdata)
+{
+        while (node) {
+                uintptr_t next = atomic_load(&node->next[0]);
+
+                if (!UF_SKIPLIST_IS_MARKED(next)) {
+                        if (bounded && self->compare(node->key, hi) >= 0) {
+                                return;
+                        }
+                        if (!func(node->key, node->value, userdata)) {
+                                return;
+                        }
+                }
+                node = UF_SKIPLIST_PTR(next);
+        }
+}
+
+void uf_skiplist_foreach(UfSkipList *self, uf_skiplist_iter_func func, void *userdata)
+{
+        unsigned int slot;
+
+        if (uf_unlikely(!self || !func)) {
+                return;
+        }
+
+        slot = uf_skiplist_enter(self);
+        uf_skiplist_walk(self,
+                         UF_SKIPLIST_PTR(atomic_load(&self->head->next[0])),
+                         NULL,
+                         false,
+                         func,
+                         userdata);
+        uf_skiplist_exit(self, slot);
+}
+
+void uf_skiplist_foreach_range(UfSkipList *self, const void *lo, const void *hi,
+                               uf_skiplist_iter_func func, void *userdata)
+{
+        unsigned int slot;
+
+        if (uf_unlikely(!self || !func)) {
+                return;
+        }
+
+        slot = uf_skiplist_enter(self);
+        uf_skiplist_walk(self, uf_skiplist_lower_bound(self, lo), hi, true, func, userdata);
+        uf_skiplist_exit(self, slot);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,150 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * UfSkipList is an ordered map that may be used from many threads at once
+ * without any locking. Insertion and removal use atomic compare-and-swap,
+ * and removed nodes are reclaimed once no thread can still observe them
+ * (epoch based reclamation).
+ *
+ * Readers, including ordered iteration and range scans, never block and
+ * proceed concurrently with writers.
+ *
+ * There is no limit on the number of threads. The first 64 concurrent
+ * operations each take a private epoch slot, and any beyond that share a
+ * single overflow slot. Nothing waits on the overflow slot, but while it
+ * stays occupied reclamation of removed nodes is held back.
+ */
+typedef struct UfSkipList UfSkipList;
+
+/**
+ * Callback for ordered iteration
+ *
+ * @param key Key of the current entry
+ * @param value Value of the current entry
+ * @param userdata User data passed to the iteration function
+ *
+ * @returns true to continue iterating, false to stop
+ */
+typedef bool (*uf_skiplist_iter_func)(void *key, void *value, void *userdata);
+
+/**
+ * Construct a new UfSkipList with the given @compare function
+ *
+ * @param compare A key ordering function
+ *
+ * @note Free with uf_skiplist_free
+ *
+ * @return A newly allocated UfSkipList
+ */
+UfSkipList *uf_skiplist_new(uf_hashmap_compare_func compare);
+
+/**
+ * Construct a new UfSkipList with key/value free functions
+ *
+ * @param compare A key ordering function
+ * @param key_free Function to call to free keys once removed nodes are reclaimed
+ * @param value_free Function to call to free values once removed nodes are reclaimed
+ *
+ * @note Free with uf_skiplist_free
+ *
+ * @return A newly allocated UfSkipList
+ */
+UfSkipList *uf_skiplist_new_full(uf_hashmap_compare_func compare, uf_hashmap_free_func key_free,
+                                 uf_hashmap_free_func value_free);
+
+/**
+ * Free a previously allocated list.
+ *
+ * @note No other thread may be using the list at this point.
+ *
+ * @param list Pointer to a previously allocated list
+ */
+void uf_skiplist_free(UfSkipList *list);
+
+/**
+ * Insert a new key/value mapping. Existing keys are never replaced, as
+ * other threads may be reading the current value.
+ *
+ * @param list Pointer to a valid UfSkipList instance
+ * @param key Key for the new mapping
+ * @param value Value for the new mapping
+ *
+ * @returns True if the pair was inserted, false if the key exists (or OOM)
+ */
+bool uf_skiplist_insert(UfSkipList *list, void *key, void *value);
+
+/**
+ * Attempt to retrieve the value associated with @key
+ *
+ * @note If the list has a value free function, the returned value is only
+ * safe to use while no other thread may remove @key.
+ *
+ * @param list Pointer to an allocated list
+ * @param key Key to lookup a value for
+ *
+ * @returns The stored value, if found.
+ */
+void *uf_skiplist_get(UfSkipList *list, const void *key);
+
+/**
+ * Remove the key from the list. Key and value are freed once no other
+ * thread can be using them.
+ *
+ * @param list Pointer to an allocated list
+ * @param key Key to remove
+ *
+ * @returns True if this call removed the key
+ */
+bool uf_skiplist_remove(UfSkipList *list, const void *key);
+
+/**
+ * Walk every entry in ascending order. Entries inserted or removed
+ * concurrently may or may not be seen.
+ *
+ * @param list Pointer to an allocated list
+ * @param func Callback for each entry
+ * @param userdata User data to pass to @func
+ */
+void uf_skiplist_foreach(UfSkipList *list, uf_skiplist_iter_func func, void *userdata);
+
+/**
+ * Walk the entries with keys in [@lo, @hi) in ascending order, with the
+ * same concurrency guarantees as uf_skiplist_foreach.
+ *
+ * @param list Pointer to an allocated list
+ * @param lo Inclusive lower bound
+ * @param hi Exclusive upper bound
+ * @param func Callback for each entry
+ * @param userdata User data to pass to @func
+ */
+void uf_skiplist_foreach_range(UfSkipList *list, const void *lo, const void *hi,
+                               uf_skiplist_iter_func func, void *userdata);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+#include "str.h"
+#include "util.h"
+
+/**
+ * First heap allocation, doubled from there
+ */
+#define UF_STRING_MIN_HEAP 128
+
+void uf_string_init(UfString *self)
+{
+        self->len = 0;
+        self->cap = 0;
+        self->inline_data[0] = '\0';
+}
+
+void uf_string_clear(UfString *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        if (self->cap) {
+                free(self->heap);
+        }
+        uf_string_init(self);
+}
+
+UfString *uf_string_new(void)
+{
+        UfString *ret = NULL;
+
+        ret = malloc(sizeof(struct UfString));
+        if (!ret) {
+                return NULL;
+        }
+        uf_string_init(ret);
+        return ret;
+}
+
+void uf_string_free(UfString *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        uf_string_clear(self);
+        free(self);
+}
+
+static inline char *uf_string_data(UfString *self)
+{
+        return self->cap ? self->heap : self->inline_data;
+}
+
+bool uf_string_reserve(UfString *self, size_t len)
+{
+        size_t cap = self->cap ? self->cap : UF_STRING_INLINE_SIZE - 1;
+        char *data = NULL;
+
+        if (uf_likely(len <= cap)) {
+                return true;
+        }
+
+        /* Grow geometrically so that repeated appends are amortised O(1) */
+        if (uf_unlikely(len == (size_t)-1)) {
+                return false;
+        }
+        cap = cap < UF_STRING_MIN_HEAP ? UF_STRING_MIN_HEAP : cap;
+        while (cap < len) {
+                cap = cap > (size_t)-1 / 2 ? len : cap * 2;
+        }
+
+        if (self->cap) {
+                data = realloc(self->heap, cap + 1);
+                if (!data) {
+                        return false;
+                }
+        } else {
+                data = malloc(cap + 1);
+                if (!data) {
+                        return false;
+                }
+                memcpy(data, self->inline_data, self->len + 1);
+        }
+
+        self->heap = data;
+        self->cap = cap;
+
+        return true;
+}
+
+bool uf_string_append_len(UfString *self, const char *data, size_t len)
+{
+        char *dst = NULL;
+
+        if (uf_unlikely(!self || (!data && len))) {
+                return false;
+        }
+        if (uf_unlikely(len > (size_t)-1 - self->len - 1)) {
+                return false;
+        }
+        if (!uf_string_reserve(self, self->len + len)) {
+                return false;
+        }
+
+        dst = uf_string_data(self);
+        memcpy(dst + self->len, data, len);
+        self->len += len;
+        dst[self->len] = '\0';
+
+        return true;
+}
+
+bool uf_string_append(UfString *self, const char *str)
+{
+        if (uf_unlikely(!str)) {
+                return false;
+        }
+        return uf_string_append_len(self, str, strlen(str));
+}
+
+bool uf_string_append_c(UfString *self, char c)
+{
+        return uf_string_append_len(self, &c, 1);
+}
+
+bool uf_string_vprintf(UfString *self, const char *fmt, va_list ap)
+{
+        size_t avail;
+        va_list copy;
+        int n;
+
+        if (uf_unlikely(!self || !fmt)) {
+                return false;
+        }
+
+        /* Format straight into the spare capacity, and only if that was too
+         * small grow to the exact size and format again. */
+        avail = (self->cap ? self->cap : UF_STRING_INLINE_SIZE - 1) - self->len + 1;
+        va_copy(copy, ap);
+        n = vsnprintf(uf_string_data(self) + self->len, avail, fmt, copy);
+        va_end(copy);
+        if (uf_unlikely(n < 0)) {
+                uf_string_data(self)[self->len] = '\0';
+                return false;
+        }
+
+        if ((size_t)n >= avail) {
+                if (!uf_string_reserve(self, self->len + (size_t)n)) {
+                        uf_string_data(self)[self->len] = '\0';
+                        return false;
+                }
+                va_copy(copy, ap);
+                vsnprintf(uf_string_data(self) + self->len, (size_t)n + 1, fmt, copy);
+                va_end(copy);
+        }
+        self->len += (size_t)n;
+
+        return true;
+}
+
+bool uf_string_printf(UfString *self, const char *fmt, ...)
+{
+        va_list ap;
+        bool ret;
+
+        va_start(ap, fmt);
+        ret = uf_string_vprintf(self, fmt, ap);
+        va_end(ap);
+
+        return ret;
+}
+
+void uf_string_truncate(UfString *self, size_t len)
+{
+        if (uf_unlikely(!self) || len >= self->len) {
+                return;
+        }
+        self->len = len;
+        uf_string_data(self)[len] = '\0';
+}
+
+char *uf_string_steal(UfString *self)
+{
+        char *ret = NULL;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+
+        if (self->cap) {
+                ret = self->heap;
+        } else {
+                ret = malloc(self->len + 1);
+                if (!ret) {
+                        return NULL;
+                }
+                memcpy(ret, self->inline_data, self->len + 1);
+        }
+        uf_string_init(self);
+
+        return ret;
+}
+
+bool uf_string_put_key(UfString *self, UfHashmap *map, void *value)
+{
+        size_t len;
+        char *key = NULL;
+
+        if (uf_unlikely(!self || !map)) {
+                return false;
+        }
+
+        len = self->len;
+        key = uf_string_steal(self);
+        if (!key) {
+                return false;
+        }
+        if (uf_likely(uf_hashmap_put(map, key, value))) {
+                return true;
+        }
+
+        /* Hand it back so the caller still owns the contents */
+        self->len = len;
+        if (len < UF_STRING_INLINE_SIZE) {
+                memcpy(self->inline_data, key, len + 1);
+                free(key);
+        } else {
+                self->heap = key;
+                self->cap = len;
+        }
+        return false;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,163 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "map.h"
+
+/**
+ * Strings up to this many bytes (less the terminator) need no allocation
+ */
+#define UF_STRING_INLINE_SIZE 48
+
+/**
+ * UfString is a growable, always NUL terminated string builder.
+ *
+ * Short strings live inline within the struct, so a UfString on the stack
+ * costs nothing until it outgrows UF_STRING_INLINE_SIZE. Beyond that the
+ * buffer grows geometrically. Once built, uf_string_steal hands the buffer
+ * over as a plain char *, e.g. as a key for a UfHashmap using
+ * uf_hashmap_string_hash with free as the key free function.
+ *
+ * The struct may be embedded or placed on the stack with uf_string_init,
+ * but must not be copied by value.
+ */
+typedef struct UfString {
+        size_t len; /**<Length excluding the terminator */
+        size_t cap; /**<Heap capacity excluding the terminator, 0 while inline */
+        union {
+                char *heap;
+                char inline_data[UF_STRING_INLINE_SIZE];
+        };
+} UfString;
+
+/**
+ * Initialise a UfString in place to the empty string
+ *
+ * @note Release with uf_string_clear
+ */
+void uf_string_init(UfString *string);
+
+/**
+ * Release any storage held by @string, leaving it empty and reusable
+ */
+void uf_string_clear(UfString *string);
+
+/**
+ * Construct a new, empty, heap allocated UfString
+ *
+ * @note Free with uf_string_free
+ *
+ * @return A newly allocated UfString
+ */
+UfString *uf_string_new(void);
+
+/**
+ * Free a string allocated with uf_string_new
+ */
+void uf_string_free(UfString *string);
+
+/**
+ * Return the current contents. The pointer is invalidated by any
+ * modification of @string.
+ */
+static inline const char *uf_string_str(const UfString *string)
+{
+        return string->cap ? string->heap : string->inline_data;
+}
+
+/**
+ * Return the length of @string in bytes
+ */
+static inline size_t uf_string_len(const UfString *string)
+{
+        return string->len;
+}
+
+/**
+ * Ensure there is room for at least @len bytes without reallocating
+ *
+ * @returns True if the storage is available
+ */
+bool uf_string_reserve(UfString *string, size_t len);
+
+/**
+ * Append @len bytes of @data
+ *
+ * @returns True if the data could be appended
+ */
+bool uf_string_append_len(UfString *string, const char *data, size_t len);
+
+/**
+ * Append the NUL terminated @str
+ *
+ * @returns True if the data could be appended
+ */
+bool uf_string_append(UfString *string, const char *str);
+
+/**
+ * Append a single character
+ *
+ * @returns True if the character could be appended
+ */
+bool uf_string_append_c(UfString *string, char c);
+
+/**
+ * Append formatted output directly into the string storage
+ *
+ * @returns True if the output could be appended
+ */
+bool uf_string_printf(UfString *string, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * va_list variant of uf_string_printf
+ */
+bool uf_string_vprintf(UfString *string, const char *fmt, va_list ap)
+    __attribute__((format(printf, 2, 0)));
+
+/**
+ * Shorten @string to @len bytes. Longer lengths are ignored.
+ */
+void uf_string_truncate(UfString *string, size_t len);
+
+/**
+ * Take ownership of the contents as a malloc allocated C string, leaving
+ * @string empty. Heap buffers are handed over without a copy.
+ *
+ * @returns The string contents, to be released with free, or NULL on OOM
+ */
+char *uf_string_steal(UfString *string);
+
+/**
+ * Store the contents of @string as a new key in @map, leaving @string
+ * empty. Heap buffers are handed over without a copy, so @map must free
+ * its keys with free.
+ *
+ * @returns True if the pair was stored. On failure @string is unchanged.
+ */
+bool uf_string_put_key(UfString *string, UfHashmap *map, void *value);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,307 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if UF_CPU_X86
+#include <immintrin.h>
+#endif
+
+#include "strview.h"
+#include "util.h"
+
+static inline char uf_strview_fold(char c)
+{
+        return (c >= 'A' && c <= 'Z') ? (char)(c | 0x20) : c;
+}
+
+static inline bool uf_strview_is_space(char c)
+{
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+int uf_strview_casecmp(UfStrView a, UfStrView b)
+{
+        size_t n = a.len < b.len ? a.len : b.len;
+
+        for (size_t i = 0; i < n; i++) {
+                unsigned char x = (unsigned char)uf_strview_fold(a.data[i]);
+                unsigned char y = (unsigned char)uf_strview_fold(b.data[i]);
+                if (x != y) {
+                        return x < y ? -1 : 1;
+                }
+        }
+        return (a.len > b.len) - (a.len < b.len);
+}
+
+bool uf_strview_starts_with(UfStrView view, UfStrView prefix)
+{
+        return prefix.len <= view.len &&
+               (prefix.len == 0 || memcmp(view.data, prefix.data, prefix.len) == 0);
+}
+
+bool uf_strview_ends_with(UfStrView view, UfStrView suffix)
+{
+        return suffix.len <= view.len &&
+               (suffix.len == 0 ||
+                memcmp(view.data + view.len - suffix.len, suffix.data, suffix.len) == 0);
+}
+
+UfStrView uf_strview_trim(UfStrView view)
+{
+        while (view.len && uf_strview_is_space(view.data[0])) {
+                view.data++;
+                view.len--;
+        }
+        while (view.len && uf_strview_is_space(view.data[view.len - 1])) {
+                view.len--;
+        }
+        return view;
+}
+
+bool uf_strview_find_char(UfStrView view, char c, size_t *offset)
+{
+        const char *p = NULL;
+
+        /* libc memchr is already vectorised on every target we care about */
+        if (!view.len) {
+                return false;
+        }
+        p = memchr(view.data, c, view.len);
+        if (!p) {
+                return false;
+        }
+        *offset = (size_t)(p - view.data);
+        return true;
+}
+
+/**
+ * Scalar tail of the substring search, from position @i. The needle is
+ * at least 2 bytes and no longer than the view.
+ */
+static bool uf_strview_find_from(UfStrView view, UfStrView needle, size_t i, size_t *offset)
+{
+        for (; i + needle.len <= view.len; i++) {
+                if (view.data[i] == needle.data[0] &&
+                    memcmp(view.data + i, needle.data, needle.len) == 0) {
+                        *offset = i;
+                        return true;
+                }
+        }
+        return false;
+}
+
+/**
+ * Handle the needles every kernel treats the same way
+ *
+ * @returns True if @found holds the answer
+ */
+static inline bool uf_strview_find_trivial(UfStrView view, UfStrView needle, size_t *offset,
+                                           bool *found)
+{
+        if (needle.len == 0) {
+                *offset = 0;
+                *found = true;
+                return true;
+        }
+        if (needle.len > view.len) {
+                *found = false;
+                return true;
+        }
+        if (needle.len == 1) {
+                *found = uf_strview_find_char(view, needle.data[0], offset);
+                return true;
+        }
+        return false;
+}
+
+#if !defined(__SSE2__)
+static bool uf_strview_find_scalar(UfStrView view, UfStrView needle, size_t *offset)
+{
+        bool found;
+
+        if (uf_strview_find_trivial(view, needle, offset, &found)) {
+                return found;
+        }
+        return uf_strview_find_from(view, needle, 0, offset);
+}
+#endif
+
+/**
+ * Compare the first and last needle bytes against a vector of candidate
+ * positions at once, and only memcmp the survivors.
+ */
+#define UF_STRVIEW_FIND_KERNEL(width, vec, set1, loadu, cmpeq, and, movemask)                      \
+        vec first, last;                                                                           \
+        size_t i = 0;                                                                              \
+        bool found;                                                                                \
+                                                                                                   \
+        if (uf_strview_find_trivial(view, needle, offset, &found)) {                               \
+                return found;                                                                      \
+        }                                                                                          \
+        first = set1(needle.data[0]);                                                              \
+        last = set1(needle.data[needle.len - 1]);                                                  \
+                                                                                                   \
+        for (; i + needle.len + (width - 1) <= view.len; i += width) {                             \
+                vec bf = loadu((const vec *)(const void *)(view.data + i));                        \
+                vec bl = loadu((const vec *)(const void *)(view.data + i + needle.len - 1));       \
+                unsigned int mask =                                                                \
+                    (unsigned int)movemask(and(cmpeq(first, bf), cmpeq(last, bl)));                \
+                                                                                                   \
+                while (mask) {                                                                     \
+                        unsigned int bit = (unsigned int)__builtin_ctz(mask);                      \
+                        if (memcmp(view.data + i + bit + 1, needle.data + 1, needle.len - 2) ==    \
+                            0) {                                                                   \
+                                *offset = i + bit;                                                 \
+                                return true;                                                       \
+                        }                                                                          \
+                        mask &= mask - 1;                                                          \
+                }                                                                                  \
+        }                                                                                          \
+        return uf_strview_find_from(view, needle, i, offset);
+
+#if defined(__SSE2__)
+static bool uf_strview_find_sse2(UfStrView view, UfStrView needle, size_t *offset)
+{
+        UF_STRVIEW_FIND_KERNEL(16,
+                               __m128i,
+                               _mm_set1_epi8,
+                               _mm_loadu_si128,
+                               _mm_cmpeq_epi8,
+                               _mm_and_si128,
+                               _mm_movemask_epi8)
+}
+#endif
+
+#if UF_CPU_X86
+__attribute__((target("avx2"))) static bool uf_strview_find_avx2(UfStrView view, UfStrView needle,
+                                                                  size_t *offset)
+{
+        UF_STRVIEW_FIND_KERNEL(32,
+                               __m256i,
+                               _mm256_set1_epi8,
+                               _mm256_loadu_si256,
+                               _mm256_cmpeq_epi8,
+                               _mm256_and_si256,
+                               _mm256_movemask_epi8)
+}
+#endif
+
+static uf_strview_find_func uf_strview_find_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_strview_find_avx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_strview_find_sse2;
+#else
+        return uf_strview_find_scalar;
+#endif
+}
+
+uf_strview_find_func uf_strview_find_select(unsigned int features)
+{
+        return uf_strview_find_choose(features);
+}
+
+UF_CPU_DISPATCH(bool, uf_strview_find, (UfStrView view, UfStrView needle, size_t *offset),
+                (view, needle, offset), uf_strview_find_choose)
+
+void uf_strview_split_init(UfStrViewSplit *split, UfStrView view, char delim, bool skip_empty)
+{
+        *split = (UfStrViewSplit){
+                .rest = view,
+                .delim = delim,
+                .skip_empty = skip_empty,
+                .done = false,
+        };
+}
+
+bool uf_strview_split_next(UfStrViewSplit *split, UfStrView *field)
+{
+        size_t offset;
+
+        while (!split->done) {
+                UfStrView ret;
+
+                if (uf_strview_find_char(split->rest, split->delim, &offset)) {
+                        ret = uf_strview_len(split->rest.data, offset);
+                        split->rest = uf_strview_slice(split->rest, offset + 1, split->rest.len);
+                } else {
+                        ret = split->rest;
+                        split->rest.len = 0;
+                        split->done = true;
+                }
+
+                if (ret.len == 0 && split->skip_empty) {
+                        continue;
+                }
+                *field = ret;
+                return true;
+        }
+        return false;
+}
+
+char *uf_strview_dup(UfStrView view)
+{
+        char *ret = NULL;
+
+        ret = malloc(view.len + 1);
+        if (!ret) {
+                return NULL;
+        }
+        if (view.len) {
+                memcpy(ret, view.data, view.len);
+        }
+        ret[view.len] = '\0';
+        return ret;
+}
+
+uint32_t uf_strview_hash(const void *v)
+{
+        const UfStrView *view = v;
+        unsigned int hash = 5381;
+
+        /* Must stay in step with uf_hashmap_string_hash */
+        for (size_t i = 0; i < view->len; i++) {
+                hash = (hash << 5) + hash + (unsigned)(signed char)view->data[i];
+        }
+
+        return (uint32_t)hash;
+}
+
+bool uf_strview_key_equal(const void *a, const void *b)
+{
+        if (!a || !b) {
+                return false;
+        }
+        return uf_strview_equal(*(const UfStrView *)a, *(const UfStrView *)b);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
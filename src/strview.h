@@ -0,0 +1,162 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * UfStrView is a non-owning (pointer, length) view into a string. The data
+ * need not be NUL terminated, so views can point into the middle of a
+ * larger buffer and tokenizing needs no copies or allocations.
+ *
+ * A view is only valid for as long as the underlying buffer.
+ */
+typedef struct UfStrView {
+        const char *data;
+        size_t len;
+} UfStrView;
+
+/**
+ * Iterator state for uf_strview_split_next
+ */
+typedef struct UfStrViewSplit {
+        UfStrView rest;  /**<Unconsumed input */
+        char delim;      /**<Separator byte */
+        bool skip_empty; /**<Skip empty fields, like strtok */
+        bool done;       /**<Set once the final field is returned */
+} UfStrViewSplit;
+
+/**
+ * Construct a view over the NUL terminated @str
+ */
+static inline UfStrView uf_strview(const char *str)
+{
+        return (UfStrView){.data = str, .len = str ? strlen(str) : 0 };
+}
+
+/**
+ * Construct a view over @len bytes at @data
+ */
+static inline UfStrView uf_strview_len(const char *data, size_t len)
+{
+        return (UfStrView){.data = data, .len = len };
+}
+
+/**
+ * Return the sub-view of at most @len bytes starting at @start, clamped to
+ * the bounds of @view
+ */
+static inline UfStrView uf_strview_slice(UfStrView view, size_t start, size_t len)
+{
+        if (start > view.len) {
+                start = view.len;
+        }
+        if (len > view.len - start) {
+                len = view.len - start;
+        }
+        return uf_strview_len(view.data + start, len);
+}
+
+/**
+ * Test whether @a and @b hold the same bytes
+ */
+static inline bool uf_strview_equal(UfStrView a, UfStrView b)
+{
+        return a.len == b.len && (a.len == 0 || memcmp(a.data, b.data, a.len) == 0);
+}
+
+/**
+ * Compare two views ignoring ASCII case, like strcasecmp
+ */
+int uf_strview_casecmp(UfStrView a, UfStrView b);
+
+/**
+ * Test whether @view starts with @prefix
+ */
+bool uf_strview_starts_with(UfStrView view, UfStrView prefix);
+
+/**
+ * Test whether @view ends with @suffix
+ */
+bool uf_strview_ends_with(UfStrView view, UfStrView suffix);
+
+/**
+ * Strip leading and trailing ASCII whitespace
+ */
+UfStrView uf_strview_trim(UfStrView view);
+
+/**
+ * Find the first occurrence of @c within @view
+ *
+ * @returns True if found, storing the position in @offset
+ */
+bool uf_strview_find_char(UfStrView view, char c, size_t *offset);
+
+/**
+ * Find the first occurrence of @needle within @view. An empty needle
+ * matches at offset 0.
+ *
+ * @returns True if found, storing the position in @offset
+ */
+bool uf_strview_find(UfStrView view, UfStrView needle, size_t *offset);
+
+typedef bool (*uf_strview_find_func)(UfStrView view, UfStrView needle, size_t *offset);
+
+/**
+ * Return the uf_strview_find kernel used on a CPU with @features. Exposed
+ * so tests and benchmarks can exercise every variant.
+ */
+uf_strview_find_func uf_strview_find_select(unsigned int features);
+
+/**
+ * Begin splitting @view on @delim. With @skip_empty set, runs of the
+ * delimiter are collapsed and leading/trailing delimiters ignored.
+ */
+void uf_strview_split_init(UfStrViewSplit *split, UfStrView view, char delim, bool skip_empty);
+
+/**
+ * Yield the next field of the split as a view into the original string
+ *
+ * @returns True if a field was stored in @field
+ */
+bool uf_strview_split_next(UfStrViewSplit *split, UfStrView *field);
+
+/**
+ * Allocate a NUL terminated copy of @view, to be released with free
+ */
+char *uf_strview_dup(UfStrView view);
+
+/**
+ * Hash a UfStrView * key. Produces the same value as uf_hashmap_string_hash
+ * does for the equivalent NUL terminated string.
+ */
+uint32_t uf_strview_hash(const void *v);
+
+/**
+ * Key equality for UfStrView * keys, to pair with uf_strview_hash
+ */
+bool uf_strview_key_equal(const void *a, const void *b);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,305 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "topk.h"
+#include "util.h"
+
+/**
+ * Counters form a min-heap on count, so the one to take over is the root
+ */
+typedef struct UfTopKCounter {
+        void *key;
+        uint64_t count;
+        uint64_t error;
+        uint32_t hash;
+        uint32_t slot; /**<Index slot pointing back here */
+} UfTopKCounter;
+
+/**
+ * Open addressed index from hash to heap position
+ */
+typedef struct UfTopKSlot {
+        uint32_t hash;
+        uint32_t pos; /**<Heap position + 1, 0 for an empty slot */
+} UfTopKSlot;
+
+struct UfTopK {
+        size_t k;
+        size_t n;
+        size_t mask;        /**<Index slots - 1 */
+        unsigned int shift; /**<32 - log2(index slots) */
+        UfTopKCounter *heap;
+        UfTopKSlot *index;
+};
+
+UfTopK *uf_top_k_new(size_t k)
+{
+        UfTopK *ret = NULL;
+        size_t slots = 2;
+        unsigned int shift = 31;
+
+        if (k == 0 || k > UINT32_MAX / 4) {
+                return NULL;
+        }
+
+        /* Keep the index at most half full */
+        while (slots < k * 2) {
+                slots <<= 1;
+                shift--;
+        }
+
+        ret = calloc(1, sizeof(struct UfTopK) + k * sizeof(UfTopKCounter) +
+                            slots * sizeof(UfTopKSlot));
+        if (!ret) {
+                return NULL;
+        }
+        ret->k = k;
+        ret->mask = slots - 1;
+        ret->shift = shift;
+        ret->heap = (UfTopKCounter *)(void *)(ret + 1);
+        ret->index = (UfTopKSlot *)(void *)(ret->heap + k);
+
+        return ret;
+}
+
+void uf_top_k_free(UfTopK *self)
+{
+        free(self);
+}
+
+void uf_top_k_clear(UfTopK *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+        self->n = 0;
+        memset(self->index, 0, (self->mask + 1) * sizeof(UfTopKSlot));
+}
+
+static inline size_t uf_top_k_home(UfTopK *self, uint32_t hash)
+{
+        return (size_t)((uint32_t)(hash * 0x9E3779B1U) >> self->shift);
+}
+
+static size_t uf_top_k_find(UfTopK *self, uint32_t hash)
+{
+        for (size_t i = uf_top_k_home(self, hash);; i = (i + 1) & self->mask) {
+                if (self->index[i].pos == 0) {
+                        return SIZE_MAX;
+                }
+                if (self->index[i].hash == hash) {
+                        return i;
+                }
+        }
+}
+
+static uint32_t uf_top_k_index_insert(UfTopK *self, uint32_t hash, size_t pos)
+{
+        size_t i = uf_top_k_home(self, hash);
+
+        while (self->index[i].pos != 0) {
+                i = (i + 1) & self->mask;
+        }
+        self->index[i] = (UfTopKSlot){ .hash = hash, .pos = (uint32_t)pos + 1 };
+        return (uint32_t)i;
+}
+
+/**
+ * Backward shift deletion, repointing counters whose slot moves
+ */
+static void uf_top_k_index_delete(UfTopK *self, size_t hole)
+{
+        for (size_t j = (hole + 1) & self->mask; self->index[j].pos != 0; j = (j + 1) & self->mask) {
+                size_t home = uf_top_k_home(self, self->index[j].hash);
+
+                if (((j - home) & self->mask) >= ((j - hole) & self->mask)) {
+                        self->index[hole] = self->index[j];
+                        self->heap[self->index[hole].pos - 1].slot = (uint32_t)hole;
+                        hole = j;
+                }
+        }
+        self->index[hole].pos = 0;
+}
+
+static inline void uf_top_k_place(UfTopK *self, size_t pos, UfTopKCounter counter)
+{
+        self->heap[pos] = counter;
+        self->index[counter.slot].pos = (uint32_t)pos + 1;
+}
+
+static void uf_top_k_sift_up(UfTopK *self, size_t pos)
+{
+        UfTopKCounter counter = self->heap[pos];
+
+        while (pos > 0) {
+                size_t parent = (pos - 1) / 2;
+                if (self->heap[parent].count <= counter.count) {
+                        break;
+                }
+                uf_top_k_place(self, pos, self->heap[parent]);
+                pos = parent;
+        }
+        uf_top_k_place(self, pos, counter);
+}
+
+static void uf_top_k_sift_down(UfTopK *self, size_t pos)
+{
+        UfTopKCounter counter = self->heap[pos];
+
+        for (;;) {
+                size_t child = pos * 2 + 1;
+                if (child >= self->n) {
+                        break;
+                }
+                if (child + 1 < self->n && self->heap[child + 1].count < self->heap[child].count) {
+                        child++;
+                }
+                if (self->heap[child].count >= counter.count) {
+                        break;
+                }
+                uf_top_k_place(self, pos, self->heap[child]);
+                pos = child;
+        }
+        uf_top_k_place(self, pos, counter);
+}
+
+/**
+ * Space-saving update, weighted so merges can carry error bounds over
+ */
+static uint64_t uf_top_k_update(UfTopK *self, uint32_t hash, void *key, uint64_t count,
+                                uint64_t error)
+{
+        UfTopKCounter *counter = NULL;
+        size_t slot = uf_top_k_find(self, hash);
+        size_t pos;
+        uint64_t min;
+        uint64_t ret;
+
+        if (slot != SIZE_MAX) {
+                counter = &self->heap[self->index[slot].pos - 1];
+                counter->count += count;
+                counter->error += error;
+                if (!counter->key) {
+                        counter->key = key;
+                }
+                ret = counter->count;
+                uf_top_k_sift_down(self, self->index[slot].pos - 1);
+                return ret;
+        }
+
+        if (self->n < self->k) {
+                pos = self->n++;
+                self->heap[pos] = (UfTopKCounter){
+                        .key = key,
+                        .count = count,
+                        .error = error,
+                        .hash = hash,
+                        .slot = uf_top_k_index_insert(self, hash, pos),
+                };
+                uf_top_k_sift_up(self, pos);
+                return count;
+        }
+
+        /* Take over the smallest counter, inheriting its count as error */
+        min = self->heap[0].count;
+        uf_top_k_index_delete(self, self->heap[0].slot);
+        self->heap[0] = (UfTopKCounter){
+                .key = key,
+                .count = min + count,
+                .error = min + error,
+                .hash = hash,
+                .slot = uf_top_k_index_insert(self, hash, 0),
+        };
+        uf_top_k_sift_down(self, 0);
+        return min + count;
+}
+
+uint64_t uf_top_k_add(UfTopK *self, uint32_t hash, void *key, uint64_t count)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return uf_top_k_update(self, hash, key, count, 0);
+}
+
+uint64_t uf_top_k_count(UfTopK *self, uint32_t hash)
+{
+        size_t slot;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        slot = uf_top_k_find(self, hash);
+        return slot == SIZE_MAX ? 0 : self->heap[self->index[slot].pos - 1].count;
+}
+
+static int uf_top_k_counter_compare(const void *a, const void *b)
+{
+        uint64_t x = ((const UfTopKCounter *)a)->count;
+        uint64_t y = ((const UfTopKCounter *)b)->count;
+
+        return (x > y) - (x < y);
+}
+
+size_t uf_top_k_list(UfTopK *self, UfTopKEntry *entries, size_t n)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+
+        /* An ascending array is still a valid min-heap, so sort in place */
+        qsort(self->heap, self->n, sizeof(UfTopKCounter), uf_top_k_counter_compare);
+        for (size_t i = 0; i < self->n; i++) {
+                self->index[self->heap[i].slot].pos = (uint32_t)i + 1;
+        }
+
+        if (n > self->n) {
+                n = self->n;
+        }
+        for (size_t i = 0; i < n; i++) {
+                UfTopKCounter *counter = &self->heap[self->n - 1 - i];
+                entries[i] = (UfTopKEntry){
+                        .key = counter->key,
+                        .hash = counter->hash,
+                        .count = counter->count,
+                        .error = counter->error,
+                };
+        }
+        return n;
+}
+
+bool uf_top_k_merge(UfTopK *self, UfTopK *other)
+{
+        if (uf_unlikely(!self || !other) || self == other) {
+                return false;
+        }
+
+        for (size_t i = 0; i < other->n; i++) {
+                UfTopKCounter *counter = &other->heap[i];
+                uf_top_k_update(self, counter->hash, counter->key, counter->count, counter->error);
+        }
+        return true;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
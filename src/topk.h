@@ -0,0 +1,104 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * UfTopK tracks the heaviest hitters of a stream with the space-saving
+ * algorithm, in memory fixed at construction.
+ *
+ * It keeps @k counters. A key not being tracked takes over the counter
+ * with the smallest count, inheriting that count as its error bound, so
+ * counts never undercount and any key occurring more than N / k times in
+ * a stream of N is guaranteed to be tracked.
+ *
+ * Keys are identified by the hashes the libuf hash functions produce, so
+ * keys with equal hashes are counted together. A key pointer may be
+ * attached for reporting. It is borrowed, not copied, and must outlive
+ * the tracker or be NULL.
+ *
+ * Updates never allocate or block and take O(log k) steps. A tracker has
+ * a single writer: give each thread its own and merge them for reading.
+ */
+typedef struct UfTopK UfTopK;
+
+/**
+ * A tracked key, as returned by uf_top_k_list
+ */
+typedef struct UfTopKEntry {
+        void *key;      /**<Key pointer given when the counter was taken */
+        uint32_t hash;  /**<Key hash */
+        uint64_t count; /**<Upper bound on the key's true count */
+        uint64_t error; /**<count - error is a lower bound */
+} UfTopKEntry;
+
+/**
+ * Construct a new UfTopK tracking @k keys
+ *
+ * @note Free with uf_top_k_free
+ *
+ * @return A newly allocated UfTopK
+ */
+UfTopK *uf_top_k_new(size_t k);
+
+/**
+ * Free a previously allocated tracker
+ */
+void uf_top_k_free(UfTopK *topk);
+
+/**
+ * Add @count occurrences of the key with @hash
+ *
+ * @param key Borrowed key pointer reported by uf_top_k_list, or NULL
+ *
+ * @returns The key's count after the update
+ */
+uint64_t uf_top_k_add(UfTopK *topk, uint32_t hash, void *key, uint64_t count);
+
+/**
+ * Return the count of the key with @hash, or 0 if it isn't tracked
+ */
+uint64_t uf_top_k_count(UfTopK *topk, uint32_t hash);
+
+/**
+ * Fill @entries with up to @n tracked keys, highest count first
+ *
+ * @returns The number of entries written
+ */
+size_t uf_top_k_list(UfTopK *topk, UfTopKEntry *entries, size_t n);
+
+/**
+ * Add every counter of @other into @topk, carrying over its error bounds
+ *
+ * @returns True if the trackers were merged
+ */
+bool uf_top_k_merge(UfTopK *topk, UfTopK *other);
+
+/**
+ * Forget every tracked key
+ */
+void uf_top_k_clear(UfTopK *topk);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,448 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "pool.h"
+#include "ttlmap.h"
+#include "util.h"
+
+/**
+ * Expiry times are rounded up to ticks of UF_TTL_TICK_MS. The next 256
+ * ticks each have a near slot. Three far levels of 64 slots each cover
+ * 2^14, 2^20 and 2^26 ticks (about 12 days). Each far slot spans 2^8,
+ * 2^14 or 2^20 ticks. When the cursor reaches the start of a far slot's
+ * span, the whole slot moves to the pending list and its entries are
+ * placed again, nearer in. An entry is only examined again when it gets
+ * closer to expiring. Entries further out than the last level are parked
+ * at its far end.
+ */
+#define UF_TTL_TICK_MS 16
+#define UF_TTL_NEAR_BITS 8
+#define UF_TTL_FAR_BITS 6
+#define UF_TTL_FAR_LEVELS 3
+#define UF_TTL_NEAR_SLOTS (1u << UF_TTL_NEAR_BITS)
+#define UF_TTL_FAR_SLOTS (1u << UF_TTL_FAR_BITS)
+#define UF_TTL_PENDING (UF_TTL_NEAR_SLOTS + UF_TTL_FAR_LEVELS * UF_TTL_FAR_SLOTS)
+#define UF_TTL_LISTS (UF_TTL_PENDING + 1)
+
+/**
+ * Ticks covered by the near slots and the first @level far levels
+ */
+#define UF_TTL_SPAN(level) (((uint64_t)1) << (UF_TTL_NEAR_BITS + (level)*UF_TTL_FAR_BITS))
+
+/**
+ * Entries examined by every put, enough to keep up with the insert rate
+ */
+#define UF_TTL_PUT_BUDGET 4
+
+/**
+ * Circular list linkage, the wheel holds one sentinel per slot
+ */
+typedef struct UfTtlLink {
+        struct UfTtlLink *prev;
+        struct UfTtlLink *next;
+} UfTtlLink;
+
+typedef struct UfTtlEntry {
+        UfTtlLink link; /**<Must be first, see uf_ttl_map_entry */
+        void *key;
+        void *value;
+        uint64_t expiry;   /**<Clock time at which the entry dies */
+        unsigned int slot; /**<Wheel slot the entry was placed in */
+} UfTtlEntry;
+
+struct UfTtlMap {
+        UfHashmap *index; /**<Key to UfTtlEntry, owns nothing */
+        UfPool *entries;
+        size_t n_entries;
+        size_t n_near;                   /**<Entries in the near slots */
+        UfTtlLink wheel[UF_TTL_LISTS];   /**<Near slots, far levels, then pending */
+        uint64_t cursor;                 /**<Next tick to sweep */
+        bool cascaded;                   /**<Far slots due at the cursor have moved */
+        struct {
+                uf_ttl_map_clock_func func;
+                void *userdata;
+        } clock;
+        struct {
+                uf_hashmap_free_func key;
+                uf_hashmap_free_func value;
+        } free;
+};
+
+static inline UfTtlEntry *uf_ttl_map_entry(UfTtlLink *link)
+{
+        return (UfTtlEntry *)link;
+}
+
+static inline bool uf_ttl_list_empty(UfTtlLink *list)
+{
+        return list->next == list;
+}
+
+/**
+ * Index of the far slot in @level (from 1) holding @tick
+ */
+static inline unsigned int uf_ttl_far_slot(unsigned int level, uint64_t tick)
+{
+        uint64_t span = tick >> (UF_TTL_NEAR_BITS + (level - 1) * UF_TTL_FAR_BITS);
+
+        return UF_TTL_NEAR_SLOTS + (level - 1) * UF_TTL_FAR_SLOTS +
+               (unsigned int)(span % UF_TTL_FAR_SLOTS);
+}
+
+static uint64_t uf_ttl_map_monotonic(__uf_unused__ void *userdata)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline uint64_t uf_ttl_map_now(UfTtlMap *self)
+{
+        return self->clock.func(self->clock.userdata);
+}
+
+UfTtlMap *uf_ttl_map_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare)
+{
+        return uf_ttl_map_new_full(hash, compare, NULL, NULL);
+}
+
+UfTtlMap *uf_ttl_map_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                              uf_hashmap_free_func key_free, uf_hashmap_free_func value_free)
+{
+        UfTtlMap *ret = NULL;
+
+        ret = calloc(1, sizeof(struct UfTtlMap));
+        if (!ret) {
+                return NULL;
+        }
+
+        ret->index = uf_hashmap_new(hash, compare);
+        ret->entries = uf_pool_new(sizeof(UfTtlEntry));
+        if (!ret->index || !ret->entries) {
+                uf_hashmap_free(ret->index);
+                uf_pool_free(ret->entries);
+                free(ret);
+                return NULL;
+        }
+        for (size_t i = 0; i < UF_TTL_LISTS; i++) {
+                ret->wheel[i].prev = ret->wheel[i].next = &ret->wheel[i];
+        }
+        ret->free.key = key_free;
+        ret->free.value = value_free;
+        uf_ttl_map_set_clock(ret, uf_ttl_map_monotonic, NULL);
+
+        return ret;
+}
+
+void uf_ttl_map_free(UfTtlMap *self)
+{
+        if (uf_unlikely(!self)) {
+                return;
+        }
+
+        for (size_t i = 0; i < UF_TTL_LISTS; i++) {
+                for (UfTtlLink *l = self->wheel[i].next; l != &self->wheel[i]; l = l->next) {
+                        UfTtlEntry *entry = uf_ttl_map_entry(l);
+                        if (self->free.key) {
+                                self->free.key(entry->key);
+                        }
+                        if (self->free.value) {
+                                self->free.value(entry->value);
+                        }
+                }
+        }
+
+        uf_hashmap_free(self->index);
+        uf_pool_free(self->entries);
+        free(self);
+}
+
+void uf_ttl_map_set_clock(UfTtlMap *self, uf_ttl_map_clock_func clock, void *userdata)
+{
+        if (uf_unlikely(!self || !clock)) {
+                return;
+        }
+        self->clock.func = clock;
+        self->clock.userdata = userdata;
+        self->cursor = uf_ttl_map_now(self) / UF_TTL_TICK_MS;
+        self->cascaded = false;
+}
+
+/**
+ * Place @entry in the slot for its expiry relative to the cursor. Ticks
+ * already swept are clamped to the next one.
+ */
+static void uf_ttl_map_link(UfTtlMap *self, UfTtlEntry *entry)
+{
+        uint64_t tick = entry->expiry / UF_TTL_TICK_MS + (entry->expiry % UF_TTL_TICK_MS != 0);
+        uint64_t delta;
+        UfTtlLink *list = NULL;
+
+        if (tick <= self->cursor) {
+                tick = self->cursor + 1;
+        }
+        delta = tick - self->cursor;
+
+        if (delta < UF_TTL_SPAN(0)) {
+                entry->slot = (unsigned int)(tick % UF_TTL_NEAR_SLOTS);
+                self->n_near++;
+        } else {
+                unsigned int level = 1;
+
+                while (level < UF_TTL_FAR_LEVELS && delta >= UF_TTL_SPAN(level)) {
+                        level++;
+                }
+                if (delta >= UF_TTL_SPAN(level)) {
+                        tick = self->cursor + UF_TTL_SPAN(level) - 1;
+                }
+                entry->slot = uf_ttl_far_slot(level, tick);
+        }
+
+        list = &self->wheel[entry->slot];
+        entry->link.prev = list->prev;
+        entry->link.next = list;
+        list->prev->next = &entry->link;
+        list->prev = &entry->link;
+}
+
+static void uf_ttl_map_unlink(UfTtlMap *self, UfTtlEntry *entry)
+{
+        if (entry->slot < UF_TTL_NEAR_SLOTS) {
+                self->n_near--;
+        }
+        entry->link.prev->next = entry->link.next;
+        entry->link.next->prev = entry->link.prev;
+}
+
+/**
+ * Unlink and free an entry, expired or removed
+ */
+static void uf_ttl_map_reclaim(UfTtlMap *self, UfTtlEntry *entry)
+{
+        uf_ttl_map_unlink(self, entry);
+        uf_hashmap_remove(self->index, entry->key);
+
+        if (self->free.key) {
+                self->free.key(entry->key);
+        }
+        if (self->free.value) {
+                self->free.value(entry->value);
+        }
+        uf_pool_release(self->entries, entry);
+        self->n_entries--;
+}
+
+/**
+ * Move every far slot whose span starts at the cursor onto the pending
+ * list, without touching the entries.
+ */
+static void uf_ttl_map_cascade(UfTtlMap *self)
+{
+        UfTtlLink *pending = &self->wheel[UF_TTL_PENDING];
+
+        for (unsigned int level = 1; level <= UF_TTL_FAR_LEVELS; level++) {
+                UfTtlLink *list = NULL;
+
+                if (self->cursor % UF_TTL_SPAN(level - 1) != 0) {
+                        break;
+                }
+                list = &self->wheel[uf_ttl_far_slot(level, self->cursor)];
+                if (uf_ttl_list_empty(list)) {
+                        continue;
+                }
+                list->next->prev = pending->prev;
+                list->prev->next = pending;
+                pending->prev->next = list->next;
+                pending->prev = list->prev;
+                list->prev = list->next = list;
+        }
+}
+
+/**
+ * Advance the wheel up to @now, examining at most @budget entries. Far
+ * slots cascading at the cursor are placed again before its near slot
+ * is swept. While the near slots are empty the cursor skips straight to
+ * the next cascade.
+ */
+static size_t uf_ttl_map_sweep(UfTtlMap *self, uint64_t now, size_t budget)
+{
+        UfTtlLink *pending = &self->wheel[UF_TTL_PENDING];
+        uint64_t now_tick = now / UF_TTL_TICK_MS;
+        size_t reclaimed = 0;
+
+        while (budget > 0) {
+                UfTtlLink *list = pending;
+
+                if (uf_ttl_list_empty(pending)) {
+                        if (self->cursor > now_tick) {
+                                break;
+                        }
+                        if (!self->cascaded) {
+                                uf_ttl_map_cascade(self);
+                                self->cascaded = true;
+                                continue;
+                        }
+                        list = &self->wheel[self->cursor % UF_TTL_NEAR_SLOTS];
+                }
+
+                if (!uf_ttl_list_empty(list)) {
+                        UfTtlEntry *entry = uf_ttl_map_entry(list->next);
+
+                        budget--;
+                        if (entry->expiry <= now) {
+                                uf_ttl_map_reclaim(self, entry);
+                                reclaimed++;
+                        } else {
+                                uf_ttl_map_unlink(self, entry);
+                                uf_ttl_map_link(self, entry);
+                        }
+                        continue;
+                }
+
+                self->cursor++;
+                self->cascaded = false;
+                if (self->n_near == 0 && self->cursor % UF_TTL_SPAN(0) != 0) {
+                        uint64_t next = (self->cursor | (UF_TTL_SPAN(0) - 1)) + 1;
+                        self->cursor = next <= now_tick ? next : now_tick + 1;
+                }
+        }
+
+        return reclaimed;
+}
+
+bool uf_ttl_map_put(UfTtlMap *self, void *key, void *value, uint64_t ttl_ms)
+{
+        UfTtlEntry *entry = NULL;
+        uint64_t now;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+
+        now = uf_ttl_map_now(self);
+        uf_ttl_map_sweep(self, now, UF_TTL_PUT_BUDGET);
+
+        entry = uf_hashmap_get(self->index, key);
+        if (entry) {
+                /* Repoint the index at the new key before freeing the old one */
+                if (!uf_hashmap_put(self->index, key, entry)) {
+                        return false;
+                }
+                if (entry->key != key && self->free.key) {
+                        self->free.key(entry->key);
+                }
+                if (entry->value != value && self->free.value) {
+                        self->free.value(entry->value);
+                }
+                uf_ttl_map_unlink(self, entry);
+        } else {
+                entry = uf_pool_alloc(self->entries);
+                if (!entry) {
+                        return false;
+                }
+                if (!uf_hashmap_put(self->index, key, entry)) {
+                        uf_pool_release(self->entries, entry);
+                        return false;
+                }
+                self->n_entries++;
+        }
+
+        entry->key = key;
+        entry->value = value;
+        entry->expiry = ttl_ms > UINT64_MAX - now ? UINT64_MAX : now + ttl_ms;
+        uf_ttl_map_link(self, entry);
+
+        return true;
+}
+
+/**
+ * Find the live entry for @key, reclaiming it if it has expired
+ */
+static UfTtlEntry *uf_ttl_map_lookup(UfTtlMap *self, void *key, uint64_t now)
+{
+        UfTtlEntry *entry = uf_hashmap_get(self->index, key);
+
+        if (entry && entry->expiry <= now) {
+                uf_ttl_map_reclaim(self, entry);
+                return NULL;
+        }
+        return entry;
+}
+
+void *uf_ttl_map_get(UfTtlMap *self, void *key)
+{
+        UfTtlEntry *entry = NULL;
+
+        if (uf_unlikely(!self)) {
+                return NULL;
+        }
+        entry = uf_ttl_map_lookup(self, key, uf_ttl_map_now(self));
+        return entry ? entry->value : NULL;
+}
+
+uint64_t uf_ttl_map_remaining(UfTtlMap *self, void *key)
+{
+        UfTtlEntry *entry = NULL;
+        uint64_t now;
+
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        now = uf_ttl_map_now(self);
+        entry = uf_ttl_map_lookup(self, key, now);
+        return entry ? entry->expiry - now : 0;
+}
+
+bool uf_ttl_map_remove(UfTtlMap *self, void *key)
+{
+        UfTtlEntry *entry = NULL;
+
+        if (uf_unlikely(!self)) {
+                return false;
+        }
+        entry = uf_ttl_map_lookup(self, key, uf_ttl_map_now(self));
+        if (!entry) {
+                return false;
+        }
+        uf_ttl_map_reclaim(self, entry);
+        return true;
+}
+
+size_t uf_ttl_map_expire(UfTtlMap *self, size_t budget)
+{
+        if (uf_unlikely(!self)) {
+                return 0;
+        }
+        return uf_ttl_map_sweep(self, uf_ttl_map_now(self), budget);
+}
+
+size_t uf_ttl_map_size(UfTtlMap *self)
+{
+        return self ? self->n_entries : 0;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
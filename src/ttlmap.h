@@ -0,0 +1,120 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+/**
+ * UfTtlMap is a key-value cache where every entry expires after its own
+ * time-to-live.
+ *
+ * Expired entries are never returned. A lookup that finds one reclaims it
+ * on the spot, and the rest are reclaimed incrementally: entries sit on a
+ * hierarchical timer wheel keyed by expiry time, so a long-lived entry is
+ * only examined a handful of times as its expiry draws near, and every
+ * put examines a few entries due to expire. uf_ttl_map_expire runs a
+ * larger pass, e.g. from an idle timer. Neither ever scans the whole map.
+ *
+ * Reclaiming an entry calls the configured free functions, as removal
+ * does. Like UfHashmap, a UfTtlMap must not be used from several threads
+ * at once without external locking.
+ */
+typedef struct UfTtlMap UfTtlMap;
+
+/**
+ * Time source, returning milliseconds from an arbitrary fixed point
+ */
+typedef uint64_t (*uf_ttl_map_clock_func)(void *userdata);
+
+/**
+ * Construct a new UfTtlMap without free functions
+ *
+ * @note Free with uf_ttl_map_free
+ *
+ * @return A newly allocated UfTtlMap
+ */
+UfTtlMap *uf_ttl_map_new(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare);
+
+/**
+ * Construct a new UfTtlMap with free functions, called whenever an entry
+ * is replaced, removed, expired or the map is freed
+ *
+ * @note Free with uf_ttl_map_free
+ *
+ * @return A newly allocated UfTtlMap
+ */
+UfTtlMap *uf_ttl_map_new_full(uf_hashmap_hash_func hash, uf_hashmap_equal_func compare,
+                              uf_hashmap_free_func key_free, uf_hashmap_free_func value_free);
+
+/**
+ * Free the map and every entry in it, expired or not
+ */
+void uf_ttl_map_free(UfTtlMap *map);
+
+/**
+ * Replace the monotonic clock, for tests or callers with their own notion
+ * of time. Must be called before the first put.
+ */
+void uf_ttl_map_set_clock(UfTtlMap *map, uf_ttl_map_clock_func clock, void *userdata);
+
+/**
+ * Store @value for @key, expiring @ttl_ms milliseconds from now. An
+ * existing entry is replaced and given the new expiry.
+ *
+ * @returns True if the pair was stored
+ */
+bool uf_ttl_map_put(UfTtlMap *map, void *key, void *value, uint64_t ttl_ms);
+
+/**
+ * Return the value for @key, or NULL if it is missing or has expired
+ */
+void *uf_ttl_map_get(UfTtlMap *map, void *key);
+
+/**
+ * Return the milliseconds @key has left to live, 0 if missing or expired
+ */
+uint64_t uf_ttl_map_remaining(UfTtlMap *map, void *key);
+
+/**
+ * Remove @key and free it along with its value
+ *
+ * @returns True if a live entry was removed
+ */
+bool uf_ttl_map_remove(UfTtlMap *map, void *key);
+
+/**
+ * Reclaim expired entries, examining at most @budget entries
+ *
+ * @returns The number of entries reclaimed
+ */
+size_t uf_ttl_map_expire(UfTtlMap *map, size_t budget);
+
+/**
+ * Return the number of entries, including expired ones not yet reclaimed
+ */
+size_t uf_ttl_map_size(UfTtlMap *map);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
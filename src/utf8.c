@@ -0,0 +1,163 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#include <stdint.h>
+
+#include "dispatch.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if UF_CPU_X86
+#include <immintrin.h>
+#endif
+
+#include "utf8.h"
+#include "util.h"
+
+/**
+ * Validate the single sequence starting at @s[*i], advancing @i past it
+ */
+static inline bool uf_utf8_sequence(const unsigned char *s, size_t len, size_t *i)
+{
+        unsigned char c = s[*i];
+        uint32_t cp;
+        uint32_t min;
+        size_t need;
+
+        if (c < 0x80) {
+                (*i)++;
+                return true;
+        }
+
+        if ((c & 0xE0) == 0xC0) {
+                need = 1;
+                cp = c & 0x1F;
+                min = 0x80;
+        } else if ((c & 0xF0) == 0xE0) {
+                need = 2;
+                cp = c & 0x0F;
+                min = 0x800;
+        } else if ((c & 0xF8) == 0xF0) {
+                need = 3;
+                cp = c & 0x07;
+                min = 0x10000;
+        } else {
+                return false;
+        }
+
+        if (len - *i <= need) {
+                return false;
+        }
+        for (size_t k = 1; k <= need; k++) {
+                unsigned char cc = s[*i + k];
+                if ((cc & 0xC0) != 0x80) {
+                        return false;
+                }
+                cp = (cp << 6) | (cc & 0x3F);
+        }
+        if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+                return false;
+        }
+
+        *i += need + 1;
+        return true;
+}
+
+/**
+ * Finish validation one sequence at a time from @i
+ */
+static bool uf_utf8_validate_from(const unsigned char *s, size_t len, size_t i)
+{
+        while (i < len) {
+                if (!uf_utf8_sequence(s, len, &i)) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+#if !defined(__SSE2__)
+static bool uf_utf8_validate_scalar(const char *data, size_t len)
+{
+        return uf_utf8_validate_from((const unsigned char *)data, len, 0);
+}
+#endif
+
+/**
+ * Skip whole vectors of ASCII, which is the overwhelmingly common case in
+ * our inputs, and decode sequences only within vectors containing them.
+ */
+#define UF_UTF8_KERNEL(width, vec, loadu, movemask)                                                \
+        const unsigned char *s = (const unsigned char *)data;                                      \
+        size_t i = 0;                                                                              \
+                                                                                                   \
+        while (i + width <= len) {                                                                 \
+                size_t end = i + width;                                                            \
+                if (movemask(loadu((const vec *)(const void *)(s + i))) == 0) {                    \
+                        i = end;                                                                   \
+                        continue;                                                                  \
+                }                                                                                  \
+                while (i < end) {                                                                  \
+                        if (!uf_utf8_sequence(s, len, &i)) {                                       \
+                                return false;                                                      \
+                        }                                                                          \
+                }                                                                                  \
+        }                                                                                          \
+        return uf_utf8_validate_from(s, len, i);
+
+#if defined(__SSE2__)
+static bool uf_utf8_validate_sse2(const char *data, size_t len)
+{
+        UF_UTF8_KERNEL(16, __m128i, _mm_loadu_si128, _mm_movemask_epi8)
+}
+#endif
+
+#if UF_CPU_X86
+__attribute__((target("avx2"))) static bool uf_utf8_validate_avx2(const char *data, size_t len)
+{
+        UF_UTF8_KERNEL(32, __m256i, _mm256_loadu_si256, _mm256_movemask_epi8)
+}
+#endif
+
+static uf_utf8_validate_func uf_utf8_validate_choose(__uf_unused__ unsigned int features)
+{
+#if UF_CPU_X86
+        if (features & UF_CPU_AVX2) {
+                return uf_utf8_validate_avx2;
+        }
+#endif
+#if defined(__SSE2__)
+        return uf_utf8_validate_sse2;
+#else
+        return uf_utf8_validate_scalar;
+#endif
+}
+
+uf_utf8_validate_func uf_utf8_validate_select(unsigned int features)
+{
+        return uf_utf8_validate_choose(features);
+}
+
+UF_CPU_DISPATCH(bool, uf_utf8_validate, (const char *data, size_t len), (data, len),
+                uf_utf8_validate_choose)
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
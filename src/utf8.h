@@ -0,0 +1,44 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Validate that @len bytes at @data are well formed UTF-8: no overlong
+ * encodings, surrogates or code points beyond U+10FFFF. Embedded NUL
+ * bytes are permitted.
+ *
+ * The implementation is picked for the running CPU, see cpu.h.
+ */
+bool uf_utf8_validate(const char *data, size_t len);
+
+typedef bool (*uf_utf8_validate_func)(const char *data, size_t len);
+
+/**
+ * Return the uf_utf8_validate kernel used on a CPU with @features.
+ * Exposed so tests and benchmarks can exercise every variant.
+ */
+uf_utf8_validate_func uf_utf8_validate_select(unsigned int features);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
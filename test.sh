@@ -11,7 +11,7 @@ jobCount=-j$(getconf _NPROCESSORS_ONLN)
 meson build --buildtype debugoptimized
 ninja -C build $jobCount
 
-# Normal
+# Normal, including the allocation budgets (tests/alloc-counter.h)
 meson test -C build
 
 # Valgrind
@@ -0,0 +1,170 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "alloc-counter.h"
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define UF_ALLOC_COUNTER 1
+#else
+#define UF_ALLOC_COUNTER 0
+#endif
+
+static atomic_uint_fast64_t uf_alloc_allocs;
+static atomic_uint_fast64_t uf_alloc_frees;
+static atomic_uint_fast64_t uf_alloc_fail_countdown;
+
+bool uf_alloc_counter_enabled(void)
+{
+        return UF_ALLOC_COUNTER;
+}
+
+UfAllocCount uf_alloc_counter_get(void)
+{
+        return (UfAllocCount){
+                .allocs = atomic_load_explicit(&uf_alloc_allocs, memory_order_relaxed),
+                .frees = atomic_load_explicit(&uf_alloc_frees, memory_order_relaxed),
+        };
+}
+
+void uf_alloc_counter_fail_nth(uint64_t nth)
+{
+        atomic_store(&uf_alloc_fail_countdown, nth);
+}
+
+#if UF_ALLOC_COUNTER
+
+/**
+ * glibc supports replacing malloc, and exports its own implementation
+ * under these names for us to forward to. memalign covers aligned_alloc
+ * and posix_memalign, which glibc would otherwise serve from its own
+ * copies; they mix freely with ours since both end up in glibc.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static inline void uf_alloc_count(atomic_uint_fast64_t *counter)
+{
+        atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+/**
+ * Count down to an injected failure, see uf_alloc_counter_fail_nth
+ */
+static inline bool uf_alloc_fail(void)
+{
+        uint_fast64_t n = atomic_load(&uf_alloc_fail_countdown);
+
+        while (n != 0) {
+                if (atomic_compare_exchange_weak(&uf_alloc_fail_countdown, &n, n - 1)) {
+                        if (n == 1) {
+                                errno = ENOMEM;
+                                return true;
+                        }
+                        return false;
+                }
+        }
+        return false;
+}
+
+void *malloc(size_t size)
+{
+        if (uf_alloc_fail()) {
+                return NULL;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+        if (uf_alloc_fail()) {
+                return NULL;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+        if (uf_alloc_fail()) {
+                return NULL;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+        if (uf_alloc_fail()) {
+                return NULL;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        return __libc_memalign(alignment, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+        if (uf_alloc_fail()) {
+                return NULL;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+        void *ret = NULL;
+
+        if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+                return EINVAL;
+        }
+        if (uf_alloc_fail()) {
+                return ENOMEM;
+        }
+        uf_alloc_count(&uf_alloc_allocs);
+        ret = __libc_memalign(alignment, size);
+        if (!ret) {
+                return ENOMEM;
+        }
+        *memptr = ret;
+        return 0;
+}
+
+void free(void *ptr)
+{
+        if (ptr) {
+                uf_alloc_count(&uf_alloc_frees);
+        }
+        __libc_free(ptr);
+}
+
+#endif
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
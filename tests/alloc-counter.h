@@ -0,0 +1,75 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Every test binary links in a replacement malloc family that counts
+ * calls before forwarding to glibc, so tests can assert allocation
+ * budgets for performance critical paths.
+ *
+ * Counting is unavailable when malloc can't be replaced safely (under a
+ * sanitizer runtime, or off glibc), so budget checks should be wrapped in
+ * uf_alloc_counter_enabled().
+ */
+typedef struct UfAllocCount {
+        uint64_t allocs; /**<malloc, calloc, realloc and aligned allocations */
+        uint64_t frees;  /**<free of a non-NULL pointer */
+} UfAllocCount;
+
+/**
+ * Returns true if allocations are being counted
+ */
+bool uf_alloc_counter_enabled(void);
+
+/**
+ * Snapshot the counters, covering every thread in the process
+ */
+UfAllocCount uf_alloc_counter_get(void);
+
+/**
+ * Make the @nth allocation from now on fail with ENOMEM, counting from 1,
+ * to exercise error paths. Passing 0 cancels a pending failure.
+ *
+ * @note Has no effect unless uf_alloc_counter_enabled()
+ */
+void uf_alloc_counter_fail_nth(uint64_t nth);
+
+/**
+ * Fail the current test if @stmt performs more than @budget allocations
+ */
+#define fail_if_allocs_exceed(budget, stmt)                                                         \
+        do {                                                                                        \
+                UfAllocCount uf_allocs_before_ = uf_alloc_counter_get();                            \
+                uint64_t uf_allocs_n_;                                                              \
+                stmt;                                                                               \
+                uf_allocs_n_ = uf_alloc_counter_get().allocs - uf_allocs_before_.allocs;            \
+                fail_if(uf_alloc_counter_enabled() && uf_allocs_n_ > (uint64_t)(budget),            \
+                        "%s performed %lu allocations, budget is %lu",                              \
+                        #stmt,                                                                      \
+                        (unsigned long)uf_allocs_n_,                                                \
+                        (unsigned long)(budget));                                                   \
+        } while (0)
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,242 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "art.h"
+#include "util.h"
+
+START_TEST(test_art_simple)
+{
+        UfArt *art = NULL;
+        void *v = NULL;
+
+        art = uf_art_new();
+        fail_if(!art, "Failed to construct tree!");
+
+        fail_if(!uf_art_put(art, "charlie", UF_INT_TO_PTR(12)), "Failed to insert");
+        fail_if(!uf_art_put(art, "bob", UF_INT_TO_PTR(38)), "Failed to insert");
+        fail_if(!uf_art_put(art, "", UF_INT_TO_PTR(1)), "Failed to insert empty key");
+
+        v = uf_art_get(art, "charlie");
+        fail_if(UF_PTR_TO_INT(v) != 12, "Retrieved value is incorrect");
+        v = uf_art_get(art, "bob");
+        fail_if(UF_PTR_TO_INT(v) != 38, "Retrieved value is incorrect");
+        v = uf_art_get(art, "");
+        fail_if(UF_PTR_TO_INT(v) != 1, "Retrieved value is incorrect");
+        fail_if(uf_art_get(art, "charli") != NULL, "Prefix shouldn't be a hit");
+        fail_if(uf_art_get(art, "charlies") != NULL, "Extension shouldn't be a hit");
+
+        /* Replace */
+        fail_if(!uf_art_put(art, "bob", UF_INT_TO_PTR(40)), "Failed to replace");
+        fail_if(UF_PTR_TO_INT(uf_art_get(art, "bob")) != 40, "Replace didn't take");
+        fail_if(uf_art_size(art) != 3, "Incorrect size");
+
+        uf_art_free(art);
+}
+END_TEST
+
+/**
+ * Force every node type to grow and then shrink again, checking at each
+ * step that nothing got lost in the copy.
+ */
+START_TEST(test_art_grow_shrink)
+{
+        UfArt *art = NULL;
+
+        art = uf_art_new_full(free);
+        fail_if(!art, "Failed to construct tree!");
+
+        for (int i = 0; i < 20000; i++) {
+                char key[32];
+                char *p = NULL;
+
+                snprintf(key, sizeof(key), "/usr/share/%d/file", i);
+                if (asprintf(&p, "VALUE: %d", i) < 0) {
+                        abort();
+                }
+                fail_if(!uf_art_put(art, key, p), "Failed to insert keypair");
+        }
+        fail_if(uf_art_size(art) != 20000, "Incorrect size");
+
+        for (int i = 0; i < 20000; i++) {
+                char key[32];
+                char val[32];
+                const char *v = NULL;
+
+                snprintf(key, sizeof(key), "/usr/share/%d/file", i);
+                snprintf(val, sizeof(val), "VALUE: %d", i);
+                v = uf_art_get(art, key);
+                fail_if(!v, "Failed to find key");
+                fail_if(strcmp(v, val) != 0, "Wrong value");
+        }
+
+        for (int i = 0; i < 20000; i += 2) {
+                char key[32];
+
+                snprintf(key, sizeof(key), "/usr/share/%d/file", i);
+                fail_if(!uf_art_remove(art, key), "Failed to remove key");
+                fail_if(uf_art_get(art, key) != NULL, "Key still present");
+                fail_if(uf_art_remove(art, key), "Removed key twice");
+        }
+
+        for (int i = 1; i < 20000; i += 2) {
+                char key[32];
+
+                snprintf(key, sizeof(key), "/usr/share/%d/file", i);
+                fail_if(!uf_art_get(art, key), "Lost key during shrink");
+        }
+        fail_if(uf_art_size(art) != 10000, "Incorrect size");
+
+        /* Valgrind will tell us if the remaining values leak */
+        uf_art_free(art);
+}
+END_TEST
+
+START_TEST(test_art_longest_prefix)
+{
+        UfArt *art = NULL;
+        size_t len = 0;
+
+        art = uf_art_new();
+        fail_if(!art, "Failed to construct tree!");
+
+        fail_if(!uf_art_put(art, "/", UF_INT_TO_PTR(1)), "Failed to insert");
+        fail_if(!uf_art_put(art, "/usr/", UF_INT_TO_PTR(2)), "Failed to insert");
+        fail_if(!uf_art_put(art, "/usr/lib/", UF_INT_TO_PTR(3)), "Failed to insert");
+        fail_if(!uf_art_put(art, "/usr/lib/systemd/system/", UF_INT_TO_PTR(4)),
+                "Failed to insert");
+
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/usr/lib/libc.so", &len)) != 3,
+                "Wrong rule matched");
+        fail_if(len != strlen("/usr/lib/"), "Wrong match length");
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/usr/bin/ls", NULL)) != 2,
+                "Wrong rule matched");
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/etc/passwd", NULL)) != 1,
+                "Wrong rule matched");
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/usr/lib/systemd/system/x", NULL)) != 4,
+                "Wrong rule matched");
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/usr/lib/systemd/sys", NULL)) != 3,
+                "Compressed path mismatch not handled");
+        fail_if(UF_PTR_TO_INT(uf_art_longest_prefix(art, "/usr/", NULL)) != 2,
+                "Exact key should match itself");
+        fail_if(uf_art_longest_prefix(art, "usr", NULL) != NULL, "Shouldn't match anything");
+
+        uf_art_free(art);
+}
+END_TEST
+
+typedef struct ArtCollect {
+        char keys[8][32];
+        int n;
+} ArtCollect;
+
+static bool collect_key(const char *key, __uf_unused__ void *value, void *userdata)
+{
+        ArtCollect *c = userdata;
+
+        if (c->n >= 8) {
+                return false;
+        }
+        snprintf(c->keys[c->n++], sizeof(c->keys[0]), "%s", key);
+        return true;
+}
+
+START_TEST(test_art_prefix_iter)
+{
+        UfArt *art = NULL;
+        ArtCollect c = { 0 };
+        const char *keys[] = {
+                "/usr/lib/b", "/usr/lib", "/usr/libexec/a", "/usr/bin/a", "/usr/lib/a", "/etc",
+        };
+
+        art = uf_art_new();
+        fail_if(!art, "Failed to construct tree!");
+
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+                fail_if(!uf_art_put(art, keys[i], UF_INT_TO_PTR(i + 1)), "Failed to insert");
+        }
+
+        uf_art_foreach_prefix(art, "/usr/lib", collect_key, &c);
+        fail_if(c.n != 4, "Wrong number of prefix matches");
+        fail_if(strcmp(c.keys[0], "/usr/lib") != 0, "Iteration out of order");
+        fail_if(strcmp(c.keys[1], "/usr/lib/a") != 0, "Iteration out of order");
+        fail_if(strcmp(c.keys[2], "/usr/lib/b") != 0, "Iteration out of order");
+        fail_if(strcmp(c.keys[3], "/usr/libexec/a") != 0, "Iteration out of order");
+
+        memset(&c, 0, sizeof(c));
+        uf_art_foreach_prefix(art, "", collect_key, &c);
+        fail_if(c.n != 6, "Full walk missed keys");
+        fail_if(strcmp(c.keys[0], "/etc") != 0, "Iteration out of order");
+
+        memset(&c, 0, sizeof(c));
+        uf_art_foreach_prefix(art, "/opt", collect_key, &c);
+        fail_if(c.n != 0, "Should not match anything");
+
+        uf_art_free(art);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_art_simple);
+        tcase_add_test(tc, test_art_grow_shrink);
+        tcase_add_test(tc, test_art_longest_prefix);
+        tcase_add_test(tc, test_art_prefix_iter);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
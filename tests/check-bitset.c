@@ -0,0 +1,149 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "util.h"
+
+START_TEST(test_bitset_simple)
+{
+        UfBitset *set = NULL;
+        size_t bit = 0;
+
+        set = uf_bitset_new(10);
+        fail_if(!set, "Failed to construct bitset");
+
+        fail_if(uf_bitset_test(set, 3), "Fresh set has bits");
+        fail_if(uf_bitset_next(set, 0, &bit), "Fresh set has bits");
+
+        fail_if(!uf_bitset_set(set, 3), "Failed to set bit");
+        fail_if(!uf_bitset_set(set, 100000), "Failed to grow set");
+        fail_if(!uf_bitset_test(set, 3), "Bit not set");
+        fail_if(!uf_bitset_test(set, 100000), "Bit not set");
+        fail_if(uf_bitset_test(set, 4), "Wrong bit set");
+        fail_if(uf_bitset_test(set, 1 << 30), "Test beyond the end should be false");
+
+        fail_if(!uf_bitset_next(set, 0, &bit) || bit != 3, "Find first set is wrong");
+        fail_if(!uf_bitset_next(set, 4, &bit) || bit != 100000, "Next set is wrong");
+        fail_if(uf_bitset_next(set, 100001, &bit), "Nothing should follow the last bit");
+        fail_if(uf_bitset_count(set) != 2, "Incorrect popcount");
+
+        uf_bitset_clear(set, 3);
+        fail_if(uf_bitset_test(set, 3), "Bit not cleared");
+        fail_if(uf_bitset_count(set) != 1, "Incorrect popcount");
+
+        uf_bitset_free(set);
+}
+END_TEST
+
+START_TEST(test_bitset_algebra)
+{
+        UfBitset *a = NULL;
+        UfBitset *b = NULL;
+        size_t bit = 0;
+        size_t n = 0;
+
+        a = uf_bitset_new(0);
+        b = uf_bitset_new(0);
+        fail_if(!a || !b, "Failed to construct bitsets");
+
+        /* a = multiples of 2, b = multiples of 3 (and larger) */
+        for (size_t i = 0; i < 10000; i += 2) {
+                fail_if(!uf_bitset_set(a, i), "Failed to set bit");
+        }
+        for (size_t i = 0; i < 20000; i += 3) {
+                fail_if(!uf_bitset_set(b, i), "Failed to set bit");
+        }
+
+        fail_if(uf_bitset_count(a) != 5000, "Incorrect popcount");
+        fail_if(uf_bitset_count(b) != 6667, "Incorrect popcount");
+        fail_if(uf_bitset_and_count(a, b) != 1667, "Incorrect intersection count");
+
+        uf_bitset_and(a, b);
+        fail_if(uf_bitset_count(a) != 1667, "Incorrect intersection");
+        for (bool ok = uf_bitset_next(a, 0, &bit); ok; ok = uf_bitset_next(a, bit + 1, &bit)) {
+                fail_if(bit % 6 != 0, "Intersection contains a stray bit");
+                n++;
+        }
+        fail_if(n != 1667, "Iteration missed bits");
+
+        /* (a & b) | b == b */
+        fail_if(!uf_bitset_or(a, b), "Failed to union");
+        fail_if(uf_bitset_count(a) != 6667, "Incorrect union");
+
+        /* b ^ b == 0 */
+        fail_if(!uf_bitset_xor(a, b), "Failed to xor");
+        fail_if(uf_bitset_count(a) != 0, "Incorrect xor");
+
+        fail_if(!uf_bitset_set(a, 3), "Failed to set bit");
+        fail_if(!uf_bitset_set(a, 4), "Failed to set bit");
+        uf_bitset_andnot(a, b);
+        fail_if(uf_bitset_test(a, 3) || !uf_bitset_test(a, 4), "Incorrect andnot");
+
+        uf_bitset_free(a);
+        uf_bitset_free(b);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_bitset_simple);
+        tcase_add_test(tc, test_bitset_algebra);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
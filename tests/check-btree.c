@@ -0,0 +1,234 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree.h"
+#include "util.h"
+
+START_TEST(test_btree_simple)
+{
+        UfBTree *tree = NULL;
+        void *v = NULL;
+
+        tree = uf_btree_new(uf_hashmap_string_compare);
+        fail_if(!tree, "Failed to construct string tree!");
+
+        fail_if(!uf_btree_put(tree, "charlie", UF_INT_TO_PTR(12)), "Failed to insert");
+        fail_if(!uf_btree_put(tree, "bob", UF_INT_TO_PTR(38)), "Failed to insert");
+
+        v = uf_btree_get(tree, "charlie");
+        fail_if(UF_PTR_TO_INT(v) != 12, "Retrieved value is incorrect");
+        v = uf_btree_get(tree, "bob");
+        fail_if(UF_PTR_TO_INT(v) != 38, "Retrieved value is incorrect");
+        fail_if(uf_btree_get(tree, "alice") != NULL, "Shouldn't find missing key");
+
+        fail_if(!uf_btree_put(tree, "bob", UF_INT_TO_PTR(40)), "Failed to replace");
+        fail_if(UF_PTR_TO_INT(uf_btree_get(tree, "bob")) != 40, "Replace didn't take");
+        fail_if(uf_btree_size(tree) != 2, "Incorrect size");
+
+        uf_btree_free(tree);
+}
+END_TEST
+
+/**
+ * Insert in a scrambled order to force splits at every level, then make
+ * sure a full walk yields everything in order.
+ */
+START_TEST(test_btree_ordered)
+{
+        UfBTree *tree = NULL;
+        UfBTreeIter iter;
+        void *key = NULL;
+        void *value = NULL;
+        size_t expect = 0;
+
+        tree = uf_btree_new_full(uf_hashmap_simple_compare, NULL, free);
+        fail_if(!tree, "Failed to construct tree");
+
+        for (size_t i = 0; i < 100000; i++) {
+                size_t k = (i * 7919) % 100000;
+                char *p = NULL;
+                if (asprintf(&p, "VALUE: %ld", k) < 0) {
+                        abort();
+                }
+                fail_if(!uf_btree_put(tree, UF_INT_TO_PTR(k), p), "Failed to insert keypair");
+        }
+        fail_if(uf_btree_size(tree) != 100000, "Incorrect size");
+
+        uf_btree_iter_init(tree, &iter);
+        while (uf_btree_iter_next(&iter, &key, &value)) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "VALUE: %ld", expect);
+                fail_if((size_t)key != expect, "Iteration out of order");
+                fail_if(strcmp(value, buf) != 0, "Wrong value for key");
+                expect++;
+        }
+        fail_if(expect != 100000, "Iteration missed keys");
+
+        /* Drain most of the tree to exercise node reclamation */
+        for (size_t i = 0; i < 100000; i++) {
+                if (i % 1000 == 0) {
+                        continue;
+                }
+                fail_if(!uf_btree_remove(tree, UF_INT_TO_PTR(i)), "Failed to remove key");
+                fail_if(uf_btree_get(tree, UF_INT_TO_PTR(i)) != NULL, "Key still present");
+        }
+        fail_if(uf_btree_size(tree) != 100, "Incorrect size after removal");
+
+        expect = 0;
+        uf_btree_iter_init(tree, &iter);
+        while (uf_btree_iter_next(&iter, &key, NULL)) {
+                fail_if((size_t)key != expect, "Iteration out of order after removal");
+                expect += 1000;
+        }
+        fail_if(expect != 100000, "Iteration missed keys after removal");
+
+        uf_btree_free(tree);
+}
+END_TEST
+
+START_TEST(test_btree_range)
+{
+        UfBTree *tree = NULL;
+        UfBTreeIter iter;
+        void *key = NULL;
+        size_t n = 0;
+
+        tree = uf_btree_new(uf_hashmap_simple_compare);
+        fail_if(!tree, "Failed to construct tree");
+
+        /* Even keys only */
+        for (size_t i = 0; i < 10000; i += 2) {
+                fail_if(!uf_btree_put(tree, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i)), "Failed to insert");
+        }
+
+        uf_btree_iter_init_range(tree, &iter, UF_INT_TO_PTR(4001), UF_INT_TO_PTR(5000));
+        while (uf_btree_iter_next(&iter, &key, NULL)) {
+                fail_if((size_t)key != 4002 + n * 2, "Range out of order");
+                n++;
+        }
+        fail_if(n != 499, "Range returned wrong number of keys");
+
+        uf_btree_iter_init_range(tree, &iter, UF_INT_TO_PTR(20000), UF_INT_TO_PTR(30000));
+        fail_if(uf_btree_iter_next(&iter, NULL, NULL), "Range past the end should be empty");
+
+        uf_btree_free(tree);
+}
+END_TEST
+
+START_TEST(test_btree_bulk_load)
+{
+        UfBTree *tree = NULL;
+        UfBTreeIter iter;
+        void **keys = NULL;
+        void **values = NULL;
+        void *key = NULL;
+        size_t expect = 0;
+        const size_t n = 50001;
+
+        keys = calloc(n, sizeof(void *));
+        values = calloc(n, sizeof(void *));
+        fail_if(!keys || !values, "OOM");
+
+        for (size_t i = 0; i < n; i++) {
+                keys[i] = UF_INT_TO_PTR(i * 3);
+                values[i] = UF_INT_TO_PTR(i);
+        }
+
+        tree = uf_btree_new(uf_hashmap_simple_compare);
+        fail_if(!tree, "Failed to construct tree");
+
+        /* Unsorted input is refused */
+        keys[10] = UF_INT_TO_PTR(1);
+        fail_if(uf_btree_bulk_load(tree, keys, values, n), "Loaded unsorted input");
+        keys[10] = UF_INT_TO_PTR(30);
+
+        fail_if(!uf_btree_bulk_load(tree, keys, values, n), "Failed to bulk load");
+        fail_if(uf_btree_size(tree) != n, "Incorrect size");
+        fail_if(uf_btree_bulk_load(tree, keys, values, n), "Bulk loaded a non-empty tree");
+
+        for (size_t i = 0; i < n; i++) {
+                fail_if(UF_PTR_TO_INT(uf_btree_get(tree, UF_INT_TO_PTR(i * 3))) != i,
+                        "Bulk loaded key is missing");
+        }
+
+        /* Tree must remain fully usable after a bulk load */
+        fail_if(!uf_btree_put(tree, UF_INT_TO_PTR(1), UF_INT_TO_PTR(1)), "Insert after load");
+        fail_if(!uf_btree_remove(tree, UF_INT_TO_PTR(3)), "Remove after load");
+
+        uf_btree_iter_init(tree, &iter);
+        while (uf_btree_iter_next(&iter, &key, NULL)) {
+                fail_if(expect > 0 && (size_t)key <= expect, "Iteration out of order");
+                expect = (size_t)key;
+        }
+
+        uf_btree_free(tree);
+        free(keys);
+        free(values);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_btree_simple);
+        tcase_add_test(tc, test_btree_ordered);
+        tcase_add_test(tc, test_btree_range);
+        tcase_add_test(tc, test_btree_bulk_load);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,260 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-counter.h"
+#include "countmap.h"
+#include "util.h"
+
+START_TEST(test_count_map_simple)
+{
+        UfCountMap *map = NULL;
+
+        map = uf_count_map_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!map, "Failed to construct count map");
+        fail_if(uf_count_map_get(map, "usr") != 0, "Empty map has a count");
+        fail_if(uf_count_map_size(map) != 0, "Empty map has keys");
+
+        fail_if(!uf_count_map_increment(map, "usr"), "Failed to increment");
+        fail_if(!uf_count_map_increment(map, "usr"), "Failed to increment");
+        fail_if(!uf_count_map_add(map, "etc", 40), "Failed to add");
+        fail_if(!uf_count_map_add(map, "usr", 0), "Failed to add zero");
+
+        fail_if(uf_count_map_get(map, "usr") != 2, "Wrong count for usr");
+        fail_if(uf_count_map_get(map, "etc") != 40, "Wrong count for etc");
+        fail_if(uf_count_map_size(map) != 2, "Wrong key count");
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+/**
+ * Integer keys may be zero, as with UfHashmap
+ */
+START_TEST(test_count_map_null_key)
+{
+        UfCountMap *map = NULL;
+
+        map = uf_count_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct count map");
+
+        fail_if(!uf_count_map_add(map, UF_INT_TO_PTR(0), 3), "Failed to add zero key");
+        fail_if(!uf_count_map_increment(map, UF_INT_TO_PTR(1)), "Failed to increment");
+        fail_if(!uf_count_map_increment(map, UF_INT_TO_PTR(0)), "Failed to increment zero key");
+        fail_if(uf_count_map_get(map, UF_INT_TO_PTR(0)) != 4, "Wrong count for zero key");
+        fail_if(uf_count_map_get(map, UF_INT_TO_PTR(1)) != 1, "Wrong count for key 1");
+        fail_if(uf_count_map_size(map) != 2, "Wrong key count");
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+START_TEST(test_count_map_grow)
+{
+        UfCountMap *map = NULL;
+
+        map = uf_count_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct count map");
+
+        for (size_t i = 1; i <= 100000; i++) {
+                fail_if(!uf_count_map_add(map, UF_INT_TO_PTR(i), i), "Failed to add");
+        }
+        fail_if(uf_count_map_size(map) != 100000, "Wrong key count");
+        for (size_t i = 1; i <= 100000; i++) {
+                fail_if(uf_count_map_get(map, UF_INT_TO_PTR(i)) != i, "Wrong count for %zu", i);
+        }
+        fail_if(uf_count_map_get(map, UF_INT_TO_PTR(100001)) != 0, "Missing key has a count");
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+static void *count_map_strdup(const void *v)
+{
+        return strdup(v);
+}
+
+START_TEST(test_count_map_dup)
+{
+        UfCountMap *map = NULL;
+        char path[64];
+
+        map = uf_count_map_new_full(uf_hashmap_string_hash,
+                                    uf_hashmap_string_equal,
+                                    count_map_strdup,
+                                    free);
+        fail_if(!map, "Failed to construct count map");
+
+        /* Keys come from a reused buffer, only the first sighting copies */
+        for (size_t i = 0; i < 1000; i++) {
+                snprintf(path, sizeof(path), "/usr/lib/%zu", i % 10);
+                fail_if(!uf_count_map_increment(map, path), "Failed to increment");
+        }
+        fail_if(uf_count_map_size(map) != 10, "Wrong key count");
+        fail_if(uf_count_map_get(map, "/usr/lib/3") != 100, "Wrong count");
+
+        /* Seen keys cost no allocation */
+        fail_if_allocs_exceed(0, {
+                for (size_t i = 0; i < 1000; i++) {
+                        snprintf(path, sizeof(path), "/usr/lib/%zu", i % 10);
+                        uf_count_map_increment(map, path);
+                }
+        });
+        fail_if(uf_count_map_get(map, "/usr/lib/3") != 200, "Wrong count");
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+START_TEST(test_count_map_top)
+{
+        UfCountMap *map = NULL;
+        UfCountMapEntry top[10];
+        size_t n;
+
+        map = uf_count_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct count map");
+        fail_if(uf_count_map_top(map, top, 10) != 0, "Empty map has a top");
+
+        /* Key i is counted (i * 7919) % 1000 times, all distinct */
+        for (size_t i = 1; i <= 1000; i++) {
+                fail_if(!uf_count_map_add(map, UF_INT_TO_PTR(i), (i * 7919) % 1000 + 1),
+                        "Failed to add");
+        }
+
+        n = uf_count_map_top(map, top, 10);
+        fail_if(n != 10, "Expected 10 entries, got %zu", n);
+        for (size_t i = 0; i < n; i++) {
+                fail_if(top[i].count != 1000 - i, "Entry %zu has count %lu", i,
+                        (unsigned long)top[i].count);
+                fail_if(uf_count_map_get(map, top[i].key) != top[i].count, "Key doesn't match count");
+        }
+
+        /* Asking for more than there is returns everything */
+        fail_if(uf_count_map_add(map, UF_INT_TO_PTR(5000), 1) == false, "Failed to add");
+        {
+                UfCountMapEntry all[2000];
+                n = uf_count_map_top(map, all, 2000);
+                fail_if(n != 1001, "Expected every key, got %zu", n);
+                for (size_t i = 1; i < n; i++) {
+                        fail_if(all[i].count > all[i - 1].count, "Not sorted");
+                }
+        }
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+#define COUNT_THREADS 8
+#define COUNT_KEYS 5000
+#define COUNT_ROUNDS 20
+
+static void *count_map_worker(void *userdata)
+{
+        UfCountMap *map = userdata;
+
+        /* Every thread walks the keys from a different place, racing inserts */
+        for (size_t r = 0; r < COUNT_ROUNDS; r++) {
+                for (size_t i = 1; i <= COUNT_KEYS; i++) {
+                        size_t key = (i * 31 + r) % COUNT_KEYS + 1;
+                        if (!uf_count_map_increment(map, UF_INT_TO_PTR(key))) {
+                                abort();
+                        }
+                }
+        }
+        return NULL;
+}
+
+START_TEST(test_count_map_threads)
+{
+        UfCountMap *map = NULL;
+        pthread_t threads[COUNT_THREADS];
+
+        map = uf_count_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct count map");
+
+        for (size_t i = 0; i < COUNT_THREADS; i++) {
+                fail_if(pthread_create(&threads[i], NULL, count_map_worker, map) != 0,
+                        "Failed to start thread");
+        }
+        for (size_t i = 0; i < COUNT_THREADS; i++) {
+                pthread_join(threads[i], NULL);
+        }
+
+        fail_if(uf_count_map_size(map) != COUNT_KEYS, "Wrong key count");
+        for (size_t i = 1; i <= COUNT_KEYS; i++) {
+                fail_if(uf_count_map_get(map, UF_INT_TO_PTR(i)) != COUNT_THREADS * COUNT_ROUNDS,
+                        "Lost increments for %zu",
+                        i);
+        }
+
+        uf_count_map_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_count_map_simple);
+        tcase_add_test(tc, test_count_map_null_key);
+        tcase_add_test(tc, test_count_map_grow);
+        tcase_add_test(tc, test_count_map_dup);
+        tcase_add_test(tc, test_count_map_top);
+        tcase_add_test(tc, test_count_map_threads);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,186 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc-counter.h"
+#include "countmin.h"
+#include "map.h"
+#include "util.h"
+
+static uint32_t cms_hash(size_t key)
+{
+        return uf_hashmap_simple_hash(UF_INT_TO_PTR(key));
+}
+
+START_TEST(test_count_min_new)
+{
+        fail_if(uf_count_min_new(0, 4) != NULL, "Accepted zero width");
+        fail_if(uf_count_min_new(64, 0) != NULL, "Accepted zero depth");
+        fail_if(uf_count_min_new(64, UF_COUNT_MIN_MAX_DEPTH + 1) != NULL, "Accepted deep sketch");
+}
+END_TEST
+
+START_TEST(test_count_min_small)
+{
+        UfCountMin *sketch = uf_count_min_new(1024, 4);
+
+        fail_if(!sketch, "Failed to construct sketch");
+        fail_if(uf_count_min_estimate(sketch, cms_hash(1)) != 0, "Empty sketch counted");
+
+        /* Few keys in a wide sketch are counted exactly */
+        for (size_t i = 1; i <= 20; i++) {
+                for (size_t j = 0; j < i; j++) {
+                        uf_count_min_add(sketch, cms_hash(i), 1);
+                }
+        }
+        for (size_t i = 1; i <= 20; i++) {
+                fail_if(uf_count_min_estimate(sketch, cms_hash(i)) != i, "Inexact count for %zu", i);
+        }
+        fail_if(uf_count_min_add(sketch, cms_hash(3), 10) != 13, "Add didn't return the estimate");
+        fail_if(uf_count_min_total(sketch) != 220, "Wrong total");
+
+        uf_count_min_clear(sketch);
+        fail_if(uf_count_min_estimate(sketch, cms_hash(3)) != 0, "Clear didn't reset");
+        fail_if(uf_count_min_total(sketch) != 0, "Clear didn't reset the total");
+
+        /* Saturation instead of wrapping */
+        uf_count_min_add(sketch, cms_hash(1), UINT32_MAX - 1);
+        fail_if(uf_count_min_add(sketch, cms_hash(1), 5) != UINT32_MAX, "Counter wrapped");
+
+        uf_count_min_free(sketch);
+}
+END_TEST
+
+/**
+ * Key i of a skewed stream occurs roughly 10000 / i times
+ */
+static size_t cms_occurrences(size_t key)
+{
+        return 10000 / key + 1;
+}
+
+START_TEST(test_count_min_bounds)
+{
+        UfCountMin *sketch = uf_count_min_new(512, 4);
+        uint64_t total = 0;
+        uint64_t overcount = 0;
+
+        fail_if(!sketch, "Failed to construct sketch");
+
+        /* Updates never allocate */
+        fail_if_allocs_exceed(0, {
+                for (size_t key = 1; key <= 5000; key++) {
+                        for (size_t n = cms_occurrences(key); n > 0; n--) {
+                                uf_count_min_add(sketch, cms_hash(key), 1);
+                        }
+                        total += cms_occurrences(key);
+                }
+        });
+
+        for (size_t key = 1; key <= 5000; key++) {
+                uint32_t estimate = uf_count_min_estimate(sketch, cms_hash(key));
+                fail_if(estimate < cms_occurrences(key), "Undercounted key %zu", key);
+                overcount += estimate - cms_occurrences(key);
+        }
+
+        /* Average overcount stays well inside the e * N / width bound */
+        fail_if(overcount / 5000 > total * 272 / 100 / 512,
+                "Average overcount %lu too high",
+                (unsigned long)(overcount / 5000));
+        for (size_t key = 1; key <= 10; key++) {
+                fail_if(uf_count_min_estimate(sketch, cms_hash(key)) > cms_occurrences(key) * 11 / 10,
+                        "Hot key %zu badly overcounted",
+                        key);
+        }
+
+        uf_count_min_free(sketch);
+}
+END_TEST
+
+START_TEST(test_count_min_merge)
+{
+        UfCountMin *a = uf_count_min_new(256, 4);
+        UfCountMin *b = uf_count_min_new(256, 4);
+        UfCountMin *narrow = uf_count_min_new(128, 4);
+
+        fail_if(!a || !b || !narrow, "Failed to construct sketches");
+        fail_if(uf_count_min_merge(a, narrow), "Merged differing widths");
+
+        /* Per-thread halves of the same stream */
+        for (size_t key = 1; key <= 1000; key++) {
+                uf_count_min_add(key & 1 ? a : b, cms_hash(key % 50 + 1), 1);
+        }
+        fail_if(!uf_count_min_merge(a, b), "Failed to merge");
+        fail_if(uf_count_min_total(a) != 1000, "Merged total wrong");
+        for (size_t key = 1; key <= 50; key++) {
+                fail_if(uf_count_min_estimate(a, cms_hash(key)) < 20, "Merge undercounted %zu", key);
+        }
+
+        uf_count_min_free(a);
+        uf_count_min_free(b);
+        uf_count_min_free(narrow);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_count_min_new);
+        tcase_add_test(tc, test_count_min_small);
+        tcase_add_test(tc, test_count_min_bounds);
+        tcase_add_test(tc, test_count_min_merge);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
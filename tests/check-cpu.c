@@ -0,0 +1,349 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "cpu.h"
+#include "hyperloglog.h"
+#include "map.h"
+#include "strview.h"
+#include "utf8.h"
+#include "util.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/**
+ * Every feature subset worth selecting a kernel for, each is masked by
+ * what the host supports so we only run code the CPU can execute.
+ */
+static const unsigned int feature_sets[] = {
+        0,
+        UF_CPU_SSE2,
+        UF_CPU_SSE2 | UF_CPU_POPCNT,
+        UF_CPU_SSE2 | UF_CPU_POPCNT | UF_CPU_AVX2,
+        ~0U,
+};
+
+START_TEST(test_cpu_features)
+{
+        unsigned int features = uf_cpu_features();
+
+        fail_if(features != uf_cpu_features(), "Features changed between calls");
+        fail_if(features != uf_cpu_detect(), "Cached features differ from the CPU");
+#if defined(__SSE2__)
+        fail_if(!(features & UF_CPU_SSE2), "Compiled for SSE2 but not detected");
+#endif
+        if (features & UF_CPU_AVX2) {
+                fail_if(!(features & UF_CPU_SSE2), "AVX2 without SSE2");
+        }
+}
+END_TEST
+
+START_TEST(test_cpu_popcount)
+{
+        uint64_t words[67];
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+        size_t expected[68] = { 0 };
+
+        for (size_t i = 0; i < ARRAY_SIZE(words); i++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                words[i] = i == 5 ? ~0ULL : seed;
+                expected[i + 1] = expected[i] + (size_t)__builtin_popcountll(words[i]);
+        }
+
+        for (size_t f = 0; f < ARRAY_SIZE(feature_sets); f++) {
+                uf_bits_popcount_func popcount =
+                    uf_bits_popcount_select(feature_sets[f] & uf_cpu_features());
+
+                /* Every length exercises each vector body and tail */
+                for (size_t n = 0; n <= ARRAY_SIZE(words); n++) {
+                        fail_if(popcount(words, n) != expected[n],
+                                "Popcount of %zu words wrong for features 0x%x",
+                                n,
+                                feature_sets[f]);
+                }
+        }
+        fail_if(uf_bits_popcount(words, ARRAY_SIZE(words)) != expected[ARRAY_SIZE(words)],
+                "Dispatched popcount wrong");
+}
+END_TEST
+
+START_TEST(test_cpu_hyperloglog_merge)
+{
+        uint8_t a[99];
+        uint8_t b[99];
+        uint8_t dst[99];
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+        for (size_t i = 0; i < ARRAY_SIZE(a); i++) {
+                seed ^= seed << 13;
+                seed ^= seed >> 7;
+                seed ^= seed << 17;
+                a[i] = (uint8_t)seed;
+                b[i] = (uint8_t)(seed >> 8);
+        }
+
+        for (size_t f = 0; f < ARRAY_SIZE(feature_sets); f++) {
+                uf_hyperloglog_merge_func merge =
+                    uf_hyperloglog_merge_select(feature_sets[f] & uf_cpu_features());
+
+                /* Every length exercises each vector body and tail */
+                for (size_t n = 0; n <= ARRAY_SIZE(a); n++) {
+                        memcpy(dst, a, sizeof(dst));
+                        fail_if(merge(dst, b, n) != dst, "Merge didn't return dst");
+                        for (size_t i = 0; i < ARRAY_SIZE(a); i++) {
+                                uint8_t want = i < n && b[i] > a[i] ? b[i] : a[i];
+                                fail_if(dst[i] != want,
+                                        "Merge of %zu bytes wrong at %zu for features 0x%x",
+                                        n,
+                                        i,
+                                        feature_sets[f]);
+                        }
+                }
+        }
+}
+END_TEST
+
+/**
+ * Byte at a time reference for the case-insensitive kernels
+ */
+static bool case_equal_reference(const char *a, const char *b)
+{
+        for (;; a++, b++) {
+                unsigned char x = (unsigned char)*a;
+                unsigned char y = (unsigned char)*b;
+                x = x >= 'A' && x <= 'Z' ? (unsigned char)(x | 0x20) : x;
+                y = y >= 'A' && y <= 'Z' ? (unsigned char)(y | 0x20) : y;
+                if (x != y) {
+                        return false;
+                }
+                if (x == '\0') {
+                        return true;
+                }
+        }
+}
+
+START_TEST(test_cpu_string_case)
+{
+        char upper[101];
+        char lower[101];
+        char other[101];
+        uint32_t expected[ARRAY_SIZE(upper)];
+
+        /* Letters, neighbours of the A-Z range and high bytes */
+        for (size_t i = 0; i < ARRAY_SIZE(upper) - 1; i++) {
+                static const char pool[] = "AbZz@[`{09-_\xc1\xe1";
+                char c = pool[i % (sizeof(pool) - 1)];
+                upper[i] = c;
+                lower[i] = (c >= 'A' && c <= 'Z') ? (char)(c | 0x20) : c;
+        }
+
+        for (size_t f = 0; f < ARRAY_SIZE(feature_sets); f++) {
+                uf_hashmap_hash_func hash =
+                    uf_hashmap_string_case_hash_select(feature_sets[f] & uf_cpu_features());
+                uf_hashmap_equal_func equal =
+                    uf_hashmap_string_case_equal_select(feature_sets[f] & uf_cpu_features());
+
+                /* Every length exercises each vector body and tail */
+                for (size_t n = 0; n < ARRAY_SIZE(upper); n++) {
+                        char saved_upper = upper[n];
+                        char saved_lower = lower[n];
+                        uint32_t h;
+
+                        upper[n] = lower[n] = '\0';
+                        h = hash(upper);
+                        fail_if(h != hash(lower), "Case changed the hash at %zu bytes", n);
+                        if (f == 0) {
+                                expected[n] = h;
+                        }
+                        fail_if(h != expected[n], "Kernels disagree at %zu bytes", n);
+                        fail_if(!equal(upper, lower), "Unequal at %zu bytes", n);
+
+                        /* Flipping 0x20 must only be ignored on letters */
+                        if (n > 0) {
+                                memcpy(other, lower, n + 1);
+                                other[n - 1] = (char)(other[n - 1] ^ 0x20);
+                                fail_if(equal(other, lower) != case_equal_reference(other, lower),
+                                        "Wrong equality with byte %zu flipped",
+                                        n - 1);
+                        }
+                        upper[n] = saved_upper;
+                        lower[n] = saved_lower;
+                }
+        }
+        fail_if(uf_hashmap_string_case_equal("abc", "abcd"), "Prefix compared equal");
+        fail_if(uf_hashmap_string_case_equal(NULL, "abc"), "NULL compared equal");
+}
+END_TEST
+
+/**
+ * Naive reference search
+ */
+static bool find_reference(UfStrView view, UfStrView needle, size_t *offset)
+{
+        if (needle.len > view.len) {
+                return false;
+        }
+        for (size_t i = 0; i + needle.len <= view.len; i++) {
+                if (memcmp(view.data + i, needle.data, needle.len) == 0) {
+                        *offset = i;
+                        return true;
+                }
+        }
+        return false;
+}
+
+START_TEST(test_cpu_find)
+{
+        char hay[150];
+        static const char *needles[] = {
+                "", "a", "ab", "aab", "aaaaaaaaaaaaaaab", "zz", "ba", "abababababababababababababababababc",
+        };
+
+        /* Long runs of near misses, with a match in varying positions */
+        for (size_t i = 0; i < sizeof(hay); i++) {
+                hay[i] = (char)(i % 7 == 6 ? 'b' : 'a');
+        }
+
+        for (size_t f = 0; f < ARRAY_SIZE(feature_sets); f++) {
+                uf_strview_find_func find =
+                    uf_strview_find_select(feature_sets[f] & uf_cpu_features());
+
+                for (size_t n = 0; n < ARRAY_SIZE(needles); n++) {
+                        UfStrView needle = uf_strview(needles[n]);
+
+                        for (size_t len = 0; len <= sizeof(hay); len++) {
+                                UfStrView view = uf_strview_len(hay, len);
+                                size_t got = 0, want = 0;
+                                bool found = find(view, needle, &got);
+
+                                fail_if(found != find_reference(view, needle, &want),
+                                        "Find '%s' in %zu bytes disagrees for features 0x%x",
+                                        needles[n],
+                                        len,
+                                        feature_sets[f]);
+                                fail_if(found && got != want, "Find returned wrong offset");
+                        }
+                }
+        }
+}
+END_TEST
+
+START_TEST(test_cpu_utf8)
+{
+        static const struct {
+                const char *data;
+                bool valid;
+        } cases[] = {
+                { "plain ascii", true },
+                { "caf\xc3\xa9", true },
+                { "\xe2\x82\xac", true },
+                { "\xf0\x9f\x98\x80", true },
+                { "\xf4\x8f\xbf\xbf", true },
+                { "\xc0\xaf", false },         /* overlong */
+                { "\xe0\x80\xaf", false },     /* overlong */
+                { "\xed\xa0\x80", false },     /* surrogate */
+                { "\xf4\x90\x80\x80", false }, /* beyond U+10FFFF */
+                { "\xf8\x88\x80\x80\x80", false },
+                { "\x80", false },
+                { "\xc3", false },
+                { "\xe2\x82", false },
+        };
+        char buf[96];
+
+        for (size_t f = 0; f < ARRAY_SIZE(feature_sets); f++) {
+                uf_utf8_validate_func validate =
+                    uf_utf8_validate_select(feature_sets[f] & uf_cpu_features());
+
+                /* Slide each case through the buffer so it straddles vectors */
+                for (size_t c = 0; c < ARRAY_SIZE(cases); c++) {
+                        size_t len = strlen(cases[c].data);
+
+                        for (size_t at = 0; at + len <= sizeof(buf); at++) {
+                                memset(buf, 'x', sizeof(buf));
+                                memcpy(buf + at, cases[c].data, len);
+                                fail_if(validate(buf, sizeof(buf)) != cases[c].valid,
+                                        "utf8 case %zu at %zu wrong for features 0x%x",
+                                        c,
+                                        at,
+                                        feature_sets[f]);
+                                /* Truncated at the end of the input */
+                                fail_if(validate(buf, at + len) != cases[c].valid,
+                                        "utf8 case %zu ending at %zu wrong",
+                                        c,
+                                        at + len);
+                        }
+                }
+                fail_if(!validate("", 0), "Empty input is valid");
+                fail_if(!validate("a\0b", 3), "Embedded NUL is valid");
+        }
+        fail_if(uf_utf8_validate("\xc0\xaf", 2), "Dispatched validate accepted overlong");
+        fail_if(!uf_utf8_validate("caf\xc3\xa9", 5), "Dispatched validate rejected valid");
+}
+END_TEST
+
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_cpu_features);
+        tcase_add_test(tc, test_cpu_popcount);
+        tcase_add_test(tc, test_cpu_hyperloglog_merge);
+        tcase_add_test(tc, test_cpu_string_case);
+        tcase_add_test(tc, test_cpu_find);
+        tcase_add_test(tc, test_cpu_utf8);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,198 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuckoo.h"
+#include "util.h"
+
+START_TEST(test_cuckoo_simple)
+{
+        UfCuckooMap *map = NULL;
+
+        map = uf_cuckoo_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!map, "Failed to construct cuckoo map");
+        fail_if(uf_cuckoo_get(map, "charlie") != NULL, "Empty map returned a value");
+        fail_if(uf_cuckoo_remove(map, "charlie"), "Empty map removed a key");
+
+        fail_if(!uf_cuckoo_put(map, "charlie", UF_INT_TO_PTR(12)), "Failed to insert");
+        fail_if(!uf_cuckoo_put(map, "bob", UF_INT_TO_PTR(38)), "Failed to insert");
+        fail_if(UF_PTR_TO_INT(uf_cuckoo_get(map, "charlie")) != 12, "Retrieved value is incorrect");
+        fail_if(UF_PTR_TO_INT(uf_cuckoo_get(map, "bob")) != 38, "Retrieved value is incorrect");
+
+        fail_if(!uf_cuckoo_put(map, "bob", UF_INT_TO_PTR(40)), "Failed to replace");
+        fail_if(UF_PTR_TO_INT(uf_cuckoo_get(map, "bob")) != 40, "Replace didn't take");
+        fail_if(uf_cuckoo_size(map) != 2, "Replace changed the size");
+
+        fail_if(!uf_cuckoo_remove(map, "bob"), "Failed to remove");
+        fail_if(uf_cuckoo_get(map, "bob") != NULL, "Removed key still present");
+        fail_if(uf_cuckoo_size(map) != 1, "Remove didn't change the size");
+
+        uf_cuckoo_free(map);
+}
+END_TEST
+
+START_TEST(test_cuckoo_load)
+{
+        UfCuckooMap *map = NULL;
+        double peak = 0.0;
+        size_t capacity = 0;
+
+        map = uf_cuckoo_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct cuckoo map");
+
+        /* Record the load reached just before each growth */
+        for (size_t i = 1; i <= 200000; i++) {
+                size_t size = uf_cuckoo_size(map);
+
+                fail_if(!uf_cuckoo_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i)), "Failed to insert");
+                if (uf_cuckoo_capacity(map) != capacity && capacity > 0) {
+                        double load = (double)size / (double)capacity;
+                        peak = load > peak ? load : peak;
+                        fail_if(uf_cuckoo_capacity(map) > capacity * 2, "Grew by more than 2x");
+                }
+                capacity = uf_cuckoo_capacity(map);
+        }
+        fail_if(peak < 0.9, "Only reached %.2f load before growing", peak);
+
+        for (size_t i = 1; i <= 200000; i++) {
+                fail_if(UF_PTR_TO_INT(uf_cuckoo_get(map, UF_INT_TO_PTR(i))) != i,
+                        "Lost key %zu",
+                        i);
+        }
+        fail_if(uf_cuckoo_get(map, UF_INT_TO_PTR(200001)) != NULL, "Found missing key");
+
+        /* Remove every other key and check the rest survive */
+        for (size_t i = 1; i <= 200000; i += 2) {
+                fail_if(!uf_cuckoo_remove(map, UF_INT_TO_PTR(i)), "Failed to remove");
+        }
+        for (size_t i = 1; i <= 200000; i++) {
+                void *v = uf_cuckoo_get(map, UF_INT_TO_PTR(i));
+                fail_if((i & 1) ? v != NULL : UF_PTR_TO_INT(v) != i, "Wrong value after remove");
+        }
+        fail_if(uf_cuckoo_size(map) != 100000, "Wrong size after remove");
+
+        uf_cuckoo_free(map);
+}
+END_TEST
+
+START_TEST(test_cuckoo_reserve)
+{
+        UfCuckooMap *map = NULL;
+        size_t capacity;
+
+        map = uf_cuckoo_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct cuckoo map");
+        fail_if(!uf_cuckoo_reserve(map, 10000), "Failed to reserve");
+        capacity = uf_cuckoo_capacity(map);
+
+        for (size_t i = 1; i <= 10000; i++) {
+                fail_if(!uf_cuckoo_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i)), "Failed to insert");
+        }
+        fail_if(uf_cuckoo_capacity(map) != capacity, "Grew despite reserving");
+
+        uf_cuckoo_free(map);
+}
+END_TEST
+
+static uint32_t cuckoo_constant_hash(__uf_unused__ const void *v)
+{
+        return 7;
+}
+
+START_TEST(test_cuckoo_degenerate)
+{
+        UfCuckooMap *map = NULL;
+
+        /* Every key shares two buckets, the rest must go to the stash */
+        map = uf_cuckoo_new_full(cuckoo_constant_hash, uf_hashmap_string_equal, free, free);
+        fail_if(!map, "Failed to construct cuckoo map");
+
+        for (size_t i = 0; i < 100; i++) {
+                char *key = NULL;
+                if (asprintf(&key, "key-%zu", i) < 0) {
+                        abort();
+                }
+                fail_if(!uf_cuckoo_put(map, key, strdup(key)), "Failed to insert");
+        }
+        fail_if(uf_cuckoo_capacity(map) > 64, "Grew for colliding keys");
+        fail_if(strcmp(uf_cuckoo_get(map, "key-99"), "key-99") != 0, "Lost stashed key");
+        fail_if(strcmp(uf_cuckoo_get(map, "key-0"), "key-0") != 0, "Lost bucket key");
+
+        fail_if(!uf_cuckoo_put(map, strdup("key-50"), strdup("fifty")), "Failed to replace");
+        fail_if(strcmp(uf_cuckoo_get(map, "key-50"), "fifty") != 0, "Replace didn't take");
+        fail_if(!uf_cuckoo_remove(map, "key-60"), "Failed to remove stashed key");
+        fail_if(uf_cuckoo_get(map, "key-60") != NULL, "Removed key still present");
+        fail_if(uf_cuckoo_size(map) != 99, "Wrong size");
+
+        /* Growing carries the stash across */
+        fail_if(!uf_cuckoo_reserve(map, 1000), "Failed to reserve");
+        fail_if(strcmp(uf_cuckoo_get(map, "key-98"), "key-98") != 0, "Lost key on rehash");
+        fail_if(uf_cuckoo_size(map) != 99, "Wrong size after rehash");
+
+        uf_cuckoo_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_cuckoo_simple);
+        tcase_add_test(tc, test_cuckoo_load);
+        tcase_add_test(tc, test_cuckoo_reserve);
+        tcase_add_test(tc, test_cuckoo_degenerate);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
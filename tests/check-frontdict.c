@@ -0,0 +1,211 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-counter.h"
+#include "frontdict.h"
+#include "util.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+static int front_dict_sort(const void *a, const void *b)
+{
+        return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/**
+ * Reference lower bound over a sorted array
+ */
+static size_t front_dict_lower_bound(char **sorted, size_t n, const char *key)
+{
+        size_t lo = 0;
+        size_t hi = n;
+
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (strcmp(sorted[mid], key) < 0) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+START_TEST(test_front_dict_simple)
+{
+        static const char *strings[] = {
+                "usr/lib", "usr/bin/ls", "usr/bin", "", "usr/bin/less", "usr/bin/ls",
+                "etc",     "usr/lib64",  "usr/",    "a", "usr/bin/lsblk",
+        };
+        static const char *sorted[] = {
+                "",        "a",           "etc",          "usr/",    "usr/bin",
+                "usr/bin/less", "usr/bin/ls", "usr/bin/lsblk", "usr/lib", "usr/lib64",
+        };
+        static const char *missing[] = { "usr", "usr/bin/l", "usr/bin/lsb", "usr/lib6", "z", "b" };
+        UfFrontDict *dict = NULL;
+        char buf[64];
+
+        dict = uf_front_dict_new(strings, ARRAY_SIZE(strings));
+        fail_if(!dict, "Failed to construct dictionary");
+        fail_if(uf_front_dict_size(dict) != ARRAY_SIZE(sorted), "Duplicates were not merged");
+
+        for (size_t i = 0; i < ARRAY_SIZE(sorted); i++) {
+                fail_if(uf_front_dict_lookup(dict, sorted[i]) != i, "Lookup returned the wrong id");
+                fail_if(uf_front_dict_get(dict, i, buf, sizeof(buf)) != strlen(sorted[i]),
+                        "Decoded length is wrong");
+                fail_if(strcmp(buf, sorted[i]) != 0, "Decoded string is wrong");
+                fail_if(uf_front_dict_lower_bound(dict, sorted[i]) != i, "Lower bound missed a member");
+        }
+        for (size_t i = 0; i < ARRAY_SIZE(missing); i++) {
+                fail_if(uf_front_dict_lookup(dict, missing[i]) != UF_FRONT_DICT_NOT_FOUND,
+                        "Found a string never added");
+        }
+        fail_if(uf_front_dict_lower_bound(dict, "usr/bin/") != 5, "Prefix lower bound is wrong");
+        fail_if(uf_front_dict_lower_bound(dict, "z") != ARRAY_SIZE(sorted), "Lower bound past end");
+        fail_if(uf_front_dict_get(dict, ARRAY_SIZE(sorted), buf, sizeof(buf)) !=
+                    UF_FRONT_DICT_NOT_FOUND,
+                "Decoded an id out of range");
+
+        /* Truncated like snprintf */
+        fail_if(uf_front_dict_get(dict, 7, buf, 6) != strlen("usr/bin/lsblk"), "Length lost");
+        fail_if(strcmp(buf, "usr/b") != 0, "Truncated string is wrong");
+        fail_if(uf_front_dict_get(dict, 7, NULL, 0) != strlen("usr/bin/lsblk"), "Length lost");
+
+        uf_front_dict_free(dict);
+
+        dict = uf_front_dict_new(NULL, 0);
+        fail_if(!dict, "Failed to construct empty dictionary");
+        fail_if(uf_front_dict_size(dict) != 0, "Empty dictionary has strings");
+        fail_if(uf_front_dict_lookup(dict, "") != UF_FRONT_DICT_NOT_FOUND, "Found in empty dictionary");
+        fail_if(uf_front_dict_lower_bound(dict, "a") != 0, "Lower bound in empty dictionary");
+        uf_front_dict_free(dict);
+}
+END_TEST
+
+#define UF_FRONT_DICT_PATHS 50000
+
+START_TEST(test_front_dict_paths)
+{
+        static const char *dirs[] = { "usr/share/locale/", "usr/lib/x86_64-linux-gnu/", "usr/include/" };
+        char **paths = NULL;
+        UfFrontDict *dict = NULL;
+        size_t raw = 0;
+        char buf[256];
+
+        /* Sequential file names under a few deep directories */
+        paths = malloc(UF_FRONT_DICT_PATHS * sizeof(char *));
+        fail_if(!paths, "Out of memory");
+        for (size_t i = 0; i < UF_FRONT_DICT_PATHS; i++) {
+                if (asprintf(&paths[i],
+                             "/%spackage-%zu/subsystem-%zu/file-%zu.txt",
+                             dirs[i % ARRAY_SIZE(dirs)],
+                             i / 500,
+                             (i / 20) % 25,
+                             i) < 0) {
+                        abort();
+                }
+                raw += strlen(paths[i]) + 1;
+        }
+
+        dict = uf_front_dict_new((const char *const *)paths, UF_FRONT_DICT_PATHS);
+        fail_if(!dict, "Failed to construct dictionary");
+        fail_if(uf_front_dict_size(dict) != UF_FRONT_DICT_PATHS, "Lost strings");
+
+        /* The index included, well under the bare string bytes */
+        fail_if(uf_front_dict_memory(dict) * 3 > raw, "Dictionary did not compress");
+
+        qsort(paths, UF_FRONT_DICT_PATHS, sizeof(char *), front_dict_sort);
+        fail_if_allocs_exceed(0, {
+                for (size_t i = 0; i < UF_FRONT_DICT_PATHS; i++) {
+                        fail_if(uf_front_dict_lookup(dict, paths[i]) != i, "Lookup returned the wrong id");
+                        uf_front_dict_get(dict, i, buf, sizeof(buf));
+                        fail_if(strcmp(buf, paths[i]) != 0, "Decoded string is wrong");
+                }
+        });
+
+        /* Misses and lower bounds around every member */
+        for (size_t i = 0; i < UF_FRONT_DICT_PATHS; i += 7) {
+                size_t len = strlen(paths[i]);
+
+                memcpy(buf, paths[i], len + 1);
+                buf[len - 1] = 'u';
+                fail_if(uf_front_dict_lookup(dict, buf) != UF_FRONT_DICT_NOT_FOUND, "Found a miss");
+                fail_if(uf_front_dict_lower_bound(dict, buf) !=
+                            front_dict_lower_bound(paths, UF_FRONT_DICT_PATHS, buf),
+                        "Lower bound disagrees with reference");
+                buf[len - 5] = '\0';
+                fail_if(uf_front_dict_lower_bound(dict, buf) !=
+                            front_dict_lower_bound(paths, UF_FRONT_DICT_PATHS, buf),
+                        "Prefix lower bound disagrees with reference");
+        }
+
+        uf_front_dict_free(dict);
+        for (size_t i = 0; i < UF_FRONT_DICT_PATHS; i++) {
+                free(paths[i]);
+        }
+        free(paths);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_front_dict_simple);
+        tcase_add_test(tc, test_front_dict_paths);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
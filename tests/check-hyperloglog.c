@@ -0,0 +1,218 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hyperloglog.h"
+#include "map.h"
+#include "util.h"
+
+/**
+ * Add keys [from, to) through the hash UfHashmap would use for them
+ */
+static void hll_add_range(UfHyperLogLog *hll, size_t from, size_t to)
+{
+        for (size_t i = from; i < to; i++) {
+                fail_if(!uf_hyperloglog_add_hash(hll, uf_hashmap_simple_hash(UF_INT_TO_PTR(i))),
+                        "Failed to add");
+        }
+}
+
+static double hll_error(UfHyperLogLog *hll, size_t expected)
+{
+        double estimate = (double)uf_hyperloglog_estimate(hll);
+
+        return (estimate - (double)expected) / (double)expected;
+}
+
+START_TEST(test_hyperloglog_new)
+{
+        UfHyperLogLog *hll = NULL;
+
+        fail_if(uf_hyperloglog_new(UF_HYPERLOGLOG_MIN_PRECISION - 1) != NULL, "Accepted low precision");
+        fail_if(uf_hyperloglog_new(UF_HYPERLOGLOG_MAX_PRECISION + 1) != NULL, "Accepted high precision");
+
+        hll = uf_hyperloglog_new(UF_HYPERLOGLOG_DEFAULT_PRECISION);
+        fail_if(!hll, "Failed to construct estimator");
+        fail_if(uf_hyperloglog_estimate(hll) != 0, "Empty estimator counted something");
+        fail_if(!uf_hyperloglog_is_sparse(hll), "Empty estimator isn't sparse");
+        uf_hyperloglog_free(hll);
+}
+END_TEST
+
+START_TEST(test_hyperloglog_sparse)
+{
+        UfHyperLogLog *hll = NULL;
+        uint64_t estimate;
+
+        hll = uf_hyperloglog_new(UF_HYPERLOGLOG_DEFAULT_PRECISION);
+        fail_if(!hll, "Failed to construct estimator");
+
+        /* Repeats must not count */
+        for (int round = 0; round < 5; round++) {
+                hll_add_range(hll, 0, 200);
+        }
+        fail_if(!uf_hyperloglog_is_sparse(hll), "Went dense for 200 items");
+        estimate = uf_hyperloglog_estimate(hll);
+        fail_if(estimate < 196 || estimate > 204, "Estimated %lu for 200", (unsigned long)estimate);
+
+        /* Growing far enough switches representation, keeping what was seen */
+        hll_add_range(hll, 200, 20000);
+        fail_if(uf_hyperloglog_is_sparse(hll), "Still sparse after 20000 items");
+        fail_if(fabs(hll_error(hll, 20000)) > 0.03, "Lost accuracy going dense");
+
+        uf_hyperloglog_clear(hll);
+        fail_if(!uf_hyperloglog_is_sparse(hll), "Clear didn't go sparse");
+        fail_if(uf_hyperloglog_estimate(hll) != 0, "Clear didn't forget");
+
+        uf_hyperloglog_free(hll);
+}
+END_TEST
+
+START_TEST(test_hyperloglog_accuracy)
+{
+        static const size_t sizes[] = { 10, 1000, 50000, 1000000 };
+
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+                UfHyperLogLog *hll = uf_hyperloglog_new(UF_HYPERLOGLOG_DEFAULT_PRECISION);
+                double error;
+
+                fail_if(!hll, "Failed to construct estimator");
+                hll_add_range(hll, 1, sizes[i] + 1);
+                error = hll_error(hll, sizes[i]);
+                fail_if(fabs(error) > 0.03, "Error %.3f for %zu items", error, sizes[i]);
+                uf_hyperloglog_free(hll);
+        }
+
+        /* 64-bit hashes and the smallest precision work too */
+        {
+                UfHyperLogLog *hll = uf_hyperloglog_new(UF_HYPERLOGLOG_MIN_PRECISION);
+                double error;
+
+                fail_if(!hll, "Failed to construct estimator");
+                for (uint64_t i = 0; i < 100000; i++) {
+                        uf_hyperloglog_add_hash64(hll, i << 32);
+                }
+                error = hll_error(hll, 100000);
+                fail_if(fabs(error) > 0.8, "Error %.3f at precision 4", error);
+                uf_hyperloglog_free(hll);
+        }
+}
+END_TEST
+
+START_TEST(test_hyperloglog_merge)
+{
+        UfHyperLogLog *a = uf_hyperloglog_new(12);
+        UfHyperLogLog *b = uf_hyperloglog_new(12);
+        UfHyperLogLog *c = uf_hyperloglog_new(12);
+        UfHyperLogLog *other = uf_hyperloglog_new(10);
+
+        fail_if(!a || !b || !c || !other, "Failed to construct estimators");
+        fail_if(uf_hyperloglog_merge(a, other), "Merged differing precisions");
+
+        /* Overlapping dense halves */
+        hll_add_range(a, 0, 60000);
+        hll_add_range(b, 40000, 100000);
+        fail_if(!uf_hyperloglog_merge(a, b), "Failed to merge");
+        fail_if(fabs(hll_error(a, 100000)) > 0.05, "Merged estimate off by %.3f", hll_error(a, 100000));
+
+        /* Sparse into dense, then dense into sparse */
+        hll_add_range(c, 100000, 100050);
+        fail_if(!uf_hyperloglog_is_sparse(c), "Small estimator went dense");
+        fail_if(!uf_hyperloglog_merge(a, c), "Failed to merge sparse");
+        fail_if(!uf_hyperloglog_merge(c, a), "Failed to merge dense");
+        fail_if(uf_hyperloglog_is_sparse(c), "Merging dense didn't go dense");
+        fail_if(uf_hyperloglog_estimate(a) != uf_hyperloglog_estimate(c), "Merges disagree");
+        fail_if(fabs(hll_error(c, 100050)) > 0.05, "Merged estimate off by %.3f", hll_error(c, 100050));
+
+        uf_hyperloglog_free(a);
+        uf_hyperloglog_free(b);
+        uf_hyperloglog_free(c);
+        uf_hyperloglog_free(other);
+}
+END_TEST
+
+START_TEST(test_hyperloglog_presize)
+{
+        UfHyperLogLog *hll = uf_hyperloglog_new(UF_HYPERLOGLOG_DEFAULT_PRECISION);
+        UfHashmap *map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        uint64_t estimate;
+
+        fail_if(!hll || !map, "Failed to construct");
+
+        /* First pass over a stream with repeats, then size the map once */
+        for (size_t i = 0; i < 300000; i++) {
+                uf_hyperloglog_add_hash(hll, uf_hashmap_simple_hash(UF_INT_TO_PTR(i % 100000 + 1)));
+        }
+        estimate = uf_hyperloglog_estimate(hll);
+        fail_if(estimate < 97000 || estimate > 103000, "Estimated %lu", (unsigned long)estimate);
+        fail_if(!uf_hashmap_reserve(map, estimate), "Failed to reserve");
+
+        uf_hashmap_free(map);
+        uf_hyperloglog_free(hll);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_hyperloglog_new);
+        tcase_add_test(tc, test_hyperloglog_sparse);
+        tcase_add_test(tc, test_hyperloglog_accuracy);
+        tcase_add_test(tc, test_hyperloglog_merge);
+        tcase_add_test(tc, test_hyperloglog_presize);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
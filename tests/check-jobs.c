@@ -0,0 +1,182 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "util.h"
+
+#define N_JOBS 8
+
+static double now(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void count_done(__uf_unused__ UfJobRunner *runner, __uf_unused__ size_t job,
+                       void *userdata)
+{
+        (*(size_t *)userdata)++;
+}
+
+/**
+ * Sleeping jobs must overlap, and each keeps its own output
+ */
+START_TEST(test_jobs_parallel)
+{
+        UfJobRunner *runner = NULL;
+        char scripts[N_JOBS][64];
+        const char *argv[N_JOBS][4];
+        size_t n_done = 0;
+        double start;
+
+        runner = uf_job_runner_new(4);
+        fail_if(!runner, "Failed to construct runner");
+
+        for (int i = 0; i < N_JOBS; i++) {
+                UfSpawnOptions options = {
+                        .argv = argv[i],
+                        .flags = UF_SPAWN_CAPTURE_STDOUT | UF_SPAWN_CAPTURE_STDERR,
+                };
+                size_t job = 0;
+
+                snprintf(scripts[i], sizeof(scripts[i]), "sleep 0.3; echo job%d; exit %d", i, i);
+                argv[i][0] = "/bin/sh";
+                argv[i][1] = "-c";
+                argv[i][2] = scripts[i];
+                argv[i][3] = NULL;
+                fail_if(!uf_job_runner_add(runner, &options, &job), "Failed to add job");
+                fail_if(job != (size_t)i, "Wrong job index");
+        }
+
+        start = now();
+        fail_if(!uf_job_runner_run(runner, count_done, &n_done), "Run failed");
+        fail_if(now() - start > 1.5, "Jobs didn't run in parallel");
+        fail_if(n_done != N_JOBS, "Missed completions");
+
+        for (int i = 0; i < N_JOBS; i++) {
+                char expect[16];
+                int status = 0;
+
+                fail_if(!uf_job_runner_status(runner, (size_t)i, &status), "Job didn't run");
+                fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != i, "Wrong exit status");
+                snprintf(expect, sizeof(expect), "job%d\n", i);
+                fail_if(strcmp(uf_job_runner_stdout(runner, (size_t)i, NULL), expect) != 0,
+                        "Wrong output");
+        }
+
+        uf_job_runner_free(runner);
+}
+END_TEST
+
+static void record_order(__uf_unused__ UfJobRunner *runner, size_t job, void *userdata)
+{
+        size_t *order = userdata;
+        order[++order[0]] = job;
+}
+
+/**
+ * A limit of one runs strictly in order, and launch failures are reported
+ * without stopping the run.
+ */
+START_TEST(test_jobs_sequential)
+{
+        UfJobRunner *runner = NULL;
+        const char *ok_argv[] = { "/bin/sh", "-c", "head -c 100000 /dev/zero >&2", NULL };
+        const char *bad_argv[] = { "/nonexistent/program", NULL };
+        UfSpawnOptions ok = {.argv = ok_argv, .flags = UF_SPAWN_CAPTURE_STDERR };
+        UfSpawnOptions bad = {.argv = bad_argv };
+        size_t order[5] = { 0 };
+        size_t len = 0;
+        int status = 0;
+
+        runner = uf_job_runner_new(1);
+        fail_if(!runner, "Failed to construct runner");
+        fail_if(!uf_job_runner_add(runner, &ok, NULL), "Failed to add job");
+        fail_if(!uf_job_runner_add(runner, &bad, NULL), "Failed to add job");
+        fail_if(!uf_job_runner_add(runner, &ok, NULL), "Failed to add job");
+        fail_if(uf_job_runner_size(runner) != 3, "Wrong size");
+
+        uf_job_runner_run(runner, record_order, order);
+        fail_if(order[0] != 3, "Missed completions");
+        for (size_t i = 0; i < 3; i++) {
+                fail_if(order[i + 1] != i, "Jobs completed out of order");
+        }
+
+        uf_job_runner_stderr(runner, 2, &len);
+        fail_if(len != 100000, "Lost stderr");
+
+        /* Launch failure is either up front or exit 127, depending on libc */
+        if (uf_job_runner_status(runner, 1, &status)) {
+                fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 127, "Wrong exit status");
+        }
+
+        uf_job_runner_free(runner);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_jobs_parallel);
+        tcase_add_test(tc, test_jobs_sequential);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,220 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "util.h"
+
+#define N_THREADS 4
+#define N_PER_THREAD 500
+
+/**
+ * Read back everything written to @fd so far
+ */
+static char *read_all(int fd)
+{
+        off_t size = lseek(fd, 0, SEEK_END);
+        char *buf = NULL;
+
+        if (size < 0 || !(buf = calloc(1, (size_t)size + 1))) {
+                return NULL;
+        }
+        if (pread(fd, buf, (size_t)size, 0) != size) {
+                free(buf);
+                return NULL;
+        }
+        return buf;
+}
+
+static size_t count_lines(const char *buf, const char *needle)
+{
+        size_t n = 0;
+
+        for (const char *p = buf; (p = strstr(p, needle)) != NULL; p += strlen(needle)) {
+                n++;
+        }
+        return n;
+}
+
+static int side_effects = 0;
+
+static int side_effect(void)
+{
+        return ++side_effects;
+}
+
+START_TEST(test_log_simple)
+{
+        FILE *f = tmpfile();
+        UfLog *log = NULL;
+        char *out = NULL;
+
+        fail_if(!f, "Failed to create temporary file");
+        log = uf_log_new(fileno(f), UF_LOG_INFO);
+        fail_if(!log, "Failed to construct log");
+
+        uf_log_info(log, "hello %s", "world");
+        uf_log_error(log, "code %d", 42);
+        uf_log_debug(log, "filtered %d", side_effect());
+        fail_if(side_effects != 0, "Disabled level evaluated its arguments");
+
+        uf_log_set_level(log, UF_LOG_DEBUG);
+        uf_log_debug(log, "now visible");
+        uf_log_flush(log);
+
+        out = read_all(fileno(f));
+        fail_if(!out, "Failed to read log");
+        fail_if(!strstr(out, " INFO: hello world\n"), "Missing info line");
+        fail_if(!strstr(out, " ERROR: code 42\n"), "Missing error line");
+        fail_if(strstr(out, "filtered"), "Filtered line was written");
+        fail_if(!strstr(out, " DEBUG: now visible\n"), "Missing debug line");
+        fail_if(count_lines(out, "\n") != 3, "Wrong number of lines");
+        fail_if(out[4] != '-' || out[10] != 'T', "Missing timestamp");
+
+        free(out);
+        uf_log_free(log);
+        fclose(f);
+}
+END_TEST
+
+/**
+ * Overlong messages are truncated but still terminated
+ */
+START_TEST(test_log_truncate)
+{
+        FILE *f = tmpfile();
+        UfLog *log = NULL;
+        char *out = NULL;
+        char big[1024];
+
+        fail_if(!f, "Failed to create temporary file");
+        log = uf_log_new(fileno(f), UF_LOG_DEBUG);
+        fail_if(!log, "Failed to construct log");
+
+        memset(big, 'x', sizeof(big) - 1);
+        big[sizeof(big) - 1] = '\0';
+        uf_log_warning(log, "%s", big);
+        uf_log_warning(log, "after");
+        uf_log_free(log);
+
+        out = read_all(fileno(f));
+        fail_if(!out, "Failed to read log");
+        fail_if(count_lines(out, "\n") != 2, "Truncated line wasn't terminated");
+        fail_if(!strstr(out, "WARNING: after\n"), "Lost the following line");
+
+        free(out);
+        fclose(f);
+}
+END_TEST
+
+static int log_worker(void *data)
+{
+        UfLog *log = data;
+
+        for (int i = 0; i < N_PER_THREAD; i++) {
+                uf_log_info(log, "worker message %d", i);
+        }
+        return 0;
+}
+
+/**
+ * Every record from every thread is either written intact or counted as
+ * dropped
+ */
+START_TEST(test_log_threads)
+{
+        FILE *f = tmpfile();
+        UfLog *log = NULL;
+        thrd_t threads[N_THREADS];
+        char *out = NULL;
+        size_t n;
+
+        fail_if(!f, "Failed to create temporary file");
+        log = uf_log_new(fileno(f), UF_LOG_INFO);
+        fail_if(!log, "Failed to construct log");
+
+        for (size_t i = 0; i < N_THREADS; i++) {
+                fail_if(thrd_create(&threads[i], log_worker, log) != thrd_success,
+                        "Failed to create thread");
+        }
+        for (size_t i = 0; i < N_THREADS; i++) {
+                thrd_join(threads[i], NULL);
+        }
+        uf_log_flush(log);
+
+        out = read_all(fileno(f));
+        fail_if(!out, "Failed to read log");
+        n = count_lines(out, " INFO: worker message ");
+        fail_if(n != count_lines(out, "\n"), "Corrupted lines");
+        fail_if(n + uf_log_dropped(log) != N_THREADS * N_PER_THREAD, "Records went missing");
+
+        free(out);
+        uf_log_free(log);
+        fclose(f);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_log_simple);
+        tcase_add_test(tc, test_log_truncate);
+        tcase_add_test(tc, test_log_threads);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
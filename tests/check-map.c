@@ -14,10 +14,14 @@
 #include <check.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "alloc-counter.h"
 #include "map.h"
 #include "util.h"
 
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
 START_TEST(test_map_simple)
 {
         UfHashmap *map = NULL;
@@ -131,6 +135,353 @@ START_TEST(test_map_remove)
 }
 END_TEST
 
+#define UF_MAP_BULK_ITEMS 1000000
+
+static void map_put_ints(UfHashmap *map, size_t n)
+{
+        for (size_t i = 1; i <= n; i++) {
+                fail_if(!uf_hashmap_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i)),
+                        "Failed to insert keypair");
+        }
+}
+
+static void map_get_ints(UfHashmap *map, size_t n)
+{
+        for (size_t i = 1; i <= n; i++) {
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, UF_INT_TO_PTR(i))) != i,
+                        "Retrieved value is incorrect");
+        }
+}
+
+START_TEST(test_map_reserve)
+{
+        UfHashmap *map = NULL;
+
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+
+        /* One bucket blob up front, and distinct int keys never chain */
+        fail_if_allocs_exceed(2, {
+                fail_if(!uf_hashmap_reserve(map, UF_MAP_BULK_ITEMS), "Failed to reserve");
+                map_put_ints(map, UF_MAP_BULK_ITEMS);
+        });
+        fail_if_allocs_exceed(0, map_get_ints(map, UF_MAP_BULK_ITEMS));
+        fail_if_allocs_exceed(0, uf_hashmap_reserve(map, UF_MAP_BULK_ITEMS));
+
+        uf_hashmap_free(map);
+}
+END_TEST
+
+START_TEST(test_map_reserve_populated)
+{
+        UfHashmap *map = NULL;
+
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+
+        map_put_ints(map, 1000);
+        fail_if(!uf_hashmap_reserve(map, 100000), "Failed to reserve");
+        map_get_ints(map, 1000);
+
+        /* Growing past the reservation still works as normal */
+        fail_if_allocs_exceed(0, map_put_ints(map, 50000));
+        map_put_ints(map, 200000);
+        map_get_ints(map, 200000);
+
+        uf_hashmap_free(map);
+}
+END_TEST
+
+START_TEST(test_map_small)
+{
+        UfHashmap *map = NULL;
+        char *keys[12];
+
+        /* Nothing beyond the map itself until it outgrows the inline array */
+        fail_if_allocs_exceed(1, {
+                map = uf_hashmap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, NULL);
+        });
+        fail_if(!map, "Failed to construct hashmap");
+
+        for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+                if (asprintf(&keys[i], "key-%zu", i) < 0) {
+                        abort();
+                }
+        }
+        fail_if_allocs_exceed(0, {
+                for (size_t i = 0; i < 8; i++) {
+                        fail_if(!uf_hashmap_put(map, keys[i], UF_INT_TO_PTR(i + 1)), "Failed to insert");
+                }
+        });
+
+        /* Replace and remove while small, key_free takes the old keys */
+        fail_if(!uf_hashmap_put(map, strdup("key-3"), UF_INT_TO_PTR(40)), "Failed to replace");
+        fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, "key-3")) != 40, "Replace lost the value");
+        fail_if(!uf_hashmap_remove(map, "key-0"), "Failed to remove");
+        fail_if(uf_hashmap_remove(map, "key-0"), "Removed twice");
+        fail_if(uf_hashmap_get(map, "key-0") != NULL, "Removed key still present");
+        fail_if(uf_hashmap_get(map, "key-7") == NULL, "Moved key went missing");
+        fail_if(!uf_hashmap_put(map, keys[8], UF_INT_TO_PTR(9)), "Failed to insert");
+
+        /* Outgrowing the array promotes to buckets, keeping every entry */
+        for (size_t i = 9; i < ARRAY_SIZE(keys); i++) {
+                fail_if(!uf_hashmap_put(map, keys[i], UF_INT_TO_PTR(i + 1)), "Failed to insert");
+        }
+        for (size_t i = 1; i < ARRAY_SIZE(keys); i++) {
+                size_t expected = i == 3 ? 40 : i + 1;
+                char key[16];
+
+                snprintf(key, sizeof(key), "key-%zu", i);
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, key)) != expected,
+                        "Lost %s on promotion",
+                        key);
+        }
+
+        uf_hashmap_free(map);
+}
+END_TEST
+
+/**
+ * A small map costs one allocation, and promoting it one more
+ */
+START_TEST(test_map_small_allocs)
+{
+        UfHashmap *map = NULL;
+
+        fail_if_allocs_exceed(1, {
+                map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        });
+        fail_if(!map, "Failed to construct hashmap");
+
+        fail_if_allocs_exceed(0, map_put_ints(map, 8));
+        fail_if_allocs_exceed(0, {
+                fail_if(!uf_hashmap_remove(map, UF_INT_TO_PTR(8)), "Failed to remove");
+        });
+        fail_if_allocs_exceed(0, map_put_ints(map, 8));
+        fail_if_allocs_exceed(1, map_put_ints(map, 9));
+        fail_if_allocs_exceed(0, map_get_ints(map, 9));
+        uf_hashmap_free(map);
+
+        /* Reserving beyond the inline array promotes straight away */
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+        fail_if_allocs_exceed(0, fail_if(!uf_hashmap_reserve(map, 8), "Failed to reserve"));
+        fail_if_allocs_exceed(1, fail_if(!uf_hashmap_reserve(map, 9), "Failed to reserve"));
+        fail_if_allocs_exceed(0, map_put_ints(map, 100));
+        uf_hashmap_free(map);
+}
+END_TEST
+
+static uint32_t map_constant_hash(__uf_unused__ const void *v)
+{
+        return 42;
+}
+
+START_TEST(test_map_collision_allocs)
+{
+        UfHashmap *map = NULL;
+        UfAllocCount before;
+        UfAllocCount after;
+
+        map = uf_hashmap_new(map_constant_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+
+        /* The counter must see every chain node, or the budgets prove nothing.
+         * Buckets are only allocated once the small map is promoted. */
+        before = uf_alloc_counter_get();
+        map_put_ints(map, 100);
+        after = uf_alloc_counter_get();
+        fail_if(uf_alloc_counter_enabled() && after.allocs - before.allocs != 99 + 1,
+                "Expected one allocation per colliding key");
+
+        map_get_ints(map, 100);
+        uf_hashmap_free(map);
+        fail_if(uf_alloc_counter_enabled() && uf_alloc_counter_get().frees - after.frees != 101,
+                "Expected chain nodes, buckets and map to be freed");
+}
+END_TEST
+
+START_TEST(test_map_copy)
+{
+        UfHashmap *map = NULL;
+        UfHashmap *copy = NULL;
+
+        map = uf_hashmap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+        map_put_ints(map, 100000);
+        fail_if(!uf_hashmap_remove(map, UF_INT_TO_PTR(100000)), "Failed to remove");
+
+        /* Distinct int keys never chain, so just the map and its buckets */
+        fail_if_allocs_exceed(2, copy = uf_hashmap_copy(map, NULL, NULL));
+        fail_if(!copy, "Failed to copy hashmap");
+        map_get_ints(copy, 99999);
+        fail_if(uf_hashmap_get(copy, UF_INT_TO_PTR(100000)) != NULL, "Removed key was copied");
+
+        /* Changes to the copy stay there */
+        fail_if(!uf_hashmap_put(copy, UF_INT_TO_PTR(1), UF_INT_TO_PTR(7)), "Failed to replace");
+        fail_if(!uf_hashmap_remove(copy, UF_INT_TO_PTR(2)), "Failed to remove");
+        fail_if(!uf_hashmap_put(copy, UF_INT_TO_PTR(200000), UF_INT_TO_PTR(1)), "Failed to insert");
+        map_get_ints(map, 99999);
+        fail_if(uf_hashmap_get(map, UF_INT_TO_PTR(200000)) != NULL, "Insert leaked into source");
+        uf_hashmap_free(copy);
+
+        /* Chains are rebuilt rather than shared */
+        uf_hashmap_free(map);
+        map = uf_hashmap_new(map_constant_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct hashmap");
+        map_put_ints(map, 100);
+        fail_if(!uf_hashmap_remove(map, UF_INT_TO_PTR(50)), "Failed to remove");
+        fail_if_allocs_exceed(100, copy = uf_hashmap_copy(map, NULL, NULL));
+        fail_if(!copy, "Failed to copy hashmap");
+        uf_hashmap_free(map);
+        fail_if(uf_hashmap_get(copy, UF_INT_TO_PTR(50)) != NULL, "Removed key was copied");
+        for (size_t i = 1; i <= 100; i++) {
+                fail_if(i != 50 && UF_PTR_TO_INT(uf_hashmap_get(copy, UF_INT_TO_PTR(i))) != i,
+                        "Retrieved value is incorrect");
+        }
+        uf_hashmap_free(copy);
+
+        fail_if(uf_hashmap_copy(NULL, NULL, NULL) != NULL, "Copied a NULL map");
+}
+END_TEST
+
+static void *map_strdup(const void *v)
+{
+        return strdup(v);
+}
+
+static size_t map_dup_budget = 0;
+
+static void *map_strdup_limited(const void *v)
+{
+        if (map_dup_budget == 0) {
+                return NULL;
+        }
+        map_dup_budget--;
+        return strdup(v);
+}
+
+START_TEST(test_map_copy_dup)
+{
+        static const size_t counts[] = { 5, 5000 };
+
+        for (size_t c = 0; c < ARRAY_SIZE(counts); c++) {
+                UfHashmap *map = NULL;
+                UfHashmap *copy = NULL;
+                char key[32];
+
+                map = uf_hashmap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, free);
+                fail_if(!map, "Failed to construct hashmap");
+                for (size_t i = 0; i < counts[c]; i++) {
+                        snprintf(key, sizeof(key), "key-%zu", i);
+                        fail_if(!uf_hashmap_put(map, strdup(key), strdup(key)), "Failed to insert");
+                }
+
+                copy = uf_hashmap_copy(map, map_strdup, map_strdup);
+                fail_if(!copy, "Failed to copy hashmap");
+
+                /* Owned duplicates outlive the source, and so do later puts */
+                uf_hashmap_free(map);
+                fail_if(!uf_hashmap_put(copy, strdup("key-0"), strdup("new")), "Failed to replace");
+                fail_if(!uf_hashmap_put(copy, strdup("added"), strdup("added")),
+                        "Failed to insert");
+                fail_if(strcmp(uf_hashmap_get(copy, "key-0"), "new") != 0, "Replace lost the value");
+                for (size_t i = 1; i < counts[c]; i++) {
+                        snprintf(key, sizeof(key), "key-%zu", i);
+                        fail_if(strcmp(uf_hashmap_get(copy, key), key) != 0,
+                                "Retrieved value is incorrect");
+                }
+                uf_hashmap_free(copy);
+        }
+}
+END_TEST
+
+/**
+ * A copy inherits the free functions, so it must own what they free
+ */
+START_TEST(test_map_copy_dup_mismatch)
+{
+        UfHashmap *owning = NULL;
+        UfHashmap *borrowing = NULL;
+
+        owning = uf_hashmap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, free);
+        borrowing = uf_hashmap_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!owning || !borrowing, "Failed to construct hashmap");
+        fail_if(!uf_hashmap_put(owning, strdup("key"), strdup("value")), "Failed to insert");
+        fail_if(!uf_hashmap_put(borrowing, "key", "value"), "Failed to insert");
+
+        fail_if(uf_hashmap_copy(owning, NULL, NULL) != NULL, "Shared entries the copy would free");
+        fail_if(uf_hashmap_copy(owning, map_strdup, NULL) != NULL,
+                "Shared values the copy would free");
+        fail_if(uf_hashmap_copy(owning, NULL, map_strdup) != NULL,
+                "Shared keys the copy would free");
+        fail_if(uf_hashmap_copy(borrowing, map_strdup, map_strdup) != NULL,
+                "Made duplicates the copy would leak");
+
+        uf_hashmap_free(owning);
+        uf_hashmap_free(borrowing);
+}
+END_TEST
+
+START_TEST(test_map_copy_dup_fail)
+{
+        UfHashmap *maps[2] = { NULL };
+
+        maps[0] = uf_hashmap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, free);
+        maps[1] = uf_hashmap_new_full(map_constant_hash, uf_hashmap_string_equal, free, free);
+        for (size_t m = 0; m < ARRAY_SIZE(maps); m++) {
+                fail_if(!maps[m], "Failed to construct hashmap");
+                for (size_t i = 0; i < 40; i++) {
+                        char key[32];
+                        snprintf(key, sizeof(key), "key-%zu", i);
+                        fail_if(!uf_hashmap_put(maps[m], strdup(key), strdup(key)), "Failed to insert");
+                }
+        }
+
+        /* Running out part way, even between key and value, leaks nothing */
+        for (size_t m = 0; m < ARRAY_SIZE(maps); m++) {
+                for (size_t budget = 0; budget < 80; budget += 7) {
+                        map_dup_budget = budget;
+                        fail_if(uf_hashmap_copy(maps[m], map_strdup_limited, map_strdup_limited) !=
+                                    NULL,
+                                "Copy should fail once duplication fails");
+                }
+                uf_hashmap_free(maps[m]);
+        }
+}
+END_TEST
+
+START_TEST(test_map_case)
+{
+        UfHashmap *map = NULL;
+        static const char *long_key = "X-Forwarded-For-Some-Very-Long-Header-Name-Beyond-32";
+
+        map = uf_hashmap_new(uf_hashmap_string_case_hash, uf_hashmap_string_case_equal);
+        fail_if(!map, "Failed to construct map");
+
+        fail_if(!uf_hashmap_put(map, "Content-Type", UF_INT_TO_PTR(1)), "Failed to insert");
+        fail_if(!uf_hashmap_put(map, (void *)long_key, UF_INT_TO_PTR(2)), "Failed to insert");
+        fail_if(!uf_hashmap_put(map, "[section]", UF_INT_TO_PTR(3)), "Failed to insert");
+
+        fail_if_allocs_exceed(0, {
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, "content-type")) != 1, "Lowercase missed");
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, "CONTENT-TYPE")) != 1, "Uppercase missed");
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(
+                            map, "x-forwarded-for-some-very-long-header-name-beyond-32")) != 2,
+                        "Long key missed");
+        });
+
+        /* Only A-Z fold: '[' and '{' differ by 0x20 but aren't letters */
+        fail_if(uf_hashmap_get(map, "{SECTION}") != NULL, "Folded non letters");
+        fail_if(uf_hashmap_get(map, "content-typ") != NULL, "Matched a prefix");
+
+        fail_if(!uf_hashmap_put(map, "CONTENT-type", UF_INT_TO_PTR(4)), "Failed to replace");
+        fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, "Content-Type")) != 4, "Replace didn't fold");
+
+        uf_hashmap_free(map);
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -159,6 +510,16 @@ static Suite *test_create(void)
         tcase_add_test(tc, test_map_simple);
         tcase_add_test(tc, test_map_null_zero);
         tcase_add_test(tc, test_map_remove);
+        tcase_add_test(tc, test_map_reserve);
+        tcase_add_test(tc, test_map_reserve_populated);
+        tcase_add_test(tc, test_map_collision_allocs);
+        tcase_add_test(tc, test_map_small);
+        tcase_add_test(tc, test_map_small_allocs);
+        tcase_add_test(tc, test_map_copy);
+        tcase_add_test(tc, test_map_copy_dup);
+        tcase_add_test(tc, test_map_copy_dup_fail);
+        tcase_add_test(tc, test_map_copy_dup_mismatch);
+        tcase_add_test(tc, test_map_case);
 
         /* TODO: Add actual tests. */
         return s;
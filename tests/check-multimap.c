@@ -0,0 +1,382 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc-counter.h"
+#include "multimap.h"
+#include "util.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+START_TEST(test_multimap_simple)
+{
+        UfMultimap *map = NULL;
+        void *const *values = NULL;
+        size_t n = 99;
+
+        map = uf_multimap_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!map, "Failed to construct multimap");
+        fail_if(uf_multimap_get(map, "alice", &n) != NULL || n != 0, "Empty map returned values");
+        fail_if(uf_multimap_remove(map, "alice"), "Empty map removed a key");
+
+        for (int i = 1; i <= 5; i++) {
+                fail_if(!uf_multimap_append(map, "alice", UF_INT_TO_PTR(i)), "Failed to append");
+        }
+        fail_if(!uf_multimap_append(map, "bob", UF_INT_TO_PTR(10)), "Failed to append");
+        fail_if(uf_multimap_size(map) != 2, "Wrong key count");
+
+        values = uf_multimap_get(map, "alice", &n);
+        fail_if(n != 5, "Expected 5 values, got %zu", n);
+        for (size_t i = 0; i < n; i++) {
+                fail_if(UF_PTR_TO_INT(values[i]) != i + 1, "Values out of order");
+        }
+        values = uf_multimap_get(map, "bob", &n);
+        fail_if(n != 1 || UF_PTR_TO_INT(values[0]) != 10, "Wrong inline value");
+
+        fail_if(!uf_multimap_remove(map, "alice"), "Failed to remove");
+        fail_if(uf_multimap_get(map, "alice", &n) != NULL, "Removed key still present");
+        fail_if(uf_multimap_size(map) != 1, "Remove didn't change the size");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+START_TEST(test_multimap_remove_value)
+{
+        UfMultimap *map = NULL;
+        void *const *values = NULL;
+        size_t n = 0;
+
+        map = uf_multimap_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!map, "Failed to construct multimap");
+
+        for (int i = 1; i <= 4; i++) {
+                fail_if(!uf_multimap_append(map, "key", UF_INT_TO_PTR(i)), "Failed to append");
+        }
+        fail_if(uf_multimap_remove_value(map, "key", UF_INT_TO_PTR(7)), "Removed a missing value");
+        fail_if(uf_multimap_remove_value(map, "nope", UF_INT_TO_PTR(1)), "Removed from missing key");
+
+        /* Order of the survivors is kept */
+        fail_if(!uf_multimap_remove_value(map, "key", UF_INT_TO_PTR(2)), "Failed to remove value");
+        values = uf_multimap_get(map, "key", &n);
+        fail_if(n != 3, "Expected 3 values");
+        fail_if(UF_PTR_TO_INT(values[0]) != 1 || UF_PTR_TO_INT(values[1]) != 3 ||
+                    UF_PTR_TO_INT(values[2]) != 4,
+                "Order not preserved");
+
+        /* Back down to one value, then none */
+        fail_if(!uf_multimap_remove_value(map, "key", UF_INT_TO_PTR(1)), "Failed to remove value");
+        fail_if(!uf_multimap_remove_value(map, "key", UF_INT_TO_PTR(4)), "Failed to remove value");
+        values = uf_multimap_get(map, "key", &n);
+        fail_if(n != 1 || UF_PTR_TO_INT(values[0]) != 3, "Wrong last value");
+        fail_if(!uf_multimap_remove_value(map, "key", UF_INT_TO_PTR(3)), "Failed to remove value");
+        fail_if(uf_multimap_get(map, "key", &n) != NULL, "Key survived its last value");
+        fail_if(uf_multimap_size(map) != 0, "Wrong size");
+
+        /* And grow again from scratch */
+        fail_if(!uf_multimap_append(map, "key", UF_INT_TO_PTR(5)), "Failed to append");
+        fail_if(!uf_multimap_append(map, "key", UF_INT_TO_PTR(6)), "Failed to append");
+        values = uf_multimap_get(map, "key", &n);
+        fail_if(n != 2 || UF_PTR_TO_INT(values[1]) != 6, "Wrong values after regrowth");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+START_TEST(test_multimap_many_keys)
+{
+        UfMultimap *map = NULL;
+        size_t n = 0;
+
+        map = uf_multimap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct multimap");
+
+        /* Key i gets i % 4 + 1 values */
+        for (size_t i = 1; i <= 50000; i++) {
+                for (size_t j = 0; j <= i % 4; j++) {
+                        fail_if(!uf_multimap_append(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(j)),
+                                "Failed to append");
+                }
+        }
+        fail_if(uf_multimap_size(map) != 50000, "Wrong key count");
+
+        /* Drop every other key so deletion has to shift probe runs */
+        for (size_t i = 1; i <= 50000; i += 2) {
+                fail_if(!uf_multimap_remove(map, UF_INT_TO_PTR(i)), "Failed to remove");
+        }
+        for (size_t i = 1; i <= 50000; i++) {
+                void *const *values = uf_multimap_get(map, UF_INT_TO_PTR(i), &n);
+                if (i & 1) {
+                        fail_if(values != NULL, "Removed key %zu still present", i);
+                        continue;
+                }
+                fail_if(n != i % 4 + 1, "Key %zu has %zu values", i, n);
+                fail_if(UF_PTR_TO_INT(values[n - 1]) != n - 1, "Wrong last value");
+        }
+        fail_if(uf_multimap_size(map) != 25000, "Wrong size after remove");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+START_TEST(test_multimap_build)
+{
+        UfMultimap *map = NULL;
+        void *keys[1000];
+        void *values[1000];
+        void *const *got = NULL;
+        size_t n = 0;
+
+        map = uf_multimap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct multimap");
+        fail_if(!uf_multimap_build(map, keys, values, 0), "Empty build failed");
+
+        /* Existing values must come before the built ones */
+        fail_if(!uf_multimap_append(map, UF_INT_TO_PTR(1), UF_INT_TO_PTR(5000)), "Failed to append");
+        fail_if(!uf_multimap_append(map, UF_INT_TO_PTR(2), UF_INT_TO_PTR(6000)), "Failed to append");
+        fail_if(!uf_multimap_append(map, UF_INT_TO_PTR(2), UF_INT_TO_PTR(6001)), "Failed to append");
+
+        /* 10 keys with 100 values each, interleaved */
+        for (size_t i = 0; i < 1000; i++) {
+                keys[i] = UF_INT_TO_PTR(i % 10 + 1);
+                values[i] = UF_INT_TO_PTR(i);
+        }
+
+        /* One array per key, plus the table and two scratch arrays */
+        fail_if_allocs_exceed(13, fail_if(!uf_multimap_build(map, keys, values, 1000), "Build failed"));
+        fail_if(uf_multimap_size(map) != 10, "Wrong key count");
+
+        got = uf_multimap_get(map, UF_INT_TO_PTR(1), &n);
+        fail_if(n != 101 || UF_PTR_TO_INT(got[0]) != 5000, "Existing value lost");
+        for (size_t i = 1; i < n; i++) {
+                fail_if(UF_PTR_TO_INT(got[i]) != (i - 1) * 10, "Built values out of order");
+        }
+        got = uf_multimap_get(map, UF_INT_TO_PTR(2), &n);
+        fail_if(n != 102 || UF_PTR_TO_INT(got[1]) != 6001 || UF_PTR_TO_INT(got[2]) != 1,
+                "Existing array not extended");
+
+        /* A single value per new key stays inline */
+        keys[0] = UF_INT_TO_PTR(500);
+        fail_if_allocs_exceed(2, fail_if(!uf_multimap_build(map, keys, values, 1), "Build failed"));
+        got = uf_multimap_get(map, UF_INT_TO_PTR(500), &n);
+        fail_if(n != 1 || UF_PTR_TO_INT(got[0]) != 0, "Wrong single built value");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+START_TEST(test_multimap_allocs)
+{
+        UfMultimap *map = NULL;
+
+        map = uf_multimap_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct multimap");
+
+        /* Single valued keys cost nothing beyond the table */
+        fail_if_allocs_exceed(1, {
+                for (size_t i = 1; i <= 12; i++) {
+                        uf_multimap_append(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i));
+                }
+        });
+
+        /* Doubling arrays: 2, 4, 8, 16 */
+        fail_if_allocs_exceed(4, {
+                for (size_t i = 0; i < 15; i++) {
+                        uf_multimap_append(map, UF_INT_TO_PTR(1), UF_INT_TO_PTR(i));
+                }
+        });
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+static bool multimap_count(__uf_unused__ void *key, __uf_unused__ void *const *values,
+                           size_t n_values, void *userdata)
+{
+        *(size_t *)userdata += n_values;
+        return true;
+}
+
+START_TEST(test_multimap_free_funcs)
+{
+        UfMultimap *map = NULL;
+        size_t total = 0;
+        size_t n = 0;
+
+        map = uf_multimap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, free);
+        fail_if(!map, "Failed to construct multimap");
+
+        /* Duplicate keys are freed as they're merged */
+        for (size_t i = 0; i < 30; i++) {
+                char *key = NULL;
+                char *value = NULL;
+                if (asprintf(&key, "key-%zu", i % 3) < 0 || asprintf(&value, "%zu", i) < 0) {
+                        abort();
+                }
+                fail_if(!uf_multimap_append(map, key, value), "Failed to append");
+        }
+        fail_if(uf_multimap_size(map) != 3, "Wrong key count");
+
+        uf_multimap_foreach(map, multimap_count, &total);
+        fail_if(total != 30, "foreach saw %zu values", total);
+
+        /* Removing a value frees it */
+        void *const *values = uf_multimap_get(map, "key-1", &n);
+        fail_if(n != 10 || strcmp(values[0], "1") != 0, "Wrong first value");
+        fail_if(!uf_multimap_remove_value(map, "key-1", values[0]), "Failed to remove value");
+        fail_if(!uf_multimap_remove(map, "key-2"), "Failed to remove key");
+
+        {
+                char *keys[2] = { strdup("key-0"), strdup("key-9") };
+                char *vals[2] = { strdup("x"), strdup("y") };
+                fail_if(!uf_multimap_build(map, (void **)keys, (void **)vals, 2), "Build failed");
+        }
+        values = uf_multimap_get(map, "key-0", &n);
+        fail_if(n != 11 || strcmp(values[10], "x") != 0, "Built value missing");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+static size_t multimap_n_key_frees = 0;
+
+static void multimap_key_free(void *key)
+{
+        multimap_n_key_frees++;
+        free(key);
+}
+
+/**
+ * A build failing at any allocation leaves the map and key ownership alone
+ */
+START_TEST(test_multimap_build_fail)
+{
+        static const char *names[] = { "a", "b", "c", "c", "d" };
+        UfMultimap *map = NULL;
+        void *keys[ARRAY_SIZE(names)];
+        void *values[ARRAY_SIZE(names)];
+        void *const *got = NULL;
+        size_t n = 0;
+        uint64_t nth;
+        bool ok = false;
+
+        if (!uf_alloc_counter_enabled()) {
+                return;
+        }
+
+        map = uf_multimap_new_full(uf_hashmap_string_hash,
+                                   uf_hashmap_string_equal,
+                                   multimap_key_free,
+                                   NULL);
+        fail_if(!map, "Failed to construct multimap");
+        fail_if(!uf_multimap_append(map, strdup("a"), UF_INT_TO_PTR(10)), "Failed to append");
+        fail_if(!uf_multimap_append(map, strdup("b"), UF_INT_TO_PTR(20)), "Failed to append");
+        fail_if(!uf_multimap_append(map, strdup("b"), UF_INT_TO_PTR(21)), "Failed to append");
+
+        for (nth = 1; !ok; nth++) {
+                multimap_n_key_frees = 0;
+                for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+                        keys[i] = strdup(names[i]);
+                        values[i] = UF_INT_TO_PTR(i + 1);
+                }
+
+                uf_alloc_counter_fail_nth(nth);
+                ok = uf_multimap_build(map, keys, values, ARRAY_SIZE(names));
+                uf_alloc_counter_fail_nth(0);
+                if (ok) {
+                        break;
+                }
+
+                fail_if(multimap_n_key_frees != 0,
+                        "Failed build freed %zu keys",
+                        multimap_n_key_frees);
+                fail_if(uf_multimap_size(map) != 2, "Failed build changed the keys");
+                got = uf_multimap_get(map, "a", &n);
+                fail_if(n != 1 || UF_PTR_TO_INT(got[0]) != 10, "Failed build changed a");
+                got = uf_multimap_get(map, "b", &n);
+                fail_if(n != 2 || UF_PTR_TO_INT(got[1]) != 21, "Failed build changed b");
+
+                /* Every key is still ours to free */
+                for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+                        free(keys[i]);
+                }
+        }
+        fail_if(nth == 1, "No allocation failure was injected");
+
+        /* Duplicates of a, b and c went to the map once it committed */
+        fail_if(multimap_n_key_frees != 3, "Build freed %zu keys", multimap_n_key_frees);
+        got = uf_multimap_get(map, "b", &n);
+        fail_if(n != 3 || UF_PTR_TO_INT(got[2]) != 2, "Wrong values for b");
+        got = uf_multimap_get(map, "c", &n);
+        fail_if(n != 2 || UF_PTR_TO_INT(got[1]) != 4, "Wrong values for c");
+
+        uf_multimap_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_multimap_simple);
+        tcase_add_test(tc, test_multimap_remove_value);
+        tcase_add_test(tc, test_multimap_many_keys);
+        tcase_add_test(tc, test_multimap_build);
+        tcase_add_test(tc, test_multimap_build_fail);
+        tcase_add_test(tc, test_multimap_allocs);
+        tcase_add_test(tc, test_multimap_free_funcs);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,250 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "map.h"
+#include "pool.h"
+#include "util.h"
+
+#define N_THREADS 4
+#define N_OBJECTS 10000
+
+START_TEST(test_pool_simple)
+{
+        UfPool *pool = NULL;
+        UfPoolStats stats = { 0 };
+        void *a = NULL;
+        void *b = NULL;
+
+        pool = uf_pool_new(24);
+        fail_if(!pool, "Failed to construct pool");
+
+        a = uf_pool_alloc(pool);
+        b = uf_pool_alloc(pool);
+        fail_if(!a || !b, "Failed to allocate");
+        fail_if(a == b, "Allocated the same object twice");
+        fail_if(((uintptr_t)a % 16) != 0, "Object is misaligned");
+        memset(a, 0xFF, 24);
+        memset(b, 0xFF, 24);
+
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.object_size != 32, "Object size wasn't rounded up");
+        fail_if(stats.n_slabs != 1, "Should only need one slab");
+        fail_if(stats.n_refills != 1, "Should only refill once");
+
+        /* LIFO reuse keeps the working set hot */
+        uf_pool_release(pool, b);
+        fail_if(uf_pool_alloc(pool) != b, "Released object wasn't reused");
+
+        uf_pool_release(pool, a);
+        uf_pool_release(pool, b);
+        uf_pool_flush(pool);
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_free != stats.n_objects, "Flush didn't return everything");
+
+        uf_pool_free(pool);
+}
+END_TEST
+
+/**
+ * Allocate across many slabs, make sure nothing overlaps, and that the
+ * shared list is only visited in batches.
+ */
+START_TEST(test_pool_many)
+{
+        UfPool *pool = NULL;
+        UfPoolStats stats = { 0 };
+        uint32_t **objects = NULL;
+
+        pool = uf_pool_new(sizeof(uint32_t));
+        fail_if(!pool, "Failed to construct pool");
+        objects = calloc(N_OBJECTS, sizeof(uint32_t *));
+        fail_if(!objects, "OOM");
+
+        for (uint32_t i = 0; i < N_OBJECTS; i++) {
+                objects[i] = uf_pool_alloc(pool);
+                fail_if(!objects[i], "Failed to allocate");
+                *objects[i] = i;
+        }
+        for (uint32_t i = 0; i < N_OBJECTS; i++) {
+                fail_if(*objects[i] != i, "Object was overwritten");
+        }
+
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_objects < N_OBJECTS, "Too few objects carved");
+        fail_if(stats.n_slabs * stats.slab_size > 2 * N_OBJECTS * stats.object_size,
+                "Slabs are wasting memory");
+        fail_if(stats.n_refills > N_OBJECTS / 8, "Refills aren't batched");
+
+        for (uint32_t i = 0; i < N_OBJECTS; i++) {
+                uf_pool_release(pool, objects[i]);
+        }
+        uf_pool_flush(pool);
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_free != stats.n_objects, "Objects went missing");
+
+        free(objects);
+        uf_pool_free(pool);
+}
+END_TEST
+
+static int pool_worker(void *data)
+{
+        UfPool *pool = data;
+        void *objects[64];
+
+        for (int round = 0; round < 200; round++) {
+                for (size_t i = 0; i < 64; i++) {
+                        objects[i] = uf_pool_alloc(pool);
+                        if (!objects[i]) {
+                                return 1;
+                        }
+                        memset(objects[i], (int)i, 64);
+                }
+                for (size_t i = 0; i < 64; i++) {
+                        unsigned char *c = objects[i];
+                        if (c[0] != (unsigned char)i || c[63] != (unsigned char)i) {
+                                return 1;
+                        }
+                        uf_pool_release(pool, objects[i]);
+                }
+        }
+        uf_pool_flush(pool);
+        return 0;
+}
+
+START_TEST(test_pool_threads)
+{
+        UfPool *pool = NULL;
+        UfPoolStats stats = { 0 };
+        thrd_t threads[N_THREADS];
+
+        pool = uf_pool_new(64);
+        fail_if(!pool, "Failed to construct pool");
+
+        for (size_t i = 0; i < N_THREADS; i++) {
+                fail_if(thrd_create(&threads[i], pool_worker, pool) != thrd_success,
+                        "Failed to create thread");
+        }
+        for (size_t i = 0; i < N_THREADS; i++) {
+                int ret = 0;
+                thrd_join(threads[i], &ret);
+                fail_if(ret != 0, "Worker saw corrupted objects");
+        }
+
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_free != stats.n_objects, "Objects went missing");
+
+        uf_pool_free(pool);
+}
+END_TEST
+
+/**
+ * Ensure the hashmap collision nodes come from the pool
+ */
+START_TEST(test_pool_hashmap)
+{
+        UfPool *pool = NULL;
+        UfPoolStats stats = { 0 };
+        UfHashmap *map = NULL;
+
+        pool = uf_pool_new(32);
+        fail_if(!pool, "Failed to construct pool");
+
+        map = uf_hashmap_new_with_allocator(uf_hashmap_simple_hash,
+                                            uf_hashmap_simple_equal,
+                                            NULL,
+                                            NULL,
+                                            uf_pool_allocator(pool));
+        fail_if(!map, "Failed to construct map");
+
+        /* 256 buckets, so every key past the first collides */
+        for (unsigned int i = 0; i < 100; i++) {
+                fail_if(!uf_hashmap_put(map, UF_INT_TO_PTR(i * 256), UF_INT_TO_PTR(i + 1)),
+                        "Failed to insert");
+        }
+        for (unsigned int i = 0; i < 100; i++) {
+                fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, UF_INT_TO_PTR(i * 256))) != i + 1,
+                        "Wrong value");
+        }
+
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_objects - stats.n_free < 99, "Collision nodes not from the pool");
+
+        uf_hashmap_free(map);
+        uf_pool_flush(pool);
+        uf_pool_stats(pool, &stats);
+        fail_if(stats.n_free != stats.n_objects, "Map leaked pool objects");
+
+        fail_if(uf_allocator_alloc(uf_pool_allocator(pool), 64) != NULL,
+                "Oversized request should fail");
+
+        uf_pool_free(pool);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_pool_simple);
+        tcase_add_test(tc, test_pool_many);
+        tcase_add_test(tc, test_pool_threads);
+        tcase_add_test(tc, test_pool_hashmap);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
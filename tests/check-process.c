@@ -0,0 +1,235 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "process.h"
+#include "util.h"
+
+START_TEST(test_spawn_capture)
+{
+        const char *argv[] = { "/bin/sh", "-c", "echo out; echo err >&2; exit 3", NULL };
+        UfSpawnOptions options = {
+                .argv = argv,
+                .flags = UF_SPAWN_CAPTURE_STDOUT | UF_SPAWN_CAPTURE_STDERR,
+        };
+        UfSpawn *spawn = NULL;
+        size_t len = 0;
+        int status = 0;
+
+        spawn = uf_spawn_new(&options);
+        fail_if(!spawn, "Failed to spawn");
+        fail_if(uf_spawn_pid(spawn) <= 0, "Invalid pid");
+        fail_if(!uf_spawn_wait(spawn, &status), "Failed to wait");
+
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 3, "Wrong exit status");
+        fail_if(strcmp(uf_spawn_stdout(spawn, &len), "out\n") != 0, "Wrong stdout");
+        fail_if(len != 4, "Wrong stdout length");
+        fail_if(strcmp(uf_spawn_stderr(spawn, NULL), "err\n") != 0, "Wrong stderr");
+
+        uf_spawn_free(spawn);
+}
+END_TEST
+
+/**
+ * Fill both pipes well beyond their capacity. Draining one at a time
+ * would deadlock.
+ */
+START_TEST(test_spawn_large)
+{
+        const char *argv[] = {
+                "sh",
+                "-c",
+                "head -c 300000 /dev/zero; head -c 200000 /dev/zero >&2; head -c 1000 /dev/zero",
+                NULL,
+        };
+        UfSpawnOptions options = {
+                .argv = argv,
+                .flags = UF_SPAWN_CAPTURE_STDOUT | UF_SPAWN_CAPTURE_STDERR |
+                         UF_SPAWN_SEARCH_PATH,
+        };
+        UfSpawn *spawn = NULL;
+        size_t out = 0;
+        size_t err = 0;
+        int status = 0;
+
+        spawn = uf_spawn_new(&options);
+        fail_if(!spawn, "Failed to spawn");
+        fail_if(!uf_spawn_wait(spawn, &status), "Failed to wait");
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 0, "Child failed");
+
+        uf_spawn_stdout(spawn, &out);
+        uf_spawn_stderr(spawn, &err);
+        fail_if(out != 301000, "Lost stdout");
+        fail_if(err != 200000, "Lost stderr");
+
+        uf_spawn_free(spawn);
+}
+END_TEST
+
+/**
+ * Explicit descriptor map and environment
+ */
+START_TEST(test_spawn_fds_env)
+{
+        const char *argv[] = { "/bin/sh", "-c", "echo $UF_TEST >&5", NULL };
+        const char *envp[] = { "UF_TEST=mapped", NULL };
+        UfSpawnFd fds[1];
+        UfSpawnOptions options = {
+                .argv = argv,
+                .envp = envp,
+                .fds = fds,
+                .n_fds = 1,
+        };
+        UfSpawn *spawn = NULL;
+        char buf[32] = { 0 };
+        int p[2];
+        int status = 0;
+
+        fail_if(pipe2(p, O_CLOEXEC) != 0, "Failed to create pipe");
+        fds[0] = (UfSpawnFd){.parent_fd = p[1], .child_fd = 5 };
+
+        spawn = uf_spawn_new(&options);
+        fail_if(!spawn, "Failed to spawn");
+        close(p[1]);
+        fail_if(!uf_spawn_wait(spawn, &status), "Failed to wait");
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 0, "Child failed");
+
+        fail_if(read(p[0], buf, sizeof(buf) - 1) != 7, "Wrong output size");
+        fail_if(strcmp(buf, "mapped\n") != 0, "Wrong output");
+        close(p[0]);
+
+        uf_spawn_free(spawn);
+}
+END_TEST
+
+/**
+ * Map onto the descriptor the stdout capture pipe would otherwise get
+ */
+START_TEST(test_spawn_fds_collide)
+{
+        const char *argv[] = { "/bin/sh", "-c", "echo captured", NULL };
+        UfSpawnFd fds[1];
+        UfSpawnOptions options = {
+                .argv = argv,
+                .fds = fds,
+                .n_fds = 1,
+                .flags = UF_SPAWN_CAPTURE_STDOUT,
+        };
+        UfSpawn *spawn = NULL;
+        const char *out = NULL;
+        int devnull;
+        int probe;
+        int status = 0;
+
+        devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        fail_if(devnull < 0, "Failed to open /dev/null");
+
+        /* pipe2 hands out the two lowest free descriptors */
+        probe = dup(devnull);
+        fail_if(probe < 0, "Failed to dup");
+        close(probe);
+        fds[0] = (UfSpawnFd){.parent_fd = devnull, .child_fd = probe + 1 };
+
+        spawn = uf_spawn_new(&options);
+        fail_if(!spawn, "Failed to spawn");
+        fail_if(!uf_spawn_wait(spawn, &status), "Failed to wait");
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 0, "Child failed");
+
+        out = uf_spawn_stdout(spawn, NULL);
+        fail_if(!out || strcmp(out, "captured\n") != 0, "Capture was redirected");
+
+        uf_spawn_free(spawn);
+        close(devnull);
+}
+END_TEST
+
+START_TEST(test_spawn_missing)
+{
+        const char *argv[] = { "/nonexistent/program", NULL };
+        UfSpawnOptions options = {
+                .argv = argv,
+                .flags = UF_SPAWN_CAPTURE_STDOUT,
+        };
+        UfSpawn *spawn = NULL;
+        int status = 0;
+
+        /* Depending on libc this fails up front or as exit status 127 */
+        spawn = uf_spawn_new(&options);
+        if (!spawn) {
+                fail_if(errno != ENOENT, "Wrong errno");
+                return;
+        }
+        fail_if(!uf_spawn_wait(spawn, &status), "Failed to wait");
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != 127, "Wrong exit status");
+        uf_spawn_free(spawn);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_spawn_capture);
+        tcase_add_test(tc, test_spawn_large);
+        tcase_add_test(tc, test_spawn_fds_env);
+        tcase_add_test(tc, test_spawn_fds_collide);
+        tcase_add_test(tc, test_spawn_missing);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roaring.h"
+#include "util.h"
+
+START_TEST(test_roaring_simple)
+{
+        UfRoaring *set = NULL;
+        uint32_t v = 0;
+
+        set = uf_roaring_new();
+        fail_if(!set, "Failed to construct set");
+
+        fail_if(!uf_roaring_add(set, 7), "Failed to add");
+        fail_if(!uf_roaring_add(set, 0xFFFFFFFF), "Failed to add");
+        fail_if(!uf_roaring_add(set, 70000), "Failed to add");
+        fail_if(!uf_roaring_add(set, 7), "Failed to re-add");
+        fail_if(uf_roaring_count(set) != 3, "Incorrect count");
+
+        fail_if(!uf_roaring_contains(set, 70000), "Missing value");
+        fail_if(uf_roaring_contains(set, 8), "Unexpected value");
+
+        fail_if(!uf_roaring_next(set, 0, &v) || v != 7, "Wrong first value");
+        fail_if(!uf_roaring_next(set, 8, &v) || v != 70000, "Wrong next value");
+        fail_if(!uf_roaring_next(set, 70001, &v) || v != 0xFFFFFFFF, "Wrong next value");
+
+        fail_if(!uf_roaring_remove(set, 70000), "Failed to remove");
+        fail_if(uf_roaring_remove(set, 70000), "Removed twice");
+        fail_if(uf_roaring_contains(set, 70000), "Value still present");
+
+        uf_roaring_free(set);
+}
+END_TEST
+
+/**
+ * Cross the array/bitmap threshold in both directions.
+ */
+START_TEST(test_roaring_convert)
+{
+        UfRoaring *set = NULL;
+        size_t sparse;
+
+        set = uf_roaring_new();
+        fail_if(!set, "Failed to construct set");
+
+        for (uint32_t i = 0; i < 4096; i++) {
+                fail_if(!uf_roaring_add(set, i * 16), "Failed to add");
+        }
+        sparse = uf_roaring_memory(set);
+
+        for (uint32_t i = 0; i < 65536; i++) {
+                fail_if(!uf_roaring_add(set, i), "Failed to add");
+        }
+        fail_if(uf_roaring_count(set) != 65536, "Incorrect count");
+        fail_if(uf_roaring_memory(set) > 8192 + 512, "Dense container should be a bitmap");
+
+        for (uint32_t i = 0; i < 65536; i++) {
+                if (i % 100 != 0) {
+                        fail_if(!uf_roaring_remove(set, i), "Failed to remove");
+                }
+        }
+        fail_if(uf_roaring_count(set) != 656, "Incorrect count");
+        fail_if(uf_roaring_memory(set) >= sparse, "Sparse container should be an array");
+
+        for (uint32_t i = 0; i < 65536; i++) {
+                fail_if(uf_roaring_contains(set, i) != (i % 100 == 0), "Lost a value");
+        }
+
+        uf_roaring_free(set);
+}
+END_TEST
+
+START_TEST(test_roaring_algebra)
+{
+        UfRoaring *a = NULL;
+        UfRoaring *b = NULL;
+        UfRoaring *c = NULL;
+        uint32_t v = 0;
+        uint64_t n = 0;
+
+        a = uf_roaring_new();
+        b = uf_roaring_new();
+        c = uf_roaring_new();
+        fail_if(!a || !b || !c, "Failed to construct sets");
+
+        /* a is dense in the first container, sparse across many */
+        for (uint32_t i = 0; i < 200000; i += 2) {
+                fail_if(!uf_roaring_add(a, i), "Failed to add");
+        }
+        for (uint32_t i = 0; i < 300000; i += 3) {
+                fail_if(!uf_roaring_add(b, i), "Failed to add");
+                fail_if(!uf_roaring_add(c, i), "Failed to add");
+        }
+        fail_if(!uf_roaring_add(b, 1u << 31), "Failed to add");
+
+        fail_if(!uf_roaring_and(c, a), "Failed to intersect");
+        fail_if(uf_roaring_count(c) != 33334, "Incorrect intersection");
+        for (bool ok = uf_roaring_next(c, 0, &v); ok; ok = uf_roaring_next(c, v + 1, &v)) {
+                fail_if(v % 6 != 0, "Intersection contains a stray value");
+                n++;
+        }
+        fail_if(n != 33334, "Iteration missed values");
+
+        fail_if(!uf_roaring_or(c, b), "Failed to union");
+        fail_if(uf_roaring_count(c) != 100001, "Incorrect union");
+
+        fail_if(!uf_roaring_xor(c, b), "Failed to xor");
+        fail_if(uf_roaring_count(c) != 0, "Incorrect xor");
+
+        fail_if(!uf_roaring_andnot(a, b), "Failed to andnot");
+        fail_if(uf_roaring_count(a) != 100000 - 33334, "Incorrect andnot");
+        fail_if(uf_roaring_contains(a, 6) || !uf_roaring_contains(a, 4), "Incorrect andnot");
+
+        uf_roaring_free(a);
+        uf_roaring_free(b);
+        uf_roaring_free(c);
+}
+END_TEST
+
+/**
+ * Grow a small array container after it has been the target of a union.
+ */
+START_TEST(test_roaring_union_grow)
+{
+        UfRoaring *a = NULL;
+        UfRoaring *b = NULL;
+
+        a = uf_roaring_new();
+        b = uf_roaring_new();
+        fail_if(!a || !b, "Failed to construct sets");
+
+        fail_if(!uf_roaring_add(a, 1), "Failed to add");
+        for (uint32_t i = 2; i < 5; i++) {
+                fail_if(!uf_roaring_add(b, i), "Failed to add");
+        }
+
+        fail_if(!uf_roaring_or(a, b), "Failed to union");
+        fail_if(uf_roaring_count(a) != 4, "Incorrect union");
+
+        for (uint32_t i = 10; i < 20; i++) {
+                fail_if(!uf_roaring_add(a, i), "Failed to add");
+        }
+        fail_if(uf_roaring_count(a) != 14, "Incorrect count");
+        for (uint32_t i = 10; i < 20; i++) {
+                fail_if(!uf_roaring_contains(a, i), "Missing value");
+        }
+        fail_if(!uf_roaring_contains(a, 1) || !uf_roaring_contains(a, 4), "Lost merged values");
+
+        uf_roaring_free(a);
+        uf_roaring_free(b);
+}
+END_TEST
+
+/**
+ * Use a set as both operands, across several containers of each kind.
+ */
+START_TEST(test_roaring_self_op)
+{
+        UfRoaring *set = NULL;
+
+        set = uf_roaring_new();
+        fail_if(!set, "Failed to construct set");
+
+        for (uint32_t i = 0; i < 10000; i++) {
+                fail_if(!uf_roaring_add(set, i), "Failed to add");
+        }
+        for (uint32_t i = 1; i < 8; i++) {
+                fail_if(!uf_roaring_add(set, i * 70000), "Failed to add");
+        }
+
+        fail_if(!uf_roaring_or(set, set), "Failed to union with self");
+        fail_if(uf_roaring_count(set) != 10007, "Self union changed the set");
+        fail_if(!uf_roaring_and(set, set), "Failed to intersect with self");
+        fail_if(uf_roaring_count(set) != 10007, "Self intersection changed the set");
+
+        fail_if(!uf_roaring_xor(set, set), "Failed to xor with self");
+        fail_if(uf_roaring_count(set) != 0, "Self xor should be empty");
+        fail_if(uf_roaring_contains(set, 70000), "Value survived self xor");
+
+        for (uint32_t i = 1; i < 8; i++) {
+                fail_if(!uf_roaring_add(set, i * 70000), "Failed to add");
+        }
+        fail_if(!uf_roaring_andnot(set, set), "Failed to subtract self");
+        fail_if(uf_roaring_count(set) != 0, "Self difference should be empty");
+
+        fail_if(!uf_roaring_add(set, 5), "Failed to add after clearing");
+        fail_if(uf_roaring_count(set) != 1, "Incorrect count after clearing");
+
+        uf_roaring_free(set);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_roaring_simple);
+        tcase_add_test(tc, test_roaring_convert);
+        tcase_add_test(tc, test_roaring_algebra);
+        tcase_add_test(tc, test_roaring_union_grow);
+        tcase_add_test(tc, test_roaring_self_op);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
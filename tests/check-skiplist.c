@@ -0,0 +1,367 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "skiplist.h"
+#include "util.h"
+
+#define N_THREADS 4
+#define N_PER_THREAD 20000
+
+START_TEST(test_skiplist_simple)
+{
+        UfSkipList *list = NULL;
+        void *v = NULL;
+
+        list = uf_skiplist_new(uf_hashmap_string_compare);
+        fail_if(!list, "Failed to construct string list!");
+
+        fail_if(!uf_skiplist_insert(list, "charlie", UF_INT_TO_PTR(12)), "Failed to insert");
+        fail_if(!uf_skiplist_insert(list, "bob", UF_INT_TO_PTR(38)), "Failed to insert");
+        fail_if(uf_skiplist_insert(list, "bob", UF_INT_TO_PTR(40)), "Shouldn't replace existing key");
+
+        v = uf_skiplist_get(list, "charlie");
+        fail_if(UF_PTR_TO_INT(v) != 12, "Retrieved value is incorrect");
+        v = uf_skiplist_get(list, "bob");
+        fail_if(UF_PTR_TO_INT(v) != 38, "Retrieved value is incorrect");
+        fail_if(uf_skiplist_get(list, "alice") != NULL, "Shouldn't find missing key");
+
+        fail_if(!uf_skiplist_remove(list, "bob"), "Failed to remove key");
+        fail_if(uf_skiplist_remove(list, "bob"), "Shouldn't remove twice");
+        fail_if(uf_skiplist_get(list, "bob") != NULL, "Removed key still present");
+        fail_if(!uf_skiplist_insert(list, "bob", UF_INT_TO_PTR(40)), "Failed to reinsert");
+        fail_if(UF_PTR_TO_INT(uf_skiplist_get(list, "bob")) != 40, "Reinsert didn't take");
+
+        uf_skiplist_free(list);
+}
+END_TEST
+
+typedef struct WalkState {
+        uintptr_t last;
+        size_t count;
+        bool ordered;
+} WalkState;
+
+static bool walk_ordered(void *key, __uf_unused__ void *value, void *userdata)
+{
+        WalkState *state = userdata;
+        uintptr_t k = (uintptr_t)key;
+
+        if (state->count > 0 && k <= state->last) {
+                state->ordered = false;
+        }
+        state->last = k;
+        state->count++;
+        return true;
+}
+
+/**
+ * Scrambled insertion with heap values, then ordered and ranged walks.
+ */
+START_TEST(test_skiplist_ordered)
+{
+        UfSkipList *list = NULL;
+        WalkState state = { .ordered = true };
+
+        list = uf_skiplist_new_full(uf_hashmap_simple_compare, NULL, free);
+        fail_if(!list, "Failed to construct list");
+
+        for (size_t i = 0; i < 10000; i++) {
+                size_t k = ((i * 7919) % 10000) + 1;
+                fail_if(!uf_skiplist_insert(list, UF_INT_TO_PTR(k), strdup("value")),
+                        "Failed to insert");
+        }
+
+        uf_skiplist_foreach(list, walk_ordered, &state);
+        fail_if(!state.ordered, "Walk was out of order");
+        fail_if(state.count != 10000, "Walk missed entries");
+
+        for (size_t i = 1; i <= 10000; i += 2) {
+                fail_if(!uf_skiplist_remove(list, UF_INT_TO_PTR(i)), "Failed to remove");
+        }
+
+        memset(&state, 0, sizeof(state));
+        state.ordered = true;
+        uf_skiplist_foreach_range(list, UF_INT_TO_PTR(100), UF_INT_TO_PTR(200), walk_ordered, &state);
+        fail_if(!state.ordered, "Range walk was out of order");
+        fail_if(state.count != 50, "Range walk returned wrong count");
+        fail_if(state.last != 198, "Range walk didn't stop at bound");
+
+        uf_skiplist_free(list);
+}
+END_TEST
+
+typedef struct Worker {
+        UfSkipList *list;
+        size_t id;
+        atomic_size_t *successes;
+} Worker;
+
+static int worker_partitioned(void *data)
+{
+        Worker *w = data;
+
+        for (size_t i = 0; i < N_PER_THREAD; i++) {
+                uintptr_t k = i * N_THREADS + w->id + 1;
+                if (!uf_skiplist_insert(w->list, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k))) {
+                        return 1;
+                }
+        }
+        for (size_t i = 1; i < N_PER_THREAD; i += 2) {
+                uintptr_t k = i * N_THREADS + w->id + 1;
+                if (!uf_skiplist_remove(w->list, UF_INT_TO_PTR(k))) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+static int worker_reader(void *data)
+{
+        Worker *w = data;
+
+        for (int i = 0; i < 20; i++) {
+                WalkState state = { .ordered = true };
+                uf_skiplist_foreach(w->list, walk_ordered, &state);
+                if (!state.ordered) {
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+/**
+ * Writers on disjoint keys plus a concurrent reader
+ */
+START_TEST(test_skiplist_concurrent)
+{
+        UfSkipList *list = NULL;
+        thrd_t threads[N_THREADS + 1];
+        Worker workers[N_THREADS + 1];
+        WalkState state = { .ordered = true };
+
+        list = uf_skiplist_new(uf_hashmap_simple_compare);
+        fail_if(!list, "Failed to construct list");
+
+        for (size_t i = 0; i <= N_THREADS; i++) {
+                workers[i] = (Worker){.list = list, .id = i };
+                fail_if(thrd_create(&threads[i],
+                                    i < N_THREADS ? worker_partitioned : worker_reader,
+                                    &workers[i]) != thrd_success,
+                        "Failed to create thread");
+        }
+        for (size_t i = 0; i <= N_THREADS; i++) {
+                int ret = 0;
+                thrd_join(threads[i], &ret);
+                fail_if(ret != 0, "Worker failed");
+        }
+
+        for (uintptr_t k = 1; k <= N_THREADS * N_PER_THREAD; k++) {
+                bool odd = ((k - 1) / N_THREADS) % 2 == 1;
+                void *v = uf_skiplist_get(list, UF_INT_TO_PTR(k));
+                fail_if(odd && v != NULL, "Removed key still present");
+                fail_if(!odd && (uintptr_t)v != k, "Retained key missing");
+        }
+
+        uf_skiplist_foreach(list, walk_ordered, &state);
+        fail_if(!state.ordered, "Walk was out of order");
+        fail_if(state.count != N_THREADS * N_PER_THREAD / 2, "Walk returned wrong count");
+
+        uf_skiplist_free(list);
+}
+END_TEST
+
+static int worker_contended(void *data)
+{
+        Worker *w = data;
+
+        for (uintptr_t k = 1; k <= N_PER_THREAD; k++) {
+                if (uf_skiplist_insert(w->list, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k))) {
+                        atomic_fetch_add(w->successes, 1);
+                }
+        }
+        for (uintptr_t k = 1; k <= N_PER_THREAD; k++) {
+                if (uf_skiplist_remove(w->list, UF_INT_TO_PTR(k))) {
+                        atomic_fetch_sub(w->successes, 1);
+                }
+        }
+        return 0;
+}
+
+/**
+ * Every thread races on the same keys: each must be inserted and removed
+ * exactly once.
+ */
+START_TEST(test_skiplist_contended)
+{
+        UfSkipList *list = NULL;
+        thrd_t threads[N_THREADS];
+        Worker workers[N_THREADS];
+        atomic_size_t successes = 0;
+        WalkState state = { .ordered = true };
+
+        list = uf_skiplist_new_full(uf_hashmap_simple_compare, NULL, NULL);
+        fail_if(!list, "Failed to construct list");
+
+        for (size_t i = 0; i < N_THREADS; i++) {
+                workers[i] = (Worker){.list = list, .id = i, .successes = &successes };
+                fail_if(thrd_create(&threads[i], worker_contended, &workers[i]) != thrd_success,
+                        "Failed to create thread");
+        }
+        for (size_t i = 0; i < N_THREADS; i++) {
+                thrd_join(threads[i], NULL);
+        }
+
+        /* Inserts may only succeed on absent keys, so whatever survives
+         * must account for the imbalance exactly */
+        uf_skiplist_foreach(list, walk_ordered, &state);
+        fail_if(!state.ordered, "Walk was out of order");
+        fail_if(state.count != atomic_load(&successes), "Insert/remove accounting is wrong");
+
+        uf_skiplist_free(list);
+}
+END_TEST
+
+/**
+ * More parked readers than the list has epoch slots
+ */
+#define N_PARKED 80
+
+typedef struct Parked {
+        UfSkipList *list;
+        atomic_int arrived;
+        atomic_bool release;
+} Parked;
+
+static bool walk_park(__attribute__((unused)) void *key, __attribute__((unused)) void *value,
+                      void *userdata)
+{
+        Parked *p = userdata;
+
+        atomic_fetch_add(&p->arrived, 1);
+        while (!atomic_load(&p->release)) {
+                thrd_yield();
+        }
+        return false;
+}
+
+static int worker_parked(void *data)
+{
+        Parked *p = data;
+
+        uf_skiplist_foreach(p->list, walk_park, p);
+        return 0;
+}
+
+/**
+ * Operations must not wait for a free epoch slot once all are in use
+ */
+START_TEST(test_skiplist_overflow)
+{
+        UfSkipList *list = NULL;
+        thrd_t threads[N_PARKED];
+        Parked parked = { 0 };
+
+        list = uf_skiplist_new(uf_hashmap_simple_compare);
+        fail_if(!list, "Failed to construct list");
+        fail_if(!uf_skiplist_insert(list, UF_INT_TO_PTR(1), UF_INT_TO_PTR(1)), "Failed to insert");
+        parked.list = list;
+
+        for (size_t i = 0; i < N_PARKED; i++) {
+                fail_if(thrd_create(&threads[i], worker_parked, &parked) != thrd_success,
+                        "Failed to create thread");
+        }
+        while (atomic_load(&parked.arrived) != N_PARKED) {
+                thrd_yield();
+        }
+
+        /* Every slot is held, these go through the overflow slot */
+        fail_if(!uf_skiplist_insert(list, UF_INT_TO_PTR(2), UF_INT_TO_PTR(2)), "Failed to insert");
+        fail_if(uf_skiplist_get(list, UF_INT_TO_PTR(2)) != UF_INT_TO_PTR(2), "Wrong value");
+        fail_if(!uf_skiplist_remove(list, UF_INT_TO_PTR(2)), "Failed to remove");
+
+        atomic_store(&parked.release, true);
+        for (size_t i = 0; i < N_PARKED; i++) {
+                thrd_join(threads[i], NULL);
+        }
+
+        /* Enough churn afterwards to reclaim through the normal slots */
+        for (uintptr_t k = 3; k < 1000; k++) {
+                fail_if(!uf_skiplist_insert(list, UF_INT_TO_PTR(k), UF_INT_TO_PTR(k)),
+                        "Failed to insert");
+                fail_if(!uf_skiplist_remove(list, UF_INT_TO_PTR(k)), "Failed to remove");
+        }
+        fail_if(uf_skiplist_get(list, UF_INT_TO_PTR(1)) != UF_INT_TO_PTR(1), "Lost an entry");
+
+        uf_skiplist_free(list);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        tcase_set_timeout(tc, 60);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_skiplist_simple);
+        tcase_add_test(tc, test_skiplist_ordered);
+        tcase_add_test(tc, test_skiplist_concurrent);
+        tcase_add_test(tc, test_skiplist_contended);
+        tcase_add_test(tc, test_skiplist_overflow);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,186 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "str.h"
+#include "util.h"
+
+START_TEST(test_string_simple)
+{
+        UfString s;
+        char *stolen = NULL;
+
+        uf_string_init(&s);
+        fail_if(uf_string_len(&s) != 0, "New string isn't empty");
+        fail_if(strcmp(uf_string_str(&s), "") != 0, "New string isn't terminated");
+
+        fail_if(!uf_string_append(&s, "hello"), "Failed to append");
+        fail_if(!uf_string_append_c(&s, ' '), "Failed to append char");
+        fail_if(!uf_string_append_len(&s, "world!!", 5), "Failed to append slice");
+        fail_if(strcmp(uf_string_str(&s), "hello world") != 0, "Wrong contents");
+        fail_if(uf_string_len(&s) != 11, "Wrong length");
+        fail_if(s.cap != 0, "Short string shouldn't allocate");
+
+        uf_string_truncate(&s, 5);
+        fail_if(strcmp(uf_string_str(&s), "hello") != 0, "Truncate failed");
+
+        stolen = uf_string_steal(&s);
+        fail_if(!stolen || strcmp(stolen, "hello") != 0, "Steal returned wrong contents");
+        fail_if(uf_string_len(&s) != 0, "Steal didn't reset string");
+        free(stolen);
+
+        uf_string_clear(&s);
+}
+END_TEST
+
+/**
+ * Cross the inline boundary and keep growing
+ */
+START_TEST(test_string_growth)
+{
+        UfString *s = NULL;
+        const char *heap = NULL;
+        char *stolen = NULL;
+        char expect[16];
+
+        s = uf_string_new();
+        fail_if(!s, "Failed to construct string");
+
+        for (int i = 0; i < 5000; i++) {
+                fail_if(!uf_string_printf(s, "%04d,", i), "Failed to printf");
+        }
+        fail_if(uf_string_len(s) != 5000 * 5, "Wrong length");
+        fail_if(s->cap < s->len, "Capacity is too small");
+        fail_if(s->cap > 4 * s->len, "Capacity is too large");
+
+        for (int i = 0; i < 5000; i += 499) {
+                snprintf(expect, sizeof(expect), "%04d,", i);
+                fail_if(strncmp(uf_string_str(s) + i * 5, expect, 5) != 0, "Wrong contents");
+        }
+
+        /* Heap buffers are handed over directly */
+        heap = uf_string_str(s);
+        stolen = uf_string_steal(s);
+        fail_if(stolen != heap, "Steal copied a heap buffer");
+        free(stolen);
+
+        uf_string_free(s);
+}
+END_TEST
+
+/**
+ * A printf that fits exactly, and one that spills out of inline storage
+ */
+START_TEST(test_string_printf)
+{
+        UfString s;
+
+        uf_string_init(&s);
+        fail_if(!uf_string_printf(&s, "%s", "abc"), "Failed to printf");
+        fail_if(!uf_string_printf(&s, "%0*d", UF_STRING_INLINE_SIZE - 4, 7), "Failed to printf");
+        fail_if(uf_string_len(&s) != UF_STRING_INLINE_SIZE - 1, "Wrong length");
+        fail_if(s.cap != 0, "Exact fit shouldn't allocate");
+
+        fail_if(!uf_string_printf(&s, "%s-%d", "tail", 42), "Failed to printf");
+        fail_if(s.cap == 0, "Should have spilled to the heap");
+        fail_if(strcmp(uf_string_str(&s) + UF_STRING_INLINE_SIZE - 1, "tail-42") != 0,
+                "Spilled printf is wrong");
+        fail_if(strncmp(uf_string_str(&s), "abc000", 6) != 0, "Prefix was lost");
+
+        uf_string_clear(&s);
+}
+END_TEST
+
+START_TEST(test_string_map_key)
+{
+        UfHashmap *map = NULL;
+        UfString s;
+
+        map = uf_hashmap_new_full(uf_hashmap_string_hash, uf_hashmap_string_equal, free, NULL);
+        fail_if(!map, "Failed to construct map");
+
+        uf_string_init(&s);
+        for (int i = 0; i < 100; i++) {
+                fail_if(!uf_string_printf(&s, "/usr/lib/package-%d/file", i), "Failed to printf");
+                if (i % 2) {
+                        /* Make every other key long enough for the heap */
+                        fail_if(!uf_string_printf(&s, "%060d", i), "Failed to printf");
+                }
+                fail_if(!uf_string_put_key(&s, map, UF_INT_TO_PTR(i + 1)), "Failed to put key");
+                fail_if(uf_string_len(&s) != 0, "Key wasn't taken");
+        }
+
+        fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, "/usr/lib/package-42/file")) != 43,
+                "Failed to find key");
+        fail_if(!uf_string_printf(&s, "/usr/lib/package-%d/file%060d", 7, 7), "Failed to printf");
+        fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, (void *)uf_string_str(&s))) != 8,
+                "Failed to find long key");
+
+        uf_string_clear(&s);
+        uf_hashmap_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_string_simple);
+        tcase_add_test(tc, test_string_growth);
+        tcase_add_test(tc, test_string_printf);
+        tcase_add_test(tc, test_string_map_key);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,195 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "map.h"
+#include "strview.h"
+#include "util.h"
+
+START_TEST(test_strview_simple)
+{
+        UfStrView v = uf_strview("  Hello, World \t\n");
+        UfStrView t = uf_strview_trim(v);
+
+        fail_if(!uf_strview_equal(t, uf_strview("Hello, World")), "Trim failed");
+        fail_if(!uf_strview_starts_with(t, uf_strview("Hello")), "starts_with failed");
+        fail_if(uf_strview_starts_with(t, uf_strview("World")), "starts_with false positive");
+        fail_if(!uf_strview_ends_with(t, uf_strview("World")), "ends_with failed");
+        fail_if(uf_strview_casecmp(t, uf_strview("hello, world")) != 0, "casecmp failed");
+        fail_if(uf_strview_casecmp(uf_strview("abc"), uf_strview("ABD")) >= 0, "casecmp order");
+        fail_if(uf_strview_casecmp(uf_strview("ab"), uf_strview("ABC")) >= 0, "casecmp length");
+
+        fail_if(!uf_strview_equal(uf_strview_slice(t, 7, 100), uf_strview("World")),
+                "Slice failed");
+        fail_if(uf_strview_slice(t, 100, 5).len != 0, "Slice should clamp");
+}
+END_TEST
+
+/**
+ * Check the vector search against a naive search at every alignment and
+ * needle length, including matches straddling the vector tail.
+ */
+START_TEST(test_strview_find)
+{
+        char haystack[200];
+        size_t offset = 0;
+
+        for (size_t i = 0; i < sizeof(haystack); i++) {
+                haystack[i] = (char)('a' + (i * 7) % 5);
+        }
+
+        for (size_t start = 0; start < 40; start++) {
+                for (size_t len = 1; len < 24; len++) {
+                        UfStrView h = uf_strview_len(haystack + start, sizeof(haystack) - start);
+                        UfStrView n = uf_strview_len(haystack + 150 + (len % 3), len);
+                        void *expect = memmem(h.data, h.len, n.data, n.len);
+
+                        fail_if(!uf_strview_find(h, n, &offset), "Failed to find needle");
+                        fail_if(h.data + offset != expect, "Found the wrong match");
+                }
+        }
+
+        fail_if(uf_strview_find(uf_strview_len(haystack, sizeof(haystack)), uf_strview("zz"), &offset),
+                "Found a missing needle");
+        fail_if(!uf_strview_find(uf_strview("abc"), uf_strview(""), &offset) || offset != 0,
+                "Empty needle should match at 0");
+        fail_if(!uf_strview_find(uf_strview("0123456789abcdefXYZ0123456789abcdefXYZ"),
+                                 uf_strview("defXYZ0"),
+                                 &offset) ||
+                    offset != 13,
+                "Wrong offset");
+}
+END_TEST
+
+START_TEST(test_strview_split)
+{
+        const char *input = "/usr/bin::/bin:/usr/local/bin:";
+        const char *expect_all[] = { "/usr/bin", "", "/bin", "/usr/local/bin", "" };
+        const char *expect_skip[] = { "/usr/bin", "/bin", "/usr/local/bin" };
+        UfStrViewSplit split;
+        UfStrView field;
+        size_t n = 0;
+
+        uf_strview_split_init(&split, uf_strview(input), ':', false);
+        while (uf_strview_split_next(&split, &field)) {
+                fail_if(n >= 5, "Too many fields");
+                fail_if(!uf_strview_equal(field, uf_strview(expect_all[n])), "Wrong field");
+                /* Fields point into the input, no copies */
+                fail_if(field.len && (field.data < input || field.data >= input + strlen(input)),
+                        "Field isn't a view");
+                n++;
+        }
+        fail_if(n != 5, "Wrong number of fields");
+
+        n = 0;
+        uf_strview_split_init(&split, uf_strview(input), ':', true);
+        while (uf_strview_split_next(&split, &field)) {
+                fail_if(n >= 3, "Too many fields");
+                fail_if(!uf_strview_equal(field, uf_strview(expect_skip[n])), "Wrong field");
+                n++;
+        }
+        fail_if(n != 3, "Wrong number of non-empty fields");
+}
+END_TEST
+
+/**
+ * Views as map keys, hashing like their NUL terminated equivalents
+ */
+START_TEST(test_strview_map)
+{
+        const char *line = "alpha=1 beta=2 gamma=3";
+        UfStrView keys[3];
+        UfStrViewSplit split;
+        UfStrView field;
+        UfStrView lookup;
+        UfHashmap *map = NULL;
+        size_t n = 0;
+
+        map = uf_hashmap_new(uf_strview_hash, uf_strview_key_equal);
+        fail_if(!map, "Failed to construct map");
+
+        uf_strview_split_init(&split, uf_strview(line), ' ', true);
+        while (uf_strview_split_next(&split, &field)) {
+                size_t eq = 0;
+                fail_if(!uf_strview_find_char(field, '=', &eq), "Missing =");
+                keys[n] = uf_strview_slice(field, 0, eq);
+                fail_if(!uf_hashmap_put(map, &keys[n], UF_INT_TO_PTR(field.data[eq + 1] - '0')),
+                        "Failed to insert");
+                n++;
+        }
+
+        lookup = uf_strview("beta");
+        fail_if(UF_PTR_TO_INT(uf_hashmap_get(map, &lookup)) != 2, "Failed to find view key");
+        lookup = uf_strview("delta");
+        fail_if(uf_hashmap_get(map, &lookup) != NULL, "Found a missing key");
+
+        fail_if(uf_strview_hash(&keys[2]) != uf_hashmap_string_hash("gamma"),
+                "Hash doesn't match the string hash");
+
+        uf_hashmap_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_strview_simple);
+        tcase_add_test(tc, test_strview_find);
+        tcase_add_test(tc, test_strview_split);
+        tcase_add_test(tc, test_strview_map);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,172 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "alloc-counter.h"
+#include "map.h"
+#include "topk.h"
+#include "util.h"
+
+static uint32_t topk_hash(size_t key)
+{
+        return uf_hashmap_simple_hash(UF_INT_TO_PTR(key));
+}
+
+START_TEST(test_top_k_exact)
+{
+        UfTopK *topk = NULL;
+        UfTopKEntry entries[16];
+        size_t n;
+
+        fail_if(uf_top_k_new(0) != NULL, "Accepted k of zero");
+        topk = uf_top_k_new(16);
+        fail_if(!topk, "Failed to construct tracker");
+        fail_if(uf_top_k_list(topk, entries, 16) != 0, "Empty tracker listed keys");
+
+        /* No more keys than counters, so every count is exact */
+        for (size_t key = 1; key <= 10; key++) {
+                fail_if(uf_top_k_add(topk, topk_hash(key), UF_INT_TO_PTR(key), key * 3) != key * 3,
+                        "Add returned the wrong count");
+        }
+        fail_if(uf_top_k_add(topk, topk_hash(4), NULL, 100) != 112, "Increment returned wrong count");
+
+        n = uf_top_k_list(topk, entries, 3);
+        fail_if(n != 3, "Expected 3 entries");
+        fail_if(UF_PTR_TO_INT(entries[0].key) != 4 || entries[0].count != 112, "Wrong leader");
+        fail_if(UF_PTR_TO_INT(entries[1].key) != 10 || UF_PTR_TO_INT(entries[2].key) != 9,
+                "Wrong order");
+        fail_if(entries[0].error != 0, "Exact count has an error bound");
+
+        /* Listing reorders counters, lookups must survive it */
+        for (size_t key = 1; key <= 10; key++) {
+                uint64_t want = key == 4 ? 112 : key * 3;
+                fail_if(uf_top_k_count(topk, topk_hash(key)) != want, "Lost key %zu", key);
+        }
+        fail_if(uf_top_k_count(topk, topk_hash(11)) != 0, "Untracked key has a count");
+
+        uf_top_k_clear(topk);
+        fail_if(uf_top_k_list(topk, entries, 16) != 0, "Clear didn't forget");
+        fail_if(uf_top_k_count(topk, topk_hash(4)) != 0, "Clear didn't forget");
+
+        uf_top_k_free(topk);
+}
+END_TEST
+
+/**
+ * Keys 1 to 5 occur 1000 times each, spread among 20000 keys seen once
+ */
+static void topk_feed(UfTopK *topk, size_t from, size_t to)
+{
+        for (size_t i = from; i < to; i++) {
+                size_t key = i % 5 == 0 ? (i / 5) % 5 + 1 : 100 + i;
+                uf_top_k_add(topk, topk_hash(key), UF_INT_TO_PTR(key), 1);
+        }
+}
+
+static void topk_check_hitters(UfTopK *topk)
+{
+        UfTopKEntry entries[5];
+
+        fail_if(uf_top_k_list(topk, entries, 5) != 5, "Expected 5 entries");
+        for (size_t i = 0; i < 5; i++) {
+                size_t key = UF_PTR_TO_INT(entries[i].key);
+                fail_if(key < 1 || key > 5, "Cold key %zu in the top 5", key);
+                fail_if(entries[i].count < 1000, "Hot key %zu undercounted", key);
+                fail_if(entries[i].count - entries[i].error > 1000, "Lower bound too high");
+        }
+}
+
+START_TEST(test_top_k_heavy_hitters)
+{
+        UfTopK *topk = uf_top_k_new(64);
+
+        fail_if(!topk, "Failed to construct tracker");
+
+        /* Updates never allocate */
+        fail_if_allocs_exceed(0, topk_feed(topk, 0, 25000));
+        topk_check_hitters(topk);
+
+        uf_top_k_free(topk);
+}
+END_TEST
+
+START_TEST(test_top_k_merge)
+{
+        UfTopK *a = uf_top_k_new(64);
+        UfTopK *b = uf_top_k_new(64);
+
+        fail_if(!a || !b, "Failed to construct trackers");
+        fail_if(uf_top_k_merge(a, a), "Merged a tracker into itself");
+
+        /* Per-thread halves of the same stream */
+        topk_feed(a, 0, 12500);
+        topk_feed(b, 12500, 25000);
+        fail_if(!uf_top_k_merge(a, b), "Failed to merge");
+        topk_check_hitters(a);
+
+        uf_top_k_free(a);
+        uf_top_k_free(b);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_top_k_exact);
+        tcase_add_test(tc, test_top_k_heavy_hitters);
+        tcase_add_test(tc, test_top_k_merge);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,272 @@
+/*
+ * This file is part of libuf.
+ *
+ * Copyright © 2017-2018 Ikey Doherty
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ */
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ttlmap.h"
+#include "util.h"
+
+static uint64_t ttl_clock(void *userdata)
+{
+        return *(uint64_t *)userdata;
+}
+
+static size_t ttl_n_freed = 0;
+
+static void ttl_count_free(__uf_unused__ void *v)
+{
+        ttl_n_freed++;
+}
+
+START_TEST(test_ttl_map_simple)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 1000;
+
+        map = uf_ttl_map_new(uf_hashmap_string_hash, uf_hashmap_string_equal);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        fail_if(uf_ttl_map_get(map, "session") != NULL, "Empty map returned a value");
+        fail_if(!uf_ttl_map_put(map, "session", UF_INT_TO_PTR(1), 100), "Failed to put");
+        fail_if(!uf_ttl_map_put(map, "token", UF_INT_TO_PTR(2), 500), "Failed to put");
+        fail_if(UF_PTR_TO_INT(uf_ttl_map_get(map, "session")) != 1, "Wrong value");
+        fail_if(uf_ttl_map_remaining(map, "session") != 100, "Wrong remaining time");
+
+        now += 99;
+        fail_if(UF_PTR_TO_INT(uf_ttl_map_get(map, "session")) != 1, "Expired early");
+        now += 1;
+        fail_if(uf_ttl_map_get(map, "session") != NULL, "Expired entry returned");
+        fail_if(uf_ttl_map_size(map) != 1, "Expired entry not reclaimed on lookup");
+        fail_if(uf_ttl_map_remaining(map, "token") != 400, "Wrong remaining time");
+
+        /* Replacing refreshes the expiry */
+        fail_if(!uf_ttl_map_put(map, "token", UF_INT_TO_PTR(3), 1000), "Failed to replace");
+        now += 600;
+        fail_if(UF_PTR_TO_INT(uf_ttl_map_get(map, "token")) != 3, "Replace didn't refresh");
+        fail_if(uf_ttl_map_size(map) != 1, "Replace changed the size");
+
+        fail_if(!uf_ttl_map_remove(map, "token"), "Failed to remove");
+        fail_if(uf_ttl_map_remove(map, "token"), "Removed twice");
+        fail_if(uf_ttl_map_size(map) != 0, "Wrong size after remove");
+
+        uf_ttl_map_free(map);
+}
+END_TEST
+
+START_TEST(test_ttl_map_free_funcs)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 0;
+
+        ttl_n_freed = 0;
+        map = uf_ttl_map_new_full(uf_hashmap_string_hash,
+                                  uf_hashmap_string_equal,
+                                  free,
+                                  ttl_count_free);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        fail_if(!uf_ttl_map_put(map, strdup("a"), UF_INT_TO_PTR(1), 10), "Failed to put");
+        fail_if(!uf_ttl_map_put(map, strdup("b"), UF_INT_TO_PTR(2), 10), "Failed to put");
+        fail_if(!uf_ttl_map_put(map, strdup("c"), UF_INT_TO_PTR(3), 1000), "Failed to put");
+
+        /* Replacing frees the old value, and the new key's duplicate */
+        fail_if(!uf_ttl_map_put(map, strdup("c"), UF_INT_TO_PTR(4), 1000), "Failed to replace");
+        fail_if(ttl_n_freed != 1, "Old value not freed on replace");
+
+        /* Expiry by lookup and by sweep both free */
+        now = 50;
+        fail_if(uf_ttl_map_get(map, "a") != NULL, "Expired entry returned");
+        fail_if(ttl_n_freed != 2, "Lookup expiry didn't free");
+        fail_if(uf_ttl_map_expire(map, 100) != 1, "Sweep didn't reclaim b");
+        fail_if(ttl_n_freed != 3, "Sweep expiry didn't free");
+        fail_if(uf_ttl_map_size(map) != 1, "Wrong size");
+
+        uf_ttl_map_free(map);
+        fail_if(ttl_n_freed != 4, "Free didn't free the rest");
+}
+END_TEST
+
+START_TEST(test_ttl_map_incremental)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 0;
+        size_t reclaimed;
+
+        map = uf_ttl_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        for (size_t i = 1; i <= 1000; i++) {
+                fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i), 100 + i % 50),
+                        "Failed to put");
+        }
+        fail_if(uf_ttl_map_size(map) != 1000, "Entries reclaimed early");
+
+        /* Every pass is bounded by its budget */
+        now = 1000;
+        reclaimed = uf_ttl_map_expire(map, 10);
+        fail_if(reclaimed == 0 || reclaimed > 10, "Reclaimed %zu with a budget of 10", reclaimed);
+        while (uf_ttl_map_expire(map, 10) > 0) {
+        }
+        fail_if(uf_ttl_map_size(map) != 0, "%zu entries left over", uf_ttl_map_size(map));
+
+        uf_ttl_map_free(map);
+}
+END_TEST
+
+START_TEST(test_ttl_map_put_sweeps)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 0;
+
+        map = uf_ttl_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        for (size_t i = 1; i <= 100; i++) {
+                fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i), 10), "Failed to put");
+        }
+
+        /* Puts alone keep the map from accumulating dead entries */
+        now = 1000;
+        for (size_t i = 1001; i <= 1100; i++) {
+                fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i), 100000),
+                        "Failed to put");
+        }
+        fail_if(uf_ttl_map_size(map) != 100, "Puts didn't reclaim, size %zu", uf_ttl_map_size(map));
+
+        uf_ttl_map_free(map);
+}
+END_TEST
+
+START_TEST(test_ttl_map_long_ttl)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 0;
+
+        map = uf_ttl_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        /* Well past one lap of the wheel */
+        fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(1), UF_INT_TO_PTR(1), 60000), "Failed to put");
+        fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(2), UF_INT_TO_PTR(2), UINT64_MAX), "Failed to put");
+
+        for (now = 0; now < 60000; now += 1000) {
+                fail_if(uf_ttl_map_expire(map, 1000) != 0, "Expired at %lu", (unsigned long)now);
+        }
+        now = 60000;
+        fail_if(uf_ttl_map_expire(map, 1000) != 1, "Didn't expire on time");
+        fail_if(UF_PTR_TO_INT(uf_ttl_map_get(map, UF_INT_TO_PTR(2))) != 2, "Lost eternal entry");
+
+        uf_ttl_map_free(map);
+}
+END_TEST
+
+/**
+ * Long-lived entries must not hold up reclaiming short-lived ones
+ */
+START_TEST(test_ttl_map_long_lived)
+{
+        UfTtlMap *map = NULL;
+        uint64_t now = 0;
+        uintptr_t key = 1000;
+
+        map = uf_ttl_map_new(uf_hashmap_simple_hash, uf_hashmap_simple_equal);
+        fail_if(!map, "Failed to construct ttl map");
+        uf_ttl_map_set_clock(map, ttl_clock, &now);
+
+        /* An hour is many laps of the near slots */
+        for (uintptr_t i = 1; i <= 1000; i++) {
+                fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(i), UF_INT_TO_PTR(i), 3600000),
+                        "Failed to put");
+        }
+
+        /* Puts alone, with their small budget, keep up with the churn */
+        for (now = 0; now < 60000; now += 50) {
+                key++;
+                fail_if(!uf_ttl_map_put(map, UF_INT_TO_PTR(key), UF_INT_TO_PTR(key), 20),
+                        "Failed to put");
+        }
+        fail_if(uf_ttl_map_size(map) > 1002,
+                "Short entries piled up, size %zu",
+                uf_ttl_map_size(map));
+        fail_if(uf_ttl_map_expire(map, 1000) > 1, "Sweep reclaimed live entries");
+
+        now = 3600000 - 1;
+        fail_if(uf_ttl_map_expire(map, 1000000) > 1, "Long entries expired early");
+        fail_if(uf_ttl_map_size(map) < 1000, "Long entries expired early");
+        now = 3600000;
+        fail_if(uf_ttl_map_expire(map, 1000000) < 1000, "Long entries didn't expire");
+        fail_if(uf_ttl_map_size(map) != 0, "%zu entries left over", uf_ttl_map_size(map));
+
+        uf_ttl_map_free(map);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int uf_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_ttl_map_simple);
+        tcase_add_test(tc, test_ttl_map_free_funcs);
+        tcase_add_test(tc, test_ttl_map_incremental);
+        tcase_add_test(tc, test_ttl_map_put_sweeps);
+        tcase_add_test(tc, test_ttl_map_long_ttl);
+        tcase_add_test(tc, test_ttl_map_long_lived);
+
+        return s;
+}
+
+int main(__attribute__((unused)) int argc, __attribute__((unused)) char **argv)
+{
+        return uf_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */